@@ -1,21 +1,34 @@
-#include "cJSON.h"
 #include "settings.h" // Includes pin, topic, and behavior settings
+#include <CborWriter.h>
+#include <Coalescer.h>
+#include <CommandSchedule.h>
+#include <JsonWriter.h>
 #include <Light.h>
+#include <LightFrame.h>
+#include <LightFrameBuffer.h>
+#include <LightStream.h>
+#include <Mailbox.h>
+#include <Metrics.h>
+#include <Model.h>
 #include <MqttClient.h>
-#include <Utils.h>
-#include <cJSON.h>
+#include <Scheduler.h>
+#include <ShowPlayer.h>
+#include <StateStore.h>
+#include <SyncClock.h>
+#include <atomic>
+#include <esp_log.h>
 #include <string>
+#include <string_view>
 
 // Export main function for C compiler
 extern "C" {
 void app_main(void);
 }
 
-// ********************* STATE DEFINITIONS *********************
+// Logging tag
+static const char *APP_TAG = "christmas_village";
 
-// Light Switch Modes
-#define SWITCH_ON "ON"   // Light Channel On
-#define SWITCH_OFF "OFF" // Light Channel Off
+// ********************* STATE DEFINITIONS *********************
 
 // Availability
 #define AVAILABLE_ONLINE "online"   // Board is available
@@ -23,45 +36,96 @@ void app_main(void);
 
 // ********************* STATES ***********************
 
-std::string allState = SWITCH_OFF;
-std::string gingerbreadState = SWITCH_OFF;
-std::string honeydukesState = SWITCH_OFF;
-std::string threebroomsticksState = SWITCH_OFF;
-std::string toystoreState = SWITCH_OFF;
-std::string musicstoreState = SWITCH_OFF;
-std::string trolleyState = SWITCH_OFF;
-std::string treesState = SWITCH_OFF;
-std::string lampsState = SWITCH_OFF;
+using VillageModel = Model<Village>;
+
+// Every building's state and light, generated from the Village description
+VillageModel village;
+
+// Channels with their own behavior
+constexpr int ALL = VillageModel::channel("all");
+constexpr int GINGERBREAD = VillageModel::channel("gingerbread");
 
 // ********************* MQTT CLIENT SETUP *********************
 MqttClient client("christmas_village"); // MQTT Client
 
-// ********************* LIGHT SETUP *************************
+// ********************* STATE STORE *********************
+
+// Keeps the state across reboots, so the lights show it before the network is
+// up (a snapshot saved by firmware with other buildings is ignored)
+StateStore stateStore("village", VillageModel::STATE_VERSION);
+
+// The lights show the restored state instead of the show (or the blinking
+// candles) until the first connection
+bool isShowingRestoredState = false;
+
+// ********************* EFFECT SCHEDULER *********************
+Scheduler scheduler; // Runs lighting effects when they are due
+
+// ********************* LIGHT STREAM *********************
+
+// Show sequencers can drive every light over UDP (without the broker), and own
+// the lights while their frames arrive
+LightStream stream(village.lights().data(), VillageModel::LIGHT_COUNT);
+
+// ********************* SHOW *********************
+
+// Choreographed show played from flash (without any network), one channel per
+// light in model order
+ShowPlayer show(village.lights().data(), VillageModel::LIGHT_COUNT);
+
+// ********************* COMMAND MAILBOX *********************
+
+// Mailbox channels, handled on the lighting task in the order they were posted
+// to. The model's channels come first, so a topic's mailbox channel is its
+// model channel
+enum Command {
+  CMD_CONNECTION = VillageModel::SIZE, // Connection status changed (signal)
+  CMD_PROGRAM, // Program for the first light (then one channel per light)
+  CMD_FRAME = CMD_PROGRAM + VillageModel::LIGHT_COUNT,
+  CMD_SHOW,
+  COMMAND_COUNT
+};
 
-int pwmChannel = 0;
+// Commands posted by the MQTT task. Only the latest payload of each channel is
+// handled, so floods of messages on a topic collapse into one update (programs
+// have a channel per light, so uploads for different lights are all kept).
+// Payloads are up to an effect program
+Mailbox<COMMAND_COUNT, EFFECT_PROGRAM_SIZE> commands;
 
-// Gingerbread House
-Light gingerbreadLight(GINGERBREAD_PIN);
-Light honeydukesLight(HONEYDUKES_PIN);
-Light threebrommsticksLight(THREEBROOMSTICKS_PIN);
-Light toystoreLight(TOYSTORE_PIN);
-Light musicstoreLight(MUSICSTORE_PIN);
-Light trolleyLight(TROLLEY_PIN);
-Light treesLight(TREES_PIN, pwmChannel++);
-Light lampsLight(LAMPS_PIN);
+// Light frames posted by the MQTT task, merged until the lighting task applies
+// them (CMD_FRAME signals that one is waiting), so a sequencer that outruns the
+// lighting task only skips levels that were replaced
+LightFrameBuffer<VillageModel::LIGHT_COUNT> frames;
+
+// Commands that carry a network time to apply them at, held on the lighting
+// task until they are due (switch and show payloads are short words)
+CommandSchedule<COMMAND_SCHEDULE_SIZE, 16> schedule;
+
+// Latest connection status (bit 0: WiFi, bit 1: IP, bit 2: MQTT), written by
+// the event tasks and read when CMD_CONNECTION is handled
+std::atomic<uint8_t> connectionStatus{0};
 
 // ************************ STATE UPDATES **********************
 
-/** Update all lights based on the current state */
-void updateLightsFromState(void) {
-  gingerbreadState == SWITCH_ON ? gingerbreadLight.on() : gingerbreadLight.off(); // Gingerbread house
-  honeydukesState == SWITCH_ON ? honeydukesLight.on() : honeydukesLight.off(); // Honeydukes
-  threebroomsticksState == SWITCH_ON ? threebrommsticksLight.on() : threebrommsticksLight.off(); // Three Broomsticks
-  toystoreState == SWITCH_ON ? toystoreLight.on() : toystoreLight.off(); // Toy Store
-  musicstoreState == SWITCH_ON ? musicstoreLight.on() : musicstoreLight.off(); // Music Store
-  trolleyState == SWITCH_ON ? trolleyLight.on() : trolleyLight.off(); // Trolley
-  treesState == SWITCH_ON ? treesLight.on(25) : treesLight.off(); // Trees (custom brightness)
-  lampsState == SWITCH_ON ? lampsLight.on() : lampsLight.off(); // Lamps
+/**
+ * Indicates if the lights are driven by a stream or the show instead of the
+ * state (the state is restored when they stop)
+ */
+bool isStateOverridden(void) { return stream.isActive() || show.isPlaying(); }
+
+/**
+ * Update the lights of the changed channels (every light by default)
+ * @param changes The channels that changed
+ */
+void updateLightsFromState(
+    const VillageModel::Mask &changes = VillageModel::LIGHTS) {
+  if (isStateOverridden()) {
+    return;
+  }
+  // Write every light together once the whole state is applied
+  LightBank::global().beginFrame();
+  village.updateLights(changes);
+  LightBank::global().commitFrame();
 }
 
 /**
@@ -70,173 +134,392 @@ void updateLightsFromState(void) {
  * Intended behavior: Any light on means "ALL" lights state should be on (best behavior for automation)
  */
 void updateAllStateFromSwitchChange(void) {
-  bool anyLightIsOn = (
-    gingerbreadState == SWITCH_ON ||
-    honeydukesState == SWITCH_ON ||
-    threebroomsticksState == SWITCH_ON ||
-    toystoreState == SWITCH_ON ||
-    musicstoreState == SWITCH_ON ||
-    trolleyState == SWITCH_ON ||
-    treesState == SWITCH_ON ||
-    lampsState == SWITCH_ON
-  );
-  if (anyLightIsOn) {
-    allState = SWITCH_ON;
-  } else {
-    allState = SWITCH_OFF;
-  }
+  village.set(ALL, village.isAnyOn(VillageModel::LIGHTS));
 }
 
 /**
- * Constructs a JSON representation of the current state and publishes it to the
- * MQTT client
+ * Writes a JSON (or CBOR) representation of the current state into a stack
+ * buffer and publishes it to the MQTT client
  */
 void publishCurrentState(void) {
-  // Create state object and fill with state values
-  cJSON *state = cJSON_CreateObject();
-  
-  cJSON_AddStringToObject(state, "all", allState.c_str());
-  cJSON_AddStringToObject(state, "gingerbread", gingerbreadState.c_str());
-  cJSON_AddStringToObject(state, "honeydukes", honeydukesState.c_str());
-  cJSON_AddStringToObject(state, "threebroomsticks", threebroomsticksState.c_str());
-  cJSON_AddStringToObject(state, "toystore", toystoreState.c_str());
-  cJSON_AddStringToObject(state, "musicstore", musicstoreState.c_str());
-  cJSON_AddStringToObject(state, "trolley", trolleyState.c_str());
-  cJSON_AddStringToObject(state, "trees", treesState.c_str());
-  cJSON_AddStringToObject(state, "lamps", lampsState.c_str());
-
-  // Convert state object to string
-  char *stateStr = cJSON_PrintUnformatted(state);
-  // Deallocate state object (MUST be done to avoid memory leaks)
-  cJSON_Delete(state);
+#if STATE_CBOR
+  CborWriter<STATE_JSON_SIZE> state;
+#else
+  JsonWriter<STATE_JSON_SIZE> state;
+#endif
+  state.beginObject();
+  village.writeState(state);
+  state.endObject();
+  // A truncated document is never published (it would be retained)
+  if (!state.isValid()) {
+    ESP_LOGW(APP_TAG, "State document is larger than STATE_JSON_SIZE");
+    return;
+  }
   // Publish state to topic
-  client.publish(PUB_STATE_TOPIC, stateStr, true);
+  client.publish(PUB_STATE_TOPIC, state.view(), true);
 }
 
-// *********************** SUBSCRIPTION UTILITIES ***********************
+// Publishes the state once per burst of commands (ex. an automation switching
+// every building)
+Coalescer statePublisher(STATE_PUBLISH_WINDOW, &publishCurrentState);
+
+// Writes the saved state to flash (unless it is already there)
+void commitState(void) { stateStore.commit(); }
 
-// Checks if the payload data is a valid switch string
-bool isSwitchStr(std::string data) {
-  return data == SWITCH_ON || data == SWITCH_OFF;
+// Writes the state to flash once per STATE_SAVE_WINDOW at most
+Coalescer stateSaver(STATE_SAVE_WINDOW, &commitState);
+
+/**
+ * Saves the state. It is kept in RTC memory right away (for warm resets), and
+ * written to flash once the save window closes
+ */
+void saveState(void) {
+  if (STATE_RESTORE) {
+    stateStore.save(village.snapshot());
+    stateSaver.request();
+  }
 }
 
 /**
- * Handles validating data and applying state updates for a topic subscription
- * @param data The data string payload from the topic subscription
- * @param state Reference to a state variable that should be updated
- * @param validate A pointer to a validation function to check the data
+ * Restores the state saved before the last reset, so the lights are right
+ * before the MQTT client starts (the retained commands still apply once it
+ * connects)
  */
-void handleSubscription(std::string data, std::string &state,
-                        bool (*validate)(std::string)) {
-  if (!validate(data)) {
-    return;
+void restoreState(void) {
+  VillageModel::Snapshot snapshot;
+  if (STATE_RESTORE && stateStore.load(snapshot) &&
+      village.restore(snapshot)) {
+    isShowingRestoredState = true;
+    // A snapshot only kept in RTC memory is written to flash too
+    stateSaver.request();
   }
-  state = data;
-  updateAllStateFromSwitchChange();
-  updateLightsFromState();
-  publishCurrentState();
+  village.takeChanges();
 }
 
-// Alias for handleSubscripton with the isSwitchStr validation function
-void handleSwitchSubscription(std::string data, std::string &state) {
-  handleSubscription(data, state, &isSwitchStr);
+/**
+ * Writes a JSON snapshot of the board's metrics (covering the time since the
+ * last snapshot) and publishes it. Nothing is reset while the board is
+ * offline, so the first snapshot after reconnecting covers the outage
+ */
+void publishMetrics(void) {
+  if (!client.isConnected()) {
+    return;
+  }
+  JsonWriter<METRICS_JSON_SIZE> metrics;
+  metrics.beginObject();
+  Metrics::global().write(metrics);
+  metrics.add("idle", (int)scheduler.getStats(true).idlePercentage());
+  metrics.add("state_writes", (int64_t)stateStore.getWrites());
+  // Messages received per topic (keyed without the base topic)
+  metrics.beginObject("topics");
+  client.forEachTopicCount(
+      [&metrics](const std::string &topic, uint32_t count) {
+        metrics.add(topic.c_str() + sizeof(BASE_TOPIC) - 1, (int64_t)count);
+      },
+      true);
+  metrics.endObject();
+  // Messages waiting to be published, unacknowledged, and dropped
+  OutboxStats outbox = client.getOutboxStats(true);
+  metrics.beginObject("outbox")
+      .add("queued", (int64_t)outbox.queued)
+      .add("in_flight", (int64_t)outbox.inFlight)
+      .add("dropped", (int64_t)outbox.dropped)
+      .endObject()
+      .endObject();
+  if (!metrics.isValid()) {
+    ESP_LOGW(APP_TAG, "Metrics snapshot is larger than METRICS_JSON_SIZE");
+    return;
+  }
+  // A lost snapshot is covered by the next one
+  client.publish(PUB_METRICS_TOPIC, metrics.view(), false, 0);
 }
 
+// Publishes the metrics every METRICS_INTERVAL
+MetricsReporter metricsReporter(METRICS_INTERVAL, &publishMetrics);
+
 // *********************** SUBSCRIPTION CALLBACKS *********************
 
-void setAllState(std::string data) {
-  if (!isSwitchStr(data)) {
+/**
+ * Hold a command until the network time it carries (ex. "ON@1733000000000"),
+ * so every board subscribed to the topic applies it at the same moment.
+ * Commands without a time are applied right away, and so are late commands,
+ * commands received before the clock is synced and commands that don't fit in
+ * the schedule
+ * @param channel The command's channel
+ * @param data The payload (the time is removed from it)
+ * @returns true if the command is held
+ */
+bool holdUntilDue(int channel, std::string_view &data) {
+  int64_t applyAt;
+  data = splitApplyAt(data, applyAt);
+  SyncClock &clock = SyncClock::global();
+  if (applyAt == 0 || !clock.isSynced()) {
+    return false;
+  }
+  Timestamp due = clock.toLocal(applyAt * 1000);
+  return due > Clock::now() && schedule.add(due, channel, data);
+}
+
+/**
+ * Handles a payload on one of the model's topics. The all switch sets every
+ * light, and any other switch updates the all switch to match the lights
+ * @param channel The model channel of the topic
+ * @param data The data string payload from the topic subscription
+ */
+void handleChannel(int channel, std::string_view data) {
+  if (holdUntilDue(channel, data)) {
+    return;
+  }
+  int value = VillageModel::parse(channel, data);
+  if (value < 0) {
+    Metrics::global().invalid.add();
     return;
   }
-  allState = data;
-  // Update all lights with new state
-  gingerbreadState = data;
-  honeydukesState = data;
-  threebroomsticksState = data;
-  toystoreState = data;
-  musicstoreState = data;
-  trolleyState = data;
-  treesState = data;
-  lampsState = data;
+  village.set(channel, value);
+  // A repeated command still reapplies its lights (ex. to stop an effect
+  // program), so the commanded lights are updated even if they didn't change
+  if (channel == ALL) {
+    VillageModel::LIGHTS.forEach([value](int light) {
+      village.set(light, value);
+      village.touch(light);
+    });
+  } else {
+    village.touch(channel);
+    updateAllStateFromSwitchChange();
+  }
   // Finalize updates
-  updateLightsFromState();
-  publishCurrentState();
+  updateLightsFromState(village.takeChanges());
+  statePublisher.request();
+  saveState();
 }
 
-// Gingerbread State
-void setGingerbreadState(std::string data) {
-  handleSwitchSubscription(data, gingerbreadState);
+/**
+ * Runs an uploaded effect program on a single light. The program keeps running
+ * until the light's state is changed by another topic
+ * @param channel The light's program channel (CMD_PROGRAM plus the light's
+ * index in the model's lights)
+ * @param data The program
+ */
+void runEffectProgram(int channel, std::string_view data) {
+  if (isStateOverridden()) {
+    return;
+  }
+  EffectProgram program;
+  if (!program.load((const uint8_t *)data.data(), data.size())) {
+    Metrics::global().invalid.add();
+    return;
+  }
+  village.lights()[channel - CMD_PROGRAM].run(program);
 }
 
-// Honeydukes State
-void setHoneydukesState(std::string data) {
-  handleSwitchSubscription(data, honeydukesState);
+/**
+ * Sets lights to raw levels in one frame (ex. from a light show sequencer),
+ * merging every frame received since the last one was applied. The levels
+ * override the lights like an effect program, so the model's state isn't
+ * changed or published
+ * @param data Unused (CMD_FRAME is a signal, the frame is in `frames`)
+ */
+void applyLightFrame([[maybe_unused]] std::string_view data) {
+  // Take the frame first, so frames received while it is ignored are dropped
+  uint8_t frame[frames.SIZE];
+  size_t size = frames.take(frame);
+  if (isStateOverridden() || size == 0) {
+    return;
+  }
+  LightFrame::apply(frame, size, village.lights().data(),
+                    VillageModel::LIGHT_COUNT);
 }
 
-// Three Broomsticks State
-void setThreebroomsticksState(std::string data) {
-  handleSwitchSubscription(data, threebroomsticksState);
+// Stop the show and restore the state
+void stopShow(void) {
+  if (show.isPlaying()) {
+    show.stop();
+    updateLightsFromState();
+  }
 }
 
-// Toy Store State
-void setToystoreState(std::string data) {
-  handleSwitchSubscription(data, toystoreState);
+/**
+ * Plays or stops the show. The show overrides the state like a stream, and
+ * commands received while it plays still change the state, which is shown once
+ * it stops
+ * @param data "ON" to play the show from the start, or "OFF" to stop it
+ * (optionally at a network time, so every board starts the show together)
+ */
+void handleShow(std::string_view data) {
+  if (holdUntilDue(CMD_SHOW, data)) {
+    return;
+  }
+  if (data == "ON" && !stream.isActive()) {
+    show.play();
+  } else if (data == "OFF") {
+    stopShow();
+  }
 }
 
-// Music Store State
-void setMusicstoreState(std::string data) {
-  handleSwitchSubscription(data, musicstoreState);
+/**
+ * Applies a timestamped command once it is due
+ * @param channel The command's channel
+ * @param data The payload (without the time)
+ */
+void applyScheduledCommand(int channel, std::string_view data) {
+  if (channel == CMD_SHOW) {
+    handleShow(data);
+  } else {
+    handleChannel(channel, data);
+  }
 }
 
-// Trolley State
-void setTrolleyState(std::string data) {
-  handleSwitchSubscription(data, trolleyState);
+/**
+ * Subscribe to a topic through the command mailbox. The MQTT task only copies
+ * the payload into the channel and wakes the scheduler, and the handler runs
+ * on the lighting task with the latest payload
+ * @param topic The topic to subscribe to
+ * @param channel The mailbox channel for the topic (its handler is set
+ * separately)
+ */
+void subscribe(const char *topic, int channel) {
+  client.onTopic(topic, [channel](std::string_view data) {
+    if (commands.post(channel, data)) {
+      scheduler.wake();
+    } else {
+      Metrics::global().dropped.add();
+    }
+  });
 }
 
-// Trees State
-void setTreesState(std::string data) {
-  handleSwitchSubscription(data, treesState);
+/**
+ * Subscribe to the program topic. The first byte of a payload selects the
+ * light, and the rest of it is posted to that light's program channel
+ */
+void subscribeToPrograms(void) {
+  client.onTopic(SUB_PROGRAM_TOPIC, [](std::string_view data) {
+    if (data.empty() || (uint8_t)data[0] >= VillageModel::LIGHT_COUNT) {
+      Metrics::global().invalid.add();
+    } else if (commands.post(CMD_PROGRAM + (uint8_t)data[0], data.substr(1))) {
+      scheduler.wake();
+    } else {
+      Metrics::global().dropped.add();
+    }
+  });
 }
 
-// Lamps State
-void setLampsState(std::string data) {
-  handleSwitchSubscription(data, lampsState);
+/**
+ * Subscribe to the frame topic. The MQTT task merges each frame into `frames`
+ * and signals CMD_FRAME, so partial frames aren't lost when frames arrive
+ * faster than the lighting task applies them
+ */
+void subscribeToFrames(void) {
+  client.onTopic(SUB_FRAME_TOPIC, [](std::string_view data) {
+    if (frames.post((const uint8_t *)data.data(), data.size())) {
+      commands.post(CMD_FRAME);
+      scheduler.wake();
+    } else {
+      Metrics::global().invalid.add();
+    }
+  });
 }
 
 // Add all topic subscriptions to the MQTT client
 void configureTopicSubscriptions(void) {
-  // Gingerbread House Topics
-  client.onTopic(SUB_ALL_TOPIC, &setAllState)
-      .onTopic(SUB_GINGERBREAD_TOPIC, &setGingerbreadState)
-      .onTopic(SUB_HONEYDUKES_TOPIC, &setHoneydukesState)
-      .onTopic(SUB_THREEBROOMSTICKS_TOPIC, &setThreebroomsticksState)
-      .onTopic(SUB_TOYSTORE_TOPIC, &setToystoreState)
-      .onTopic(SUB_MUSICSTORE_TOPIC, &setMusicstoreState)
-      .onTopic(SUB_TROLLEY_TOPIC, &setTrolleyState)
-      .onTopic(SUB_TREES_TOPIC, &setTreesState)
-      .onTopic(SUB_LAMPS_TOPIC, &setLampsState);
+  for (int channel = 0; channel < VillageModel::SIZE; channel++) {
+    if (VillageModel::hasTopic(channel)) {
+      commands.on(channel, &handleChannel);
+      subscribe(VillageModel::topic(channel), channel);
+    }
+  }
+  schedule.on(&applyScheduledCommand);
+  for (int light = 0; light < VillageModel::LIGHT_COUNT; light++) {
+    commands.on(CMD_PROGRAM + light, &runEffectProgram);
+  }
+  subscribeToPrograms();
+  commands.on(CMD_FRAME, &applyLightFrame);
+  subscribeToFrames();
+  commands.on(CMD_SHOW, &handleShow);
+  subscribe(SUB_SHOW_TOPIC, CMD_SHOW);
 }
 
-/** Handle MQTT Client Connection State */
-void onConnectionUpdate(bool wifiOk, bool ipOk, bool mqttOk) {
+/**
+ * Handle MQTT Client Connection State (runs on the lighting task)
+ * @param data Unused (CMD_CONNECTION is a signal)
+ */
+void updateConnectionState([[maybe_unused]] std::string_view data) {
   /** Resume previous state when client is fully connected */
-  if (client.isConnected()) {
+  if (connectionStatus.load() == 0x07) {
+    isShowingRestoredState = false;
     // Publish the availability
     client.publish(PUB_AVAILABLE_TOPIC, AVAILABLE_ONLINE, true);
+    // The offline show ends once the board is back online
+    if (SHOW_OFFLINE) {
+      show.stop();
+    }
     // Restore and publish the existing state
     updateLightsFromState();
     publishCurrentState();
+    // The stream only needs the network (it doesn't go through the broker)
+    if (STREAM_INPUT) {
+      stream.start();
+    }
+  } else if (!isStateOverridden() && !isShowingRestoredState) {
+    // Client is disconnected so play the show, or turn off all lights and
+    // blink the candles without one
+    if (SHOW_OFFLINE && show.isLoaded()) {
+      show.play();
+    } else {
+      village.light(GINGERBREAD).blink();
+    }
+  }
+}
+
+/**
+ * Hand the lights between the stream and MQTT control. Commands received while
+ * the stream owns the lights still change the state, which is shown once the
+ * stream stops
+ * @param isActive Whether the stream took the lights (or handed them back)
+ */
+void onStreamHandover(bool isActive) {
+  if (isActive) {
+    show.stop();
   } else {
-    // Client is disconnected so turn off all lights and blink the candles
-    gingerbreadLight.blink();
+    updateLightsFromState();
   }
 }
 
+// Configure the light stream (it is started once the network is up)
+void configureStream(void) {
+  stream.setProtocol(STREAM_INPUT_PROTOCOL)
+      .setUniverse(STREAM_INPUT_UNIVERSE)
+      .setStartChannel(STREAM_INPUT_START)
+      .setPriority(STREAM_INPUT_PRIORITY)
+      .onReceive([] { scheduler.wake(); })
+      .onHandover(&onStreamHandover);
+}
+
 /**
- * Main loop function for lighting effects
+ * Forward connection status changes from the WiFi and MQTT event tasks to the
+ * lighting task
  */
-void loop(unsigned int now) {
-  gingerbreadLight.loop(now); // Blinks while trying to establish a connection
+void onConnectionUpdate(bool wifiOk, bool ipOk, bool mqttOk) {
+  connectionStatus.store((wifiOk ? 0x01 : 0) | (ipOk ? 0x02 : 0) |
+                         (mqttOk ? 0x04 : 0));
+  commands.post(CMD_CONNECTION);
+  scheduler.wake();
+}
+
+/**
+ * Register the command mailbox (first, so effects started by commands run in
+ * the same pass), the command schedule, the light stream, the show, the light
+ * bank (runs every light's effects in one pass), the state publisher, the
+ * state saver and the metrics reporter with the scheduler
+ */
+void configureScheduler(void) {
+  scheduler.add(commands)
+      .add(schedule)
+      .add(stream)
+      .add(show)
+      .add(LightBank::global())
+      .add(statePublisher)
+      .add(stateSaver)
+      .add(metricsReporter);
 }
 
 /**
@@ -246,17 +529,31 @@ void loop(unsigned int now) {
 void app_main(void) {
   Light::configurePWMTimer();
 
-  // Set initial light state
+  // Set initial light state (the state saved before the last reset, if any),
+  // or play the show until the board is online
+  restoreState();
   updateLightsFromState();
+  if (show.loadPartition(SHOW_PARTITION) && SHOW_OFFLINE &&
+      !isShowingRestoredState) {
+    show.play();
+  }
 
   // Configure the MQTT client and setup the LWT topic and message
   client.configure(PUB_AVAILABLE_TOPIC, AVAILABLE_OFFLINE, true);
+  // Keep the clock in step with the other boards (for timestamped commands and
+  // blinking in phase)
+  client.setTimeServer(TIME_SERVER);
+  // Join the last access point (and reuse its address) without a scan
+  client.setFastConnect(WIFI_FAST_CONNECT, WIFI_REUSE_ADDRESS);
   // Configure all of the topic subscriptions
   configureTopicSubscriptions();
 
   // Listen for client connection events and start the client
+  commands.on(CMD_CONNECTION, &updateConnectionState);
   client.onConnecting(&onConnectionUpdate).start();
 
-  // Start main loop
-  Utils::startLoop(&loop);
+  // Run lighting effects on this task (sleeps until an effect is due)
+  configureStream();
+  configureScheduler();
+  scheduler.start();
 }
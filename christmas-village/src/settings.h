@@ -1,28 +1,82 @@
+#include <Model.h>
 
-/***************** GPIO PINS ******************/
+/**************** STATE REPORTING *************/
 
-#define GINGERBREAD_PIN 16
-#define HONEYDUKES_PIN 17
-#define THREEBROOMSTICKS_PIN 18
-#define TOYSTORE_PIN 19
-#define MUSICSTORE_PIN 22
-#define TROLLEY_PIN 23
-#define TREES_PIN 25
-#define LAMPS_PIN 26
+#define STATE_JSON_SIZE 256     // Buffer size for the state document in bytes
+#define STATE_PUBLISH_WINDOW 50 // Time to wait for more commands before
+                                // publishing the state in ms
+#define STATE_CBOR 0            // Publish the state as CBOR instead of JSON
 
+/***************** STATE RESTORE **************/
+
+#define STATE_RESTORE 1        // Show the last state at boot, before WiFi and
+                               // the broker are up (saved in NVS)
+#define STATE_SAVE_WINDOW 5000 // Shortest time between writes of the state to
+                               // flash in ms
+
+/***************** FAST CONNECT ***************/
+
+#define WIFI_FAST_CONNECT 1  // Join the last access point without a scan
+                             // after a power cut (cached in NVS)
+#define WIFI_REUSE_ADDRESS 0 // Reuse the last address instead of waiting for
+                             // DHCP (only with a DHCP reservation for the board
+                             // on the router, or the lease can be handed out
+                             // to another device)
+
+/******************* METRICS ******************/
+
+#define METRICS_INTERVAL 10000 // Time between metrics snapshots in ms (0 to
+                               // never publish, or build with
+                               // -DMETRICS_ENABLED=0 to compile metrics out)
+#define METRICS_JSON_SIZE 1024 // Buffer size for the metrics snapshot in bytes
+                               // (the largest snapshot is about 900)
 
 /***************** MQTT TOPICS ****************/
 
 #define BASE_TOPIC "/christmas-village/"
 #define PUB_AVAILABLE_TOPIC BASE_TOPIC "available"
 #define PUB_STATE_TOPIC BASE_TOPIC "state"
+#define PUB_METRICS_TOPIC BASE_TOPIC "metrics"
+
+#define SUB_PROGRAM_TOPIC BASE_TOPIC "program" // Upload an effect program
+#define SUB_FRAME_TOPIC BASE_TOPIC "frame"     // Set many lights at once
+#define SUB_SHOW_TOPIC BASE_TOPIC "show"       // Play the show (ON or OFF)
+
+/***************** TIME SYNC ******************/
+
+#define TIME_SERVER "pool.ntp.org" // SNTP server shared by every board (ex. the
+                                   // broker's host if it runs an NTP server)
+#define COMMAND_SCHEDULE_SIZE 8    // Timestamped commands that can wait at once
+
+/***************** LIGHT STREAM ***************/
+
+#define STREAM_INPUT 0                            // Listen for light streams
+#define STREAM_INPUT_PROTOCOL StreamProtocol::DDP // Protocol to listen for
+#define STREAM_INPUT_UNIVERSE 1                   // E1.31 universe
+#define STREAM_INPUT_START 0      // Channel of the first light (in model order)
+#define STREAM_INPUT_PRIORITY 100 // Priority a source needs to take over from
+                                  // MQTT control (E1.31 priority, DDP is 100)
+
+/******************** SHOW ********************/
+
+#define SHOW_PARTITION "show" // Data partition holding the show
+#define SHOW_OFFLINE 1        // Play the show while the board is offline
+
+/******************** MODEL *******************/
 
-#define SUB_ALL_TOPIC BASE_TOPIC "all"                           // All Lights (off or on)
-#define SUB_GINGERBREAD_TOPIC BASE_TOPIC "gingerbread"           // Gingerbread House
-#define SUB_HONEYDUKES_TOPIC BASE_TOPIC "honeydukes"             // Honeydukes
-#define SUB_THREEBROOMSTICKS_TOPIC BASE_TOPIC "threebroomsticks" // Three Broomsticks
-#define SUB_TOYSTORE_TOPIC BASE_TOPIC "toystore"                 // Toy Store
-#define SUB_MUSICSTORE_TOPIC BASE_TOPIC "musicstore"             // Music Store
-#define SUB_TROLLEY_TOPIC BASE_TOPIC "trolley"                   // Trolley
-#define SUB_TREES_TOPIC BASE_TOPIC "trees"                       // Trees
-#define SUB_LAMPS_TOPIC BASE_TOPIC "lamps"                       // Lamps
+// Every channel of the village: its topic (BASE_TOPIC followed by the name),
+// the pin of its light, and how bright the light turns on
+struct Village {
+  static constexpr const char *TOPIC_PREFIX = BASE_TOPIC;
+  static constexpr ModelChannel CHANNELS[] = {
+      {.name = "all"},                                               // All Lights (off or on)
+      {.name = "gingerbread", .pin = 16},                            // Gingerbread House
+      {.name = "honeydukes", .pin = 17},                             // Honeydukes
+      {.name = "threebroomsticks", .pin = 18},                       // Three Broomsticks
+      {.name = "toystore", .pin = 19},                               // Toy Store
+      {.name = "musicstore", .pin = 22},                             // Music Store
+      {.name = "trolley", .pin = 23},                                // Trolley
+      {.name = "trees", .pin = 25, .isDimmable = true, .level = 25}, // Trees (custom brightness)
+      {.name = "lamps", .pin = 26},                                  // Lamps
+  };
+};
@@ -1,329 +1,565 @@
-#include "cJSON.h"
 #include "settings.h" // Includes pin, topic, and behavior settings
+#include <CborWriter.h>
+#include <Coalescer.h>
+#include <CommandSchedule.h>
+#include <JsonWriter.h>
 #include <Light.h>
+#include <LightFrame.h>
+#include <LightFrameBuffer.h>
+#include <LightStream.h>
+#include <LightGroup.h>
+#include <Mailbox.h>
+#include <Metrics.h>
+#include <Model.h>
 #include <MqttClient.h>
-#include <SequentialLightGroup.h>
-#include <Utils.h>
-#include <cJSON.h>
+#include <Scheduler.h>
+#include <StateStore.h>
+#include <SyncClock.h>
+#include <atomic>
+#include <esp_log.h>
 #include <string>
+#include <string_view>
 
 // Export main function for C compiler
 extern "C" {
 void app_main(void);
 }
 
-// ********************* STATE DEFINITIONS *********************
+// Logging tag
+static const char *APP_TAG = "lego_mustang";
 
-// Lighting Modes
-#define LIGHT_MODE_OFF "OFF"           // Lights Off
-#define LIGHT_MODE_RUNNING "RUNNING"   // Daytime Running Lights
-#define LIGHT_MODE_LOW_BEAM "LOW_BEAM" // Low Beams
+// ********************* STATE DEFINITIONS *********************
 
-// Light Switch Modes
-#define SWITCH_ON "ON"   // Light Channel On
-#define SWITCH_OFF "OFF" // Light Channel Off
+// Lighting Modes (indexes into LIGHTING_MODES)
+enum LightingMode {
+  LIGHTING_OFF,      // Lights Off
+  LIGHTING_RUNNING,  // Daytime Running Lights
+  LIGHTING_LOW_BEAM, // Low Beams
+};
 
-// Turning Modes
-#define TURNING_OFF "OFF"     // No turn signal
-#define TURNING_LEFT "LEFT"   // Left turn signal
-#define TURNING_RIGHT "RIGHT" // Right turn signal
+// Turning Modes (indexes into TURNING_MODES)
+enum TurningMode {
+  TURNING_OFF,   // No turn signal
+  TURNING_LEFT,  // Left turn signal
+  TURNING_RIGHT, // Right turn signal
+};
 
 #define AVAILABLE_YES "YES" // Board is available
 #define AVAILABLE_NO "NO"   // Board is not available
 
 // ********************* STATES ***********************
-std::string lightingState = LIGHT_MODE_OFF;
-std::string highBeamState = SWITCH_OFF;
-std::string brakingState = SWITCH_OFF;
-std::string turningState = TURNING_OFF;
-std::string reverseState = SWITCH_OFF;
-std::string fogState = SWITCH_OFF;
-std::string interiorState = SWITCH_OFF;
-std::string hazardState = SWITCH_OFF;
+
+using MustangModel = Model<Mustang>;
+
+// Every channel's state and light, generated from the Mustang description
+MustangModel mustang;
+
+// Channels that drive the lighting logic
+constexpr int LIGHTING = MustangModel::channel("lighting");
+constexpr int HIGH_BEAM = MustangModel::channel("high_beam");
+constexpr int BRAKING = MustangModel::channel("braking");
+constexpr int TURNING = MustangModel::channel("turning");
+constexpr int HAZARD = MustangModel::channel("hazard");
+constexpr int ALL = MustangModel::channel("all");
+constexpr int REVERSE = MustangModel::channel("reverse");
+constexpr int FOG = MustangModel::channel("fog");
+constexpr int INTERIOR = MustangModel::channel("interior");
+
+// Inputs of each group of lights, so a command only recomputes the lights that
+// depend on the channels it changed
+constexpr MustangModel::Mask RUNNING_INPUTS = {LIGHTING};
+constexpr MustangModel::Mask HEADLIGHT_INPUTS = {LIGHTING, HIGH_BEAM, TURNING,
+                                                 HAZARD};
+constexpr MustangModel::Mask TAILLIGHT_INPUTS = {LIGHTING, BRAKING, TURNING,
+                                                 HAZARD};
+// Every input (fog, reverse and interior lights follow their own channel)
+constexpr MustangModel::Mask ALL_INPUTS = MustangModel::FOLLOWERS |
+                                          RUNNING_INPUTS | HEADLIGHT_INPUTS |
+                                          TAILLIGHT_INPUTS;
 
 // ********************* MQTT CLIENT SETUP *********************
 MqttClient client("lego_mustang"); // MQTT Client
 
-// ********************* LIGHT SETUP *************************
-int pwmChannel = 0; // incremental PWM channel
+// ********************* STATE STORE *********************
+
+// Keeps the state across reboots, so the lights show it before the network is
+// up (a snapshot saved by firmware with other channels is ignored)
+StateStore stateStore("mustang", MustangModel::STATE_VERSION);
+
+// The lights show the restored state instead of the connecting pattern until
+// the first connection
+bool isShowingRestoredState = false;
+
+// ********************* EFFECT SCHEDULER *********************
+Scheduler scheduler; // Runs lighting effects when they are due
+
+// ********************* LIGHT STREAM *********************
+
+// Show sequencers can drive every light over UDP (without the broker), and own
+// the lights while their frames arrive
+LightStream stream(mustang.lights().data(), MustangModel::LIGHT_COUNT);
+
+// ********************* COMMAND MAILBOX *********************
+
+// Mailbox channels, handled on the lighting task in the order they were posted
+// to. The model's channels come first, so a topic's mailbox channel is its
+// model channel
+enum Command {
+  CMD_CONNECTION = MustangModel::SIZE, // Connection status changed (signal)
+  CMD_PROGRAM, // Program for the first light (then one channel per light)
+  CMD_FRAME = CMD_PROGRAM + MustangModel::LIGHT_COUNT,
+  COMMAND_COUNT
+};
+
+// Commands posted by the MQTT task. Only the latest payload of each channel is
+// handled, so floods of messages on a topic collapse into one update (programs
+// have a channel per light, so uploads for different lights are all kept).
+// Payloads are up to an effect program
+Mailbox<COMMAND_COUNT, EFFECT_PROGRAM_SIZE> commands;
+
+// Light frames posted by the MQTT task, merged until the lighting task applies
+// them (CMD_FRAME signals that one is waiting), so a sequencer that outruns the
+// lighting task only skips levels that were replaced
+LightFrameBuffer<MustangModel::LIGHT_COUNT> frames;
+
+// Commands that carry a network time to apply them at, held on the lighting
+// task until they are due (the model's payloads are short words)
+CommandSchedule<COMMAND_SCHEDULE_SIZE, 16> schedule;
 
-// Left Headlight
-Light leftHeadlight(LEFT_HEADLIGHT_PIN, pwmChannel++);
+// Latest connection status (bit 0: WiFi, bit 1: IP, bit 2: MQTT), written by
+// the event tasks and read when CMD_CONNECTION is handled
+std::atomic<uint8_t> connectionStatus{0};
 
-// Right Headlight
-Light rightHeadlight(RIGHT_HEADLIGHT_PIN, pwmChannel++);
+// ********************* LIGHT SETUP *************************
+
+// Headlights
+Light &leftHeadlight = mustang.light(MustangModel::channel("left_headlight"));
+Light &rightHeadlight = mustang.light(MustangModel::channel("right_headlight"));
 
 // Left Taillight Group
-Light leftInnerTaillight(LEFT_INNER_TAILLIGHT_PIN, pwmChannel++);
-Light leftMiddleTaillight(LEFT_MIDDLE_TAILLIGHT_PIN, pwmChannel++);
-Light leftOuterTaillight(LEFT_OUTER_TAILLIGHT_PIN, pwmChannel++);
-SequentialLightGroup leftTaillight(leftInnerTaillight, leftMiddleTaillight,
-                                   leftOuterTaillight);
+Light &leftInnerTaillight = mustang.light(MustangModel::channel("left_inner"));
+Light &leftMiddleTaillight =
+    mustang.light(MustangModel::channel("left_middle"));
+Light &leftOuterTaillight = mustang.light(MustangModel::channel("left_outer"));
+LightGroup leftTaillight(leftInnerTaillight, leftMiddleTaillight,
+                         leftOuterTaillight);
 
 // Right Taillight Group
-Light rightInnerTaillight(RIGHT_INNER_TAILLIGHT_PIN, pwmChannel++);
-Light rightMiddleTaillight(RIGHT_MIDDLE_TAILLIGHT_PIN, pwmChannel++);
-Light rightOuterTaillight(RIGHT_OUTER_TAILLIGHT_PIN, pwmChannel++);
-SequentialLightGroup rightTaillight(rightInnerTaillight, rightMiddleTaillight,
-                                    rightOuterTaillight);
+Light &rightInnerTaillight =
+    mustang.light(MustangModel::channel("right_inner"));
+Light &rightMiddleTaillight =
+    mustang.light(MustangModel::channel("right_middle"));
+Light &rightOuterTaillight =
+    mustang.light(MustangModel::channel("right_outer"));
+LightGroup rightTaillight(rightInnerTaillight, rightMiddleTaillight,
+                          rightOuterTaillight);
 
 // Other lights
-Light fogLights(FOG_LIGHTS_PIN);
-Light runningLights(RUNNING_LIGHTS_PIN);
-Light reverseLights(REVERSE_LIGHTS_PIN);
-Light interiorLights(INTERIOR_LIGHTS_PIN);
+Light &fogLights = mustang.light(FOG);
+Light &runningLights = mustang.light(MustangModel::channel("running"));
+Light &reverseLights = mustang.light(REVERSE);
+Light &interiorLights = mustang.light(INTERIOR);
 
 // ************************ STATE UPDATES **********************
 
-/** Update all lights based on the current state */
-void updateLightsFromState(void) {
-  // Fog lights
-  fogState == SWITCH_ON ? fogLights.on() : fogLights.off();
-  // Reverse lights
-  reverseState == SWITCH_ON ? reverseLights.on() : reverseLights.off();
-  // Interior lights
-  interiorState == SWITCH_ON ? interiorLights.on() : interiorLights.off();
-  // Lights switched off
-  if (lightingState == LIGHT_MODE_OFF) {
-    runningLights.off();
-    leftHeadlight.off();
-    rightHeadlight.off();
-    leftTaillight.off();
-    rightTaillight.off();
+/** Update the running lights from the lighting mode */
+void updateRunningLights(void) {
+  mustang.get(LIGHTING) == LIGHTING_OFF ? runningLights.off()
+                                        : runningLights.on();
+}
+
+/**
+ * Update the headlights from the lighting mode, high beams, hazards and turn
+ * signals
+ */
+void updateHeadlights(void) {
+  int lighting = mustang.get(LIGHTING);
+  // Low beams (off in the other lighting modes), or high beams
+  int brightness = lighting == LIGHTING_LOW_BEAM ? LOW_BEAM_BRIGHTNESS : 0;
+  if (mustang.isOn(HIGH_BEAM)) {
+    brightness = HIGH_BEAM_BRIGHTNESS;
   }
-  // Daytime running lights
-  else if (lightingState == LIGHT_MODE_RUNNING) {
-    runningLights.on();
-    leftHeadlight.off();
-    rightHeadlight.off();
-    leftTaillight.on(RUNNING_BRIGHTNESS);
-    rightTaillight.on(RUNNING_BRIGHTNESS);
+  leftHeadlight.fadeTo(brightness, FADE_DURATION);
+  rightHeadlight.fadeTo(brightness, FADE_DURATION);
+  // Hazards
+  if (mustang.isOn(HAZARD)) {
+    leftHeadlight.blink(BLINKING_INTERVAL);
+    rightHeadlight.blink(BLINKING_INTERVAL);
   }
-  // Low beams
-  else if (lightingState == LIGHT_MODE_LOW_BEAM) {
-    runningLights.on();
-    leftHeadlight.on(LOW_BEAM_BRIGHTNESS);
-    rightHeadlight.on(LOW_BEAM_BRIGHTNESS);
-    leftTaillight.on(LOW_BEAM_BRIGHTNESS);
-    rightTaillight.on(LOW_BEAM_BRIGHTNESS);
+  // Turning left
+  else if (mustang.get(TURNING) == TURNING_LEFT) {
+    leftHeadlight.blink(BLINKING_INTERVAL);
   }
-  // High Beams
-  if (highBeamState == SWITCH_ON) {
-    leftHeadlight.on(HIGH_BEAM_BRIGHTNESS);
-    rightHeadlight.on(HIGH_BEAM_BRIGHTNESS);
+  // Turning right
+  else if (mustang.get(TURNING) == TURNING_RIGHT) {
+    rightHeadlight.blink(BLINKING_INTERVAL);
   }
+}
+
+/**
+ * Update the taillights from the lighting mode, braking, hazards and turn
+ * signals
+ */
+void updateTaillights(void) {
+  int lighting = mustang.get(LIGHTING);
+  // Dimmed in running mode, brighter with the low beams
+  int brightness = lighting == LIGHTING_RUNNING    ? RUNNING_BRIGHTNESS
+                   : lighting == LIGHTING_LOW_BEAM ? LOW_BEAM_BRIGHTNESS
+                                                   : 0;
+  leftTaillight.fadeTo(brightness, FADE_DURATION);
+  rightTaillight.fadeTo(brightness, FADE_DURATION);
   // Braking
-  if (brakingState == SWITCH_ON) {
+  if (mustang.isOn(BRAKING)) {
     leftTaillight.on(HIGH_BEAM_BRIGHTNESS);
     rightTaillight.on(HIGH_BEAM_BRIGHTNESS);
   }
   // Hazards
-  if (hazardState == SWITCH_ON) {
-    leftHeadlight.blink(BLINKING_INTERVAL);
-    rightHeadlight.blink(BLINKING_INTERVAL);
+  if (mustang.isOn(HAZARD)) {
     leftTaillight.blink(BLINKING_INTERVAL);
     rightTaillight.blink(BLINKING_INTERVAL);
   }
   // Turning left
-  else if (turningState == TURNING_LEFT) {
-    leftHeadlight.blink(BLINKING_INTERVAL);
-    leftTaillight.start(BLINKING_INTERVAL, SEQUENTIAL_INTERVAL);
+  else if (mustang.get(TURNING) == TURNING_LEFT) {
+    leftTaillight.sequence(BLINKING_INTERVAL, SEQUENTIAL_INTERVAL);
   }
   // Turning right
-  else if (turningState == TURNING_RIGHT) {
-    rightHeadlight.blink(BLINKING_INTERVAL);
-    rightTaillight.start(BLINKING_INTERVAL, SEQUENTIAL_INTERVAL);
+  else if (mustang.get(TURNING) == TURNING_RIGHT) {
+    rightTaillight.sequence(BLINKING_INTERVAL, SEQUENTIAL_INTERVAL);
+  }
+}
+
+/**
+ * Update the lights that depend on the changed channels (every light by
+ * default)
+ * @param changes The channels that changed
+ */
+void updateLightsFromState(const MustangModel::Mask &changes = ALL_INPUTS) {
+  // The state is restored when the stream hands the lights back
+  if (stream.isActive()) {
+    return;
+  }
+  // Write every light together once the whole state is applied
+  LightBank::global().beginFrame();
+  // Fog, reverse and interior lights
+  mustang.updateLights(changes);
+  if (changes.intersects(RUNNING_INPUTS)) {
+    updateRunningLights();
+  }
+  if (changes.intersects(HEADLIGHT_INPUTS)) {
+    updateHeadlights();
   }
+  if (changes.intersects(TAILLIGHT_INPUTS)) {
+    updateTaillights();
+  }
+  LightBank::global().commitFrame();
 }
 
 /**
- * Constructs a JSON representation of the current state and publishes it to the
- * MQTT client
+ * Writes a JSON (or CBOR) representation of the current state into a stack
+ * buffer and publishes it to the MQTT client
  */
 void publishCurrentState(void) {
-  // Create state object and fill with state values
-  cJSON *state = cJSON_CreateObject();
-  cJSON_AddStringToObject(state, "lighting", lightingState.c_str());
-  cJSON_AddStringToObject(state, "high_beam", highBeamState.c_str());
-  cJSON_AddStringToObject(state, "braking", brakingState.c_str());
-  cJSON_AddStringToObject(state, "turning", turningState.c_str());
-  cJSON_AddStringToObject(state, "reverse", reverseState.c_str());
-  cJSON_AddStringToObject(state, "fog", fogState.c_str());
-  cJSON_AddStringToObject(state, "interior", interiorState.c_str());
-  cJSON_AddStringToObject(state, "hazard", hazardState.c_str());
-  // Convert state object to string
-  char *stateStr = cJSON_PrintUnformatted(state);
-  // Deallocate state object (MUST be done to avoid memory leaks)
-  cJSON_Delete(state);
+#if STATE_CBOR
+  CborWriter<STATE_JSON_SIZE> state;
+#else
+  JsonWriter<STATE_JSON_SIZE> state;
+#endif
+  state.beginObject();
+  mustang.writeState(state);
+  state.endObject();
+  // A truncated document is never published (it would be retained)
+  if (!state.isValid()) {
+    ESP_LOGW(APP_TAG, "State document is larger than STATE_JSON_SIZE");
+    return;
+  }
   // Publish state to topic
-  client.publish(PUB_STATE_TOPIC, stateStr, true);
+  client.publish(PUB_STATE_TOPIC, state.view(), true);
 }
 
-// *********************** SUBSCRIPTION UTILITIES ***********************
+// Publishes the state once per burst of commands
+Coalescer statePublisher(STATE_PUBLISH_WINDOW, &publishCurrentState);
 
-// Checks if the payload data is a valid light mode string
-bool isLightModeStr(std::string data) {
-  return (data == LIGHT_MODE_OFF || data == LIGHT_MODE_RUNNING ||
-          data == LIGHT_MODE_LOW_BEAM);
-}
+// Writes the saved state to flash (unless it is already there)
+void commitState(void) { stateStore.commit(); }
+
+// Writes the state to flash once per STATE_SAVE_WINDOW at most
+Coalescer stateSaver(STATE_SAVE_WINDOW, &commitState);
 
-// Checks if the payload data is a valid turning string
-bool isTurningStr(std::string data) {
-  return data == TURNING_OFF || data == TURNING_LEFT || data == TURNING_RIGHT;
+/**
+ * Saves the state. It is kept in RTC memory right away (for warm resets), and
+ * written to flash once the save window closes
+ */
+void saveState(void) {
+  if (STATE_RESTORE) {
+    stateStore.save(mustang.snapshot());
+    stateSaver.request();
+  }
 }
 
-// Checks if the payload data is a valid switch string
-bool isSwitchStr(std::string data) {
-  return data == SWITCH_ON || data == SWITCH_OFF;
+/**
+ * Restores the state saved before the last reset, so the lights are right
+ * before the MQTT client starts (the retained commands still apply once it
+ * connects)
+ */
+void restoreState(void) {
+  MustangModel::Snapshot snapshot;
+  if (STATE_RESTORE && stateStore.load(snapshot) &&
+      mustang.restore(snapshot)) {
+    isShowingRestoredState = true;
+    // A snapshot only kept in RTC memory is written to flash too
+    stateSaver.request();
+  }
+  mustang.takeChanges();
 }
 
 /**
- * Handles validating data and applying state updates for a topic subscription
- * @param data The data string payload from the topic subscription
- * @param state Reference to a state variable that should be updated
- * @param validate A pointer to a validation function to check the data
+ * Writes a JSON snapshot of the board's metrics (covering the time since the
+ * last snapshot) and publishes it. Nothing is reset while the board is
+ * offline, so the first snapshot after reconnecting covers the outage
  */
-void handleSubscription(std::string data, std::string &state,
-                        bool (*validate)(std::string)) {
-  if (!validate(data)) {
+void publishMetrics(void) {
+  if (!client.isConnected()) {
     return;
   }
-  state = data;
-  updateLightsFromState();
-  publishCurrentState();
+  JsonWriter<METRICS_JSON_SIZE> metrics;
+  metrics.beginObject();
+  Metrics::global().write(metrics);
+  metrics.add("idle", (int)scheduler.getStats(true).idlePercentage());
+  metrics.add("state_writes", (int64_t)stateStore.getWrites());
+  // Messages received per topic (keyed without the base topic)
+  metrics.beginObject("topics");
+  client.forEachTopicCount(
+      [&metrics](const std::string &topic, uint32_t count) {
+        metrics.add(topic.c_str() + sizeof(BASE_TOPIC) - 1, (int64_t)count);
+      },
+      true);
+  metrics.endObject();
+  // Messages waiting to be published, unacknowledged, and dropped
+  OutboxStats outbox = client.getOutboxStats(true);
+  metrics.beginObject("outbox")
+      .add("queued", (int64_t)outbox.queued)
+      .add("in_flight", (int64_t)outbox.inFlight)
+      .add("dropped", (int64_t)outbox.dropped)
+      .endObject()
+      .endObject();
+  if (!metrics.isValid()) {
+    ESP_LOGW(APP_TAG, "Metrics snapshot is larger than METRICS_JSON_SIZE");
+    return;
+  }
+  // A lost snapshot is covered by the next one
+  client.publish(PUB_METRICS_TOPIC, metrics.view(), false, 0);
 }
 
-// Alias for handleSubscripton with the isSwitchStr validation function
-void handleSwitchSubscription(std::string data, std::string &state) {
-  handleSubscription(data, state, &isSwitchStr);
-}
+// Publishes the metrics every METRICS_INTERVAL
+MetricsReporter metricsReporter(METRICS_INTERVAL, &publishMetrics);
 
 // *********************** SUBSCRIPTION CALLBACKS *********************
 
 /**
  * Set the state of all lights simultaneously
- * @param data Should be ON or OFF
+ * @param isOn Turn every light on with no effects, or turn everything off
  */
-void setAllLights(std::string data) {
-  if (!isSwitchStr(data)) {
-    return;
-  }
-  // Turn off all lights
-  if (data == SWITCH_OFF) {
-    lightingState = LIGHT_MODE_OFF;
-    highBeamState = SWITCH_OFF;
-    brakingState = SWITCH_OFF;
-    turningState = TURNING_OFF;
-    reverseState = SWITCH_OFF;
-    fogState = SWITCH_OFF;
-    interiorState = SWITCH_OFF;
-    hazardState = SWITCH_OFF;
-  }
-  // Turn all lights on with no effects
-  else if (data == SWITCH_ON) {
-    lightingState = LIGHT_MODE_LOW_BEAM;
-    highBeamState = SWITCH_ON;
-    brakingState = SWITCH_ON;
-    turningState = TURNING_OFF;
-    reverseState = SWITCH_ON;
-    fogState = SWITCH_ON;
-    interiorState = SWITCH_ON;
-    hazardState = SWITCH_OFF;
-  }
-  updateLightsFromState();
-  publishCurrentState();
+void setAllLights(bool isOn) {
+  mustang.set(LIGHTING, isOn ? LIGHTING_LOW_BEAM : LIGHTING_OFF);
+  mustang.set(HIGH_BEAM, isOn);
+  mustang.set(BRAKING, isOn);
+  mustang.set(TURNING, TURNING_OFF);
+  mustang.set(REVERSE, isOn);
+  mustang.set(FOG, isOn);
+  mustang.set(INTERIOR, isOn);
+  mustang.set(HAZARD, false);
 }
 
 /**
- * Sets the lighting mode. This only affects running lights, headlights, and
- * taillights
- * @param data Should be OFF, RUNNING, or LOW_BEAM
+ * Hold a command until the network time it carries (ex. "ON@1733000000000"),
+ * so every board subscribed to the topic applies it at the same moment.
+ * Commands without a time are applied right away, and so are late commands,
+ * commands received before the clock is synced and commands that don't fit in
+ * the schedule
+ * @param channel The command's channel
+ * @param data The payload (the time is removed from it)
+ * @returns true if the command is held
  */
-void setLightState(std::string data) {
-  handleSubscription(data, lightingState, &isLightModeStr);
+bool holdUntilDue(int channel, std::string_view &data) {
+  int64_t applyAt;
+  data = splitApplyAt(data, applyAt);
+  SyncClock &clock = SyncClock::global();
+  if (applyAt == 0 || !clock.isSynced()) {
+    return false;
+  }
+  Timestamp due = clock.toLocal(applyAt * 1000);
+  return due > Clock::now() && schedule.add(due, channel, data);
 }
 
 /**
- * Sets the high beam state. This overrides the behavior of the low beam
- * lighting mode while on
- * @param data Should be ON or OFF
+ * Handles a payload on one of the model's topics. The lighting mode only
+ * affects running lights, headlights, and taillights. High beams, braking and
+ * turning override the low beam lighting mode while on, and hazards override
+ * low beams, high beams, and turning. Reverse, fog and interior lights are
+ * standalone
+ * @param channel The model channel of the topic
+ * @param data The data string payload from the topic subscription
  */
-void setHighBeamState(std::string data) {
-  handleSwitchSubscription(data, highBeamState);
+void handleChannel(int channel, std::string_view data) {
+  if (holdUntilDue(channel, data)) {
+    return;
+  }
+  int value = MustangModel::parse(channel, data);
+  if (value < 0) {
+    Metrics::global().invalid.add();
+    return;
+  }
+  if (channel == ALL) {
+    setAllLights(value);
+  } else {
+    mustang.set(channel, value);
+  }
+  // A repeated command still reapplies the lights that depend on it (ex. to
+  // stop an effect program), and the all switch reapplies every light
+  mustang.touch(channel);
+  MustangModel::Mask changes = mustang.takeChanges();
+  updateLightsFromState(channel == ALL ? ALL_INPUTS : changes);
+  statePublisher.request();
+  saveState();
 }
 
 /**
- * Sets the braking state. This overrides the behavior of the low beam
- * lighting mode while on
- * @param data Should be ON or OFF
+ * Stops the taillight patterns (leaving the lights at their levels), so they
+ * don't overwrite levels written by a program or a frame on their next step
  */
-void setBrakingState(std::string data) {
-  handleSwitchSubscription(data, brakingState);
+void stopTaillightPatterns(void) {
+  leftTaillight.stop();
+  rightTaillight.stop();
 }
 
 /**
- * Sets the turning state. This overrides the behavior of the low beam
- * lighting mode while on
- * @param data Should be OFF, LEFT, or RIGHT
+ * Runs an uploaded effect program on a single light. The program keeps running
+ * until the light's state is changed by another topic
+ * @param channel The light's program channel (CMD_PROGRAM plus the light's
+ * index in the model's lights)
+ * @param data The program
  */
-void setTurningState(std::string data) {
-  handleSubscription(data, turningState, &isTurningStr);
+void runEffectProgram(int channel, std::string_view data) {
+  if (stream.isActive()) {
+    return;
+  }
+  EffectProgram program;
+  if (!program.load((const uint8_t *)data.data(), data.size())) {
+    Metrics::global().invalid.add();
+    return;
+  }
+  stopTaillightPatterns();
+  mustang.lights()[channel - CMD_PROGRAM].run(program);
 }
 
 /**
- * Sets the reverse lights state. This is a standalone effect
- * @param data Should be ON or OFF
+ * Sets lights to raw levels in one frame (ex. from a light show sequencer),
+ * merging every frame received since the last one was applied. The levels
+ * override the lights like an effect program, so the model's state isn't
+ * changed or published
+ * @param data Unused (CMD_FRAME is a signal, the frame is in `frames`)
  */
-void setReverseState(std::string data) {
-  handleSwitchSubscription(data, reverseState);
+void applyLightFrame([[maybe_unused]] std::string_view data) {
+  // Take the frame first, so frames received while it is ignored are dropped
+  uint8_t frame[frames.SIZE];
+  size_t size = frames.take(frame);
+  if (stream.isActive() || size == 0) {
+    return;
+  }
+  stopTaillightPatterns();
+  LightFrame::apply(frame, size, mustang.lights().data(),
+                    MustangModel::LIGHT_COUNT);
 }
 
 /**
- * Sets the fog lights state. This is a standalone effect
- * @param data Should be ON or OFF
+ * Subscribe to a topic through the command mailbox. The MQTT task only copies
+ * the payload into the channel and wakes the scheduler, and the handler runs
+ * on the lighting task with the latest payload
+ * @param topic The topic to subscribe to
+ * @param channel The mailbox channel for the topic (its handler is set
+ * separately)
  */
-void setFogState(std::string data) { handleSwitchSubscription(data, fogState); }
+void subscribe(const char *topic, int channel) {
+  client.onTopic(topic, [channel](std::string_view data) {
+    if (commands.post(channel, data)) {
+      scheduler.wake();
+    } else {
+      Metrics::global().dropped.add();
+    }
+  });
+}
 
 /**
- * Sets the interior lights state. This is a standalone effect
- * @param data Should be ON or OFF
+ * Subscribe to the program topic. The first byte of a payload selects the
+ * light, and the rest of it is posted to that light's program channel
  */
-void setInteriorState(std::string data) {
-  handleSwitchSubscription(data, interiorState);
+void subscribeToPrograms(void) {
+  client.onTopic(SUB_PROGRAM_TOPIC, [](std::string_view data) {
+    if (data.empty() || (uint8_t)data[0] >= MustangModel::LIGHT_COUNT) {
+      Metrics::global().invalid.add();
+    } else if (commands.post(CMD_PROGRAM + (uint8_t)data[0], data.substr(1))) {
+      scheduler.wake();
+    } else {
+      Metrics::global().dropped.add();
+    }
+  });
 }
 
 /**
- * Sets the hazard lights state. This effect overrides low beam, high beam, and
- * turning states
- * @param data Should be ON or OFF
+ * Subscribe to the frame topic. The MQTT task merges each frame into `frames`
+ * and signals CMD_FRAME, so partial frames aren't lost when frames arrive
+ * faster than the lighting task applies them
  */
-void setHazardState(std::string data) {
-  handleSwitchSubscription(data, hazardState);
+void subscribeToFrames(void) {
+  client.onTopic(SUB_FRAME_TOPIC, [](std::string_view data) {
+    if (frames.post((const uint8_t *)data.data(), data.size())) {
+      commands.post(CMD_FRAME);
+      scheduler.wake();
+    } else {
+      Metrics::global().invalid.add();
+    }
+  });
 }
 
 // Add all topic subscriptions to the MQTT client
 void configureTopicSubscriptions(void) {
-  client.onTopic(SUB_LIGHTING_TOPIC, &setLightState)
-      .onTopic(SUB_HIGH_BEAM_TOPIC, &setHighBeamState)
-      .onTopic(SUB_BRAKING_TOPIC, &setBrakingState)
-      .onTopic(SUB_TURNING_TOPIC, &setTurningState)
-      .onTopic(SUB_REVERSE_TOPIC, &setReverseState)
-      .onTopic(SUB_FOG_TOPIC, &setFogState)
-      .onTopic(SUB_INTERIOR_TOPIC, &setInteriorState)
-      .onTopic(SUB_HAZARD_TOPIC, &setHazardState)
-      .onTopic(SUB_ALL_TOPIC, &setAllLights);
+  for (int channel = 0; channel < MustangModel::SIZE; channel++) {
+    if (MustangModel::hasTopic(channel)) {
+      commands.on(channel, &handleChannel);
+      subscribe(MustangModel::topic(channel), channel);
+    }
+  }
+  schedule.on(&handleChannel);
+  for (int light = 0; light < MustangModel::LIGHT_COUNT; light++) {
+    commands.on(CMD_PROGRAM + light, &runEffectProgram);
+  }
+  subscribeToPrograms();
+  commands.on(CMD_FRAME, &applyLightFrame);
+  subscribeToFrames();
 }
 
-/** Handle MQTT Client Connection State */
-void onConnectionUpdate(bool wifiOk, bool ipOk, bool mqttOk) {
+/**
+ * Handle MQTT Client Connection State (runs on the lighting task)
+ * @param data Unused (CMD_CONNECTION is a signal)
+ */
+void updateConnectionState([[maybe_unused]] std::string_view data) {
+  uint8_t status = connectionStatus.load();
+  bool wifiOk = status & 0x01;
+  bool ipOk = status & 0x02;
+  bool mqttOk = status & 0x04;
   /** Resume previous state when client is fully connected */
-  if (client.isConnected()) {
+  if (wifiOk && ipOk && mqttOk) {
+    isShowingRestoredState = false;
     // Publish the availability
     client.publish(PUB_AVAILABLE_TOPIC, AVAILABLE_YES, true);
     // Restore and publish the existing state
     updateLightsFromState();
     publishCurrentState();
-  } else {
+    // The stream only needs the network (it doesn't go through the broker)
+    if (STREAM_INPUT) {
+      stream.start();
+    }
+  } else if (!stream.isActive() && !isShowingRestoredState) {
     // Client is disconnected (turn off all lights except headlights and
     // taillights)
     fogLights.off();
@@ -357,13 +593,57 @@ void onConnectionUpdate(bool wifiOk, bool ipOk, bool mqttOk) {
 }
 
 /**
- * Main loop function for lighting effects
+ * Hand the lights between the stream and MQTT control. The taillight patterns
+ * are turned off while the stream owns the lights, and commands received in the
+ * meantime still change the state, which is shown once the stream stops
+ * @param isActive Whether the stream took the lights (or handed them back)
+ */
+void onStreamHandover(bool isActive) {
+  if (isActive) {
+    leftTaillight.off();
+    rightTaillight.off();
+  } else {
+    updateLightsFromState();
+  }
+}
+
+// Configure the light stream (it is started once the network is up)
+void configureStream(void) {
+  stream.setProtocol(STREAM_INPUT_PROTOCOL)
+      .setUniverse(STREAM_INPUT_UNIVERSE)
+      .setStartChannel(STREAM_INPUT_START)
+      .setPriority(STREAM_INPUT_PRIORITY)
+      .onReceive([] { scheduler.wake(); })
+      .onHandover(&onStreamHandover);
+}
+
+/**
+ * Forward connection status changes from the WiFi and MQTT event tasks to the
+ * lighting task
+ */
+void onConnectionUpdate(bool wifiOk, bool ipOk, bool mqttOk) {
+  connectionStatus.store((wifiOk ? 0x01 : 0) | (ipOk ? 0x02 : 0) |
+                         (mqttOk ? 0x04 : 0));
+  commands.post(CMD_CONNECTION);
+  scheduler.wake();
+}
+
+/**
+ * Register the command mailbox (first, so effects started by commands run in
+ * the same pass), the command schedule, the light stream, the light bank (runs
+ * every light's effects in one pass), the light groups, the state publisher,
+ * the state saver and the metrics reporter with the scheduler
  */
-void loop(unsigned int now) {
-  leftHeadlight.loop(now);
-  rightHeadlight.loop(now);
-  leftTaillight.loop(now);
-  rightTaillight.loop(now);
+void configureScheduler(void) {
+  scheduler.add(commands)
+      .add(schedule)
+      .add(stream)
+      .add(LightBank::global())
+      .add(leftTaillight)
+      .add(rightTaillight)
+      .add(statePublisher)
+      .add(stateSaver)
+      .add(metricsReporter);
 }
 
 /**
@@ -373,17 +653,26 @@ void loop(unsigned int now) {
 void app_main(void) {
   Light::configurePWMTimer();
 
-  // Set initial light state
+  // Set initial light state (the state saved before the last reset, if any)
+  restoreState();
   updateLightsFromState();
 
   // Configure the MQTT client and setup the LWT topic and message
   client.configure(PUB_AVAILABLE_TOPIC, AVAILABLE_NO, true);
+  // Keep the clock in step with the other boards (for timestamped commands and
+  // blinking in phase)
+  client.setTimeServer(TIME_SERVER);
+  // Join the last access point (and reuse its address) without a scan
+  client.setFastConnect(WIFI_FAST_CONNECT, WIFI_REUSE_ADDRESS);
   // Configure all of the topic subscriptions
   configureTopicSubscriptions();
 
   // Listen for client connection events and start the client
+  commands.on(CMD_CONNECTION, &updateConnectionState);
   client.onConnecting(&onConnectionUpdate).start();
 
-  // Start main loop
-  Utils::startLoop(&loop);
+  // Run lighting effects on this task (sleeps until an effect is due)
+  configureStream();
+  configureScheduler();
+  scheduler.start();
 }
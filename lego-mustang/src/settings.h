@@ -1,18 +1,4 @@
-
-/***************** GPIO PINS ******************/
-
-#define LEFT_HEADLIGHT_PIN 16
-#define RIGHT_HEADLIGHT_PIN 13
-#define FOG_LIGHTS_PIN 18
-#define RUNNING_LIGHTS_PIN 17
-#define INTERIOR_LIGHTS_PIN 19
-#define LEFT_INNER_TAILLIGHT_PIN 23
-#define LEFT_MIDDLE_TAILLIGHT_PIN 22
-#define LEFT_OUTER_TAILLIGHT_PIN 21
-#define RIGHT_INNER_TAILLIGHT_PIN 33
-#define RIGHT_MIDDLE_TAILLIGHT_PIN 25
-#define RIGHT_OUTER_TAILLIGHT_PIN 26
-#define REVERSE_LIGHTS_PIN 32
+#include <Model.h>
 
 /************** LIGHTING BEHAVIOR ************/
 
@@ -21,6 +7,38 @@
 #define HIGH_BEAM_BRIGHTNESS 100 // How bright are the high beams when on
 #define BLINKING_INTERVAL 500    // What is the blinking interval in ms
 #define SEQUENTIAL_INTERVAL 100  // What is the sequential effect delay in ms
+#define FADE_DURATION 250        // How long brightness transitions take in ms
+
+/**************** STATE REPORTING *************/
+
+#define STATE_JSON_SIZE 256     // Buffer size for the state document in bytes
+#define STATE_PUBLISH_WINDOW 50 // Time to wait for more commands before
+                                // publishing the state in ms
+#define STATE_CBOR 0            // Publish the state as CBOR instead of JSON
+
+/***************** STATE RESTORE **************/
+
+#define STATE_RESTORE 1        // Show the last state at boot, before WiFi and
+                               // the broker are up (saved in NVS)
+#define STATE_SAVE_WINDOW 5000 // Shortest time between writes of the state to
+                               // flash in ms
+
+/***************** FAST CONNECT ***************/
+
+#define WIFI_FAST_CONNECT 1  // Join the last access point without a scan
+                             // after a power cut (cached in NVS)
+#define WIFI_REUSE_ADDRESS 0 // Reuse the last address instead of waiting for
+                             // DHCP (only with a DHCP reservation for the board
+                             // on the router, or the lease can be handed out
+                             // to another device)
+
+/******************* METRICS ******************/
+
+#define METRICS_INTERVAL 10000 // Time between metrics snapshots in ms (0 to
+                               // never publish, or build with
+                               // -DMETRICS_ENABLED=0 to compile metrics out)
+#define METRICS_JSON_SIZE 1024 // Buffer size for the metrics snapshot in bytes
+                               // (the largest snapshot is about 900)
 
 /***************** MQTT TOPICS ****************/
 
@@ -28,12 +46,58 @@
 
 #define PUB_STATE_TOPIC BASE_TOPIC "state" // For reporting current state
 #define PUB_AVAILABLE_TOPIC BASE_TOPIC "available" // For reporting availability
-#define SUB_LIGHTING_TOPIC BASE_TOPIC "lighting"   // Update the lighting mode
-#define SUB_HIGH_BEAM_TOPIC BASE_TOPIC "high_beam" // Update the high beams
-#define SUB_BRAKING_TOPIC BASE_TOPIC "braking"     // Update the braking state
-#define SUB_TURNING_TOPIC BASE_TOPIC "turning"     // Update the turning mode
-#define SUB_REVERSE_TOPIC BASE_TOPIC "reverse"     // Update the reverse lights
-#define SUB_FOG_TOPIC BASE_TOPIC "fog"             // Update the fog lights
-#define SUB_INTERIOR_TOPIC BASE_TOPIC "interior"   // Update the interior lights
-#define SUB_HAZARD_TOPIC BASE_TOPIC "hazard"       // Update the hazard lights
-#define SUB_ALL_TOPIC BASE_TOPIC "all"             // All lights on/off
\ No newline at end of file
+#define PUB_METRICS_TOPIC BASE_TOPIC "metrics" // For reporting metrics
+#define SUB_PROGRAM_TOPIC BASE_TOPIC "program" // Upload an effect program
+#define SUB_FRAME_TOPIC BASE_TOPIC "frame" // Set many lights at once
+
+/***************** TIME SYNC ******************/
+
+#define TIME_SERVER "pool.ntp.org" // SNTP server shared by every board (ex. the
+                                   // broker's host if it runs an NTP server)
+#define COMMAND_SCHEDULE_SIZE 8    // Timestamped commands that can wait at once
+
+/***************** LIGHT STREAM ***************/
+
+#define STREAM_INPUT 0                            // Listen for light streams
+#define STREAM_INPUT_PROTOCOL StreamProtocol::DDP // Protocol to listen for
+#define STREAM_INPUT_UNIVERSE 1                   // E1.31 universe
+#define STREAM_INPUT_START 0      // Channel of the first light (in model order)
+#define STREAM_INPUT_PRIORITY 100 // Priority a source needs to take over from
+                                  // MQTT control (E1.31 priority, DDP is 100)
+
+/******************** MODEL *******************/
+
+// Payloads of the lighting and turning topics (in value order)
+inline constexpr const char *LIGHTING_MODES[] = {"OFF", "RUNNING", "LOW_BEAM"};
+inline constexpr const char *TURNING_MODES[] = {"OFF", "LEFT", "RIGHT"};
+
+// Every channel of the car: its topic (BASE_TOPIC followed by the name) and
+// the pin of its light. The lights' order is their effect program upload index
+struct Mustang {
+  static constexpr const char *TOPIC_PREFIX = BASE_TOPIC;
+  static constexpr ModelChannel CHANNELS[] = {
+      // Lighting modes and signals (drive the headlights and taillights)
+      {.name = "lighting", .values = LIGHTING_MODES},
+      {.name = "high_beam"},
+      {.name = "braking"},
+      {.name = "turning", .values = TURNING_MODES},
+      {.name = "hazard"},
+      {.name = "all", .isReported = false}, // All lights on/off
+      // Headlights
+      {.name = "left_headlight", .pin = 16, .isDimmable = true, .values = NO_TOPIC},
+      {.name = "right_headlight", .pin = 13, .isDimmable = true, .values = NO_TOPIC},
+      // Left taillight group (inner, middle, outer)
+      {.name = "left_inner", .pin = 23, .isDimmable = true, .values = NO_TOPIC},
+      {.name = "left_middle", .pin = 22, .isDimmable = true, .values = NO_TOPIC},
+      {.name = "left_outer", .pin = 21, .isDimmable = true, .values = NO_TOPIC},
+      // Right taillight group (inner, middle, outer)
+      {.name = "right_inner", .pin = 33, .isDimmable = true, .values = NO_TOPIC},
+      {.name = "right_middle", .pin = 25, .isDimmable = true, .values = NO_TOPIC},
+      {.name = "right_outer", .pin = 26, .isDimmable = true, .values = NO_TOPIC},
+      // Standalone lights (running lights follow the lighting mode)
+      {.name = "fog", .pin = 18},
+      {.name = "running", .pin = 17, .values = NO_TOPIC},
+      {.name = "reverse", .pin = 32},
+      {.name = "interior", .pin = 19},
+  };
+};
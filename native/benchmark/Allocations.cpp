@@ -0,0 +1,38 @@
+#include "BenchmarkUtils.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Number of heap allocations made by the whole process, and their bytes
+static std::atomic<uint64_t> allocations{0};
+static std::atomic<uint64_t> bytes{0};
+
+uint64_t allocationCount(void) { return allocations.load(); }
+
+uint64_t allocatedBytes(void) { return bytes.load(); }
+
+void countAllocation(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+// Replace the global allocation functions so every allocation is counted
+void *operator new(size_t size) {
+  countAllocation(size);
+  void *pointer = std::malloc(size == 0 ? 1 : size);
+  if (pointer == NULL) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+
+void operator delete[](void *pointer, size_t) noexcept { std::free(pointer); }
@@ -0,0 +1,99 @@
+#ifndef BENCHMARK_UTILS_H
+#define BENCHMARK_UTILS_H
+
+#include <benchmark/benchmark.h>
+#include <Light.h>
+#include <driver/gpio.h>
+#include <driver/ledc.h>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Registers the light counts every per-tick benchmark is measured at (a model
+ * sized like the mustang, a large village, and a stress case)
+ */
+inline void lightCounts(benchmark::internal::Benchmark *bench) {
+  bench->ArgName("lights")->Arg(12)->Arg(100)->Arg(1000);
+}
+
+/**
+ * Reports the per-call cost of a benchmark where each iteration makes
+ * `callsPerIteration` calls. Adds a calls/second rate and an inverted rate that
+ * Google Benchmark prints as seconds per call (e.g. "12.3n" is 12.3 ns/call)
+ */
+inline void reportCalls(benchmark::State &state, int64_t callsPerIteration) {
+  int64_t calls = state.iterations() * callsPerIteration;
+  state.counters["calls/s"] =
+      benchmark::Counter((double)calls, benchmark::Counter::kIsRate);
+  state.counters["time/call"] = benchmark::Counter(
+      (double)calls,
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+/** Number of heap allocations made by the process so far */
+uint64_t allocationCount(void);
+
+/** Number of bytes allocated on the heap by the process so far */
+uint64_t allocatedBytes(void);
+
+/**
+ * Count an allocation made outside of operator new (ex. by a C library's
+ * malloc hook)
+ */
+void countAllocation(size_t size);
+
+/**
+ * Reports the average number of heap allocations per call made between
+ * `startCount` (from allocationCount) and now
+ */
+inline void reportAllocations(benchmark::State &state, uint64_t startCount,
+                              int64_t callsPerIteration) {
+  int64_t calls = state.iterations() * callsPerIteration;
+  state.counters["allocs/call"] =
+      calls == 0 ? 0 : (double)(allocationCount() - startCount) / calls;
+}
+
+/**
+ * Reports the average number of bytes allocated on the heap per call between
+ * `startBytes` (from allocatedBytes) and now
+ */
+inline void reportAllocatedBytes(benchmark::State &state, uint64_t startBytes,
+                                 int64_t callsPerIteration) {
+  int64_t calls = state.iterations() * callsPerIteration;
+  state.counters["bytes/call"] =
+      calls == 0 ? 0 : (double)(allocatedBytes() - startBytes) / calls;
+}
+
+/** GPIO pin for the nth benchmark light (pins are reused past GPIO_NUM_MAX) */
+inline int benchmarkPin(int index) { return index % GPIO_NUM_MAX; }
+
+/**
+ * PWM channel for the nth benchmark light (channels are reused past the 8
+ * available LEDC channels so every light still exercises the driver path)
+ */
+inline int benchmarkChannel(int index) { return index % LEDC_CHANNEL_MAX; }
+
+/**
+ * Holds `count` configured lights stored in their own bank (so every benchmark
+ * starts from an empty bank)
+ */
+struct LightFixture {
+  std::unique_ptr<LightBank> bank = std::make_unique<LightBank>();
+  std::vector<Light> lights;
+
+  LightFixture(int count, bool dimmable = true) {
+    Light::configurePWMTimer();
+    lights.reserve(count);
+    for (int i = 0; i < count; i++) {
+      if (dimmable) {
+        lights.emplace_back(benchmarkPin(i), benchmarkChannel(i), *bank);
+      } else {
+        lights.emplace_back(benchmarkPin(i), *bank);
+      }
+      lights.back().configure();
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "BenchmarkUtils.h"
+
+#include <DutyTable.h>
+#include <Light.h>
+#include <vector>
+
+// Sanity checks on the generated tables (evaluated at compile time)
+static_assert(DutyTable<13, 10>::fromPercentage(0) == 0);
+static_assert(DutyTable<13, 10>::fromPercentage(50) == 4096);
+static_assert(DutyTable<13, 10>::fromPercentage(100) == 8192);
+static_assert(DutyTable<13, 22>::fromPercentage(1) == 1);
+static_assert(DutyTable<13, 22>::fromPercentage(50) == 1783);
+static_assert(DutyTable<8, 22>::fromPercentage(100) == 256);
+static_assert(DutyTable<13, 22>::toPercentage(1783) == 50);
+static_assert(DutyTable<13, 22>::toPercentage(0) == 0);
+
+/** Brightness percentages cycled through by the conversion benchmarks */
+static std::vector<int> percentages(int count) {
+  std::vector<int> values(count);
+  for (int i = 0; i < count; i++) {
+    values[i] = (i * 37) % 101;
+  }
+  return values;
+}
+
+// The previous floating point percentage to duty conversion used by Light::on
+static void BM_DutyFromPercentageDouble(benchmark::State &state) {
+  std::vector<int> values = percentages(state.range(0));
+  for (auto _ : state) {
+    for (int brightness : values) {
+      double percentage = brightness == 0 ? 0.0 : brightness / 100.0;
+      double duty = 8192 * percentage;
+      benchmark::DoNotOptimize((uint32_t)duty);
+    }
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_DutyFromPercentageDouble)->Apply(lightCounts);
+
+// The compile-time gamma corrected lookup table used by Light::on
+static void BM_DutyFromPercentageTable(benchmark::State &state) {
+  std::vector<int> values = percentages(state.range(0));
+  for (auto _ : state) {
+    for (int brightness : values) {
+      benchmark::DoNotOptimize(LightDutyTable::fromPercentage(brightness));
+    }
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_DutyFromPercentageTable)->Apply(lightCounts);
@@ -0,0 +1,96 @@
+#include "BenchmarkUtils.h"
+
+#include <EffectProgram.h>
+#include <Light.h>
+#include <NativeShim.h>
+
+/** Starts the same program on every light in a fixture */
+static void runOnAll(LightFixture &fixture, const EffectProgram &program) {
+  for (Light &light : fixture.lights) {
+    light.run(program);
+  }
+}
+
+// Interpreter cost per light-tick for a blink program that steps every tick
+// (compare with BM_LightBankTickBlinking, the built-in blink effect)
+static void BM_EffectProgramTickBlink(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  EffectProgram program;
+  program.set(100).wait(1).set(0).wait(1).loop();
+  runOnAll(fixture, program);
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    fixture.bank->tick(now);
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_EffectProgramTickBlink)->Apply(lightCounts);
+
+// Interpreter cost per light-tick for a program that starts a hardware fade
+// every tick
+static void BM_EffectProgramTickRamp(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  EffectProgram program;
+  program.ramp(100, 1).ramp(0, 1).loop();
+  runOnAll(fixture, program);
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    fixture.bank->tick(now);
+    NativeShim::completeFades();
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_EffectProgramTickRamp)->Apply(lightCounts);
+
+// Interpreter cost per light-tick when every light meets at a sync barrier
+// every other tick
+static void BM_EffectProgramTickSync(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  EffectProgram program;
+  program.set(100).wait(1).sync().set(0).wait(1).sync().loop();
+  runOnAll(fixture, program);
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    fixture.bank->tick(now);
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_EffectProgramTickSync)->Apply(lightCounts);
+
+// Cost per light-tick while every program is in the middle of a long wait
+static void BM_EffectProgramTickWaiting(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  EffectProgram program;
+  program.set(100).wait(UINT16_MAX).loop();
+  runOnAll(fixture, program);
+  int elapsedMs = 0;
+  for (auto _ : state) {
+    // Stay inside the wait so the programs never advance
+    elapsedMs = (elapsedMs + 1) % UINT16_MAX;
+    fixture.bank->tick(Timestamp(millis(elapsedMs)));
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_EffectProgramTickWaiting)->Apply(lightCounts);
+
+// Validating a full size program (the cost of each upload)
+static void BM_EffectProgramValidate(benchmark::State &state) {
+  EffectProgram program;
+  int start = program.here();
+  program.ramp(100, 500).wait(250);
+  int inner = program.here();
+  program.set(0).wait(50).set(100).wait(50).loop(3, inner);
+  program.ramp(0, 500).sync(1).loop(EFFECT_LOOP_FOREVER, start);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        EffectProgram::validate(program.data(), program.size()));
+  }
+}
+BENCHMARK(BM_EffectProgramValidate);
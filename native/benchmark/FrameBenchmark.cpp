@@ -0,0 +1,77 @@
+#include "BenchmarkUtils.h"
+
+#include <Light.h>
+#include <NativeShim.h>
+
+/**
+ * Reports how a scene change reached the outputs: how many separate commits it
+ * took (every commit is a point where a partly applied scene is visible) and
+ * how many lights each commit wrote
+ */
+static void reportFrames(benchmark::State &state, LightBank &bank) {
+  FrameStats stats = bank.getFrameStats();
+  state.counters["commits/change"] =
+      (double)stats.frames / (double)state.iterations();
+  state.counters["lights/commit"] =
+      stats.frames == 0 ? 0 : (double)stats.lights / (double)stats.frames;
+  state.counters["cycles/commit"] = stats.averageCommitCycles();
+}
+
+// Switch every light of a scene with one call per light, each written as soon
+// as it changes
+static void BM_SceneImmediate(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  std::vector<Light> &lights = fixture.lights;
+  int brightness = 25;
+  for (auto _ : state) {
+    brightness = brightness == 25 ? 75 : 25;
+    for (Light &light : lights) {
+      light.on(brightness);
+    }
+  }
+  reportCalls(state, state.range(0));
+  reportFrames(state, *fixture.bank);
+}
+BENCHMARK(BM_SceneImmediate)->Apply(lightCounts);
+
+// The same scene change staged in a frame and written by a single commit
+static void BM_SceneFrame(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  std::vector<Light> &lights = fixture.lights;
+  int brightness = 25;
+  for (auto _ : state) {
+    brightness = brightness == 25 ? 75 : 25;
+    fixture.bank->beginFrame();
+    for (Light &light : lights) {
+      light.on(brightness);
+    }
+    fixture.bank->commitFrame();
+  }
+  reportCalls(state, state.range(0));
+  reportFrames(state, *fixture.bank);
+}
+BENCHMARK(BM_SceneFrame)->Apply(lightCounts);
+
+// A scene that fades every light, with the fades started together at the end
+// of the frame
+static void BM_SceneFrameFades(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  std::vector<Light> &lights = fixture.lights;
+  int brightness = 25;
+  for (auto _ : state) {
+    brightness = brightness == 25 ? 75 : 25;
+    fixture.bank->beginFrame();
+    for (Light &light : lights) {
+      light.fadeTo(brightness, 500);
+    }
+    fixture.bank->commitFrame();
+    // The fades finish before the next change
+    NativeShim::completeFades();
+  }
+  reportCalls(state, state.range(0));
+  reportFrames(state, *fixture.bank);
+}
+BENCHMARK(BM_SceneFrameFades)->Apply(lightCounts);
@@ -0,0 +1,35 @@
+#include "BenchmarkUtils.h"
+
+#include <Interval.h>
+#include <vector>
+
+// Interval::check when the interval elapses on every call (worst case)
+static void BM_IntervalCheckElapsed(benchmark::State &state) {
+  std::vector<Interval> intervals(state.range(0), Interval(1));
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    for (Interval &interval : intervals) {
+      benchmark::DoNotOptimize(interval.check(now));
+    }
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_IntervalCheckElapsed)->Apply(lightCounts);
+
+// Interval::check when the interval has not elapsed yet (common case)
+static void BM_IntervalCheckPending(benchmark::State &state) {
+  std::vector<Interval> intervals(state.range(0), Interval(1000000));
+  Timestamp now;
+  for (Interval &interval : intervals) {
+    interval.check(now);
+  }
+  for (auto _ : state) {
+    now += millis(1);
+    for (Interval &interval : intervals) {
+      benchmark::DoNotOptimize(interval.check(now));
+    }
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_IntervalCheckPending)->Apply(lightCounts);
@@ -0,0 +1,188 @@
+#include "BenchmarkUtils.h"
+
+#include <Light.h>
+#include <NativeShim.h>
+
+// Light::on for dimmable lights where every call changes the brightness
+static void BM_LightOnDimmable(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  std::vector<Light> &lights = fixture.lights;
+  int brightness = 25;
+  for (auto _ : state) {
+    brightness = brightness == 25 ? 75 : 25;
+    for (Light &light : lights) {
+      light.on(brightness);
+    }
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_LightOnDimmable)->Apply(lightCounts);
+
+// Light::on for standard lights where every call changes the brightness
+static void BM_LightOnStandard(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0), false);
+  std::vector<Light> &lights = fixture.lights;
+  int brightness = 0;
+  for (auto _ : state) {
+    brightness = brightness == 0 ? 100 : 0;
+    for (Light &light : lights) {
+      light.on(brightness);
+    }
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_LightOnStandard)->Apply(lightCounts);
+
+// Light::on when the brightness is unchanged (early out path)
+static void BM_LightOnUnchanged(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  std::vector<Light> &lights = fixture.lights;
+  for (auto _ : state) {
+    for (Light &light : lights) {
+      light.on(50);
+    }
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_LightOnUnchanged)->Apply(lightCounts);
+
+// Light::loop with no active effects (the cost of polling idle lights)
+static void BM_LightLoopIdle(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  std::vector<Light> &lights = fixture.lights;
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    for (Light &light : lights) {
+      light.loop(now);
+    }
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_LightLoopIdle)->Apply(lightCounts);
+
+// Light::loop while blinking with a 1ms interval (toggles on every tick)
+static void BM_LightLoopBlinking(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  std::vector<Light> &lights = fixture.lights;
+  for (Light &light : lights) {
+    light.blink(1);
+  }
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    for (Light &light : lights) {
+      light.loop(now);
+    }
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_LightLoopBlinking)->Apply(lightCounts);
+
+// Light::fadeTo alternating between two targets (one hardware fade per call)
+static void BM_LightFadeTo(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  std::vector<Light> &lights = fixture.lights;
+  int brightness = 25;
+  for (auto _ : state) {
+    brightness = brightness == 25 ? 75 : 25;
+    for (Light &light : lights) {
+      light.fadeTo(brightness, 500);
+    }
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_LightFadeTo)->Apply(lightCounts);
+
+// Light::loop while breathing and waiting on the fade engine (common case)
+static void BM_LightLoopBreathingIdle(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  std::vector<Light> &lights = fixture.lights;
+  for (Light &light : lights) {
+    light.breathe(2000);
+    light.loop(Timestamp());
+  }
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    for (Light &light : lights) {
+      light.loop(now);
+    }
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_LightLoopBreathingIdle)->Apply(lightCounts);
+
+// Light::loop while breathing where every tick handles a finished fade (the
+// fade end interrupt is simulated before each loop call)
+static void BM_LightLoopBreathingReverse(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  std::vector<Light> &lights = fixture.lights;
+  for (Light &light : lights) {
+    light.breathe(2000);
+  }
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    for (Light &light : lights) {
+      light.__onFadeComplete__();
+      light.loop(now);
+    }
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_LightLoopBreathingReverse)->Apply(lightCounts);
+
+// LightBank::tick over idle lights (one pass over the effect array)
+static void BM_LightBankTickIdle(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    fixture.bank->tick(now);
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_LightBankTickIdle)->Apply(lightCounts);
+
+// LightBank::tick while every light blinks with a 1ms interval (compare with
+// BM_LightLoopBlinking, which loops over each light handle)
+static void BM_LightBankTickBlinking(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  for (Light &light : fixture.lights) {
+    light.blink(1);
+  }
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    fixture.bank->tick(now);
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_LightBankTickBlinking)->Apply(lightCounts);
+
+// LightBank::tick while 1 in 10 lights blink (typical mixed workload)
+static void BM_LightBankTickSparse(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  for (int i = 0; i < (int)fixture.lights.size(); i += 10) {
+    fixture.lights[i].blink(1);
+  }
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    fixture.bank->tick(now);
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_LightBankTickSparse)->Apply(lightCounts);
@@ -0,0 +1,196 @@
+#include "BenchmarkUtils.h"
+
+#include <CborWriter.h>
+#include <JsonWriter.h>
+#include <LightFrame.h>
+#include <Mailbox.h>
+#include <Model.h>
+#include <string_view>
+
+// A model sized like the mustang: twelve lights, each with its own topic
+struct BenchShow {
+  static constexpr const char *TOPIC_PREFIX = "/lego/mustang/";
+  static constexpr ModelChannel CHANNELS[] = {
+      {.name = "left_headlight", .pin = 4},
+      {.name = "right_headlight", .pin = 5},
+      {.name = "left_inner", .pin = 12},
+      {.name = "left_middle", .pin = 13},
+      {.name = "left_outer", .pin = 14},
+      {.name = "right_inner", .pin = 15},
+      {.name = "right_middle", .pin = 16},
+      {.name = "right_outer", .pin = 17},
+      {.name = "fog", .pin = 18},
+      {.name = "running", .pin = 19},
+      {.name = "reverse", .pin = 21},
+      {.name = "interior", .pin = 22},
+  };
+};
+
+using ShowModel = Model<BenchShow>;
+
+static const int LIGHTS = ShowModel::LIGHT_COUNT;
+
+// The model driven by the handlers (handlers are plain functions)
+static ShowModel *show = NULL;
+
+// Published documents
+static size_t publishedBytes = 0;
+
+/** Stand-in for MqttClient::publish */
+static void publish(std::string_view data) {
+  publishedBytes += data.size();
+  benchmark::DoNotOptimize(data.data());
+}
+
+/** Creates the model in its own bank with configured lights */
+struct ShowFixture {
+  std::unique_ptr<LightBank> bank = std::make_unique<LightBank>();
+  ShowModel model{*bank};
+
+  ShowFixture(void) {
+    Light::configurePWMTimer();
+    for (Light &light : model.lights()) {
+      light.configure();
+    }
+    show = &model;
+  }
+};
+
+// Frame topic handler
+static void applyFrame(std::string_view data) {
+  LightFrame::apply((const uint8_t *)data.data(), data.size(),
+                    show->lights().data(), LIGHTS);
+}
+
+/**
+ * Sends frames that set every light through the frame topic: the MQTT task
+ * posts the frame to the mailbox, and the lighting task drains it and writes
+ * every light in one bank frame
+ */
+static void runFrameTopic(benchmark::State &state, bool isWide) {
+  ShowFixture fixture;
+  Mailbox<1, LightFrame::maxSize(LIGHTS)> commands;
+  commands.on(0, &applyFrame);
+  uint8_t frame[LightFrame::maxSize(LIGHTS)] = {};
+  size_t size = 1 + (LIGHTS + 7) / 8 + LIGHTS * (isWide ? 2 : 1);
+  frame[0] = isWide ? LIGHT_FRAME_WIDE : 0;
+  frame[1] = 0xFF;
+  frame[2] = 0x0F;
+  uint8_t *levels = frame + 3;
+  int frames = 0;
+  for (auto _ : state) {
+    // A ramp across the lights that moves every frame
+    for (int light = 0; light < LIGHTS; light++) {
+      uint16_t level = (uint16_t)((frames + light) * 4099);
+      if (isWide) {
+        levels[light * 2] = (uint8_t)level;
+        levels[light * 2 + 1] = (uint8_t)(level >> 8);
+      } else {
+        levels[light] = (uint8_t)(level >> 8);
+      }
+    }
+    frames++;
+    commands.post(0, std::string_view((const char *)frame, size));
+    commands.loop(Timestamp());
+  }
+  state.counters["frames/s"] =
+      benchmark::Counter((double)frames, benchmark::Counter::kIsRate);
+  state.counters["bytes/frame"] = (double)size;
+}
+
+// Frames of 8 bit levels
+static void BM_FrameTopicNarrow(benchmark::State &state) {
+  runFrameTopic(state, false);
+}
+BENCHMARK(BM_FrameTopicNarrow);
+
+// Frames of 16 bit levels
+static void BM_FrameTopicWide(benchmark::State &state) {
+  runFrameTopic(state, true);
+}
+BENCHMARK(BM_FrameTopicWide);
+
+// Light topic handler (the apps' handleChannel without the all switch)
+static void handleLight(int channel, std::string_view data) {
+  int value = ShowModel::parse(channel, data);
+  if (value < 0) {
+    return;
+  }
+  show->set(channel, value);
+  show->touch(channel);
+  LightBank &bank = show->lights()[0].getBank();
+  bank.beginFrame();
+  show->updateLights(show->takeChanges());
+  bank.commitFrame();
+}
+
+/**
+ * Sets every light with a message on its own topic (the only way to set many
+ * lights before frames). Each message is posted and drained on its own, like
+ * messages that arrive one at a time, and the state document is published once
+ * per frame (as the coalescer would)
+ */
+static void BM_FrameFromLightTopics(benchmark::State &state) {
+  ShowFixture fixture;
+  Mailbox<LIGHTS, 8> commands;
+  // Every message carries its topic and a payload of about 3 bytes
+  size_t bytes = 0;
+  for (int light = 0; light < LIGHTS; light++) {
+    commands.on(light, &handleLight);
+    bytes += std::string_view(BenchShow::TOPIC_PREFIX).size() +
+             std::string_view(ShowModel::name(light)).size() + 3;
+  }
+  int frames = 0;
+  for (auto _ : state) {
+    std::string_view payload = frames % 2 == 0 ? "ON" : "OFF";
+    for (int light = 0; light < LIGHTS; light++) {
+      commands.post(light, payload);
+      commands.loop(Timestamp());
+    }
+    frames++;
+    JsonWriter<512> document;
+    document.beginObject();
+    show->writeState(document);
+    document.endObject();
+    publish(document.view());
+  }
+  state.counters["frames/s"] =
+      benchmark::Counter((double)frames, benchmark::Counter::kIsRate);
+  state.counters["bytes/frame"] = (double)bytes;
+}
+BENCHMARK(BM_FrameFromLightTopics);
+
+/**
+ * Writes the state document of every light in a format (the model's channels
+ * change between documents)
+ */
+template <typename Writer>
+static void runStateDocument(benchmark::State &state) {
+  ShowFixture fixture;
+  size_t bytes = 0;
+  int documents = 0;
+  for (auto _ : state) {
+    show->set(documents % LIGHTS, (documents / LIGHTS) % 2 == 0);
+    documents++;
+    Writer document;
+    document.beginObject();
+    show->writeState(document);
+    document.endObject();
+    bytes = document.size();
+    publish(document.view());
+  }
+  reportCalls(state, 1);
+  state.counters["bytes/doc"] = (double)bytes;
+}
+
+// The state document as JSON (copies the pre-serialized members)
+static void BM_StateDocumentJson(benchmark::State &state) {
+  runStateDocument<JsonWriter<512>>(state);
+}
+BENCHMARK(BM_StateDocumentJson);
+
+// The state document as CBOR
+static void BM_StateDocumentCbor(benchmark::State &state) {
+  runStateDocument<CborWriter<512>>(state);
+}
+BENCHMARK(BM_StateDocumentCbor);
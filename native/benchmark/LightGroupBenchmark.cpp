@@ -0,0 +1,101 @@
+#include "BenchmarkUtils.h"
+
+#include <Light.h>
+#include <LightGroup.h>
+#include <NativeShim.h>
+#include <deque>
+
+/**
+ * Holds `lightCount` dimmable lights split into groups of three (like the
+ * mustang's taillights). Groups live in a deque since they can't be moved
+ */
+struct TripleFixture {
+  LightFixture lights;
+  std::deque<LightGroup<3>> groups;
+
+  TripleFixture(int lightCount) : lights(lightCount) {
+    for (int i = 0; i + 2 < lightCount; i += 3) {
+      groups.emplace_back(lights.lights[i], lights.lights[i + 1],
+                          lights.lights[i + 2]);
+    }
+  }
+
+  void loop(Timestamp now) {
+    for (LightGroup<3> &group : groups) {
+      group.loop(now);
+    }
+  }
+};
+
+// LightGroup<3>::loop while the sequential effect is running with a stagger
+// that advances on every tick
+static void BM_LightGroupLoopSequential(benchmark::State &state) {
+  NativeShim::reset();
+  TripleFixture fixture(state.range(0));
+  for (LightGroup<3> &group : fixture.groups) {
+    group.sequence(4, 1);
+  }
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    fixture.loop(now);
+  }
+  reportCalls(state, fixture.groups.size());
+}
+BENCHMARK(BM_LightGroupLoopSequential)->Apply(lightCounts);
+
+// LightGroup<3>::loop while every group blinks on every tick
+static void BM_LightGroupLoopBlinking(benchmark::State &state) {
+  NativeShim::reset();
+  TripleFixture fixture(state.range(0));
+  for (LightGroup<3> &group : fixture.groups) {
+    group.blink(1);
+  }
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    fixture.loop(now);
+  }
+  reportCalls(state, fixture.groups.size());
+}
+BENCHMARK(BM_LightGroupLoopBlinking)->Apply(lightCounts);
+
+// A single group chasing across every light, stepping on every tick. The cost
+// per tick should stay flat as the group grows
+static void BM_LightGroupLoopChase(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture lights(state.range(0));
+  DynamicLightGroup group;
+  for (Light &light : lights.lights) {
+    group.add(light);
+  }
+  group.chase(1);
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    group.loop(now);
+  }
+  reportCalls(state, 1);
+}
+BENCHMARK(BM_LightGroupLoopChase)->Apply(lightCounts);
+
+// A group of groups (ex. a village-wide chase across houses) where each step
+// switches a whole nested group of 4 lights
+static void BM_LightGroupLoopNestedChase(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture lights(state.range(0));
+  std::deque<LightGroup<4>> houses;
+  DynamicLightGroup village;
+  std::vector<Light> &all = lights.lights;
+  for (size_t i = 0; i + 3 < all.size(); i += 4) {
+    village.add(houses.emplace_back(all[i], all[i + 1], all[i + 2], all[i + 3]));
+  }
+  village.chase(1);
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    village.loop(now);
+  }
+  reportCalls(state, 1);
+}
+BENCHMARK(BM_LightGroupLoopNestedChase)->Apply(lightCounts);
@@ -0,0 +1,49 @@
+#include "BenchmarkUtils.h"
+
+#include <LightStream.h>
+#include <string.h>
+
+/** Builds a DDP packet that sets `count` channels, with the push flag set */
+static std::vector<uint8_t> ddpPacket(int count, uint8_t sequence,
+                                      uint8_t level) {
+  std::vector<uint8_t> packet(10 + count, level);
+  packet[0] = 0x41; // Version 1, push
+  packet[1] = sequence;
+  packet[2] = 0x01;
+  packet[3] = 1; // Default display
+  memset(packet.data() + 4, 0, 4);
+  packet[8] = (uint8_t)(count >> 8);
+  packet[9] = (uint8_t)count;
+  return packet;
+}
+
+/**
+ * Receives DDP frames and writes them to the lights, like the receive task
+ * and the lighting task would: every frame is received, then taken from the
+ * jitter buffer once it is due (frames arrive 25ms apart, like a 40 fps show)
+ */
+static void BM_StreamDdpFrame(benchmark::State &state) {
+  int count = state.range(0);
+  LightFixture fixture(count);
+  LightStream stream(fixture.lights.data(), count);
+  // Every packet is built up front, so only the stream is measured
+  std::vector<std::vector<uint8_t>> packets;
+  for (int frame = 0; frame < 15; frame++) {
+    packets.push_back(ddpPacket(count, frame + 1, frame * 16));
+  }
+  Timestamp now;
+  int frame = 0;
+  for (auto _ : state) {
+    const std::vector<uint8_t> &packet = packets[frame % 15];
+    stream.receive(packet.data(), packet.size(), now);
+    now = stream.nextDeadline(now);
+    stream.loop(now);
+    now += millis(25);
+    frame++;
+  }
+  StreamStats stats = stream.getStats();
+  state.counters["frames/s"] =
+      benchmark::Counter((double)stats.frames, benchmark::Counter::kIsRate);
+  state.counters["lost"] = stats.lost;
+}
+BENCHMARK(BM_StreamDdpFrame)->Apply(lightCounts);
@@ -0,0 +1,84 @@
+#include "BenchmarkUtils.h"
+
+#include <Mailbox.h>
+#include <atomic>
+#include <string.h>
+#include <string_view>
+#include <thread>
+
+// Largest payload (an effect program upload)
+static const size_t PAYLOAD_SIZE = 33;
+
+// Handled payloads
+static int handledCount = 0;
+static int tornCount = 0;
+
+/** Counts payloads, and checks that every byte came from the same post */
+static void handle(std::string_view data) {
+  handledCount++;
+  for (char c : data) {
+    if (c != data[0]) {
+      tornCount++;
+      return;
+    }
+  }
+}
+
+// Cost of posting a slider value from the MQTT task
+static void BM_MailboxPost(benchmark::State &state) {
+  Mailbox<8, PAYLOAD_SIZE> mailbox;
+  mailbox.on(0, &handle);
+  uint64_t startCount = allocationCount();
+  for (auto _ : state) {
+    mailbox.post(0, "75");
+  }
+  reportCalls(state, 1);
+  reportAllocations(state, startCount, 1);
+}
+BENCHMARK(BM_MailboxPost);
+
+// A flood of posts on one channel collapses into a single handler call
+static void BM_MailboxFloodDrain(benchmark::State &state) {
+  Mailbox<8, PAYLOAD_SIZE> mailbox;
+  mailbox.on(0, &handle);
+  int posts = state.range(0);
+  char value[] = "00";
+  handledCount = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < posts; i++) {
+      value[1] = '0' + i % 10;
+      mailbox.post(0, value);
+    }
+    mailbox.loop(Timestamp());
+  }
+  reportCalls(state, posts);
+  state.counters["handled/post"] =
+      (double)handledCount / ((double)state.iterations() * posts);
+}
+BENCHMARK(BM_MailboxFloodDrain)->Arg(1)->Arg(10)->Arg(100);
+
+// Another task posts full sized payloads while this one drains, which checks
+// that no handled payload mixes bytes from two posts
+static void BM_MailboxConcurrentDrain(benchmark::State &state) {
+  Mailbox<1, PAYLOAD_SIZE> mailbox;
+  mailbox.on(0, &handle);
+  std::atomic<bool> isRunning{true};
+  std::thread producer([&]() {
+    char payload[PAYLOAD_SIZE];
+    for (uint8_t value = 0; isRunning.load(std::memory_order_relaxed);
+         value++) {
+      memset(payload, value, sizeof(payload));
+      mailbox.post(0, std::string_view(payload, sizeof(payload)));
+    }
+  });
+  handledCount = 0;
+  tornCount = 0;
+  for (auto _ : state) {
+    mailbox.loop(Timestamp());
+  }
+  isRunning = false;
+  producer.join();
+  state.counters["handled"] = handledCount;
+  state.counters["torn"] = tornCount;
+}
+BENCHMARK(BM_MailboxConcurrentDrain);
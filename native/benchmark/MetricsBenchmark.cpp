@@ -0,0 +1,76 @@
+#include "BenchmarkUtils.h"
+
+#include <JsonWriter.h>
+#include <Metrics.h>
+#include <TopicTable.h>
+#include <string>
+
+// Cost of counting a dropped payload
+static void BM_MetricsCounterAdd(benchmark::State &state) {
+  Counter counter;
+  for (auto _ : state) {
+    counter.add();
+  }
+  benchmark::DoNotOptimize(counter.read());
+  reportCalls(state, 1);
+}
+BENCHMARK(BM_MetricsCounterAdd);
+
+// Cost of recording the duration of a scheduler pass
+static void BM_MetricsHistogramRecord(benchmark::State &state) {
+  Histogram histogram(8);
+  int64_t us = 0;
+  for (auto _ : state) {
+    // Spread the durations over the buckets
+    histogram.record(Duration(us));
+    us = (us * 7 + 13) & 0xFFFF;
+  }
+  benchmark::DoNotOptimize(histogram.read());
+  reportCalls(state, 1);
+}
+BENCHMARK(BM_MetricsHistogramRecord);
+
+// Cost of the mailbox's receive mark and the scheduler taking it
+static void BM_MetricsReceiveToCommit(benchmark::State &state) {
+  Metrics metrics;
+  Timestamp now;
+  Timestamp received;
+  for (auto _ : state) {
+    now += millis(1);
+    metrics.markReceived(now);
+    if (metrics.takeReceived(received)) {
+      metrics.latency.record(now - received);
+    }
+  }
+  reportCalls(state, 1);
+}
+BENCHMARK(BM_MetricsReceiveToCommit);
+
+// Cost of writing a snapshot with the mustang's topics (reset every time)
+static void BM_MetricsSnapshot(benchmark::State &state) {
+  Metrics metrics;
+  TopicTable topics;
+  for (int i = 0; i < 12; i++) {
+    topics.add("/lego/mustang/topic" + std::to_string(i),
+               [](std::string_view) {});
+  }
+  uint64_t startCount = allocationCount();
+  for (auto _ : state) {
+    metrics.tick.record(Duration(40));
+    topics.dispatch("/lego/mustang/topic3", "ON");
+    JsonWriter<768> json;
+    json.beginObject();
+    metrics.write(json);
+    json.beginObject("topics");
+    topics.forEachCount(
+        [&json](const std::string &topic, uint32_t count) {
+          json.add(topic.c_str() + 14, (int64_t)count);
+        },
+        true);
+    json.endObject().endObject();
+    benchmark::DoNotOptimize(json.view());
+  }
+  reportCalls(state, 1);
+  reportAllocations(state, startCount, 1);
+}
+BENCHMARK(BM_MetricsSnapshot);
@@ -0,0 +1,236 @@
+#include "BenchmarkUtils.h"
+
+#include <JsonWriter.h>
+#include <Model.h>
+#include <string>
+#include <string_view>
+
+// Commands per iteration: every building switched on, then off again. Both
+// villages write their lights the same way (a frame of on/off calls), so only
+// the command handling and the state document are measured
+static const int COMMANDS = 16;
+
+// Published documents
+static size_t publishedBytes = 0;
+
+/** Stand-in for MqttClient::publish */
+static void publish(std::string_view data) {
+  publishedBytes += data.size();
+  benchmark::DoNotOptimize(data.data());
+}
+
+// The village described as a model
+struct BenchVillage {
+  static constexpr const char *TOPIC_PREFIX = "/christmas-village/";
+  static constexpr ModelChannel CHANNELS[] = {
+      {.name = "all"},
+      {.name = "gingerbread", .pin = 16},
+      {.name = "honeydukes", .pin = 17},
+      {.name = "threebroomsticks", .pin = 18},
+      {.name = "toystore", .pin = 19},
+      {.name = "musicstore", .pin = 22},
+      {.name = "trolley", .pin = 23},
+      {.name = "trees", .pin = 25, .isDimmable = true, .level = 25},
+      {.name = "lamps", .pin = 26},
+  };
+};
+
+using BenchModel = Model<BenchVillage>;
+
+// Payload of the nth command (the building is the channel after "all")
+static std::string_view commandPayload(int command) {
+  return command < COMMANDS / 2 ? "ON" : "OFF";
+}
+
+/**
+ * The hand-written village: a std::string per building, a callback per topic
+ * that validates the payload with string compares, and a document built from
+ * every string by name
+ */
+struct StringVillage {
+  std::string allState = "OFF";
+  std::string states[8] = {"OFF", "OFF", "OFF", "OFF",
+                           "OFF", "OFF", "OFF", "OFF"};
+
+  static bool isSwitchStr(std::string_view data) {
+    return data == "ON" || data == "OFF";
+  }
+
+  void updateAllStateFromSwitchChange(void) {
+    bool anyLightIsOn = states[0] == "ON" || states[1] == "ON" ||
+                        states[2] == "ON" || states[3] == "ON" ||
+                        states[4] == "ON" || states[5] == "ON" ||
+                        states[6] == "ON" || states[7] == "ON";
+    allState = anyLightIsOn ? "ON" : "OFF";
+  }
+
+  void handleSwitch(std::string_view data, std::string &state) {
+    if (!isSwitchStr(data)) {
+      return;
+    }
+    state = data;
+    updateAllStateFromSwitchChange();
+  }
+
+  void publishCurrentState(void) {
+    JsonWriter<256> state;
+    state.beginObject()
+        .add("all", allState)
+        .add("gingerbread", states[0])
+        .add("honeydukes", states[1])
+        .add("threebroomsticks", states[2])
+        .add("toystore", states[3])
+        .add("musicstore", states[4])
+        .add("trolley", states[5])
+        .add("trees", states[6])
+        .add("lamps", states[7])
+        .endObject();
+    publish(state.view());
+  }
+};
+
+/** The village generated from its description */
+struct ModelVillage {
+  std::unique_ptr<LightBank> bank = std::make_unique<LightBank>();
+  BenchModel model{*bank};
+
+  void handleChannel(int channel, std::string_view data) {
+    int value = BenchModel::parse(channel, data);
+    if (value < 0) {
+      return;
+    }
+    model.set(channel, value);
+    bool anyLightIsOn = false;
+    for (int light = 0; light < BenchModel::SIZE; light++) {
+      anyLightIsOn |= BenchModel::hasLight(light) && model.isOn(light);
+    }
+    model.set(0, anyLightIsOn);
+  }
+
+  void publishCurrentState(void) {
+    JsonWriter<256> state;
+    state.beginObject();
+    model.writeState(state);
+    state.endObject();
+    publish(state.view());
+  }
+};
+
+// Handle a switch command and publish the state with the hand-written paths
+static void BM_VillageCommandStrings(benchmark::State &state) {
+  StringVillage village;
+  uint64_t startCount = allocationCount();
+  for (auto _ : state) {
+    for (int command = 0; command < COMMANDS; command++) {
+      int building = command % 8;
+      village.handleSwitch(commandPayload(command), village.states[building]);
+      village.publishCurrentState();
+    }
+  }
+  reportCalls(state, COMMANDS);
+  reportAllocations(state, startCount, COMMANDS);
+}
+BENCHMARK(BM_VillageCommandStrings);
+
+// The same commands handled and published by the generated model
+static void BM_VillageCommandModel(benchmark::State &state) {
+  ModelVillage village;
+  uint64_t startCount = allocationCount();
+  for (auto _ : state) {
+    for (int command = 0; command < COMMANDS; command++) {
+      int building = command % 8;
+      village.handleChannel(building + 1, commandPayload(command));
+      village.publishCurrentState();
+    }
+  }
+  reportCalls(state, COMMANDS);
+  reportAllocations(state, startCount, COMMANDS);
+}
+BENCHMARK(BM_VillageCommandModel);
+
+
+// One block of the village's buildings, numbered so blocks can be repeated to
+// build larger villages (only the first trees get PWM channels)
+#define VILLAGE_BLOCK(n)                                                       \
+  {.name = "gingerbread" #n, .pin = 16}, {.name = "honeydukes" #n, .pin = 17}, \
+      {.name = "threebroomsticks" #n, .pin = 18},                              \
+      {.name = "toystore" #n, .pin = 19}, {.name = "musicstore" #n, .pin = 22}, \
+      {.name = "trolley" #n, .pin = 23},                                       \
+      {.name = "trees" #n,                                                     \
+       .pin = 25,                                                              \
+       .isDimmable = (n) < LEDC_CHANNEL_MAX,                                   \
+       .level = 25},                                                           \
+      {.name = "lamps" #n, .pin = 26}
+
+// A village ten times larger
+struct BenchVillage10 {
+  static constexpr const char *TOPIC_PREFIX = "/christmas-village/";
+  static constexpr ModelChannel CHANNELS[] = {
+      {.name = "all"},   VILLAGE_BLOCK(0), VILLAGE_BLOCK(1), VILLAGE_BLOCK(2),
+      VILLAGE_BLOCK(3),  VILLAGE_BLOCK(4), VILLAGE_BLOCK(5), VILLAGE_BLOCK(6),
+      VILLAGE_BLOCK(7),  VILLAGE_BLOCK(8), VILLAGE_BLOCK(9),
+  };
+};
+
+/**
+ * Handle switch commands from the payload to the duty writes: set the building
+ * and the all switch, then write the lights in one frame. Full recomputation
+ * updates every light and checks every building for the all switch on every
+ * command (like the hand-written handlers), while incremental recomputation
+ * only updates the lights whose channel changed
+ */
+template <typename Description>
+static void runCommandToDuty(benchmark::State &state, bool isIncremental) {
+  using TestModel = Model<Description>;
+  std::unique_ptr<LightBank> bank = std::make_unique<LightBank>();
+  TestModel model(*bank);
+  Light::configurePWMTimer();
+  for (Light &light : model.lights()) {
+    light.configure();
+  }
+  // Commands cycle through the buildings, switching each on and then off
+  int buildings = TestModel::LIGHT_COUNT;
+  int command = 0;
+  for (auto _ : state) {
+    int channel = 1 + command % buildings;
+    bool isOn = (command / buildings) % 2 == 0;
+    command++;
+    int value = TestModel::parse(channel, isOn ? "ON" : "OFF");
+    model.set(channel, value);
+    model.touch(channel);
+    bank->beginFrame();
+    if (isIncremental) {
+      model.set(0, model.isAnyOn(TestModel::LIGHTS));
+      model.updateLights(model.takeChanges());
+    } else {
+      bool anyLightIsOn = false;
+      for (int light = 0; light < TestModel::SIZE; light++) {
+        anyLightIsOn |= TestModel::hasLight(light) && model.get(light) != 0;
+      }
+      model.set(0, anyLightIsOn);
+      model.updateLights();
+    }
+    bank->commitFrame();
+  }
+  reportCalls(state, 1);
+  state.counters["channels"] = TestModel::SIZE;
+}
+
+// Registers the village sizes (the current village, and ten times larger)
+static void villageScales(benchmark::internal::Benchmark *bench) {
+  bench->ArgName("scale")->Arg(1)->Arg(10);
+}
+
+// Every command recomputes every light
+static void BM_CommandToDutyFull(benchmark::State &state) {
+  state.range(0) == 1 ? runCommandToDuty<BenchVillage>(state, false)
+                      : runCommandToDuty<BenchVillage10>(state, false);
+}
+BENCHMARK(BM_CommandToDutyFull)->Apply(villageScales);
+
+// Every command only recomputes the lights that depend on what it changed
+static void BM_CommandToDutyIncremental(benchmark::State &state) {
+  state.range(0) == 1 ? runCommandToDuty<BenchVillage>(state, true)
+                      : runCommandToDuty<BenchVillage10>(state, true);
+}
+BENCHMARK(BM_CommandToDutyIncremental)->Apply(villageScales);
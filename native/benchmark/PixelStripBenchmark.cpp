@@ -0,0 +1,56 @@
+#include "BenchmarkUtils.h"
+
+#include <Light.h>
+#include <NativeShim.h>
+#include <PixelStrip.h>
+
+/** Registers the strip lengths measured (a long string and a whole village) */
+static void pixelCounts(benchmark::internal::Benchmark *bench) {
+  bench->ArgName("pixels")->Arg(300)->Arg(1000);
+}
+
+/**
+ * Reports pixels rendered per second, and the time the strip needs to send a
+ * frame (the frame rate limit of the chain itself)
+ */
+static void reportPixels(benchmark::State &state, PixelStrip &strip) {
+  state.counters["pixels/s"] = benchmark::Counter(
+      (double)state.iterations() * strip.size(), benchmark::Counter::kIsRate);
+  state.counters["wireUs/frame"] = strip.getFrameTime().count();
+}
+
+// Render every pixel of the strip and show the frame
+static void BM_PixelStripShow(benchmark::State &state) {
+  NativeShim::reset();
+  PixelStrip strip(5, state.range(0));
+  uint32_t color = 0;
+  for (auto _ : state) {
+    color += 0x010203;
+    strip.fill(0, strip.size(), color);
+    strip.show();
+  }
+  reportPixels(state, strip);
+}
+BENCHMARK(BM_PixelStripShow)->Apply(pixelCounts);
+
+// Blink the strip as 10 pixel segments through the Light API, committed by
+// the bank's tick as one frame
+static void BM_PixelSegmentsBlink(benchmark::State &state) {
+  NativeShim::reset();
+  PixelStrip strip(5, state.range(0));
+  LightBank bank;
+  std::vector<Light> segments;
+  for (int start = 0; start < strip.size(); start += 10) {
+    segments.emplace_back(strip, start, 10, 0xFF8020, bank);
+    segments.back().blink(1);
+  }
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    bank.tick(now);
+  }
+  reportPixels(state, strip);
+  state.counters["frames/tick"] =
+      (double)NativeShim::rmtFrames() / (double)state.iterations();
+}
+BENCHMARK(BM_PixelSegmentsBlink)->Apply(pixelCounts);
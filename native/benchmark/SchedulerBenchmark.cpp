@@ -0,0 +1,90 @@
+#include "BenchmarkUtils.h"
+
+#include <Light.h>
+#include <NativeShim.h>
+#include <Scheduler.h>
+
+// One polling pass over idle lights (what Utils::startLoop does every tick)
+static void BM_PollingPassIdle(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  std::vector<Light> &lights = fixture.lights;
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    for (Light &light : lights) {
+      light.loop(now);
+    }
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_PollingPassIdle)->Apply(lightCounts);
+
+// One scheduler pass over idle lights (only runs when woken)
+static void BM_SchedulerPassIdle(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  std::vector<Light> &lights = fixture.lights;
+  Scheduler scheduler;
+  for (Light &light : lights) {
+    scheduler.add(light);
+  }
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    benchmark::DoNotOptimize(scheduler.runDue(now));
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_SchedulerPassIdle)->Apply(lightCounts);
+
+// One scheduler pass where every light is blinking and due
+static void BM_SchedulerPassBlinking(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(state.range(0));
+  std::vector<Light> &lights = fixture.lights;
+  Scheduler scheduler;
+  for (Light &light : lights) {
+    light.blink(1);
+    scheduler.add(light);
+  }
+  Timestamp now;
+  for (auto _ : state) {
+    now += millis(1);
+    benchmark::DoNotOptimize(scheduler.runDue(now));
+  }
+  reportCalls(state, state.range(0));
+}
+BENCHMARK(BM_SchedulerPassBlinking)->Apply(lightCounts);
+
+// Simulates one second of the christmas village while disconnected (one light
+// blinking every second) and reports how often each loop style wakes up
+static void BM_VillageSecondWakeups(benchmark::State &state) {
+  NativeShim::reset();
+  LightFixture fixture(8);
+  std::vector<Light> &lights = fixture.lights;
+  lights[0].blink(1000);
+  Scheduler scheduler;
+  scheduler.add(lights[0]);
+  bool scheduled = state.range(0) == 1;
+  uint64_t wakeups = 0;
+  Timestamp now;
+  for (auto _ : state) {
+    Timestamp end = now + millis(1000);
+    while (now < end) {
+      wakeups++;
+      if (scheduled) {
+        Timestamp deadline = scheduler.runDue(now);
+        now = deadline > end  ? end
+              : deadline <= now ? now + millis(1)
+                                : deadline;
+      } else {
+        lights[0].loop(now);
+        now += millis(1);
+      }
+    }
+  }
+  state.counters["wakeups/s"] =
+      benchmark::Counter((double)wakeups / state.iterations());
+}
+BENCHMARK(BM_VillageSecondWakeups)->ArgName("scheduled")->Arg(0)->Arg(1);
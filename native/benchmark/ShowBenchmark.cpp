@@ -0,0 +1,96 @@
+#include "BenchmarkUtils.h"
+
+#include <ShowEncoder.h>
+#include <ShowPlayer.h>
+#include <random>
+
+// Frames in every benchmark show (ten seconds at 40 fps)
+static const int SHOW_FRAMES = 400;
+
+// Show patterns, from the cheapest to the most expensive to decode
+enum ShowPattern { HOLD, FADE, CHASE, TWINKLE };
+
+/**
+ * Registers the channel counts (up to a show's limit) and patterns every show
+ * benchmark is measured at
+ */
+static void showArgs(benchmark::internal::Benchmark *bench) {
+  bench->ArgNames({"channels", "pattern"});
+  for (int channels : {12, 100, SHOW_MAX_CHANNELS}) {
+    for (int pattern : {HOLD, FADE, CHASE, TWINKLE}) {
+      bench->Args({channels, pattern});
+    }
+  }
+}
+
+/**
+ * Compiles a show: every channel held at one level, every channel fading
+ * together, a ramp chasing across the channels, or every channel twinkling at
+ * random
+ */
+static std::vector<uint8_t> buildShow(int channels, int pattern) {
+  ShowEncoder encoder(channels, millis(25));
+  std::vector<uint8_t> levels(channels);
+  std::mt19937 random(1);
+  for (int frame = 0; frame < SHOW_FRAMES; frame++) {
+    for (int channel = 0; channel < channels; channel++) {
+      switch (pattern) {
+      case HOLD:
+        levels[channel] = 128;
+        break;
+      case FADE:
+        levels[channel] = frame * 4;
+        break;
+      case CHASE:
+        levels[channel] = channel == frame % channels ? 255 : 0;
+        break;
+      default:
+        levels[channel] = random() & 0xFF;
+      }
+    }
+    encoder.add(levels.data());
+  }
+  return encoder.build();
+}
+
+/** Decodes every frame of a show in order, starting over at its end */
+static void BM_ShowDecodeFrame(benchmark::State &state) {
+  int channels = state.range(0);
+  std::vector<uint8_t> data = buildShow(channels, state.range(1));
+  ShowFile show;
+  show.open(data.data(), data.size());
+  std::vector<uint8_t> levels(channels);
+  show.rewind(levels.data());
+  for (auto _ : state) {
+    if (!show.next(levels.data())) {
+      show.rewind(levels.data());
+      show.next(levels.data());
+    }
+    benchmark::DoNotOptimize(levels.data());
+  }
+  reportCalls(state, 1);
+  state.counters["bytes/frame"] =
+      (double)(data.size() - SHOW_HEADER_SIZE) / SHOW_FRAMES;
+}
+BENCHMARK(BM_ShowDecodeFrame)->Apply(showArgs);
+
+/**
+ * Plays a show on the lights one frame at a time, like the lighting task when
+ * each frame is due (decoding the frame and writing it in one bank frame)
+ */
+static void BM_ShowPlayFrame(benchmark::State &state) {
+  int channels = state.range(0);
+  std::vector<uint8_t> data = buildShow(channels, state.range(1));
+  LightFixture fixture(channels);
+  ShowPlayer player(fixture.lights.data(), channels);
+  player.load(data.data(), data.size());
+  player.play();
+  Timestamp now = player.nextDeadline(Clock::now());
+  for (auto _ : state) {
+    player.loop(now);
+    now = player.nextDeadline(now);
+  }
+  reportCalls(state, 1);
+  state.counters["late"] = player.getLateFrames();
+}
+BENCHMARK(BM_ShowPlayFrame)->Apply(showArgs);
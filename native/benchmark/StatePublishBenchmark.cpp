@@ -0,0 +1,142 @@
+#include "BenchmarkUtils.h"
+
+#include <Coalescer.h>
+#include <JsonWriter.h>
+#include <stdlib.h>
+#include <string_view>
+#if HAVE_CJSON
+#include <cJSON.h>
+#endif
+
+// Soak test size: commands per iteration, sent in bursts (ex. an automation
+// switching every light at once)
+static const int COMMANDS = 10000;
+static const int BURST_SIZE = 8;
+
+// The mustang's state values (changed between publishes)
+static const char *lightModes[] = {"OFF", "RUNNING", "LOW_BEAM"};
+static const char *turnModes[] = {"OFF", "LEFT", "RIGHT"};
+static int commandCount = 0;
+
+/** An ON/OFF switch state that changes with the commands */
+static const char *switchState(int period) {
+  return (commandCount / period) % 2 == 0 ? "ON" : "OFF";
+}
+
+// Published documents
+static int publishCount = 0;
+static size_t publishedBytes = 0;
+
+/** Stand-in for MqttClient::publish */
+static void publish(std::string_view data) {
+  publishCount++;
+  publishedBytes += data.size();
+  benchmark::DoNotOptimize(data.data());
+}
+
+#if HAVE_CJSON
+/** malloc hook for cJSON, so its allocations are counted */
+static void *countedMalloc(size_t size) {
+  countAllocation(size);
+  return malloc(size);
+}
+
+// The previous serializer: build a cJSON tree on the heap and print it (the
+// printed string is freed here, where the applications leaked it)
+static void publishCJsonState(void) {
+  cJSON *state = cJSON_CreateObject();
+  cJSON_AddStringToObject(state, "lighting", lightModes[commandCount % 3]);
+  cJSON_AddStringToObject(state, "high_beam", switchState(2));
+  cJSON_AddStringToObject(state, "braking", switchState(3));
+  cJSON_AddStringToObject(state, "turning", turnModes[commandCount % 3]);
+  cJSON_AddStringToObject(state, "reverse", switchState(5));
+  cJSON_AddStringToObject(state, "fog", switchState(7));
+  cJSON_AddStringToObject(state, "interior", switchState(11));
+  cJSON_AddStringToObject(state, "hazard", switchState(13));
+  char *stateStr = cJSON_PrintUnformatted(state);
+  cJSON_Delete(state);
+  publish(stateStr);
+  cJSON_free(stateStr);
+}
+#endif
+
+// Write the same document into a stack buffer
+static void publishWriterState(void) {
+  JsonWriter<256> state;
+  state.beginObject()
+      .add("lighting", lightModes[commandCount % 3])
+      .add("high_beam", switchState(2))
+      .add("braking", switchState(3))
+      .add("turning", turnModes[commandCount % 3])
+      .add("reverse", switchState(5))
+      .add("fog", switchState(7))
+      .add("interior", switchState(11))
+      .add("hazard", switchState(13))
+      .endObject();
+  if (state.isValid()) {
+    publish(state.view());
+  }
+}
+
+/** Publish the state after every command with a serializer */
+static void publishEveryCommand(benchmark::State &state,
+                                void (*serialize)(void)) {
+  publishCount = 0;
+  uint64_t startCount = allocationCount();
+  uint64_t startBytes = allocatedBytes();
+  for (auto _ : state) {
+    for (commandCount = 0; commandCount < COMMANDS; commandCount++) {
+      serialize();
+    }
+  }
+  reportCalls(state, COMMANDS);
+  reportAllocations(state, startCount, COMMANDS);
+  reportAllocatedBytes(state, startBytes, COMMANDS);
+  state.counters["publishes/cmd"] =
+      (double)publishCount / ((double)state.iterations() * COMMANDS);
+}
+
+#if HAVE_CJSON
+// Publish the state after every command with cJSON (the applications before
+// JsonWriter)
+static void BM_StatePublishCJson(benchmark::State &state) {
+  cJSON_Hooks hooks = {.malloc_fn = &countedMalloc, .free_fn = &free};
+  cJSON_InitHooks(&hooks);
+  publishEveryCommand(state, &publishCJsonState);
+  cJSON_InitHooks(NULL);
+}
+BENCHMARK(BM_StatePublishCJson);
+#endif
+
+// Publish the state after every command with JsonWriter
+static void BM_StatePublishEveryCommand(benchmark::State &state) {
+  publishEveryCommand(state, &publishWriterState);
+}
+BENCHMARK(BM_StatePublishEveryCommand);
+
+// Coalesce each burst into one publish written with JsonWriter. Commands in a
+// burst arrive 1ms apart, and bursts are a second apart
+static void BM_StatePublishCoalesced(benchmark::State &state) {
+  Coalescer publisher(50, &publishWriterState);
+  publishCount = 0;
+  Timestamp now;
+  uint64_t startCount = allocationCount();
+  uint64_t startBytes = allocatedBytes();
+  for (auto _ : state) {
+    for (commandCount = 0; commandCount < COMMANDS; commandCount++) {
+      publisher.request();
+      publisher.loop(now);
+      now += millis(commandCount % BURST_SIZE == BURST_SIZE - 1 ? 1000 : 1);
+      // The scheduler runs the publisher when its deadline passes
+      if (publisher.nextDeadline(now) <= now) {
+        publisher.loop(now);
+      }
+    }
+  }
+  reportCalls(state, COMMANDS);
+  reportAllocations(state, startCount, COMMANDS);
+  reportAllocatedBytes(state, startBytes, COMMANDS);
+  state.counters["publishes/cmd"] =
+      (double)publishCount / ((double)state.iterations() * COMMANDS);
+}
+BENCHMARK(BM_StatePublishCoalesced);
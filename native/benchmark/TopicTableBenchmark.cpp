@@ -0,0 +1,100 @@
+#include "BenchmarkUtils.h"
+
+#include <TopicTable.h>
+#include <functional>
+#include <map>
+#include <string.h>
+#include <string>
+#include <string_view>
+
+// The mustang's subscription topics and a typical payload for each
+static const char *TOPICS[][2] = {
+    {"/lego/mustang/lighting", "LOW_BEAM"},
+    {"/lego/mustang/high_beam", "ON"},
+    {"/lego/mustang/braking", "OFF"},
+    {"/lego/mustang/turning", "LEFT"},
+    {"/lego/mustang/reverse", "ON"},
+    {"/lego/mustang/fog", "OFF"},
+    {"/lego/mustang/interior", "ON"},
+    {"/lego/mustang/hazard", "OFF"},
+    {"/lego/mustang/all", "ON"},
+    {"/lego/mustang/program", "\x00\x01\x64\x03\xf4\x01\x01\x00\x03\xf4\x01"
+                              "\x04\x00\x00"},
+};
+static const int TOPIC_COUNT = sizeof(TOPICS) / sizeof(TOPICS[0]);
+
+// Simulated event buffer (topic and payload are not null terminated)
+struct Message {
+  const char *topic;
+  int topicLength;
+  const char *data;
+  int dataLength;
+};
+
+/** Messages for every topic, plus one for a topic nobody subscribed to */
+static std::vector<Message> makeMessages(void) {
+  std::vector<Message> messages;
+  for (int i = 0; i < TOPIC_COUNT; i++) {
+    int dataLength = i == TOPIC_COUNT - 1 ? 14 : (int)strlen(TOPICS[i][1]);
+    messages.push_back({TOPICS[i][0], (int)strlen(TOPICS[i][0]), TOPICS[i][1],
+                        dataLength});
+  }
+  messages.push_back({"/lego/mustang/unknown", 21, "ON", 2});
+  return messages;
+}
+
+// The previous dispatch path: copy the topic into a std::string, look it up
+// twice in a std::map, copy the payload and pass it by value
+static void BM_DispatchStringMap(benchmark::State &state) {
+  std::map<std::string, std::function<void(std::string)>> subscriptions;
+  size_t received = 0;
+  for (int i = 0; i < TOPIC_COUNT; i++) {
+    subscriptions[TOPICS[i][0]] = [&](std::string data) {
+      received += data.size();
+    };
+  }
+  std::vector<Message> messages = makeMessages();
+  uint64_t startCount = allocationCount();
+  for (auto _ : state) {
+    for (const Message &message : messages) {
+      std::string topic;
+      topic.assign(message.topic, (size_t)message.topicLength);
+      if (subscriptions.contains(topic)) {
+        std::string data;
+        data.assign(message.data, (size_t)message.dataLength);
+        subscriptions.at(topic)(data);
+      }
+    }
+  }
+  benchmark::DoNotOptimize(received);
+  reportCalls(state, messages.size());
+  reportAllocations(state, startCount, messages.size());
+}
+BENCHMARK(BM_DispatchStringMap);
+
+// TopicTable dispatch with views into the event buffer
+static void BM_DispatchTopicTable(benchmark::State &state) {
+  TopicTable subscriptions;
+  size_t received = 0;
+  for (int i = 0; i < TOPIC_COUNT; i++) {
+    subscriptions.add(TOPICS[i][0],
+                      [&](std::string_view data) { received += data.size(); });
+  }
+  std::vector<Message> messages = makeMessages();
+  uint64_t startCount = allocationCount();
+  for (auto _ : state) {
+    for (const Message &message : messages) {
+      subscriptions.dispatch(
+          std::string_view(message.topic, (size_t)message.topicLength),
+          std::string_view(message.data, (size_t)message.dataLength));
+    }
+  }
+  benchmark::DoNotOptimize(received);
+  reportCalls(state, messages.size());
+  reportAllocations(state, startCount, messages.size());
+}
+BENCHMARK(BM_DispatchTopicTable);
+
+// Topic hashes are constexpr, so topics known at compile time cost nothing
+static_assert(TopicTable::hash("/lego/mustang/all") !=
+              TopicTable::hash("/lego/mustang/fog"));
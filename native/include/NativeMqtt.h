@@ -0,0 +1,128 @@
+#ifndef NATIVE_MQTT_H
+#define NATIVE_MQTT_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * NativeMqtt is a minimal MQTT 3.1.1 client over TCP, used by the esp-mqtt
+ * stand-in and by host tools that talk to a real broker. It connects with a
+ * clean session, publishes and subscribes with QoS 0 or 1, keeps the
+ * connection alive, and calls its handlers from its own receive thread
+ */
+class NativeMqtt {
+public:
+  typedef std::function<void(std::string_view topic, std::string_view data)>
+      MessageHandler;
+
+  ~NativeMqtt(void);
+
+  /**
+   * Set the Last Will and Testament sent with the next connection
+   * @param topic The LWT topic
+   * @param message The LWT message
+   * @param qos The LWT QoS (0 or 1)
+   * @param retain Whether the broker retains the LWT message
+   */
+  NativeMqtt &setWill(std::string topic, std::string message, int qos,
+                      bool retain);
+
+  /**
+   * Set the function called with every message received on a subscribed topic
+   * (on the receive thread, with views that are only valid during the call)
+   */
+  NativeMqtt &onMessage(MessageHandler handler);
+
+  /**
+   * Set the function called on the receive thread with the packet id of every
+   * QoS 1 message the broker acknowledges
+   */
+  NativeMqtt &onPublished(std::function<void(uint16_t)> handler);
+
+  /**
+   * Set the function called on the receive thread when the connection is lost
+   * (not when disconnect is called)
+   */
+  NativeMqtt &onDisconnect(std::function<void(void)> handler);
+
+  /**
+   * Connect to a broker and wait for it to accept the connection
+   * @param host The broker's hostname or address
+   * @param port The broker's port
+   * @param clientId The client id
+   * @param keepAliveSeconds Longest time without packets before the broker
+   * drops the connection (pings are sent at half of it)
+   * @returns false if the broker couldn't be reached or refused the client
+   */
+  bool connect(const std::string &host, int port, const std::string &clientId,
+               int keepAliveSeconds = 30);
+
+  /** Disconnect cleanly (the LWT isn't sent) */
+  void disconnect(void);
+
+  /** Indicates if the client is connected */
+  bool isConnected(void) { return _isConnected; }
+
+  /**
+   * Subscribe to a topic
+   * @param topic The topic (or filter)
+   * @param qos The highest QoS to receive messages with (0 or 1)
+   * @returns false if the client isn't connected
+   */
+  bool subscribe(std::string_view topic, int qos = 0);
+
+  /**
+   * Publish a message. QoS 1 messages are sent once and acknowledged by the
+   * broker in the background (they aren't resent)
+   * @param topic The topic
+   * @param data The payload
+   * @param qos The QoS (0 or 1)
+   * @param retain Whether the broker retains the message
+   * @param packetId Set to the packet id of a QoS 1 message (0 for QoS 0)
+   * @returns false if the client isn't connected
+   */
+  bool publish(std::string_view topic, std::string_view data, int qos = 0,
+               bool retain = false, uint16_t *packetId = NULL);
+
+  /** Number of QoS 1 messages the broker hasn't acknowledged yet */
+  uint32_t getUnacknowledged(void) { return _unacknowledged; }
+
+private:
+  int _socket = -1;                                // Connection to the broker
+  std::atomic<bool> _isConnected{false};           // The broker accepted us
+  std::atomic<bool> _isClosing{false};             // disconnect was called
+  std::atomic<uint32_t> _unacknowledged{0};        // QoS 1 awaiting PUBACK
+  std::atomic<uint16_t> _nextPacketId{1};          // Id of the next packet
+  std::mutex _sendMutex;                           // Serializes sent packets
+  std::thread _receiver;                           // Receive thread
+  std::string _willTopic;                          // LWT topic (empty for none)
+  std::string _willMessage;                        // LWT message
+  int _willQos = 0;                                // LWT QoS
+  bool _willRetain = false;                        // LWT retain flag
+  MessageHandler _messageHandler;                  // Receives messages
+  std::function<void(uint16_t)> _publishedHandler; // Called on PUBACK
+  std::function<void(void)> _disconnectHandler;    // Called on connection loss
+
+  /** Read packets until the connection closes */
+  void receive(int keepAliveSeconds);
+
+  /** Send a packet with its fixed header */
+  bool send(uint8_t header, const std::vector<uint8_t> &body);
+
+  /** Read one packet (header and body) with a timeout */
+  bool read(uint8_t &header, std::vector<uint8_t> &body, int timeoutMs);
+
+  /** Take the id of the next SUBSCRIBE or QoS 1 PUBLISH */
+  uint16_t takePacketId(void);
+
+  /** Close the socket */
+  void close(void);
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef NATIVE_SHIM_H
+#define NATIVE_SHIM_H
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * NativeShim exposes the state recorded by the native driver stand-ins so that
+ * benchmarks and host tools can observe what the shared libraries wrote to the
+ * "hardware"
+ */
+namespace NativeShim {
+/** Reset all recorded duties, levels and call counters */
+void reset(void);
+
+/** Last duty written to a LEDC channel with ledc_set_duty */
+uint32_t ledcDuty(int channel);
+
+/** Last duty latched to a LEDC channel with ledc_update_duty */
+uint32_t ledcOutput(int channel);
+
+/** Last level written to a GPIO pin */
+uint32_t gpioLevel(int pin);
+
+/** Number of ledc_set_duty calls since the last reset */
+uint64_t ledcSetDutyCalls(void);
+
+/** Number of ledc_update_duty calls since the last reset */
+uint64_t ledcUpdateDutyCalls(void);
+
+/** Number of ledc_set_fade_time_and_start calls since the last reset */
+uint64_t ledcFadeCalls(void);
+
+/**
+ * Finish every running fade by invoking the registered fade callbacks (fades
+ * latch their target duty right away on the host and only complete when this
+ * is called)
+ * @returns The number of fades completed
+ */
+int completeFades(void);
+
+/** Number of gpio_set_level calls since the last reset */
+uint64_t gpioSetLevelCalls(void);
+
+/** Last frame of pixel bytes transmitted on a pin with the RMT */
+const std::vector<uint8_t> &rmtFrame(int pin);
+
+/** Number of pixel frames transmitted with the RMT since the last reset */
+uint64_t rmtFrames(void);
+
+/** Number of pixel bytes transmitted with the RMT since the last reset */
+uint64_t rmtBytes(void);
+
+/**
+ * Register a file as a data partition, so esp_partition_find_first finds it by
+ * its label and esp_partition_mmap maps the file
+ * @param label The partition label (up to 16 characters)
+ * @param path Path of the file holding the partition's contents
+ * @returns false if the file can't be read
+ */
+bool addPartition(const char *label, const char *path);
+
+/**
+ * Register a function called whenever a light's output changes: a LEDC duty is
+ * latched (or a fade starts, with its target duty) or a GPIO level is set. It
+ * runs on the task that changed the output
+ * @param callback Receives the pin and its new level (NULL to stop observing)
+ */
+void onOutput(void (*callback)(int pin, uint32_t level));
+
+/** Broker the esp-mqtt stand-in connects to (MQTT_HOST, or localhost) */
+const char *mqttHost(void);
+
+/** Port of the broker (MQTT_PORT, or 1883) */
+uint32_t mqttPort(void);
+
+/** File the NVS stand-in keeps its values in (NVS_FILE, or NULL for none) */
+const char *nvsPath(void);
+
+/**
+ * Time the WiFi stand-in takes to associate with the access point in ms
+ * (WIFI_CONNECT_MS, or 0), ex. to measure how long boards stay dark at boot
+ */
+uint32_t wifiConnectMs(void);
+
+/**
+ * Time the WiFi stand-in takes to scan for the access point in ms
+ * (WIFI_SCAN_MS, or 0). Skipped when the station is given the channel
+ */
+uint32_t wifiScanMs(void);
+
+/**
+ * Time the WiFi stand-in takes to get an address from DHCP in ms
+ * (WIFI_DHCP_MS, or 0). Skipped when the station has a static address
+ */
+uint32_t wifiDhcpMs(void);
+
+/**
+ * Channel of the access point the WiFi stand-in connects to (WIFI_CHANNEL, or
+ * 6), ex. to move it away from the channel a board cached
+ */
+uint8_t wifiChannel(void);
+} // namespace NativeShim
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef NATIVE_SECRETS_H
+#define NATIVE_SECRETS_H
+
+#include <NativeShim.h>
+
+// Native stand-in for an application's Secrets.h. The host needs no WiFi
+// credentials, and the broker comes from the MQTT_HOST and MQTT_PORT
+// environment variables (localhost:1883 by default)
+
+#define WIFI_SSID ""
+#define WIFI_PASSWORD ""
+
+#define MQTT_HOST NativeShim::mqttHost()
+#define MQTT_PORT NativeShim::mqttPort()
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef NATIVE_DRIVER_LEDC_H
+#define NATIVE_DRIVER_LEDC_H
+
+#include <esp_err.h>
+
+// Native stand-in for the subset of driver/ledc.h used by the shared libraries
+
+typedef enum {
+  LEDC_LOW_SPEED_MODE = 0,
+  LEDC_SPEED_MODE_MAX,
+} ledc_mode_t;
+
+typedef enum {
+  LEDC_INTR_DISABLE = 0,
+  LEDC_INTR_FADE_END,
+} ledc_intr_type_t;
+
+typedef enum {
+  LEDC_TIMER_1_BIT = 1,
+  LEDC_TIMER_8_BIT = 8,
+  LEDC_TIMER_10_BIT = 10,
+  LEDC_TIMER_12_BIT = 12,
+  LEDC_TIMER_13_BIT = 13,
+  LEDC_TIMER_14_BIT = 14,
+  LEDC_TIMER_BIT_MAX = 21,
+} ledc_timer_bit_t;
+
+typedef enum {
+  LEDC_TIMER_0 = 0,
+  LEDC_TIMER_1,
+  LEDC_TIMER_2,
+  LEDC_TIMER_3,
+  LEDC_TIMER_MAX,
+} ledc_timer_t;
+
+typedef enum {
+  LEDC_CHANNEL_0 = 0,
+  LEDC_CHANNEL_1,
+  LEDC_CHANNEL_2,
+  LEDC_CHANNEL_3,
+  LEDC_CHANNEL_4,
+  LEDC_CHANNEL_5,
+  LEDC_CHANNEL_6,
+  LEDC_CHANNEL_7,
+  LEDC_CHANNEL_MAX,
+} ledc_channel_t;
+
+typedef enum {
+  LEDC_AUTO_CLK = 0,
+} ledc_clk_cfg_t;
+
+typedef enum {
+  LEDC_FADE_NO_WAIT = 0,
+  LEDC_FADE_WAIT_DONE,
+  LEDC_FADE_MAX,
+} ledc_fade_mode_t;
+
+typedef enum {
+  LEDC_FADE_END_EVT = 0,
+} ledc_cb_event_t;
+
+typedef struct {
+  ledc_cb_event_t event;
+  uint32_t speed_mode;
+  uint32_t channel;
+  uint32_t duty;
+} ledc_cb_param_t;
+
+typedef bool (*ledc_cb_t)(const ledc_cb_param_t *param, void *user_arg);
+
+typedef struct {
+  ledc_cb_t fade_cb;
+} ledc_cbs_t;
+
+typedef struct {
+  ledc_mode_t speed_mode;
+  ledc_timer_bit_t duty_resolution;
+  ledc_timer_t timer_num;
+  uint32_t freq_hz;
+  ledc_clk_cfg_t clk_cfg;
+} ledc_timer_config_t;
+
+typedef struct {
+  int gpio_num;
+  ledc_mode_t speed_mode;
+  ledc_channel_t channel;
+  ledc_intr_type_t intr_type;
+  ledc_timer_t timer_sel;
+  uint32_t duty;
+  int hpoint;
+} ledc_channel_config_t;
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf);
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf);
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel,
+                        uint32_t duty);
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel);
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel);
+
+/**
+ * Fades latch their target duty right away on the host. The registered fade
+ * callbacks fire when NativeShim::completeFades is called
+ */
+esp_err_t ledc_fade_func_install(int intr_alloc_flags);
+void ledc_fade_func_uninstall(void);
+esp_err_t ledc_set_fade_time_and_start(ledc_mode_t speed_mode,
+                                       ledc_channel_t channel,
+                                       uint32_t target_duty,
+                                       uint32_t max_fade_time_ms,
+                                       ledc_fade_mode_t fade_mode);
+esp_err_t ledc_fade_stop(ledc_mode_t speed_mode, ledc_channel_t channel);
+esp_err_t ledc_cb_register(ledc_mode_t speed_mode, ledc_channel_t channel,
+                           ledc_cbs_t *cbs, void *user_arg);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef NATIVE_ESP_ATTR_H
+#define NATIVE_ESP_ATTR_H
+
+// Native stand-in for esp_attr.h (placement attributes have no effect on the
+// host)
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_NOINIT_ATTR
+
+#endif
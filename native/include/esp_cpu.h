@@ -0,0 +1,27 @@
+#ifndef NATIVE_ESP_CPU_H
+#define NATIVE_ESP_CPU_H
+
+#include <chrono>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+/**
+ * Free running CPU cycle counter (mirrors the ESP-IDF one, which wraps every
+ * ~18 seconds at 240MHz). Reads the time stamp counter on x86 hosts and falls
+ * back to nanoseconds elsewhere
+ */
+inline esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return (esp_cpu_cycle_count_t)__rdtsc();
+#else
+  return (esp_cpu_cycle_count_t)std::chrono::steady_clock::now()
+      .time_since_epoch()
+      .count();
+#endif
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef NATIVE_ESP_ERR_H
+#define NATIVE_ESP_ERR_H
+
+#include <stdint.h>
+
+// Native stand-in for the subset of esp_err.h used by the shared libraries
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+
+#define ESP_ERROR_CHECK(x) (void)(x)
+#define ESP_ERROR_CHECK_WITHOUT_ABORT(x) (x)
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef NATIVE_ESP_EVENT_H
+#define NATIVE_ESP_EVENT_H
+
+#include <esp_err.h>
+#include <stdint.h>
+
+// Native stand-in for the subset of esp_event.h used by the shared libraries.
+// The default event loop is a thread that runs the handlers one event at a
+// time, like the ESP-IDF event task
+
+#define ESP_EVENT_ANY_ID -1
+
+typedef const char *esp_event_base_t;
+typedef void *esp_event_handler_instance_t;
+typedef void (*esp_event_handler_t)(void *event_handler_arg,
+                                    esp_event_base_t event_base,
+                                    int32_t event_id, void *event_data);
+
+esp_err_t esp_event_loop_create_default(void);
+esp_err_t
+esp_event_handler_instance_register(esp_event_base_t event_base,
+                                    int32_t event_id,
+                                    esp_event_handler_t event_handler,
+                                    void *event_handler_arg,
+                                    esp_event_handler_instance_t *instance);
+
+#endif
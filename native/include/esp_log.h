@@ -0,0 +1,21 @@
+#ifndef NATIVE_ESP_LOG_H
+#define NATIVE_ESP_LOG_H
+
+#include <esp_timer.h>
+#include <stdio.h>
+
+// Native stand-in for the subset of esp_log.h used by the shared libraries.
+// Messages are written to stderr in the ESP-IDF format (level, milliseconds
+// since boot and tag)
+
+#define ESP_LOGI(tag, format, ...)                                             \
+  fprintf(stderr, "I (%lld) %s: " format "\n",                                 \
+          (long long)(esp_timer_get_time() / 1000),                            \
+          tag __VA_OPT__(, ) __VA_ARGS__)
+
+#define ESP_LOGW(tag, format, ...)                                             \
+  fprintf(stderr, "W (%lld) %s: " format "\n",                                 \
+          (long long)(esp_timer_get_time() / 1000),                            \
+          tag __VA_OPT__(, ) __VA_ARGS__)
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef NATIVE_ESP_NETIF_SNTP_H
+#define NATIVE_ESP_NETIF_SNTP_H
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <sys/time.h>
+
+// Native stand-in for the subset of esp_netif_sntp.h used by the shared
+// libraries. The host's clock is the time server: the sync callback receives
+// the host's time of day once at start and then at every sync interval
+
+typedef void (*esp_sntp_time_cb_t)(struct timeval *tv);
+
+typedef struct {
+  bool start;
+  esp_sntp_time_cb_t sync_cb;
+  size_t num_of_servers;
+  const char *servers[1];
+} esp_sntp_config_t;
+
+#define ESP_NETIF_SNTP_DEFAULT_CONFIG(server)                                  \
+  {                                                                            \
+    .start = true, .sync_cb = NULL, .num_of_servers = 1, .servers = {server}   \
+  }
+
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *config);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef NATIVE_ESP_SNTP_H
+#define NATIVE_ESP_SNTP_H
+
+#include <stdint.h>
+
+// Native stand-in for the subset of esp_sntp.h used by the shared libraries
+
+void sntp_set_sync_interval(uint32_t interval_ms);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef NATIVE_ESP_SYSTEM_H
+#define NATIVE_ESP_SYSTEM_H
+
+#include <stdint.h>
+
+// Heap size reported by the stand-ins (the host has no fixed heap, so the
+// numbers only need to look like an ESP32's)
+#define NATIVE_FREE_HEAP 180000
+
+/** Free heap in bytes (mirrors the ESP-IDF function) */
+inline uint32_t esp_get_free_heap_size(void) { return NATIVE_FREE_HEAP; }
+
+/** Lowest free heap since boot in bytes (mirrors the ESP-IDF function) */
+inline uint32_t esp_get_minimum_free_heap_size(void) {
+  return NATIVE_FREE_HEAP;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef NATIVE_ESP_TIMER_H
+#define NATIVE_ESP_TIMER_H
+
+#include <esp_err.h>
+#include <stdint.h>
+
+// Native stand-in for the subset of esp_timer.h used by the shared libraries
+
+// Each timer gets a thread that runs its callback when it expires
+typedef struct NativeTimer *esp_timer_handle_t;
+
+// Callback run when a timer expires
+typedef void (*esp_timer_cb_t)(void *arg);
+
+// Where the callback is run from (always a thread on the host)
+typedef enum {
+  ESP_TIMER_TASK,
+  ESP_TIMER_ISR,
+} esp_timer_dispatch_t;
+
+// Timer configuration
+typedef struct {
+  esp_timer_cb_t callback;
+  void *arg;
+  esp_timer_dispatch_t dispatch_method;
+  const char *name;
+  bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+/**
+ * Microseconds since the native process started (mirrors the ESP-IDF timer
+ * which counts microseconds since boot)
+ */
+int64_t esp_timer_get_time(void);
+
+/** Creates a stopped timer */
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args,
+                           esp_timer_handle_t *out_handle);
+
+/**
+ * Runs the callback once after timeout_us microseconds. Fails with
+ * ESP_ERR_INVALID_STATE if the timer is already running
+ */
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+
+/**
+ * Stops a running timer. Fails with ESP_ERR_INVALID_STATE if it isn't running
+ */
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+/** Stops the timer's thread and frees it */
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+
+#endif
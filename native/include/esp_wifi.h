@@ -0,0 +1,127 @@
+#ifndef NATIVE_ESP_WIFI_H
+#define NATIVE_ESP_WIFI_H
+
+#include <esp_err.h>
+#include <esp_event.h>
+#include <stdint.h>
+
+// Native stand-in for the subset of esp_wifi.h (and the esp_netif types it
+// brings in) used by the shared libraries. The host is always on the network:
+// connecting reports the station as connected with the loopback address, after
+// the time a scan (skipped when the access point is given), the association and
+// DHCP (skipped with a static address) would take
+
+extern esp_event_base_t const WIFI_EVENT;
+extern esp_event_base_t const IP_EVENT;
+
+typedef enum {
+  WIFI_EVENT_STA_START = 2,
+  WIFI_EVENT_STA_STOP,
+  WIFI_EVENT_STA_CONNECTED,
+  WIFI_EVENT_STA_DISCONNECTED,
+} wifi_event_t;
+
+typedef enum {
+  IP_EVENT_STA_GOT_IP = 0,
+  IP_EVENT_STA_LOST_IP,
+} ip_event_t;
+
+typedef enum {
+  WIFI_MODE_NULL = 0,
+  WIFI_MODE_STA,
+} wifi_mode_t;
+
+typedef enum {
+  WIFI_IF_STA = 0,
+} wifi_interface_t;
+
+typedef struct {
+  uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+  esp_ip4_addr_t ip;
+  esp_ip4_addr_t netmask;
+  esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef struct {
+  esp_netif_ip_info_t ip_info;
+} ip_event_got_ip_t;
+
+typedef struct {
+  union {
+    esp_ip4_addr_t ip4;
+  } u_addr;
+  uint8_t type;
+} esp_ip_addr_t;
+
+typedef struct {
+  esp_ip_addr_t ip;
+} esp_netif_dns_info_t;
+
+typedef enum {
+  ESP_NETIF_DNS_MAIN = 0,
+  ESP_NETIF_DNS_BACKUP,
+} esp_netif_dns_type_t;
+
+#define ESP_IPADDR_TYPE_V4 0
+
+#define IPSTR "%d.%d.%d.%d"
+#define IP2STR(ipaddr)                                                         \
+  (int)((ipaddr)->addr & 0xff), (int)(((ipaddr)->addr >> 8) & 0xff),           \
+      (int)(((ipaddr)->addr >> 16) & 0xff), (int)(((ipaddr)->addr >> 24) & 0xff)
+
+typedef struct {
+  int reserved;
+} wifi_init_config_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT()                                             \
+  { .reserved = 0 }
+
+typedef enum {
+  WIFI_FAST_SCAN = 0,
+  WIFI_ALL_CHANNEL_SCAN,
+} wifi_scan_method_t;
+
+typedef struct {
+  uint8_t ssid[32];
+  uint8_t password[64];
+  wifi_scan_method_t scan_method;
+  bool bssid_set;
+  uint8_t bssid[6];
+  uint8_t channel;
+} wifi_sta_config_t;
+
+typedef struct {
+  uint8_t ssid[32];
+  uint8_t ssid_len;
+  uint8_t bssid[6];
+  uint8_t channel;
+} wifi_event_sta_connected_t;
+
+typedef union {
+  wifi_sta_config_t sta;
+} wifi_config_t;
+
+typedef struct esp_netif_obj esp_netif_t;
+
+esp_err_t esp_netif_init(void);
+esp_netif_t *esp_netif_create_default_wifi_sta(void);
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *esp_netif);
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *esp_netif);
+esp_err_t esp_netif_set_ip_info(esp_netif_t *esp_netif,
+                                const esp_netif_ip_info_t *ip_info);
+esp_err_t esp_netif_get_dns_info(esp_netif_t *esp_netif,
+                                 esp_netif_dns_type_t type,
+                                 esp_netif_dns_info_t *dns);
+esp_err_t esp_netif_set_dns_info(esp_netif_t *esp_netif,
+                                 esp_netif_dns_type_t type,
+                                 esp_netif_dns_info_t *dns);
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_connect(void);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef NATIVE_FREERTOS_TASK_H
+#define NATIVE_FREERTOS_TASK_H
+
+#include <freertos/FreeRTOS.h>
+
+// Native stand-in for the subset of task.h used by the shared libraries
+
+// Each native thread that uses the task API gets its own task control block
+typedef struct NativeTask *TaskHandle_t;
+
+// Entrypoint of a task
+typedef void (*TaskFunction_t)(void *);
+
+/**
+ * Runs a task function on a new detached thread (the stack depth and priority
+ * are ignored)
+ */
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *const pcName,
+                       const uint32_t usStackDepth, void *const pvParameters,
+                       UBaseType_t uxPriority,
+                       TaskHandle_t *const pxCreatedTask);
+
+/** Sleeps the calling thread for the given number of ticks */
+void vTaskDelay(const TickType_t xTicksToDelay);
+
+/** Ends the calling thread (only NULL, the calling task, is supported) */
+void vTaskDelete(TaskHandle_t xTaskToDelete);
+
+/** Handle for the calling thread */
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+/**
+ * Waits up to xTicksToWait for the calling thread's notification count to be
+ * non-zero, then clears it (xClearCountOnExit) or decrements it
+ * @returns The notification count before it was cleared or decremented
+ */
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit,
+                          TickType_t xTicksToWait);
+
+/** Increments a task's notification count and wakes it if it is waiting */
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+
+/** Interrupt version of xTaskNotifyGive (no difference on the host) */
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify,
+                            BaseType_t *pxHigherPriorityTaskWoken);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef NATIVE_MQTT_CLIENT_H
+#define NATIVE_MQTT_CLIENT_H
+
+#include <esp_err.h>
+#include <esp_event.h>
+#include <stdint.h>
+
+// Native stand-in for the subset of esp-mqtt's mqtt_client.h used by the
+// shared libraries. Clients connect to a real broker over TCP (see
+// NativeMqtt.h) and run their event handlers on a thread of their own, like
+// the esp-mqtt task. Queued messages are sent right away, so the outbox limit
+// is never reached
+
+extern esp_event_base_t const MQTT_EVENTS;
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+typedef enum {
+  MQTT_EVENT_ANY = -1,
+  MQTT_EVENT_ERROR = 0,
+  MQTT_EVENT_CONNECTED,
+  MQTT_EVENT_DISCONNECTED,
+  MQTT_EVENT_SUBSCRIBED,
+  MQTT_EVENT_UNSUBSCRIBED,
+  MQTT_EVENT_PUBLISHED,
+  MQTT_EVENT_DATA,
+  MQTT_EVENT_BEFORE_CONNECT,
+  MQTT_EVENT_DELETED,
+} esp_mqtt_event_id_t;
+
+typedef enum {
+  MQTT_TRANSPORT_UNKNOWN = 0,
+  MQTT_TRANSPORT_OVER_TCP,
+} esp_mqtt_transport_t;
+
+typedef struct {
+  esp_mqtt_event_id_t event_id;
+  esp_mqtt_client_handle_t client;
+  char *data;
+  int data_len;
+  char *topic;
+  int topic_len;
+  int msg_id;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+typedef struct {
+  struct {
+    struct {
+      const char *hostname;
+      esp_mqtt_transport_t transport;
+      uint32_t port;
+    } address;
+  } broker;
+  struct {
+    const char *client_id;
+  } credentials;
+  struct {
+    struct {
+      const char *topic;
+      const char *msg;
+      int qos;
+      int retain;
+    } last_will;
+  } session;
+  struct {
+    uint64_t limit;
+  } outbox;
+} esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t
+esp_mqtt_client_init(const esp_mqtt_client_config_t *config);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client,
+                                         esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler,
+                                         void *event_handler_arg);
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client,
+                              const char *topic, int qos);
+int esp_mqtt_client_subscribe_single(esp_mqtt_client_handle_t client,
+                                     const char *topic, int qos);
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic,
+                            const char *data, int len, int qos, int retain,
+                            bool store);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef NATIVE_NVS_H
+#define NATIVE_NVS_H
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Native stand-in for the subset of nvs.h used by the shared libraries. Values
+// are kept in memory, and written to the file named by NVS_FILE (if set) on
+// every commit, so they survive restarts like flash (see NativeShim::nvsPath)
+
+#define ESP_ERR_NVS_NOT_FOUND 0x1102
+#define ESP_ERR_NVS_INVALID_HANDLE 0x1107
+#define ESP_ERR_NVS_INVALID_LENGTH 0x110c
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+  NVS_READONLY,
+  NVS_READWRITE,
+} nvs_open_mode_t;
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode,
+                   nvs_handle_t *out_handle);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value,
+                       size_t *length);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value,
+                       size_t length);
+esp_err_t nvs_commit(nvs_handle_t handle);
+void nvs_close(nvs_handle_t handle);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef NATIVE_NVS_FLASH_H
+#define NATIVE_NVS_FLASH_H
+
+#include <esp_err.h>
+
+// Native stand-in for the subset of nvs_flash.h used by the shared libraries
+
+#define ESP_ERR_NVS_NO_FREE_PAGES 0x110d
+#define ESP_ERR_NVS_NEW_VERSION_FOUND 0x1110
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+
+#endif
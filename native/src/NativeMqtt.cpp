@@ -0,0 +1,305 @@
+#include "NativeMqtt.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// MQTT 3.1.1 packet types (the high nibble of the fixed header)
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_SUBSCRIBE 0x82
+#define MQTT_PINGREQ 0xC0
+#define MQTT_DISCONNECT 0xE0
+
+// Time to wait for the broker to accept a connection
+#define CONNECT_TIMEOUT_MS 5000
+
+// Append a big endian 16 bit value
+static void appendShort(std::vector<uint8_t> &body, uint16_t value) {
+  body.push_back(value >> 8);
+  body.push_back(value & 0xFF);
+}
+
+// Append a length prefixed string
+static void appendString(std::vector<uint8_t> &body, std::string_view text) {
+  appendShort(body, text.size());
+  body.insert(body.end(), text.begin(), text.end());
+}
+
+NativeMqtt::~NativeMqtt(void) { disconnect(); }
+
+// Set the LWT
+NativeMqtt &NativeMqtt::setWill(std::string topic, std::string message,
+                                int qos, bool retain) {
+  _willTopic = std::move(topic);
+  _willMessage = std::move(message);
+  _willQos = qos;
+  _willRetain = retain;
+  return *this;
+}
+
+// Set the message handler
+NativeMqtt &NativeMqtt::onMessage(MessageHandler handler) {
+  _messageHandler = std::move(handler);
+  return *this;
+}
+
+// Set the acknowledgement handler
+NativeMqtt &NativeMqtt::onPublished(std::function<void(uint16_t)> handler) {
+  _publishedHandler = std::move(handler);
+  return *this;
+}
+
+// Set the connection loss handler
+NativeMqtt &NativeMqtt::onDisconnect(std::function<void(void)> handler) {
+  _disconnectHandler = std::move(handler);
+  return *this;
+}
+
+// Connect and wait for the CONNACK
+bool NativeMqtt::connect(const std::string &host, int port,
+                         const std::string &clientId, int keepAliveSeconds) {
+  disconnect();
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addresses = NULL;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+                  &addresses) != 0) {
+    return false;
+  }
+  for (addrinfo *address = addresses; address != NULL;
+       address = address->ai_next) {
+    _socket = socket(address->ai_family, address->ai_socktype,
+                     address->ai_protocol);
+    if (_socket >= 0 &&
+        ::connect(_socket, address->ai_addr, address->ai_addrlen) == 0) {
+      break;
+    }
+    close();
+  }
+  freeaddrinfo(addresses);
+  if (_socket < 0) {
+    return false;
+  }
+  // Commands are small and latency sensitive
+  int noDelay = 1;
+  setsockopt(_socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+  // CONNECT with a clean session (and the LWT)
+  std::vector<uint8_t> body;
+  appendString(body, "MQTT");
+  body.push_back(4);
+  uint8_t flags = 0x02;
+  if (!_willTopic.empty()) {
+    flags |= 0x04 | (_willQos << 3) | (_willRetain ? 0x20 : 0);
+  }
+  body.push_back(flags);
+  appendShort(body, keepAliveSeconds);
+  appendString(body, clientId);
+  if (!_willTopic.empty()) {
+    appendString(body, _willTopic);
+    appendString(body, _willMessage);
+  }
+  uint8_t header;
+  std::vector<uint8_t> reply;
+  if (!send(MQTT_CONNECT, body) ||
+      !read(header, reply, CONNECT_TIMEOUT_MS) || header != MQTT_CONNACK ||
+      reply.size() < 2 || reply[1] != 0) {
+    close();
+    return false;
+  }
+  _isClosing = false;
+  _isConnected = true;
+  _unacknowledged = 0;
+  _receiver = std::thread(&NativeMqtt::receive, this, keepAliveSeconds);
+  return true;
+}
+
+// Disconnect without the LWT
+void NativeMqtt::disconnect(void) {
+  _isClosing = true;
+  if (_isConnected) {
+    send(MQTT_DISCONNECT, {});
+  }
+  _isConnected = false;
+  if (_socket >= 0) {
+    shutdown(_socket, SHUT_RDWR);
+  }
+  // The receive thread can't wait for itself (ex. disconnecting in a handler)
+  bool isReceiver = _receiver.get_id() == std::this_thread::get_id();
+  if (_receiver.joinable() && !isReceiver) {
+    _receiver.join();
+  }
+  close();
+}
+
+// Subscribe to a topic
+bool NativeMqtt::subscribe(std::string_view topic, int qos) {
+  if (!_isConnected) {
+    return false;
+  }
+  std::vector<uint8_t> body;
+  appendShort(body, takePacketId());
+  appendString(body, topic);
+  body.push_back(qos);
+  return send(MQTT_SUBSCRIBE, body);
+}
+
+// Publish a message
+bool NativeMqtt::publish(std::string_view topic, std::string_view data,
+                         int qos, bool retain, uint16_t *packetId) {
+  if (!_isConnected) {
+    return false;
+  }
+  std::vector<uint8_t> body;
+  body.reserve(topic.size() + data.size() + 4);
+  appendString(body, topic);
+  uint16_t id = 0;
+  if (qos > 0) {
+    id = takePacketId();
+    appendShort(body, id);
+    _unacknowledged++;
+  }
+  if (packetId != NULL) {
+    *packetId = id;
+  }
+  body.insert(body.end(), data.begin(), data.end());
+  return send(MQTT_PUBLISH | (qos > 0 ? 0x02 : 0) | (retain ? 0x01 : 0),
+              body);
+}
+
+// Read packets, answer QoS 1 messages and keep the connection alive
+void NativeMqtt::receive(int keepAliveSeconds) {
+  int pingMs = keepAliveSeconds * 500;
+  uint8_t header;
+  std::vector<uint8_t> body;
+  while (!_isClosing) {
+    if (!read(header, body, pingMs)) {
+      // Nothing arrived in time, so make sure the broker is still there
+      if (!_isClosing && _socket >= 0 && body.empty() &&
+          send(MQTT_PINGREQ, {})) {
+        continue;
+      }
+      break;
+    }
+    uint8_t type = header & 0xF0;
+    if (type == MQTT_PUBLISH && body.size() >= 2) {
+      int qos = (header >> 1) & 0x03;
+      size_t topicLength = (body[0] << 8) | body[1];
+      size_t offset = 2 + topicLength + (qos > 0 ? 2 : 0);
+      if (offset > body.size()) {
+        continue;
+      }
+      if (qos > 0) {
+        send(MQTT_PUBACK, {body[2 + topicLength], body[3 + topicLength]});
+      }
+      if (_messageHandler) {
+        _messageHandler(
+            std::string_view((const char *)body.data() + 2, topicLength),
+            std::string_view((const char *)body.data() + offset,
+                             body.size() - offset));
+      }
+    } else if (type == MQTT_PUBACK && body.size() >= 2) {
+      if (_unacknowledged > 0) {
+        _unacknowledged--;
+      }
+      if (_publishedHandler) {
+        _publishedHandler((body[0] << 8) | body[1]);
+      }
+    }
+  }
+  bool wasConnected = _isConnected.exchange(false);
+  if (wasConnected && !_isClosing && _disconnectHandler) {
+    _disconnectHandler();
+  }
+}
+
+// Send a packet
+bool NativeMqtt::send(uint8_t header, const std::vector<uint8_t> &body) {
+  std::vector<uint8_t> packet;
+  packet.reserve(body.size() + 5);
+  packet.push_back(header);
+  // Remaining length (7 bits per byte, low bits first)
+  size_t length = body.size();
+  do {
+    uint8_t digit = length & 0x7F;
+    length >>= 7;
+    packet.push_back(digit | (length > 0 ? 0x80 : 0));
+  } while (length > 0);
+  packet.insert(packet.end(), body.begin(), body.end());
+  std::lock_guard<std::mutex> lock(_sendMutex);
+  size_t sent = 0;
+  while (sent < packet.size()) {
+    ssize_t count = ::send(_socket, packet.data() + sent, packet.size() - sent,
+                           MSG_NOSIGNAL);
+    if (count <= 0) {
+      return false;
+    }
+    sent += count;
+  }
+  return true;
+}
+
+// Read one packet. A timeout leaves the body empty, and a closed connection
+// sets it to a single byte
+bool NativeMqtt::read(uint8_t &header, std::vector<uint8_t> &body,
+                      int timeoutMs) {
+  body.clear();
+  pollfd ready = {.fd = _socket, .events = POLLIN};
+  if (poll(&ready, 1, timeoutMs) <= 0) {
+    return false;
+  }
+  auto readExactly = [this](uint8_t *data, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+      ssize_t count = recv(_socket, data + received, size - received, 0);
+      if (count <= 0) {
+        return false;
+      }
+      received += count;
+    }
+    return true;
+  };
+  uint8_t digit;
+  size_t length = 0;
+  int shift = 0;
+  if (!readExactly(&header, 1)) {
+    body.push_back(0);
+    return false;
+  }
+  do {
+    if (!readExactly(&digit, 1) || shift > 21) {
+      body.push_back(0);
+      return false;
+    }
+    length |= (size_t)(digit & 0x7F) << shift;
+    shift += 7;
+  } while (digit & 0x80);
+  body.resize(length);
+  if (!readExactly(body.data(), length)) {
+    body.assign(1, 0);
+    return false;
+  }
+  return true;
+}
+
+// Take the next packet id (0 isn't allowed)
+uint16_t NativeMqtt::takePacketId(void) {
+  uint16_t id = _nextPacketId.fetch_add(1);
+  return id != 0 ? id : _nextPacketId.fetch_add(1);
+}
+
+// Close the socket
+void NativeMqtt::close(void) {
+  if (_socket >= 0) {
+    ::close(_socket);
+    _socket = -1;
+  }
+}
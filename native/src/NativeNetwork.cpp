@@ -0,0 +1,546 @@
+#include "NativeMqtt.h"
+#include "NativeShim.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <esp_event.h>
+#include <esp_netif_sntp.h>
+#include <esp_sntp.h>
+#include <esp_wifi.h>
+#include <functional>
+#include <map>
+#include <mqtt_client.h>
+#include <mutex>
+#include <nvs.h>
+#include <nvs_flash.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/time.h>
+#include <thread>
+#include <vector>
+
+// Time between attempts to reach the broker (esp-mqtt waits 10 s, which would
+// only slow down host runs)
+#define NATIVE_MQTT_RECONNECT_MS 1000
+
+// MQTT event with the topic and payload it points into
+struct NativeMqttEvent {
+  esp_mqtt_event_t event;
+  std::string topic;
+  std::string data;
+};
+
+// Registered event handler
+struct NativeHandler {
+  esp_event_base_t base;
+  int32_t id;
+  esp_event_handler_t handler;
+  void *arg;
+};
+
+/**
+ * Runs posted events on a thread of its own, one at a time (the default event
+ * loop, and the task of each MQTT client)
+ */
+class NativeEventLoop {
+public:
+  /** Register a handler for an event (or ESP_EVENT_ANY_ID) */
+  void add(esp_event_base_t base, int32_t id, esp_event_handler_t handler,
+           void *arg) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _handlers.push_back({base, id, handler, arg});
+  }
+
+  /** Post an event, with data copied into the event and handed to handlers */
+  template <typename T>
+  void post(esp_event_base_t base, int32_t id, T data) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_thread.joinable()) {
+      _thread = std::thread(&NativeEventLoop::run, this);
+    }
+    _events.push_back([this, base, id, data]() mutable {
+      dispatch(base, id, eventData(data));
+    });
+    _posted.notify_one();
+  }
+
+private:
+  std::mutex _mutex;                         // Guards the handlers and events
+  std::condition_variable _posted;           // Signals a posted event
+  std::deque<std::function<void()>> _events; // Events waiting to run
+  std::vector<NativeHandler> _handlers;      // Registered handlers
+  std::thread _thread;                       // Runs the events
+
+  /** Run events forever */
+  void run(void) {
+    while (true) {
+      std::function<void()> event;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _posted.wait(lock, [this] { return !_events.empty(); });
+        event = std::move(_events.front());
+        _events.pop_front();
+      }
+      event();
+    }
+  }
+
+  /** Data handed to the handlers of an event */
+  template <typename T> static void *eventData(T &data) { return &data; }
+
+  /** MQTT events point to their own topic and payload */
+  static void *eventData(NativeMqttEvent &data) {
+    data.event.topic = data.topic.data();
+    data.event.topic_len = data.topic.size();
+    data.event.data = data.data.data();
+    data.event.data_len = data.data.size();
+    return &data.event;
+  }
+
+  /** Call the handlers registered for an event */
+  void dispatch(esp_event_base_t base, int32_t id, void *data) {
+    std::vector<NativeHandler> handlers;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      handlers = _handlers;
+    }
+    for (NativeHandler &handler : handlers) {
+      if (handler.base == base &&
+          (handler.id == ESP_EVENT_ANY_ID || handler.id == id)) {
+        handler.handler(handler.arg, base, id, data);
+      }
+    }
+  }
+};
+
+// MQTT client connected to a real broker
+struct esp_mqtt_client {
+  std::string host;
+  uint32_t port;
+  std::string clientId;
+  NativeMqtt mqtt;
+  NativeEventLoop events;
+  bool isStarted = false;
+  std::mutex mutex;
+  std::condition_variable disconnected;
+};
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+esp_event_base_t const MQTT_EVENTS = "MQTT_EVENTS";
+
+// Default event loop
+static NativeEventLoop defaultLoop;
+
+// SNTP settings
+static uint32_t sntpInterval = 3600000;
+static bool isSntpStarted = false;
+
+// ************************ esp_event.h ************************
+
+esp_err_t esp_event_loop_create_default(void) { return ESP_OK; }
+
+esp_err_t
+esp_event_handler_instance_register(esp_event_base_t event_base,
+                                    int32_t event_id,
+                                    esp_event_handler_t event_handler,
+                                    void *event_handler_arg,
+                                    esp_event_handler_instance_t *instance) {
+  defaultLoop.add(event_base, event_id, event_handler, event_handler_arg);
+  return ESP_OK;
+}
+
+// ************************ nvs_flash.h ************************
+
+// NVS values by namespace and key
+typedef std::pair<std::string, std::string> NvsKey;
+static std::map<NvsKey, std::vector<uint8_t>> nvsValues;
+static std::mutex nvsMutex;
+static bool isNvsLoaded = false;
+
+// Read a length (32 bits) and that many bytes from the NVS file
+static bool readNvsField(FILE *file, std::string &field) {
+  uint32_t length;
+  if (fread(&length, sizeof(length), 1, file) != 1) {
+    return false;
+  }
+  field.resize(length);
+  return fread(field.data(), 1, length, file) == length;
+}
+
+// Write a length (32 bits) and its bytes to the NVS file
+static void writeNvsField(FILE *file, const void *data, uint32_t length) {
+  fwrite(&length, sizeof(length), 1, file);
+  fwrite(data, 1, length, file);
+}
+
+// Load the NVS file (a namespace, key and value per entry)
+static void loadNvs(void) {
+  const char *path = NativeShim::nvsPath();
+  FILE *file = path != NULL ? fopen(path, "rb") : NULL;
+  if (file == NULL) {
+    return;
+  }
+  std::string space, key, value;
+  while (readNvsField(file, space) && readNvsField(file, key) &&
+         readNvsField(file, value)) {
+    nvsValues[{space, key}].assign(value.begin(), value.end());
+  }
+  fclose(file);
+}
+
+// Write every value to the NVS file
+static bool saveNvs(void) {
+  const char *path = NativeShim::nvsPath();
+  if (path == NULL) {
+    return true;
+  }
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+  for (auto &[key, value] : nvsValues) {
+    writeNvsField(file, key.first.data(), key.first.size());
+    writeNvsField(file, key.second.data(), key.second.size());
+    writeNvsField(file, value.data(), value.size());
+  }
+  return fclose(file) == 0;
+}
+
+esp_err_t nvs_flash_init(void) {
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  if (!isNvsLoaded) {
+    loadNvs();
+    isNvsLoaded = true;
+  }
+  return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  nvsValues.clear();
+  return saveNvs() ? ESP_OK : ESP_FAIL;
+}
+
+// ************************ nvs.h ************************
+
+// Namespace of every opened handle (handles are their index plus one)
+static std::vector<std::string> nvsHandles;
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode,
+                   nvs_handle_t *out_handle) {
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  if (!isNvsLoaded) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  // Read only handles need the namespace to exist
+  auto first = nvsValues.lower_bound({namespace_name, ""});
+  if (open_mode == NVS_READONLY &&
+      (first == nvsValues.end() || first->first.first != namespace_name)) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+  nvsHandles.push_back(namespace_name);
+  *out_handle = nvsHandles.size();
+  return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value,
+                       size_t *length) {
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  if (handle == 0 || handle > nvsHandles.size()) {
+    return ESP_ERR_NVS_INVALID_HANDLE;
+  }
+  auto found = nvsValues.find({nvsHandles[handle - 1], key});
+  if (found == nvsValues.end()) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+  const std::vector<uint8_t> &value = found->second;
+  if (out_value != NULL) {
+    if (*length < value.size()) {
+      return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, value.data(), value.size());
+  }
+  *length = value.size();
+  return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value,
+                       size_t length) {
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  if (handle == 0 || handle > nvsHandles.size()) {
+    return ESP_ERR_NVS_INVALID_HANDLE;
+  }
+  const uint8_t *bytes = (const uint8_t *)value;
+  nvsValues[{nvsHandles[handle - 1], key}].assign(bytes, bytes + length);
+  return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  return saveNvs() ? ESP_OK : ESP_FAIL;
+}
+
+void nvs_close(nvs_handle_t handle) {}
+
+// ************************ esp_wifi.h ************************
+
+// Access point the station connects to
+static const uint8_t apBssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+// Station state
+static wifi_sta_config_t staConfig = {};
+static esp_netif_ip_info_t staticIpInfo = {};
+static esp_netif_dns_info_t dnsInfo = {};
+static std::atomic<bool> isDhcpRunning{true};
+static std::atomic<bool> isLinkUp{false};
+static std::mutex wifiMutex;
+
+// Sleep for a number of milliseconds
+static void sleepMs(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// Post the address DHCP hands out (the loopback address), after its delay
+static void postDhcpAddress(void) {
+  sleepMs(NativeShim::wifiDhcpMs());
+  if (isLinkUp && isDhcpRunning) {
+    ip_event_got_ip_t gotIp = {};
+    gotIp.ip_info.ip.addr = 0x0100007F;
+    gotIp.ip_info.netmask.addr = 0x000000FF;
+    gotIp.ip_info.gw.addr = 0x0100007F;
+    {
+      std::lock_guard<std::mutex> lock(wifiMutex);
+      dnsInfo.ip.u_addr.ip4.addr = 0x0100007F;
+    }
+    defaultLoop.post(IP_EVENT, IP_EVENT_STA_GOT_IP, gotIp);
+  }
+}
+
+esp_err_t esp_netif_init(void) { return ESP_OK; }
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void) { return NULL; }
+
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *esp_netif) {
+  if (isDhcpRunning.exchange(true)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  // A station that is already up asks for a lease right away
+  if (isLinkUp) {
+    std::thread(postDhcpAddress).detach();
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *esp_netif) {
+  return isDhcpRunning.exchange(false) ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *esp_netif,
+                                const esp_netif_ip_info_t *ip_info) {
+  if (isDhcpRunning) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  std::lock_guard<std::mutex> lock(wifiMutex);
+  staticIpInfo = *ip_info;
+  return ESP_OK;
+}
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t *esp_netif,
+                                 esp_netif_dns_type_t type,
+                                 esp_netif_dns_info_t *dns) {
+  std::lock_guard<std::mutex> lock(wifiMutex);
+  *dns = type == ESP_NETIF_DNS_MAIN ? dnsInfo : esp_netif_dns_info_t{};
+  return ESP_OK;
+}
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t *esp_netif,
+                                 esp_netif_dns_type_t type,
+                                 esp_netif_dns_info_t *dns) {
+  std::lock_guard<std::mutex> lock(wifiMutex);
+  if (type == ESP_NETIF_DNS_MAIN) {
+    dnsInfo = *dns;
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) { return ESP_OK; }
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) { return ESP_OK; }
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface,
+                              wifi_config_t *conf) {
+  std::lock_guard<std::mutex> lock(wifiMutex);
+  staConfig = conf->sta;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) {
+  defaultLoop.post(WIFI_EVENT, WIFI_EVENT_STA_START, 0);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void) {
+  wifi_sta_config_t config;
+  {
+    std::lock_guard<std::mutex> lock(wifiMutex);
+    config = staConfig;
+  }
+  isLinkUp = false;
+  std::thread([config] {
+    // A station given the channel only listens there (and only for its BSSID)
+    uint8_t channel = NativeShim::wifiChannel();
+    bool isScanning = config.channel == 0;
+    if (isScanning) {
+      sleepMs(NativeShim::wifiScanMs());
+    }
+    sleepMs(NativeShim::wifiConnectMs());
+    if (!isScanning &&
+        (config.channel != channel ||
+         (config.bssid_set && memcmp(config.bssid, apBssid, 6) != 0))) {
+      defaultLoop.post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, 0);
+      return;
+    }
+    wifi_event_sta_connected_t connected = {};
+    memcpy(connected.ssid, config.ssid, sizeof(connected.ssid));
+    connected.ssid_len = strnlen((const char *)config.ssid, 32);
+    memcpy(connected.bssid, apBssid, 6);
+    connected.channel = channel;
+    isLinkUp = true;
+    defaultLoop.post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, connected);
+    // A static address is up as soon as the station is
+    if (!isDhcpRunning) {
+      ip_event_got_ip_t gotIp = {};
+      {
+        std::lock_guard<std::mutex> lock(wifiMutex);
+        gotIp.ip_info = staticIpInfo;
+      }
+      defaultLoop.post(IP_EVENT, IP_EVENT_STA_GOT_IP, gotIp);
+    } else {
+      postDhcpAddress();
+    }
+  }).detach();
+  return ESP_OK;
+}
+
+// ************************ esp_sntp.h ************************
+
+void sntp_set_sync_interval(uint32_t interval_ms) {
+  sntpInterval = interval_ms;
+}
+
+// ************************ esp_netif_sntp.h ************************
+
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *config) {
+  if (isSntpStarted) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  isSntpStarted = true;
+  esp_sntp_time_cb_t callback = config->sync_cb;
+  std::thread([callback] {
+    while (callback != NULL) {
+      timeval now;
+      gettimeofday(&now, NULL);
+      callback(&now);
+      std::this_thread::sleep_for(std::chrono::milliseconds(sntpInterval));
+    }
+  }).detach();
+  return ESP_OK;
+}
+
+// ************************ mqtt_client.h ************************
+
+// Post an event to an MQTT client's task
+static void postMqttEvent(esp_mqtt_client_handle_t client,
+                          esp_mqtt_event_id_t id, std::string_view topic = "",
+                          std::string_view data = "", int msgId = 0) {
+  NativeMqttEvent event = {.event = {.event_id = id,
+                                     .client = client,
+                                     .msg_id = msgId},
+                           .topic = std::string(topic),
+                           .data = std::string(data)};
+  client->events.post(MQTT_EVENTS, id, std::move(event));
+}
+
+esp_mqtt_client_handle_t
+esp_mqtt_client_init(const esp_mqtt_client_config_t *config) {
+  esp_mqtt_client_handle_t client = new esp_mqtt_client;
+  client->host = config->broker.address.hostname;
+  client->port = config->broker.address.port;
+  client->clientId = config->credentials.client_id;
+  if (config->session.last_will.topic != NULL) {
+    client->mqtt.setWill(config->session.last_will.topic,
+                         config->session.last_will.msg,
+                         config->session.last_will.qos,
+                         config->session.last_will.retain != 0);
+  }
+  // Messages are handled on the client's task, like esp-mqtt
+  client->mqtt.onMessage([client](std::string_view topic,
+                                  std::string_view data) {
+    postMqttEvent(client, MQTT_EVENT_DATA, topic, data);
+  });
+  client->mqtt.onPublished([client](uint16_t msgId) {
+    postMqttEvent(client, MQTT_EVENT_PUBLISHED, "", "", msgId);
+  });
+  client->mqtt.onDisconnect([client] {
+    std::lock_guard<std::mutex> lock(client->mutex);
+    client->disconnected.notify_one();
+  });
+  return client;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+  if (client->isStarted) {
+    return ESP_FAIL;
+  }
+  client->isStarted = true;
+  std::thread([client] {
+    while (true) {
+      if (client->mqtt.connect(client->host, client->port, client->clientId)) {
+        postMqttEvent(client, MQTT_EVENT_CONNECTED);
+        std::unique_lock<std::mutex> lock(client->mutex);
+        client->disconnected.wait(
+            lock, [client] { return !client->mqtt.isConnected(); });
+        postMqttEvent(client, MQTT_EVENT_DISCONNECTED);
+      } else {
+        postMqttEvent(client, MQTT_EVENT_ERROR);
+      }
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(NATIVE_MQTT_RECONNECT_MS));
+    }
+  }).detach();
+  return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client,
+                                         esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler,
+                                         void *event_handler_arg) {
+  client->events.add(MQTT_EVENTS, event, event_handler, event_handler_arg);
+  return ESP_OK;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client,
+                              const char *topic, int qos) {
+  return client->mqtt.subscribe(topic, qos) ? 0 : -1;
+}
+
+int esp_mqtt_client_subscribe_single(esp_mqtt_client_handle_t client,
+                                     const char *topic, int qos) {
+  return esp_mqtt_client_subscribe(client, topic, qos);
+}
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic,
+                            const char *data, int len, int qos, int retain,
+                            bool store) {
+  if (len == 0 && data != NULL) {
+    len = strlen(data);
+  }
+  std::string_view payload(data != NULL ? data : "", len);
+  uint16_t msgId;
+  return client->mqtt.publish(topic, payload, qos, retain != 0, &msgId) ? msgId
+                                                                          : -1;
+}
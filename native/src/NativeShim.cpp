@@ -0,0 +1,606 @@
+#include "NativeShim.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <driver/gpio.h>
+#include <driver/ledc.h>
+#include <driver/rmt_tx.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <fcntl.h>
+#include <freertos/task.h>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <pthread.h>
+#include <string.h>
+#include <string>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+// Task control block used for task notifications
+struct NativeTask {
+  std::mutex mutex;
+  std::condition_variable notified;
+  uint32_t count = 0;
+};
+
+// esp_timer timer (a thread that waits for the expiry)
+struct NativeTimer {
+  esp_timer_cb_t callback;
+  void *arg;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::chrono::steady_clock::time_point expiry;
+  bool isRunning = false;
+  bool isDeleted = false;
+  std::thread thread;
+};
+
+// RMT transmit channel
+struct NativeRmtChannel {
+  int pin;
+  bool isEnabled = false;
+};
+
+// RMT encoder (only frames sent with a bytes encoder are pixel data)
+struct NativeRmtEncoder {
+  bool isBytes;
+};
+
+// Data partition backed by a file
+struct NativePartition {
+  esp_partition_t partition;
+  std::string path;
+};
+
+// Mapped partition region
+struct NativeMapping {
+  void *data;
+  size_t size;
+};
+
+// Recorded "hardware" state
+static uint32_t ledcDuties[LEDC_CHANNEL_MAX];
+static uint32_t ledcOutputs[LEDC_CHANNEL_MAX];
+static uint32_t gpioLevels[GPIO_NUM_MAX];
+static std::vector<uint8_t> rmtLastFrames[GPIO_NUM_MAX];
+static int ledcPins[LEDC_CHANNEL_MAX];
+
+// Output observer
+static void (*outputCallback)(int pin, uint32_t level) = NULL;
+
+// Registered partitions (a list, so partition pointers stay valid) and live
+// mappings by handle
+static std::list<NativePartition> partitions;
+static std::map<esp_partition_mmap_handle_t, NativeMapping> mappings;
+static esp_partition_mmap_handle_t nextMapping = 1;
+
+// Registered fade callbacks
+static ledc_cb_t fadeCallbacks[LEDC_CHANNEL_MAX];
+static void *fadeCallbackArgs[LEDC_CHANNEL_MAX];
+static bool fadePending[LEDC_CHANNEL_MAX];
+static bool fadeInstalled = false;
+
+// Call counters
+static uint64_t setDutyCalls = 0;
+static uint64_t updateDutyCalls = 0;
+static uint64_t setLevelCalls = 0;
+static uint64_t fadeCalls = 0;
+static uint64_t rmtFrameCount = 0;
+static uint64_t rmtByteCount = 0;
+
+// Process start time used as the native "boot" time
+static const std::chrono::steady_clock::time_point bootTime =
+    std::chrono::steady_clock::now();
+
+// Indicates if a channel number can be recorded
+static bool isValidChannel(int channel) {
+  return channel >= 0 && channel < LEDC_CHANNEL_MAX;
+}
+
+// Indicates if a pin number can be recorded
+static bool isValidPin(int pin) { return pin >= 0 && pin < GPIO_NUM_MAX; }
+
+// Report an output change to the observer
+static void reportOutput(int pin, uint32_t level) {
+  if (outputCallback != NULL) {
+    outputCallback(pin, level);
+  }
+}
+
+// ************************ NativeShim ************************
+
+void NativeShim::reset(void) {
+  for (int i = 0; i < LEDC_CHANNEL_MAX; i++) {
+    ledcDuties[i] = 0;
+    ledcOutputs[i] = 0;
+    fadePending[i] = false;
+  }
+  for (int i = 0; i < GPIO_NUM_MAX; i++) {
+    gpioLevels[i] = 0;
+    rmtLastFrames[i].clear();
+  }
+  setDutyCalls = 0;
+  updateDutyCalls = 0;
+  setLevelCalls = 0;
+  fadeCalls = 0;
+  rmtFrameCount = 0;
+  rmtByteCount = 0;
+}
+
+uint32_t NativeShim::ledcDuty(int channel) {
+  return isValidChannel(channel) ? ledcDuties[channel] : 0;
+}
+
+uint32_t NativeShim::ledcOutput(int channel) {
+  return isValidChannel(channel) ? ledcOutputs[channel] : 0;
+}
+
+uint32_t NativeShim::gpioLevel(int pin) {
+  return isValidPin(pin) ? gpioLevels[pin] : 0;
+}
+
+uint64_t NativeShim::ledcSetDutyCalls(void) { return setDutyCalls; }
+
+uint64_t NativeShim::ledcUpdateDutyCalls(void) { return updateDutyCalls; }
+
+uint64_t NativeShim::ledcFadeCalls(void) { return fadeCalls; }
+
+int NativeShim::completeFades(void) {
+  int completed = 0;
+  for (int channel = 0; channel < LEDC_CHANNEL_MAX; channel++) {
+    if (!fadePending[channel]) {
+      continue;
+    }
+    fadePending[channel] = false;
+    completed++;
+    if (fadeCallbacks[channel] != NULL) {
+      ledc_cb_param_t param = {
+          .event = LEDC_FADE_END_EVT,
+          .speed_mode = LEDC_LOW_SPEED_MODE,
+          .channel = (uint32_t)channel,
+          .duty = ledcOutputs[channel],
+      };
+      fadeCallbacks[channel](&param, fadeCallbackArgs[channel]);
+    }
+  }
+  return completed;
+}
+
+uint64_t NativeShim::gpioSetLevelCalls(void) { return setLevelCalls; }
+
+// ************************ esp_timer.h ************************
+
+int64_t esp_timer_get_time(void) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - bootTime)
+      .count();
+}
+
+// Run a timer's callback whenever it expires, until it is deleted
+static void runTimer(NativeTimer *timer) {
+  std::unique_lock<std::mutex> lock(timer->mutex);
+  while (!timer->isDeleted) {
+    if (!timer->isRunning) {
+      timer->changed.wait(lock);
+    } else if (std::chrono::steady_clock::now() < timer->expiry) {
+      timer->changed.wait_until(lock, timer->expiry);
+    } else {
+      timer->isRunning = false;
+      lock.unlock();
+      timer->callback(timer->arg);
+      lock.lock();
+    }
+  }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args,
+                           esp_timer_handle_t *out_handle) {
+  if (create_args == NULL || create_args->callback == NULL ||
+      out_handle == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  NativeTimer *timer = new NativeTimer();
+  timer->callback = create_args->callback;
+  timer->arg = create_args->arg;
+  timer->thread = std::thread(runTimer, timer);
+  *out_handle = timer;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    if (timer->isRunning) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    timer->expiry = std::chrono::steady_clock::now() +
+                    std::chrono::microseconds(timeout_us);
+    timer->isRunning = true;
+  }
+  timer->changed.notify_one();
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    if (!timer->isRunning) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    timer->isRunning = false;
+  }
+  timer->changed.notify_one();
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    timer->isDeleted = true;
+  }
+  timer->changed.notify_one();
+  timer->thread.join();
+  delete timer;
+  return ESP_OK;
+}
+
+const std::vector<uint8_t> &NativeShim::rmtFrame(int pin) {
+  static const std::vector<uint8_t> empty;
+  return isValidPin(pin) ? rmtLastFrames[pin] : empty;
+}
+
+uint64_t NativeShim::rmtFrames(void) { return rmtFrameCount; }
+
+uint64_t NativeShim::rmtBytes(void) { return rmtByteCount; }
+
+bool NativeShim::addPartition(const char *label, const char *path) {
+  struct stat info;
+  if (stat(path, &info) != 0 ||
+      strlen(label) >= sizeof(esp_partition_t::label)) {
+    return false;
+  }
+  NativePartition &added = partitions.emplace_back();
+  added.partition.type = ESP_PARTITION_TYPE_DATA;
+  added.partition.subtype = ESP_PARTITION_SUBTYPE_ANY;
+  added.partition.address = 0;
+  added.partition.size = info.st_size;
+  strcpy(added.partition.label, label);
+  added.path = path;
+  return true;
+}
+
+void NativeShim::onOutput(void (*callback)(int pin, uint32_t level)) {
+  outputCallback = callback;
+}
+
+const char *NativeShim::mqttHost(void) {
+  const char *host = getenv("MQTT_HOST");
+  return host != NULL ? host : "localhost";
+}
+
+uint32_t NativeShim::mqttPort(void) {
+  const char *port = getenv("MQTT_PORT");
+  return port != NULL ? atoi(port) : 1883;
+}
+
+const char *NativeShim::nvsPath(void) { return getenv("NVS_FILE"); }
+
+uint32_t NativeShim::wifiConnectMs(void) {
+  const char *delay = getenv("WIFI_CONNECT_MS");
+  return delay != NULL ? atoi(delay) : 0;
+}
+
+uint32_t NativeShim::wifiScanMs(void) {
+  const char *delay = getenv("WIFI_SCAN_MS");
+  return delay != NULL ? atoi(delay) : 0;
+}
+
+uint32_t NativeShim::wifiDhcpMs(void) {
+  const char *delay = getenv("WIFI_DHCP_MS");
+  return delay != NULL ? atoi(delay) : 0;
+}
+
+uint8_t NativeShim::wifiChannel(void) {
+  const char *channel = getenv("WIFI_CHANNEL");
+  return channel != NULL ? atoi(channel) : 6;
+}
+
+// ************************ freertos/task.h ************************
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *const pcName,
+                       const uint32_t usStackDepth, void *const pvParameters,
+                       UBaseType_t uxPriority,
+                       TaskHandle_t *const pxCreatedTask) {
+  // The new thread's handle only exists once the thread is running
+  std::promise<TaskHandle_t> handle;
+  std::future<TaskHandle_t> created = handle.get_future();
+  std::thread([pxTaskCode, pvParameters, &handle] {
+    handle.set_value(xTaskGetCurrentTaskHandle());
+    pxTaskCode(pvParameters);
+  }).detach();
+  TaskHandle_t task = created.get();
+  if (pxCreatedTask != NULL) {
+    *pxCreatedTask = task;
+  }
+  return pdPASS;
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay) {
+  std::this_thread::sleep_for(
+      std::chrono::milliseconds(xTicksToDelay * portTICK_PERIOD_MS));
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete) {
+  if (xTaskToDelete == NULL || xTaskToDelete == xTaskGetCurrentTaskHandle()) {
+    pthread_exit(NULL);
+  }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  static thread_local NativeTask task;
+  return &task;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit,
+                          TickType_t xTicksToWait) {
+  NativeTask *task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(task->mutex);
+  auto hasNotification = [task] { return task->count > 0; };
+  if (xTicksToWait == portMAX_DELAY) {
+    task->notified.wait(lock, hasNotification);
+  } else {
+    task->notified.wait_for(
+        lock, std::chrono::milliseconds(xTicksToWait * portTICK_PERIOD_MS),
+        hasNotification);
+  }
+  uint32_t count = task->count;
+  if (count > 0) {
+    task->count = xClearCountOnExit ? 0 : count - 1;
+  }
+  return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+  {
+    std::lock_guard<std::mutex> lock(xTaskToNotify->mutex);
+    xTaskToNotify->count++;
+  }
+  xTaskToNotify->notified.notify_one();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify,
+                            BaseType_t *pxHigherPriorityTaskWoken) {
+  xTaskNotifyGive(xTaskToNotify);
+  if (pxHigherPriorityTaskWoken != NULL) {
+    *pxHigherPriorityTaskWoken = pdFALSE;
+  }
+}
+
+// ************************ driver/gpio.h ************************
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num) {
+  if (!isValidPin(gpio_num)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  gpioLevels[gpio_num] = 0;
+  return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode) {
+  return isValidPin(gpio_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+  if (!isValidPin(gpio_num)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  setLevelCalls++;
+  gpioLevels[gpio_num] = level;
+  reportOutput(gpio_num, level);
+  return ESP_OK;
+}
+
+// ************************ driver/ledc.h ************************
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf) {
+  return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf) {
+  if (!isValidChannel(ledc_conf->channel)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  ledcDuties[ledc_conf->channel] = ledc_conf->duty;
+  ledcOutputs[ledc_conf->channel] = ledc_conf->duty;
+  ledcPins[ledc_conf->channel] = ledc_conf->gpio_num;
+  return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel,
+                        uint32_t duty) {
+  if (!isValidChannel(channel)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  setDutyCalls++;
+  ledcDuties[channel] = duty;
+  return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+  if (!isValidChannel(channel)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  updateDutyCalls++;
+  ledcOutputs[channel] = ledcDuties[channel];
+  reportOutput(ledcPins[channel], ledcOutputs[channel]);
+  return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+  return isValidChannel(channel) ? ledcOutputs[channel] : 0;
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags) {
+  if (fadeInstalled) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  fadeInstalled = true;
+  return ESP_OK;
+}
+
+void ledc_fade_func_uninstall(void) { fadeInstalled = false; }
+
+esp_err_t ledc_set_fade_time_and_start(ledc_mode_t speed_mode,
+                                       ledc_channel_t channel,
+                                       uint32_t target_duty,
+                                       uint32_t max_fade_time_ms,
+                                       ledc_fade_mode_t fade_mode) {
+  if (!fadeInstalled) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (!isValidChannel(channel)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  fadeCalls++;
+  ledcDuties[channel] = target_duty;
+  ledcOutputs[channel] = target_duty;
+  fadePending[channel] = true;
+  reportOutput(ledcPins[channel], target_duty);
+  return ESP_OK;
+}
+
+esp_err_t ledc_fade_stop(ledc_mode_t speed_mode, ledc_channel_t channel) {
+  if (!isValidChannel(channel)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  fadePending[channel] = false;
+  return ESP_OK;
+}
+
+esp_err_t ledc_cb_register(ledc_mode_t speed_mode, ledc_channel_t channel,
+                           ledc_cbs_t *cbs, void *user_arg) {
+  if (!fadeInstalled) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (!isValidChannel(channel)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  fadeCallbacks[channel] = cbs->fade_cb;
+  fadeCallbackArgs[channel] = user_arg;
+  return ESP_OK;
+}
+
+// ************************ driver/rmt_tx.h ************************
+
+esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t *config,
+                             rmt_channel_handle_t *ret_chan) {
+  if (!isValidPin(config->gpio_num)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *ret_chan = new NativeRmtChannel{config->gpio_num};
+  return ESP_OK;
+}
+
+esp_err_t rmt_new_bytes_encoder(const rmt_bytes_encoder_config_t *config,
+                                rmt_encoder_handle_t *ret_encoder) {
+  *ret_encoder = new NativeRmtEncoder{true};
+  return ESP_OK;
+}
+
+esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t *config,
+                               rmt_encoder_handle_t *ret_encoder) {
+  *ret_encoder = new NativeRmtEncoder{false};
+  return ESP_OK;
+}
+
+esp_err_t rmt_enable(rmt_channel_handle_t channel) {
+  channel->isEnabled = true;
+  return ESP_OK;
+}
+
+esp_err_t rmt_transmit(rmt_channel_handle_t tx_channel,
+                       rmt_encoder_handle_t encoder, const void *payload,
+                       size_t payload_bytes,
+                       const rmt_transmit_config_t *config) {
+  if (!tx_channel->isEnabled) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  // Frames are captured right away (transmissions finish instantly on the
+  // host)
+  if (encoder->isBytes) {
+    const uint8_t *bytes = (const uint8_t *)payload;
+    rmtLastFrames[tx_channel->pin].assign(bytes, bytes + payload_bytes);
+    rmtFrameCount++;
+    rmtByteCount += payload_bytes;
+  }
+  return ESP_OK;
+}
+
+esp_err_t rmt_tx_wait_all_done(rmt_channel_handle_t tx_channel,
+                               int timeout_ms) {
+  return ESP_OK;
+}
+
+// ************************ esp_partition.h ************************
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label) {
+  for (NativePartition &registered : partitions) {
+    esp_partition_t &partition = registered.partition;
+    if (partition.type == type &&
+        (subtype == ESP_PARTITION_SUBTYPE_ANY ||
+         partition.subtype == subtype) &&
+        (label == NULL || strcmp(partition.label, label) == 0)) {
+      return &partition;
+    }
+  }
+  return NULL;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset,
+                             size_t size, esp_partition_mmap_memory_t memory,
+                             const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle) {
+  if (partition == NULL || offset + size > partition->size || size == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  const char *path = NULL;
+  for (NativePartition &registered : partitions) {
+    if (&registered.partition == partition) {
+      path = registered.path.c_str();
+    }
+  }
+  int fd = path != NULL ? open(path, O_RDONLY) : -1;
+  if (fd < 0) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  // Map from the start of the page holding the offset (like the flash MMU)
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t start = offset - offset % page;
+  void *data = mmap(NULL, size + offset - start, PROT_READ, MAP_PRIVATE, fd,
+                    start);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return ESP_FAIL;
+  }
+  *out_ptr = (const uint8_t *)data + offset - start;
+  *out_handle = nextMapping++;
+  mappings[*out_handle] = {data, size + offset - start};
+  return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle) {
+  auto mapping = mappings.find(handle);
+  if (mapping != mappings.end()) {
+    munmap(mapping->second.data, mapping->second.size);
+    mappings.erase(mapping);
+  }
+}
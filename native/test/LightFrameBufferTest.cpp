@@ -0,0 +1,68 @@
+#include <LightFrameBuffer.h>
+#include <stdio.h>
+#include <vector>
+
+static int failures = 0;
+
+/** Takes the pending frame and compares it with the expected bytes */
+template <int Count>
+static void expect(const char *name, LightFrameBuffer<Count> &frames,
+                   std::vector<uint8_t> expected) {
+  uint8_t frame[LightFrameBuffer<Count>::SIZE];
+  size_t size = frames.take(frame);
+  if (std::vector<uint8_t>(frame, frame + size) != expected) {
+    failures++;
+    printf("FAIL %s:", name);
+    for (size_t i = 0; i < size; i++) {
+      printf(" %02x", frame[i]);
+    }
+    printf("\n");
+  }
+}
+
+// Partial frames posted before a take are merged, and a light set again takes
+// its latest level
+static void testMerge(void) {
+  LightFrameBuffer<10> frames;
+  const uint8_t first[] = {0x00, 0b00000101, 0b00, 0xFF, 0x40};
+  const uint8_t second[] = {0x01, 0b00000100, 0b10, 0x34, 0x12, 0xCD, 0xAB};
+  frames.post(first, sizeof(first));
+  frames.post(second, sizeof(second));
+  expect("merge", frames,
+         {0x01, 0b00000101, 0b10, 0xFF, 0xFF, 0x34, 0x12, 0xCD, 0xAB});
+}
+
+// Taking a frame empties the buffer
+static void testTakeEmpties(void) {
+  LightFrameBuffer<3> frames;
+  expect("nothing posted", frames, {});
+  const uint8_t frame[] = {0x00, 0b010, 0x01};
+  frames.post(frame, sizeof(frame));
+  expect("first take", frames, {0x01, 0b010, 0x01, 0x01});
+  expect("second take", frames, {});
+}
+
+// A malformed frame is rejected without changing the pending frame
+static void testMalformed(void) {
+  LightFrameBuffer<3> frames;
+  const uint8_t frame[] = {0x00, 0b001, 0x80};
+  const uint8_t stray[] = {0x00, 0b1001, 0x10, 0x20};
+  const uint8_t shortFrame[] = {0x00, 0b011, 0x10};
+  frames.post(frame, sizeof(frame));
+  if (frames.post(stray, sizeof(stray)) ||
+      frames.post(shortFrame, sizeof(shortFrame))) {
+    failures++;
+    printf("FAIL malformed: accepted\n");
+  }
+  expect("malformed", frames, {0x01, 0b001, 0x80, 0x80});
+}
+
+int main(void) {
+  testMerge();
+  testTakeEmpties();
+  testMalformed();
+  if (failures == 0) {
+    printf("All light frame buffer tests passed\n");
+  }
+  return failures == 0 ? 0 : 1;
+}
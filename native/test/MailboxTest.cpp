@@ -0,0 +1,102 @@
+#include <Mailbox.h>
+#include <stdio.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Handled channels and payloads, in handling order
+static std::vector<std::string> handled;
+static int failures = 0;
+
+/** Records the channel and payload */
+static void handle(int channel, std::string_view data) {
+  handled.push_back(std::to_string(channel) + "=" + std::string(data));
+}
+
+/** Compares the handled commands with the expected ones, and clears them */
+static void expect(const char *name, std::vector<std::string> expected) {
+  if (handled != expected) {
+    failures++;
+    printf("FAIL %s:", name);
+    for (const std::string &command : handled) {
+      printf(" %s", command.c_str());
+    }
+    printf("\n");
+  }
+  handled.clear();
+}
+
+// A channel posted to before a lower one is handled first
+static void testArrivalOrder(void) {
+  Mailbox<8, 8> mailbox;
+  for (int channel = 0; channel < 8; channel++) {
+    mailbox.on(channel, &handle);
+  }
+  mailbox.post(5, "ON");
+  mailbox.post(1, "ON");
+  mailbox.post(3);
+  mailbox.loop(Timestamp());
+  expect("arrival order", {"5=ON", "1=ON", "3="});
+}
+
+// A channel posted to again is handled once, in the place of its latest post
+// (the village's all=ON, lamps=ON, trees=ON, all=OFF burst ends with all off)
+static void testLatestPostOrder(void) {
+  Mailbox<8, 8> mailbox;
+  for (int channel = 0; channel < 8; channel++) {
+    mailbox.on(channel, &handle);
+  }
+  mailbox.post(0, "ON");
+  mailbox.post(4, "ON");
+  mailbox.post(6, "ON");
+  mailbox.post(0, "OFF");
+  mailbox.loop(Timestamp());
+  expect("latest post order", {"4=ON", "6=ON", "0=OFF"});
+}
+
+// Nothing is handled twice
+static void testDrainedOnce(void) {
+  Mailbox<8, 8> mailbox;
+  for (int channel = 0; channel < 8; channel++) {
+    mailbox.on(channel, &handle);
+  }
+  mailbox.post(2, "50");
+  mailbox.loop(Timestamp());
+  mailbox.loop(Timestamp());
+  expect("drained once", {"2=50"});
+}
+
+// Handling a payload marks the time the oldest unhandled one was posted, so
+// the scheduler pass that handles it records the latency
+static void testReceivedMark(void) {
+  Mailbox<8, 8> mailbox;
+  mailbox.on(1, &handle);
+  Metrics &metrics = Metrics::global();
+  Timestamp received;
+  metrics.takeReceived(received);
+  Timestamp before = Clock::now();
+  mailbox.post(1, "25");
+  mailbox.post(1, "50");
+  if (metrics.takeReceived(received)) {
+    failures++;
+    printf("FAIL received mark: marked before the drain\n");
+  }
+  mailbox.loop(Timestamp());
+  if (!metrics.takeReceived(received) || received < before ||
+      received > Clock::now()) {
+    failures++;
+    printf("FAIL received mark: not marked with the first post's time\n");
+  }
+  expect("received mark", {"1=50"});
+}
+
+int main(void) {
+  testArrivalOrder();
+  testLatestPostOrder();
+  testDrainedOnce();
+  testReceivedMark();
+  if (failures == 0) {
+    printf("All mailbox tests passed\n");
+  }
+  return failures == 0 ? 0 : 1;
+}
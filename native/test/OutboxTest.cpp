@@ -0,0 +1,83 @@
+#include <Outbox.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+/** Compares the sent payloads with the expected ones */
+static void expect(const char *name, const std::vector<std::string> &sent,
+                   std::vector<std::string> expected) {
+  if (sent != expected) {
+    failures++;
+    printf("FAIL %s:", name);
+    for (const std::string &payload : sent) {
+      printf(" %s", payload.c_str());
+    }
+    printf("\n");
+  }
+}
+
+// A send that fails (ex. the client's queue is full) puts the message back in
+// front, and the next flush sends it first
+static void testFailedSendKeepsOrder(void) {
+  Outbox outbox;
+  outbox.add("/a", "1", 1, false);
+  outbox.add("/a", "2", 1, false);
+  outbox.flush([](const Outbox::Message &) { return false; });
+  std::vector<std::string> sent;
+  outbox.flush([&sent](const Outbox::Message &message) {
+    sent.push_back(std::string(message.view()));
+    return true;
+  });
+  expect("failed send keeps order", sent, {"1", "2"});
+}
+
+// Another task flushing while a message is sent (ex. the MQTT task on an
+// acknowledgement) leaves the messages to the running flush, so they keep
+// their order and only one slot is out of the queue while the outbox fills up
+static void testOverlappingFlush(void) {
+  Outbox outbox;
+  outbox.add("/a", "0", 1, false);
+  outbox.add("/a", "1", 1, false);
+  std::vector<std::string> sent;
+  auto record = [&sent](const Outbox::Message &message) {
+    sent.push_back(std::string(message.view()));
+    return true;
+  };
+  bool isOverlapping = false;
+  int overlappingSent = -1;
+  outbox.flush([&](const Outbox::Message &message) {
+    if (!isOverlapping) {
+      isOverlapping = true;
+      overlappingSent = outbox.flush(record);
+      // Fill every slot while both flushes are running
+      for (int i = 2; i <= MQTT_OUTBOX_SIZE; i++) {
+        outbox.add("/a", std::to_string(i), 1, false);
+      }
+    }
+    return record(message);
+  });
+  if (overlappingSent != 0) {
+    failures++;
+    printf("FAIL overlapping flush: a second flush sent messages\n");
+  }
+  std::vector<std::string> expected;
+  for (int i = 0; i <= MQTT_OUTBOX_SIZE; i++) {
+    expected.push_back(std::to_string(i));
+  }
+  expect("overlapping flush", sent, expected);
+  if (!outbox.isEmpty()) {
+    failures++;
+    printf("FAIL overlapping flush: messages were left waiting\n");
+  }
+}
+
+int main(void) {
+  testFailedSendKeepsOrder();
+  testOverlappingFlush();
+  if (failures == 0) {
+    printf("All outbox tests passed\n");
+  }
+  return failures == 0 ? 0 : 1;
+}
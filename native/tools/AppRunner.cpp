@@ -0,0 +1,114 @@
+// Runs an application's unchanged app_main as a Linux process: the lights
+// drive the stand-in drivers, and the MQTT client connects to a real broker.
+// Linked with lego-mustang's or christmas-village's main.cpp (the lego_mustang
+// and christmas_village targets). Every change to a light's output can be
+// written to a CSV duty trace, NVS can be kept in a file across runs, and WiFi
+// can take as long to scan, connect and get an address as on a board.
+//
+// Usage: <app> [--host name] [--port number] [--seconds count]
+//              [--trace file] [--partition label=file] [--nvs file]
+//              [--wifi-delay ms] [--wifi-scan ms] [--wifi-dhcp ms]
+
+#include <NativeShim.h>
+#include <esp_timer.h>
+#include <mutex>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+// The application's entrypoint (linked from its main.cpp)
+extern "C" void app_main(void);
+
+// Duty trace (NULL when not tracing)
+static FILE *trace = NULL;
+static std::mutex traceMutex;
+
+// Write an output change to the trace (runs on the task that changed it)
+static void traceOutput(int pin, uint32_t level) {
+  int64_t now = esp_timer_get_time();
+  std::lock_guard<std::mutex> lock(traceMutex);
+  if (trace != NULL) {
+    fprintf(trace, "%lld,%d,%u\n", (long long)now, pin, (unsigned)level);
+  }
+}
+
+// Print the usage
+static int usage(void) {
+  fprintf(stderr, "usage: <app> [--host name] [--port number] "
+                  "[--seconds count] [--trace file] "
+                  "[--partition label=file] [--nvs file] "
+                  "[--wifi-delay ms] [--wifi-scan ms] [--wifi-dhcp ms]\n");
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  int seconds = 0;
+  for (int i = 1; i < argc; i += 2) {
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (value == NULL) {
+      return usage();
+    } else if (strcmp(argv[i], "--host") == 0) {
+      setenv("MQTT_HOST", value, 1);
+    } else if (strcmp(argv[i], "--port") == 0) {
+      setenv("MQTT_PORT", value, 1);
+    } else if (strcmp(argv[i], "--nvs") == 0) {
+      setenv("NVS_FILE", value, 1);
+    } else if (strcmp(argv[i], "--wifi-delay") == 0) {
+      setenv("WIFI_CONNECT_MS", value, 1);
+    } else if (strcmp(argv[i], "--wifi-scan") == 0) {
+      setenv("WIFI_SCAN_MS", value, 1);
+    } else if (strcmp(argv[i], "--wifi-dhcp") == 0) {
+      setenv("WIFI_DHCP_MS", value, 1);
+    } else if (strcmp(argv[i], "--seconds") == 0) {
+      seconds = atoi(value);
+    } else if (strcmp(argv[i], "--trace") == 0) {
+      if ((trace = fopen(value, "w")) == NULL) {
+        fprintf(stderr, "Can't write %s\n", value);
+        return 1;
+      }
+      fputs("time_us,pin,level\n", trace);
+      NativeShim::onOutput(&traceOutput);
+    } else if (strcmp(argv[i], "--partition") == 0) {
+      std::string partition = value;
+      size_t equals = partition.find('=');
+      if (equals == std::string::npos ||
+          !NativeShim::addPartition(partition.substr(0, equals).c_str(),
+                                    partition.c_str() + equals + 1)) {
+        fprintf(stderr, "Can't add the partition %s\n", value);
+        return 1;
+      }
+    } else {
+      return usage();
+    }
+  }
+
+  // app_main runs the scheduler forever, so it gets a thread of its own and
+  // this one waits for the time to run out or for Ctrl+C (the signals are
+  // blocked first so every thread created afterwards leaves them to this one)
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  std::thread(&app_main).detach();
+  if (seconds > 0) {
+    timespec timeout = {.tv_sec = seconds, .tv_nsec = 0};
+    sigtimedwait(&signals, NULL, &timeout);
+  } else {
+    int signal;
+    sigwait(&signals, &signal);
+  }
+  if (trace != NULL) {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    fclose(trace);
+    trace = NULL;
+  }
+  // The application's tasks never return
+  _exit(0);
+}
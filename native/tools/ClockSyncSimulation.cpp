@@ -0,0 +1,127 @@
+// Simulates boards whose crystals drift and whose SNTP samples arrive with
+// network delay, and prints how far apart their SyncClocks put the same
+// network time, with and without drift correction.
+//
+// Usage: clock_sync_simulation [boards] [jitter ms] [max drift ppm]
+
+#include <SyncClock.h>
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Simulated time (an hour, after the first minute of samples)
+#define SIMULATED_US 3600000000LL
+#define WARMUP_US 60000000LL
+// Network time of the simulation's start (microseconds since the Unix epoch)
+#define EPOCH_US 1733000000000000LL
+// Interval between the compared network times
+#define PROBE_US 250000LL
+
+// A simulated board
+struct Board {
+  double drift;    // Rate error of the crystal (ex. 20e-6 for 20 ppm fast)
+  double boot;     // True time the board booted at in microseconds
+  int64_t phase;   // Time from the start of each sync interval to its sample
+  SyncClock clock; // The board's clock
+
+  /** The board's local timestamp at a true time */
+  Timestamp localAt(double trueTime) {
+    return Timestamp(Duration((int64_t)((trueTime - boot) * (1 + drift))));
+  }
+
+  /** The true time the board's clock reaches a local timestamp */
+  double trueAt(Timestamp local) {
+    return local.time_since_epoch().count() / (1 + drift) + boot;
+  }
+};
+
+// Skew between the boards
+struct Result {
+  double average = 0; // Average spread of the boards in microseconds
+  double max = 0;     // Largest spread in microseconds
+  double p99 = 0;     // 99th percentile spread in microseconds
+};
+
+// Run the boards for the simulated hour and measure the spread of the true
+// times at which they reach the same network times
+static Result simulate(int count, double jitter, double maxDrift,
+                       int64_t interval, bool isCorrectingDrift) {
+  std::mt19937_64 random(1);
+  std::uniform_real_distribution<double> drifts(-maxDrift, maxDrift);
+  std::uniform_real_distribution<double> boots(0, 30e6);
+  std::uniform_int_distribution<int64_t> phases(0, interval - 1);
+  // SNTP over WiFi: the delay asymmetry of each request is mostly small, with
+  // a long tail when the channel is busy
+  std::exponential_distribution<double> delays(1 / jitter);
+  std::bernoulli_distribution signs(0.5);
+
+  std::vector<Board> boards(count);
+  for (Board &board : boards) {
+    board.drift = drifts(random) / 1e6;
+    board.boot = -boots(random);
+    board.phase = phases(random);
+    board.clock.setDriftCorrection(isCorrectingDrift);
+  }
+
+  std::vector<double> spreads;
+  Result result;
+  int64_t nextSample = 0;
+  for (int64_t now = 0; now < SIMULATED_US; now += PROBE_US) {
+    // Add the samples that arrived since the last probe
+    for (; nextSample <= now; nextSample += interval) {
+      for (Board &board : boards) {
+        double trueTime = nextSample + board.phase;
+        double error = delays(random) * (signs(random) ? 1 : -1);
+        board.clock.sample(EPOCH_US + (int64_t)(trueTime + error),
+                           board.localAt(trueTime));
+      }
+    }
+    if (now < WARMUP_US) {
+      continue;
+    }
+    // Where each board puts the next probe's network time
+    double first = INFINITY, last = -INFINITY;
+    for (Board &board : boards) {
+      double at = board.trueAt(board.clock.toLocal(EPOCH_US + now));
+      first = std::min(first, at);
+      last = std::max(last, at);
+    }
+    spreads.push_back(last - first);
+    result.average += last - first;
+    result.max = std::max(result.max, last - first);
+  }
+  result.average /= spreads.size();
+  std::sort(spreads.begin(), spreads.end());
+  result.p99 = spreads[spreads.size() * 99 / 100];
+  return result;
+}
+
+int main(int argc, char **argv) {
+  int count = argc > 1 ? atoi(argv[1]) : 8;
+  double jitter = (argc > 2 ? atof(argv[2]) : 2) * 1000;
+  double maxDrift = argc > 3 ? atof(argv[3]) : 40;
+  if (count < 2 || jitter <= 0 || maxDrift < 0) {
+    fprintf(stderr, "usage: clock_sync_simulation [boards (at least 2)] "
+                    "[jitter ms] [max drift ppm]\n");
+    return 1;
+  }
+  printf("%d boards, %.1f ms average SNTP error, drift up to %.0f ppm\n",
+         count, jitter / 1000, maxDrift);
+  printf("%-10s %-8s %12s %12s %12s\n", "interval", "drift", "average ms",
+         "p99 ms", "max ms");
+  const int64_t intervals[] = {15000000, 60000000, 300000000};
+  for (int64_t interval : intervals) {
+    for (bool isCorrectingDrift : {false, true}) {
+      Result result =
+          simulate(count, jitter, maxDrift, interval, isCorrectingDrift);
+      printf("%-10s %-8s %12.2f %12.2f %12.2f\n",
+             (std::to_string(interval / 1000000) + " s").c_str(),
+             isCorrectingDrift ? "fitted" : "ignored", result.average / 1000,
+             result.p99 / 1000, result.max / 1000);
+    }
+  }
+}
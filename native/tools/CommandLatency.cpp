@@ -0,0 +1,300 @@
+// Runs the host build of the mustang against a real broker and measures the
+// latency of its commands end to end: from publishing a command to the light's
+// output changing (commit), and to the state echo arriving back from the
+// broker (echo). Each step keeps a background load of commands on another topic
+// at a fixed rate while closed-loop probes toggle the brake lights, and prints
+// one JSON line of results.
+//
+// Usage: command_latency [--host name] [--port number] [--rates 0,50,...]
+//                        [--qos 0,1] [--probes count] [--pin number]
+//                        [--output file]
+
+#include <MqttClient.h>
+#include <NativeMqtt.h>
+#include <NativeShim.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// The mustang's entrypoint and MQTT client (linked from its main.cpp)
+extern "C" void app_main(void);
+extern MqttClient client;
+
+// Topics of the mustang
+#define STATE_TOPIC "/lego/mustang/state"
+#define PROBE_TOPIC "/lego/mustang/braking"
+#define LOAD_TOPIC "/lego/mustang/fog"
+// Longest wait for a probe's output and echo before it counts as lost
+#define PROBE_TIMEOUT_MS 1000
+// Longest random gap between probes (keeps probes off the load's cadence)
+#define PROBE_GAP_US 10000
+// Longest wait for the mustang to connect to the broker
+#define CONNECT_TIMEOUT_MS 10000
+
+typedef std::chrono::steady_clock SteadyClock;
+
+// Settings of a run
+struct Options {
+  std::string host = "localhost";
+  int port = 1883;
+  std::vector<int> rates = {0, 50, 100, 200, 500};
+  std::vector<int> qos = {0, 1};
+  int probes = 300;
+  int pin = 23; // Left inner taillight (follows braking)
+  std::string output;
+};
+
+// Latency summary in microseconds
+struct Summary {
+  double average = 0;
+  int64_t p50 = 0;
+  int64_t p99 = 0;
+  int64_t p999 = 0;
+  int64_t max = 0;
+};
+
+// What the current probe is waiting for, and when it arrived
+struct Probe {
+  std::mutex mutex;
+  std::condition_variable arrived;
+  bool isOn = false;                   // Braking state the probe sets
+  bool isActive = false;               // A probe is waiting
+  bool isCommitted = false;            // The output changed
+  bool isEchoed = false;               // The state echo arrived
+  SteadyClock::time_point committedAt; // Time the output changed
+  SteadyClock::time_point echoedAt;    // Time the state echo arrived
+};
+
+static Probe probe;
+static int probePin = 23;
+
+// Record the probe pin's output changing to the probe's level (runs on the
+// mustang's scheduler task)
+static void onOutput(int pin, uint32_t level) {
+  if (pin != probePin) {
+    return;
+  }
+  SteadyClock::time_point now = SteadyClock::now();
+  std::lock_guard<std::mutex> lock(probe.mutex);
+  if (probe.isActive && !probe.isCommitted && (level > 0) == probe.isOn) {
+    probe.committedAt = now;
+    probe.isCommitted = true;
+    probe.arrived.notify_one();
+  }
+}
+
+// Record the state echo that reports the probe's braking state (runs on the
+// tool's MQTT receive thread)
+static void onState(std::string_view topic, std::string_view data) {
+  SteadyClock::time_point now = SteadyClock::now();
+  std::lock_guard<std::mutex> lock(probe.mutex);
+  const char *expected =
+      probe.isOn ? "\"braking\":\"ON\"" : "\"braking\":\"OFF\"";
+  if (probe.isActive && !probe.isEchoed &&
+      data.find(expected) != std::string_view::npos) {
+    probe.echoedAt = now;
+    probe.isEchoed = true;
+    probe.arrived.notify_one();
+  }
+}
+
+// Summarize latencies (sorts them)
+static Summary summarize(std::vector<int64_t> &latencies) {
+  Summary summary;
+  if (latencies.empty()) {
+    return summary;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  size_t count = latencies.size();
+  for (int64_t latency : latencies) {
+    summary.average += latency;
+  }
+  summary.average /= count;
+  summary.p50 = latencies[count * 50 / 100];
+  summary.p99 = latencies[count * 99 / 100];
+  summary.p999 = latencies[count * 999 / 1000];
+  summary.max = latencies.back();
+  return summary;
+}
+
+// Write a summary as a JSON object
+static void writeSummary(FILE *file, const char *key, Summary summary) {
+  fprintf(file,
+          "\"%s\":{\"avg\":%.0f,\"p50\":%lld,\"p99\":%lld,\"p999\":%lld,"
+          "\"max\":%lld}",
+          key, summary.average, (long long)summary.p50, (long long)summary.p99,
+          (long long)summary.p999, (long long)summary.max);
+}
+
+// Publish commands on the load topic at a fixed rate until stopped
+static int runLoad(NativeMqtt &mqtt, int rate, int qos,
+                   std::atomic<bool> &isRunning) {
+  int sent = 0;
+  if (rate <= 0) {
+    return sent;
+  }
+  SteadyClock::duration interval = std::chrono::microseconds(1000000 / rate);
+  SteadyClock::time_point next = SteadyClock::now();
+  while (isRunning) {
+    mqtt.publish(LOAD_TOPIC, sent % 2 == 0 ? "ON" : "OFF", qos);
+    sent++;
+    next += interval;
+    std::this_thread::sleep_until(next);
+  }
+  return sent;
+}
+
+// Run the probes of one step and print its results
+static void runStep(NativeMqtt &mqtt, const Options &options, int rate,
+                    int qos, FILE *output) {
+  std::atomic<bool> isRunning{true};
+  int loadSent = 0;
+  std::thread load([&] { loadSent = runLoad(mqtt, rate, qos, isRunning); });
+
+  std::mt19937 random(rate * 2 + qos);
+  std::uniform_int_distribution<int> gaps(0, PROBE_GAP_US);
+  std::vector<int64_t> commits;
+  std::vector<int64_t> echoes;
+  int lost = 0;
+  for (int i = 0; i < options.probes; i++) {
+    std::unique_lock<std::mutex> lock(probe.mutex);
+    probe.isOn = !probe.isOn;
+    probe.isActive = true;
+    probe.isCommitted = false;
+    probe.isEchoed = false;
+    lock.unlock();
+    SteadyClock::time_point sentAt = SteadyClock::now();
+    mqtt.publish(PROBE_TOPIC, probe.isOn ? "ON" : "OFF", qos);
+    lock.lock();
+    bool isComplete = probe.arrived.wait_for(
+        lock, std::chrono::milliseconds(PROBE_TIMEOUT_MS),
+        [] { return probe.isCommitted && probe.isEchoed; });
+    probe.isActive = false;
+    if (isComplete) {
+      commits.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                            probe.committedAt - sentAt)
+                            .count());
+      echoes.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                           probe.echoedAt - sentAt)
+                           .count());
+    } else {
+      lost++;
+    }
+    lock.unlock();
+    std::this_thread::sleep_for(std::chrono::microseconds(gaps(random)));
+  }
+  isRunning = false;
+  load.join();
+
+  Summary commit = summarize(commits);
+  Summary echo = summarize(echoes);
+  fprintf(output, "{\"qos\":%d,\"rate\":%d,\"probes\":%d,\"lost\":%d,"
+                  "\"load_sent\":%d,",
+          qos, rate, options.probes, lost, loadSent);
+  writeSummary(output, "commit_us", commit);
+  fputc(',', output);
+  writeSummary(output, "echo_us", echo);
+  fputs("}\n", output);
+  fflush(output);
+  fprintf(stderr, "%-4d %-8d %6d %10.0f %10lld %10lld %10.0f %10lld %10lld\n",
+          qos, rate, lost, commit.average, (long long)commit.p99,
+          (long long)commit.max, echo.average, (long long)echo.p99,
+          (long long)echo.max);
+}
+
+// Parse a comma separated list of numbers
+static std::vector<int> parseList(const char *text) {
+  std::vector<int> values;
+  for (const char *start = text; *start != '\0';) {
+    values.push_back(atoi(start));
+    const char *comma = strchr(start, ',');
+    if (comma == NULL) {
+      break;
+    }
+    start = comma + 1;
+  }
+  return values;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (value != NULL && strcmp(argv[i], "--host") == 0) {
+      options.host = value;
+    } else if (value != NULL && strcmp(argv[i], "--port") == 0) {
+      options.port = atoi(value);
+    } else if (value != NULL && strcmp(argv[i], "--rates") == 0) {
+      options.rates = parseList(value);
+    } else if (value != NULL && strcmp(argv[i], "--qos") == 0) {
+      options.qos = parseList(value);
+    } else if (value != NULL && strcmp(argv[i], "--probes") == 0) {
+      options.probes = atoi(value);
+    } else if (value != NULL && strcmp(argv[i], "--pin") == 0) {
+      options.pin = atoi(value);
+    } else if (value != NULL && strcmp(argv[i], "--output") == 0) {
+      options.output = value;
+    } else {
+      fprintf(stderr, "usage: command_latency [--host name] [--port number] "
+                      "[--rates 0,50,...] [--qos 0,1] [--probes count] "
+                      "[--pin number] [--output file]\n");
+      return 1;
+    }
+    i++;
+  }
+  FILE *output = stdout;
+  if (!options.output.empty() &&
+      (output = fopen(options.output.c_str(), "w")) == NULL) {
+    fprintf(stderr, "Can't write %s\n", options.output.c_str());
+    return 1;
+  }
+
+  // Start the mustang against the broker (app_main runs the scheduler forever)
+  setenv("MQTT_HOST", options.host.c_str(), 1);
+  setenv("MQTT_PORT", std::to_string(options.port).c_str(), 1);
+  probePin = options.pin;
+  NativeShim::onOutput(&onOutput);
+  std::thread(&app_main).detach();
+  SteadyClock::time_point giveUpAt =
+      SteadyClock::now() + std::chrono::milliseconds(CONNECT_TIMEOUT_MS);
+  while (!client.isConnected() && SteadyClock::now() < giveUpAt) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  NativeMqtt mqtt;
+  mqtt.onMessage(&onState);
+  if (!client.isConnected() ||
+      !mqtt.connect(options.host, options.port, "command_latency")) {
+    fprintf(stderr, "Can't reach the broker at %s:%d\n", options.host.c_str(),
+            options.port);
+    return 1;
+  }
+  mqtt.subscribe(STATE_TOPIC, 1);
+  // Let the subscriptions and the retained messages settle
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+  fprintf(stderr, "%-4s %-8s %6s %10s %10s %10s %10s %10s %10s\n", "qos",
+          "rate", "lost", "commit avg", "p99", "max", "echo avg", "p99",
+          "max");
+  for (int qos : options.qos) {
+    for (int rate : options.rates) {
+      runStep(mqtt, options, rate, qos, output);
+    }
+  }
+  mqtt.disconnect();
+  if (output != stdout) {
+    fclose(output);
+  }
+  // The mustang's tasks never return
+  fflush(stdout);
+  _exit(0);
+}
@@ -0,0 +1,136 @@
+// Soak tests an application through the broker: publishes a list of commands
+// round robin at a fixed rate for a while, and prints every metrics snapshot
+// the application publishes in the meantime (dropped and invalid payloads,
+// scheduler pass times, latency).
+//
+// Usage: mqtt_soak [--host name] [--port number] [--rate count]
+//                  [--seconds count] [--qos 0|1] [--metrics topic] commands
+//
+// The commands file holds one command per line: its topic, a space, and its
+// payload (blank lines and lines starting with # are skipped).
+
+#include <NativeMqtt.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+typedef std::chrono::steady_clock SteadyClock;
+
+// A command: its topic and payload
+typedef std::pair<std::string, std::string> Command;
+
+// Read the commands file
+static bool readCommands(const char *path, std::vector<Command> &commands) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return false;
+  }
+  char line[1024];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    std::string text(line);
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+      text.pop_back();
+    }
+    size_t space = text.find(' ');
+    if (text.empty() || text[0] == '#' || space == std::string::npos) {
+      continue;
+    }
+    commands.emplace_back(text.substr(0, space), text.substr(space + 1));
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  std::string host = "localhost";
+  int port = 1883;
+  int rate = 1000;
+  int seconds = 60;
+  int qos = 0;
+  std::string metrics;
+  const char *path = NULL;
+  for (int i = 1; i < argc; i++) {
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (value != NULL && strcmp(argv[i], "--host") == 0) {
+      host = value;
+    } else if (value != NULL && strcmp(argv[i], "--port") == 0) {
+      port = atoi(value);
+    } else if (value != NULL && strcmp(argv[i], "--rate") == 0) {
+      rate = atoi(value);
+    } else if (value != NULL && strcmp(argv[i], "--seconds") == 0) {
+      seconds = atoi(value);
+    } else if (value != NULL && strcmp(argv[i], "--qos") == 0) {
+      qos = atoi(value);
+    } else if (value != NULL && strcmp(argv[i], "--metrics") == 0) {
+      metrics = value;
+    } else if (path == NULL && argv[i][0] != '-') {
+      path = argv[i];
+      continue;
+    } else {
+      path = NULL;
+      break;
+    }
+    i++;
+  }
+  std::vector<Command> commands;
+  if (path == NULL || rate <= 0 || seconds <= 0) {
+    fprintf(stderr, "usage: mqtt_soak [--host name] [--port number] "
+                    "[--rate count] [--seconds count] [--qos 0|1] "
+                    "[--metrics topic] commands\n");
+    return 1;
+  }
+  if (!readCommands(path, commands) || commands.empty()) {
+    fprintf(stderr, "Can't read any commands from %s\n", path);
+    return 1;
+  }
+
+  NativeMqtt mqtt;
+  mqtt.onMessage([](std::string_view topic, std::string_view data) {
+    printf("%.*s\n", (int)data.size(), data.data());
+    fflush(stdout);
+  });
+  if (!mqtt.connect(host, port, "mqtt_soak")) {
+    fprintf(stderr, "Can't reach the broker at %s:%d\n", host.c_str(), port);
+    return 1;
+  }
+  if (!metrics.empty()) {
+    mqtt.subscribe(metrics);
+  }
+
+  // Publish on a fixed cadence (sleeping once per millisecond at most, so high
+  // rates send small bursts)
+  SteadyClock::time_point start = SteadyClock::now();
+  SteadyClock::time_point end = start + std::chrono::seconds(seconds);
+  uint64_t sent = 0;
+  uint64_t failed = 0;
+  while (SteadyClock::now() < end) {
+    SteadyClock::duration elapsed = SteadyClock::now() - start;
+    uint64_t due =
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() *
+        rate / 1000000;
+    while (sent + failed < due) {
+      Command &command = commands[(sent + failed) % commands.size()];
+      if (mqtt.publish(command.first, command.second, qos)) {
+        sent++;
+      } else {
+        failed++;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  // Wait for the last QoS 1 acknowledgements
+  for (int i = 0; i < 100 && mqtt.getUnacknowledged() > 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  fprintf(stderr,
+          "%llu commands sent in %d s (%llu failed, %u unacknowledged)\n",
+          (unsigned long long)sent, seconds, (unsigned long long)failed,
+          mqtt.getUnacknowledged());
+  mqtt.disconnect();
+  return failed > 0 ? 1 : 0;
+}
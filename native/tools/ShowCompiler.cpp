@@ -0,0 +1,178 @@
+// Compiles a CSV timeline into a show file for ShowPlayer (written to a data
+// partition, or played by the host build).
+//
+// Usage: show_compiler [--fps 40] [--step] timeline.csv show.bin
+//
+// Every row of the timeline is a keyframe: a time in milliseconds followed by
+// the level (0 to 255) of every channel. Rows must be in time order, and a
+// first row that doesn't start with a number names the channels (and is
+// otherwise ignored). Lines starting with # are comments. Levels fade linearly
+// from one keyframe to the next, or jump at each keyframe with --step. The
+// show ends one frame after the last keyframe.
+
+#include <ShowEncoder.h>
+#include <ctype.h>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// A row of the timeline
+struct Keyframe {
+  double time;                // Milliseconds from the start
+  std::vector<double> levels; // Level of every channel
+};
+
+// Split a CSV line into its cells
+static std::vector<std::string> splitCells(const std::string &line) {
+  std::vector<std::string> cells;
+  std::stringstream stream(line);
+  std::string cell;
+  while (std::getline(stream, cell, ',')) {
+    cells.push_back(cell);
+  }
+  return cells;
+}
+
+// Parse a number cell
+static bool parseNumber(const std::string &cell, double &value) {
+  char *end = NULL;
+  value = strtod(cell.c_str(), &end);
+  while (end != NULL && isspace(*end)) {
+    end++;
+  }
+  return end != cell.c_str() && end != NULL && *end == '\0';
+}
+
+// Read the timeline's keyframes
+static bool readTimeline(const char *path, std::vector<Keyframe> &keyframes) {
+  std::ifstream file(path);
+  if (!file) {
+    fprintf(stderr, "can't read %s\n", path);
+    return false;
+  }
+  std::string line;
+  size_t channels = 0;
+  int number = 0;
+  while (std::getline(file, line)) {
+    number++;
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::vector<std::string> cells = splitCells(line);
+    Keyframe keyframe;
+    if (!parseNumber(cells[0], keyframe.time)) {
+      // Channel names
+      if (keyframes.empty() && channels == 0) {
+        channels = cells.size() - 1;
+        continue;
+      }
+      fprintf(stderr, "line %d: invalid time\n", number);
+      return false;
+    }
+    for (size_t i = 1; i < cells.size(); i++) {
+      double level;
+      if (!parseNumber(cells[i], level) || level < 0 || level > 255) {
+        fprintf(stderr, "line %d: invalid level %s\n", number,
+                cells[i].c_str());
+        return false;
+      }
+      keyframe.levels.push_back(level);
+    }
+    if (channels == 0) {
+      channels = keyframe.levels.size();
+    }
+    if (keyframe.levels.size() != channels || channels == 0 ||
+        channels > SHOW_MAX_CHANNELS) {
+      fprintf(stderr, "line %d: expected %zu levels\n", number, channels);
+      return false;
+    }
+    if (!keyframes.empty() && keyframe.time < keyframes.back().time) {
+      fprintf(stderr, "line %d: keyframes must be in time order\n", number);
+      return false;
+    }
+    keyframes.push_back(keyframe);
+  }
+  if (keyframes.empty()) {
+    fprintf(stderr, "%s has no keyframes\n", path);
+    return false;
+  }
+  return true;
+}
+
+// Sample the timeline at a time
+static void sample(const std::vector<Keyframe> &keyframes, double time,
+                   bool isStep, std::vector<uint8_t> &levels) {
+  size_t next = 0;
+  while (next < keyframes.size() && keyframes[next].time <= time) {
+    next++;
+  }
+  const Keyframe &from = keyframes[next == 0 ? 0 : next - 1];
+  for (size_t channel = 0; channel < levels.size(); channel++) {
+    double level = from.levels[channel];
+    if (!isStep && next > 0 && next < keyframes.size()) {
+      const Keyframe &to = keyframes[next];
+      double progress = (time - from.time) / (to.time - from.time);
+      level += (to.levels[channel] - level) * progress;
+    }
+    levels[channel] = (uint8_t)(level + 0.5);
+  }
+}
+
+int main(int argc, char **argv) {
+  double fps = 40;
+  bool isStep = false;
+  const char *paths[2] = {NULL, NULL};
+  int pathCount = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+      fps = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--step") == 0) {
+      isStep = true;
+    } else if (pathCount < 2) {
+      paths[pathCount++] = argv[i];
+    } else {
+      pathCount = 3;
+    }
+  }
+  if (pathCount != 2 || fps <= 0) {
+    fprintf(stderr, "usage: %s [--fps n] [--step] timeline.csv show.bin\n",
+            argv[0]);
+    return 1;
+  }
+
+  std::vector<Keyframe> keyframes;
+  if (!readTimeline(paths[0], keyframes)) {
+    return 1;
+  }
+  size_t channels = keyframes[0].levels.size();
+  Duration interval((int64_t)(1000000 / fps + 0.5));
+  ShowEncoder encoder(channels, interval);
+  std::vector<uint8_t> levels(channels);
+  double end = keyframes.back().time;
+  for (long frame = 0; frame * 1000 / fps <= end; frame++) {
+    sample(keyframes, frame * 1000 / fps, isStep, levels);
+    encoder.add(levels.data());
+  }
+  std::vector<uint8_t> show = encoder.build();
+
+  FILE *file = fopen(paths[1], "wb");
+  if (file == NULL ||
+      fwrite(show.data(), 1, show.size(), file) != show.size()) {
+    fprintf(stderr, "can't write %s\n", paths[1]);
+    return 1;
+  }
+  fclose(file);
+  size_t raw = channels * encoder.frames();
+  printf("%u frames of %zu channels at %.2f fps (%.2f s): %zu bytes, %.2f per "
+         "frame (%.1f%% of raw levels)\n",
+         encoder.frames(), channels, fps, encoder.frames() / fps, show.size(),
+         (double)(show.size() - SHOW_HEADER_SIZE) / encoder.frames(),
+         100.0 * (show.size() - SHOW_HEADER_SIZE) / raw);
+}
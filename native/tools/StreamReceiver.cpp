@@ -0,0 +1,83 @@
+// Receives an E1.31 or DDP light stream with the host build of LightStream and
+// prints its latency and loss statistics every second.
+//
+// Usage: stream_receiver [ddp|e131] [lights] [port]
+
+#include <Light.h>
+#include <LightStream.h>
+#include <Scheduler.h>
+#include <driver/gpio.h>
+#include <driver/ledc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Interval between printed statistics
+#define REPORT_INTERVAL millis(1000)
+
+static Scheduler scheduler;
+static std::vector<Light> lights;
+static LightStream *stream = NULL;
+
+/** Prints the stream's statistics (run by the scheduler like an effect) */
+struct StatsReporter {
+  Timestamp next = Clock::now() + REPORT_INTERVAL;
+
+  Timestamp nextDeadline(Timestamp) { return next; }
+
+  void loop(Timestamp now) {
+    StreamStats stats = stream->getStats(true);
+    double interval = stats.interval / 1000.0;
+    printf("packets %5u  frames %5u (%5.1f fps)  lost %4u (%5.2f%%)  late %3u"
+           "  ignored %3u  overruns %3u  skipped %3u  latency %6.2f ms avg"
+           " %6.2f ms max  jitter %5.2f ms  %s\n",
+           stats.packets, stats.frames, interval > 0 ? 1000.0 / interval : 0,
+           stats.lost, stats.lossRate() * 100, stats.late, stats.ignored,
+           stats.overruns, stats.skipped, stats.averageLatency() / 1000.0,
+           stats.maxLatency / 1000.0, stats.averageJitter() / 1000.0,
+           stream->isActive() ? "active" : "idle");
+    fflush(stdout);
+    next = now + REPORT_INTERVAL;
+  }
+};
+
+// Print control handovers
+static void onHandover(bool isActive) {
+  printf("stream %s the lights\n", isActive ? "took over" : "handed back");
+}
+
+int main(int argc, char **argv) {
+  StreamProtocol protocol = StreamProtocol::DDP;
+  if (argc > 1 && strcmp(argv[1], "e131") == 0) {
+    protocol = StreamProtocol::E131;
+  }
+  int count = argc > 2 ? atoi(argv[2]) : 12;
+  int port = argc > 3 ? atoi(argv[3]) : 0;
+  if (count < 1 || count > LIGHT_BANK_CAPACITY) {
+    fprintf(stderr, "lights must be between 1 and %d\n", LIGHT_BANK_CAPACITY);
+    return 1;
+  }
+
+  Light::configurePWMTimer();
+  lights.reserve(count);
+  for (int i = 0; i < count; i++) {
+    lights.emplace_back(i % GPIO_NUM_MAX, i % LEDC_CHANNEL_MAX);
+    lights.back().configure();
+  }
+  LightStream lightStream(lights.data(), count);
+  stream = &lightStream;
+  lightStream.setProtocol(protocol, port)
+      .onReceive([] { scheduler.wake(); })
+      .onHandover(&onHandover);
+  if (!lightStream.start()) {
+    perror("couldn't start the stream");
+    return 1;
+  }
+  printf("listening for %s with %d lights\n",
+         protocol == StreamProtocol::DDP ? "DDP" : "E1.31", count);
+
+  StatsReporter reporter;
+  scheduler.add(lightStream).add(LightBank::global()).add(reporter);
+  scheduler.start();
+}
@@ -0,0 +1,191 @@
+// Sends a test light stream (a ramp across the lights) in E1.31 or DDP, with
+// optional packet loss and send jitter, to exercise a LightStream receiver.
+//
+// Usage: stream_sender [--protocol ddp|e131] [--host 127.0.0.1] [--port n]
+//                      [--fps 40] [--lights 12] [--seconds 10] [--loss 0]
+//                      [--jitter 0] [--universe 1] [--priority 100]
+//
+// --loss is the fraction of packets to drop (0 to 1), and --jitter is the
+// largest random delay added to each send in milliseconds.
+
+#include <StreamPacket.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <netinet/in.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Settings from the command line
+struct Options {
+  StreamProtocol protocol = StreamProtocol::DDP;
+  const char *host = "127.0.0.1";
+  int port = 0;
+  double fps = 40;
+  int lights = 12;
+  double seconds = 10;
+  double loss = 0;
+  double jitterMs = 0;
+  int universe = 1;
+  int priority = STREAM_DEFAULT_PRIORITY;
+};
+
+/** Builds a DDP packet carrying every channel, with the push flag set */
+static std::vector<uint8_t> ddpPacket(const std::vector<uint8_t> &channels,
+                                      uint8_t sequence) {
+  std::vector<uint8_t> packet(10 + channels.size());
+  packet[0] = 0x41; // Version 1, push
+  packet[1] = sequence;
+  packet[2] = 0x01; // Data type (undefined, 8 bit)
+  packet[3] = 1;    // Default display
+  // Offset 0 (bytes 4 to 7)
+  packet[8] = (uint8_t)(channels.size() >> 8);
+  packet[9] = (uint8_t)channels.size();
+  memcpy(packet.data() + 10, channels.data(), channels.size());
+  return packet;
+}
+
+// Write a big endian 16 bit value
+static void write16(uint8_t *data, uint16_t value) {
+  data[0] = (uint8_t)(value >> 8);
+  data[1] = (uint8_t)value;
+}
+
+/** Builds an E1.31 data packet carrying every channel */
+static std::vector<uint8_t> e131Packet(const std::vector<uint8_t> &channels,
+                                       const Options &options,
+                                       uint8_t sequence, bool isTerminated) {
+  size_t size = 126 + channels.size();
+  std::vector<uint8_t> packet(size);
+  uint8_t *p = packet.data();
+  // Root layer
+  write16(p, 0x0010);
+  memcpy(p + 4, "ASC-E1.17\0\0\0", 12);
+  write16(p + 16, 0x7000 | (size - 16));
+  p[21] = 0x04;
+  memcpy(p + 22, "stream_sender-ID", 16);
+  // Framing layer
+  write16(p + 38, 0x7000 | (size - 38));
+  p[43] = 0x02;
+  snprintf((char *)p + 44, 64, "stream_sender");
+  p[108] = (uint8_t)options.priority;
+  p[111] = sequence;
+  p[112] = isTerminated ? 0x40 : 0;
+  write16(p + 113, (uint16_t)options.universe);
+  // DMP layer
+  write16(p + 115, 0x7000 | (size - 115));
+  p[117] = 0x02;
+  p[118] = 0xA1;
+  write16(p + 121, 0x0001);
+  write16(p + 123, (uint16_t)(channels.size() + 1));
+  memcpy(p + 126, channels.data(), channels.size());
+  return packet;
+}
+
+// Parse the command line
+static bool parseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *name = argv[i];
+    const char *value = argv[i + 1];
+    if (strcmp(name, "--protocol") == 0) {
+      options.protocol = strcmp(value, "e131") == 0 ? StreamProtocol::E131
+                                                    : StreamProtocol::DDP;
+    } else if (strcmp(name, "--host") == 0) {
+      options.host = value;
+    } else if (strcmp(name, "--port") == 0) {
+      options.port = atoi(value);
+    } else if (strcmp(name, "--fps") == 0) {
+      options.fps = atof(value);
+    } else if (strcmp(name, "--lights") == 0) {
+      options.lights = atoi(value);
+    } else if (strcmp(name, "--seconds") == 0) {
+      options.seconds = atof(value);
+    } else if (strcmp(name, "--loss") == 0) {
+      options.loss = atof(value);
+    } else if (strcmp(name, "--jitter") == 0) {
+      options.jitterMs = atof(value);
+    } else if (strcmp(name, "--universe") == 0) {
+      options.universe = atoi(value);
+    } else if (strcmp(name, "--priority") == 0) {
+      options.priority = atoi(value);
+    } else {
+      return false;
+    }
+  }
+  return argc % 2 == 1 && options.fps > 0 && options.lights > 0 &&
+         options.lights <= 512;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    fprintf(stderr, "usage: %s [--protocol ddp|e131] [--host address] "
+                    "[--port n] [--fps n] [--lights n] [--seconds n] "
+                    "[--loss fraction] [--jitter ms] [--universe n] "
+                    "[--priority n]\n",
+            argv[0]);
+    return 1;
+  }
+  bool isDdp = options.protocol == StreamProtocol::DDP;
+  int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port =
+      htons(options.port != 0 ? options.port : isDdp ? DDP_PORT : E131_PORT);
+  if (fd < 0 || inet_pton(AF_INET, options.host, &address.sin_addr) != 1) {
+    fprintf(stderr, "invalid host %s\n", options.host);
+    return 1;
+  }
+
+  std::mt19937 random(1);
+  std::uniform_real_distribution<double> chance(0, 1);
+  std::vector<uint8_t> channels(options.lights);
+  auto period = std::chrono::duration<double>(1 / options.fps);
+  auto start = std::chrono::steady_clock::now();
+  long frames = options.seconds * options.fps;
+  long sent = 0;
+  long dropped = 0;
+  uint8_t sequence = 0;
+  for (long frame = 0; frame < frames; frame++) {
+    std::this_thread::sleep_until(
+        start + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    period * frame));
+    if (options.jitterMs > 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(
+          (long)(chance(random) * options.jitterMs * 1000)));
+    }
+    for (int light = 0; light < options.lights; light++) {
+      channels[light] = (uint8_t)((frame * 4 + light * 16) & 0xFF);
+    }
+    // DDP sequence numbers run from 1 to 15, E1.31 from 0 to 255
+    sequence = isDdp ? sequence % 15 + 1 : (uint8_t)(sequence + 1);
+    if (chance(random) < options.loss) {
+      dropped++;
+      continue;
+    }
+    std::vector<uint8_t> packet =
+        isDdp ? ddpPacket(channels, sequence)
+              : e131Packet(channels, options, sequence, false);
+    sendto(fd, packet.data(), packet.size(), 0, (struct sockaddr *)&address,
+           sizeof(address));
+    sent++;
+  }
+  // E1.31 sources announce that they stopped with three terminated packets
+  if (!isDdp) {
+    for (int i = 0; i < 3; i++) {
+      sequence++;
+      std::vector<uint8_t> packet =
+          e131Packet(channels, options, sequence, true);
+      sendto(fd, packet.data(), packet.size(), 0,
+             (struct sockaddr *)&address, sizeof(address));
+    }
+  }
+  printf("sent %ld frames, dropped %ld (%.2f%%)\n", sent, dropped,
+         frames == 0 ? 0 : 100.0 * dropped / frames);
+  close(fd);
+}
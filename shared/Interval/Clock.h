@@ -0,0 +1,51 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "esp_timer.h"
+#include <chrono>
+#include <stdint.h>
+
+/**
+ * Clock is the time base used by every effect. It counts microseconds since
+ * boot in 64 bits (read straight from esp_timer), so effects can be timed more
+ * finely than a millisecond and timestamps never wrap during the life of the
+ * board. It follows the std::chrono clock requirements, so timestamps and
+ * durations are strongly typed and convert from other chrono units on their
+ * own (ex. `now + std::chrono::milliseconds(250)`)
+ */
+struct Clock {
+  typedef int64_t rep;
+  typedef std::micro period;
+  typedef std::chrono::duration<rep, period> duration;
+  typedef std::chrono::time_point<Clock> time_point;
+  static constexpr bool is_steady = true;
+
+  /** The current timestamp */
+  static time_point now(void) noexcept {
+    return time_point(duration(esp_timer_get_time()));
+  }
+};
+
+typedef Clock::time_point Timestamp; // A point in time on the effect clock
+typedef Clock::duration Duration;    // A span of time in microseconds
+
+// Deadline value used when nothing is scheduled (later than any timestamp)
+constexpr Timestamp NO_DEADLINE = Timestamp::max();
+
+/**
+ * Convert a duration in milliseconds (the unit used by effect settings) to a
+ * clock duration
+ * @param ms The duration in milliseconds
+ */
+constexpr Duration millis(int64_t ms) { return std::chrono::milliseconds(ms); }
+
+/**
+ * Convert a clock duration to whole milliseconds (ex. for hardware fades)
+ * @param duration The duration to convert
+ */
+constexpr int64_t toMillis(Duration duration) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(duration)
+      .count();
+}
+
+#endif
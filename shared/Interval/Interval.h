@@ -1,6 +1,8 @@
 #ifndef INTERVAL_H
 #define INTERVAL_H
 
+#include "Clock.h"
+
 #define DEFAULT_CHECK_INTERVAL 1000
 
 /**
@@ -19,7 +21,15 @@ public:
    * @param checkInterval The interval or period in milliseconds to wait before
    * returning true on a check call
    */
-  Interval(int checkInterval) : _checkInterval{checkInterval} {};
+  Interval(int checkInterval) : _checkInterval{millis(checkInterval)} {};
+
+  /**
+   * Initialize with a custom check interval that can be finer than a
+   * millisecond
+   * @param checkInterval The interval or period to wait before returning true
+   * on a check call
+   */
+  Interval(Duration checkInterval) : _checkInterval{checkInterval} {};
 
   /**
    * Reset the internal state and update the check interval if necessary
@@ -29,17 +39,26 @@ public:
    */
   void reset(int checkInterval = -1) {
     if (checkInterval >= 0) {
-      _checkInterval = checkInterval;
+      _checkInterval = millis(checkInterval);
     }
     _firstCheck = true;
   }
 
+  /**
+   * Reset the internal state and update the check interval
+   * @param checkInterval The new interval or period
+   */
+  void reset(Duration checkInterval) {
+    _checkInterval = checkInterval;
+    _firstCheck = true;
+  }
+
   /**
    * Check if the interval amount of time has passed. When the check returns
    * true, the interval resets to wait for the interval to pass again
-   * @param now Current timestamp in milliseconds
+   * @param now Current timestamp
    */
-  bool check(unsigned int now) {
+  bool check(Timestamp now) {
     if (_firstCheck || now - _lastChecked >= _checkInterval) {
       _firstCheck = false;
       _lastChecked = now;
@@ -48,12 +67,21 @@ public:
     return false;
   };
 
+  /**
+   * Get the timestamp of the next successful check
+   * @param now Current timestamp (returned if the next check will succeed right
+   * away)
+   */
+  Timestamp nextDeadline(Timestamp now) {
+    return _firstCheck ? now : _lastChecked + _checkInterval;
+  }
+
 private:
-  int _checkInterval =
-      DEFAULT_CHECK_INTERVAL;    // The check interval/period in milliseconds
-  unsigned int _lastChecked = 0; // The timestamp in milliseconds that the
-                                 // interval was last successfully checked
+  Duration _checkInterval =
+      millis(DEFAULT_CHECK_INTERVAL); // The check interval/period
+  Timestamp _lastChecked;  // The timestamp that the interval was last
+                           // successfully checked
   bool _firstCheck = true; // Indicates if it is the first check since resetting
 };
 
-#endif
\ No newline at end of file
+#endif
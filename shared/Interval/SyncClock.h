@@ -0,0 +1,193 @@
+#ifndef SYNC_CLOCK_H
+#define SYNC_CLOCK_H
+
+#include "Clock.h"
+#include <atomic>
+#include <stdint.h>
+
+#ifndef SYNC_SAMPLES
+#define SYNC_SAMPLES 8 // Time samples the clock is fitted to
+#endif
+
+#ifndef SYNC_MAX_DRIFT_PPM
+#define SYNC_MAX_DRIFT_PPM 200 // Largest drift of the local clock corrected
+#endif
+
+/**
+ * SyncClock maps the local effect clock to network time (microseconds since
+ * the Unix epoch, ex. from SNTP), so boards that share a time source can act
+ * at the same moment and run effects in phase.
+ *
+ * Each time sample is the network time at a local timestamp. The clock fits a
+ * line through the last SYNC_SAMPLES samples, which averages out the network
+ * delay of each sample and measures how fast the local crystal drifts, so the
+ * mapping stays accurate between samples. Until the first sample, network time
+ * is the local clock (so phases still line up across the effects of one
+ * board).
+ *
+ * Samples are added by one task (ex. the SNTP task), and the mapping can be
+ * read from any task without locks
+ */
+class SyncClock {
+public:
+  /** The clock shared by every effect */
+  static SyncClock &global(void) {
+    static SyncClock clock;
+    return clock;
+  }
+
+  /**
+   * Add a time sample. Only one task can add samples
+   * @param networkTime The network time in microseconds since the Unix epoch
+   * @param local The local timestamp it was received at
+   */
+  void sample(int64_t networkTime, Timestamp local) {
+    int64_t localTime = local.time_since_epoch().count();
+    _samples[_next % SYNC_SAMPLES] = {localTime, networkTime - localTime};
+    _next++;
+    int count = _next < SYNC_SAMPLES ? _next : SYNC_SAMPLES;
+    // Least squares fit of the offsets, relative to the newest sample
+    double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+    int64_t base = _samples[(_next - 1) % SYNC_SAMPLES].offset;
+    for (int i = 0; i < count; i++) {
+      double x = (double)(_samples[i].local - localTime);
+      double y = (double)(_samples[i].offset - base);
+      sumX += x;
+      sumY += y;
+      sumXX += x * x;
+      sumXY += x * y;
+    }
+    double spread = count * sumXX - sumX * sumX;
+    double slope = 0;
+    if (_isCorrectingDrift && count > 1 && spread > 0) {
+      slope = (count * sumXY - sumX * sumY) / spread;
+    }
+    double maxSlope = SYNC_MAX_DRIFT_PPM / 1e6;
+    slope = slope > maxSlope ? maxSlope : slope < -maxSlope ? -maxSlope : slope;
+    double intercept =
+        _isCorrectingDrift ? (sumY - slope * sumX) / count : 0;
+    // Publish the new mapping (readers retry if they see a partial one)
+    _sequence.fetch_add(1, std::memory_order_acq_rel);
+    _anchor.store(localTime, std::memory_order_relaxed);
+    _offset.store(base + (int64_t)intercept, std::memory_order_relaxed);
+    _ppb.store((int64_t)(slope * 1e9), std::memory_order_relaxed);
+    _sequence.fetch_add(1, std::memory_order_release);
+    _isSynced.store(true, std::memory_order_release);
+  }
+
+  /** Indicates if at least one sample was added */
+  bool isSynced(void) { return _isSynced.load(std::memory_order_acquire); }
+
+  /**
+   * Set whether the drift of the local clock is measured and corrected (true
+   * by default). Otherwise the newest sample is used as is
+   * @param isCorrectingDrift Whether to correct drift
+   */
+  void setDriftCorrection(bool isCorrectingDrift) {
+    _isCorrectingDrift = isCorrectingDrift;
+  }
+
+  /**
+   * Convert a local timestamp to network time
+   * @param local The local timestamp
+   * @returns Microseconds since the Unix epoch
+   */
+  int64_t toNetwork(Timestamp local) {
+    int64_t localTime = local.time_since_epoch().count();
+    Mapping mapping = read();
+    return localTime + mapping.offset +
+           (localTime - mapping.anchor) * mapping.ppb / 1000000000;
+  }
+
+  /**
+   * Convert network time to a local timestamp
+   * @param networkTime Microseconds since the Unix epoch
+   */
+  Timestamp toLocal(int64_t networkTime) {
+    Mapping mapping = read();
+    // The drift correction is small, so it is computed from the uncorrected
+    // local time
+    int64_t localTime = networkTime - mapping.offset;
+    localTime -= (localTime - mapping.anchor) * mapping.ppb / 1000000000;
+    return Timestamp(Duration(localTime));
+  }
+
+  /**
+   * Get the latest local timestamp (up to now) where network time is a whole
+   * number of periods, so effects started on different boards line up
+   * @param now The current timestamp
+   * @param period The period to align to
+   */
+  Timestamp lastBoundary(Timestamp now, Duration period) {
+    int64_t phase = toNetwork(now) % period.count();
+    if (phase < 0) {
+      phase += period.count();
+    }
+    return now - Duration(phase);
+  }
+
+  /**
+   * Get the first local timestamp after now where network time is a whole
+   * number of periods
+   * @param now The current timestamp
+   * @param period The period to align to
+   */
+  Timestamp nextBoundary(Timestamp now, Duration period) {
+    return lastBoundary(now, period) + period;
+  }
+
+  /**
+   * Get the number of whole periods of network time up to now (ex. to tell the
+   * high and low halves of a blink apart)
+   * @param now The current timestamp
+   * @param period The period length
+   */
+  int64_t periodIndex(Timestamp now, Duration period) {
+    int64_t network = toNetwork(now);
+    int64_t index = network / period.count();
+    return network % period.count() < 0 ? index - 1 : index;
+  }
+
+private:
+  // A time sample
+  struct Sample {
+    int64_t local;  // Local time in microseconds
+    int64_t offset; // Network time minus local time
+  };
+
+  // Mapping from local to network time
+  struct Mapping {
+    int64_t anchor; // Local time the offset was fitted at
+    int64_t offset; // Network time minus local time at the anchor
+    int64_t ppb;    // Drift of the local clock in parts per billion
+  };
+
+  // Sampling task state
+  Sample _samples[SYNC_SAMPLES] = {};
+  int _next = 0;                  // Number of samples added
+  bool _isCorrectingDrift = true; // Drift is measured
+
+  // Published mapping (a sequence lock: odd while it is written)
+  std::atomic<uint32_t> _sequence{0};
+  std::atomic<int64_t> _anchor{0};
+  std::atomic<int64_t> _offset{0};
+  std::atomic<int64_t> _ppb{0};
+  std::atomic<bool> _isSynced{false};
+
+  /** Read a consistent mapping */
+  Mapping read(void) {
+    Mapping mapping;
+    uint32_t sequence;
+    do {
+      sequence = _sequence.load(std::memory_order_acquire);
+      mapping.anchor = _anchor.load(std::memory_order_relaxed);
+      mapping.offset = _offset.load(std::memory_order_relaxed);
+      mapping.ppb = _ppb.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((sequence & 1) != 0 ||
+             sequence != _sequence.load(std::memory_order_relaxed));
+    return mapping;
+  }
+};
+
+#endif
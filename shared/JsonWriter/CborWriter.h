@@ -0,0 +1,175 @@
+#ifndef CBOR_WRITER_H
+#define CBOR_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+
+/**
+ * CborWriter builds a CBOR (RFC 8949) document in a fixed size buffer with the
+ * same chainable functions as JsonWriter, so a document can be written in
+ * either format by the same code. Objects are written as indefinite length
+ * maps, so nothing has to be counted up front, and a document that doesn't fit
+ * is flagged instead of being cut off silently
+ * @tparam Size Size of the buffer in bytes
+ */
+template <size_t Size> class CborWriter {
+  static_assert(Size >= 2, "CborWriter needs room for at least an empty map");
+
+public:
+  /** Open an object (the document itself) */
+  CborWriter &beginObject(void) {
+    append(MAP_START);
+    return *this;
+  }
+
+  /**
+   * Open an object stored under a key
+   * @param key The key in the parent object
+   */
+  CborWriter &beginObject(const char *key) {
+    writeString(key);
+    append(MAP_START);
+    return *this;
+  }
+
+  /** Close the current object */
+  CborWriter &endObject(void) {
+    append(BREAK);
+    return *this;
+  }
+
+  /**
+   * Add a string value
+   * @param key The key in the current object
+   * @param value The string value
+   */
+  CborWriter &add(const char *key, std::string_view value) {
+    writeString(key);
+    writeString(value);
+    return *this;
+  }
+
+  /** Add a string value */
+  CborWriter &add(const char *key, const char *value) {
+    return add(key, std::string_view(value));
+  }
+
+  /**
+   * Add an integer value
+   * @param key The key in the current object
+   * @param value The integer value
+   */
+  CborWriter &add(const char *key, int64_t value) {
+    writeString(key);
+    if (value < 0) {
+      writeHead(NEGATIVE, (uint64_t)(-1 - value));
+    } else {
+      writeHead(UNSIGNED, (uint64_t)value);
+    }
+    return *this;
+  }
+
+  /** Add an integer value */
+  CborWriter &add(const char *key, int value) {
+    return add(key, (int64_t)value);
+  }
+
+  /**
+   * Add a boolean value
+   * @param key The key in the current object
+   * @param value The boolean value
+   */
+  CborWriter &add(const char *key, bool value) {
+    writeString(key);
+    append(value ? TRUE_VALUE : FALSE_VALUE);
+    return *this;
+  }
+
+  /** Clear the document so the writer can be reused */
+  CborWriter &reset(void) {
+    _length = 0;
+    _isOverflowed = false;
+    return *this;
+  }
+
+  /** Indicates if everything written so far fit in the buffer */
+  bool isValid(void) const { return !_isOverflowed; }
+
+  /** The document written so far */
+  std::string_view view(void) const {
+    return std::string_view((const char *)_buffer, _length);
+  }
+
+  /** Number of bytes written */
+  size_t size(void) const { return _length; }
+
+private:
+  // Major types (the top 3 bits of an item's first byte)
+  static constexpr uint8_t UNSIGNED = 0x00;
+  static constexpr uint8_t NEGATIVE = 0x20;
+  static constexpr uint8_t TEXT = 0x60;
+
+  // Single byte items
+  static constexpr uint8_t MAP_START = 0xBF; // Indefinite length map
+  static constexpr uint8_t BREAK = 0xFF;     // End of an indefinite item
+  static constexpr uint8_t FALSE_VALUE = 0xF4;
+  static constexpr uint8_t TRUE_VALUE = 0xF5;
+
+  uint8_t _buffer[Size];      // Document
+  size_t _length = 0;         // Number of bytes written
+  bool _isOverflowed = false; // Something didn't fit in the buffer
+
+  /** Append a single byte */
+  void append(uint8_t byte) {
+    if (_length >= Size) {
+      _isOverflowed = true;
+      return;
+    }
+    _buffer[_length++] = byte;
+  }
+
+  /** Append bytes as is */
+  void appendRaw(const void *data, size_t size) {
+    if (_length + size > Size) {
+      size = Size - _length;
+      _isOverflowed = true;
+    }
+    memcpy(_buffer + _length, data, size);
+    _length += size;
+  }
+
+  /** Write an item's major type and argument (in the shortest form) */
+  void writeHead(uint8_t type, uint64_t argument) {
+    if (argument < 24) {
+      append(type | (uint8_t)argument);
+      return;
+    }
+    // 24, 25, 26 and 27 mean 1, 2, 4 and 8 argument bytes follow
+    int bytes = 8;
+    uint8_t info = 27;
+    if (argument <= 0xFF) {
+      bytes = 1;
+      info = 24;
+    } else if (argument <= 0xFFFF) {
+      bytes = 2;
+      info = 25;
+    } else if (argument <= 0xFFFFFFFF) {
+      bytes = 4;
+      info = 26;
+    }
+    append(type | info);
+    for (int i = bytes - 1; i >= 0; i--) {
+      append((uint8_t)(argument >> (i * 8)));
+    }
+  }
+
+  /** Write a text string */
+  void writeString(std::string_view value) {
+    writeHead(TEXT, value.size());
+    appendRaw(value.data(), value.size());
+  }
+};
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string_view>
+
+/**
+ * JsonWriter builds a JSON document in a fixed size buffer that lives inside
+ * the writer (ex. on the stack), so writing a document never touches the heap.
+ * Values are appended in order with chainable functions, and a document that
+ * doesn't fit is flagged instead of being cut off silently
+ * @tparam Size Size of the buffer in bytes (including the null terminator)
+ */
+template <size_t Size> class JsonWriter {
+  static_assert(Size >= 3, "JsonWriter needs room for at least \"{}\"");
+
+public:
+  JsonWriter(void) { _buffer[0] = '\0'; }
+
+  /**
+   * Open an object (the document itself, or an array item)
+   */
+  JsonWriter &beginObject(void) {
+    separate();
+    append('{');
+    _needsComma = false;
+    return *this;
+  }
+
+  /**
+   * Open an object stored under a key
+   * @param key The key in the parent object
+   */
+  JsonWriter &beginObject(const char *key) {
+    writeKey(key);
+    append('{');
+    _needsComma = false;
+    return *this;
+  }
+
+  /** Close the current object */
+  JsonWriter &endObject(void) {
+    append('}');
+    _needsComma = true;
+    return *this;
+  }
+
+  /**
+   * Add a string value (quotes, backslashes and control characters are
+   * escaped)
+   * @param key The key in the current object
+   * @param value The string value
+   */
+  JsonWriter &add(const char *key, std::string_view value) {
+    writeKey(key);
+    writeString(value);
+    return *this;
+  }
+
+  /**
+   * Add a string value
+   * @param key The key in the current object
+   * @param value Null terminated string value
+   */
+  JsonWriter &add(const char *key, const char *value) {
+    return add(key, std::string_view(value));
+  }
+
+  /**
+   * Add an integer value
+   * @param key The key in the current object
+   * @param value The integer value
+   */
+  JsonWriter &add(const char *key, int64_t value) {
+    writeKey(key);
+    char digits[24];
+    int length = snprintf(digits, sizeof(digits), "%lld", (long long)value);
+    appendRaw(std::string_view(digits, length));
+    return *this;
+  }
+
+  /** Add an integer value */
+  JsonWriter &add(const char *key, int value) {
+    return add(key, (int64_t)value);
+  }
+
+  /**
+   * Add a boolean value
+   * @param key The key in the current object
+   * @param value The boolean value
+   */
+  JsonWriter &add(const char *key, bool value) {
+    writeKey(key);
+    appendRaw(value ? "true" : "false");
+    return *this;
+  }
+
+  /**
+   * Add a member that is already serialized (ex. `"key":"value"` built at
+   * compile time). It is copied as is, so it must be valid JSON
+   * @param member The key, colon and value
+   */
+  JsonWriter &addMember(std::string_view member) {
+    separate();
+    appendRaw(member);
+    return *this;
+  }
+
+  /** Clear the document so the writer can be reused */
+  JsonWriter &reset(void) {
+    _length = 0;
+    _buffer[0] = '\0';
+    _needsComma = false;
+    _isOverflowed = false;
+    return *this;
+  }
+
+  /** Indicates if everything written so far fit in the buffer */
+  bool isValid(void) const { return !_isOverflowed; }
+
+  /** The document written so far */
+  std::string_view view(void) const {
+    return std::string_view(_buffer, _length);
+  }
+
+  /** The document written so far as a null terminated string */
+  const char *c_str(void) const { return _buffer; }
+
+  /** Number of bytes written */
+  size_t size(void) const { return _length; }
+
+private:
+  char _buffer[Size];         // Document (always null terminated)
+  size_t _length = 0;         // Number of bytes written
+  bool _needsComma = false;   // A value was written in the current object
+  bool _isOverflowed = false; // Something didn't fit in the buffer
+
+  /** Append a single character */
+  void append(char c) {
+    if (_length + 1 >= Size) {
+      _isOverflowed = true;
+      return;
+    }
+    _buffer[_length++] = c;
+    _buffer[_length] = '\0';
+  }
+
+  /** Append characters as is */
+  void appendRaw(std::string_view text) {
+    size_t size = text.size();
+    if (_length + size >= Size) {
+      size = Size - 1 - _length;
+      _isOverflowed = true;
+    }
+    memcpy(_buffer + _length, text.data(), size);
+    _length += size;
+    _buffer[_length] = '\0';
+  }
+
+  /** Write a comma if the current object already has a value */
+  void separate(void) {
+    if (_needsComma) {
+      append(',');
+    }
+    _needsComma = true;
+  }
+
+  /** Write an object key followed by a colon */
+  void writeKey(const char *key) {
+    separate();
+    writeString(key);
+    append(':');
+  }
+
+  /** Write a quoted and escaped string */
+  void writeString(std::string_view value) {
+    static const char HEX[] = "0123456789abcdef";
+    append('"');
+    for (char c : value) {
+      if (c == '"' || c == '\\') {
+        append('\\');
+        append(c);
+      } else if ((uint8_t)c < 0x20) {
+        appendRaw("\\u00");
+        append(HEX[(c >> 4) & 0xF]);
+        append(HEX[c & 0xF]);
+      } else {
+        append(c);
+      }
+    }
+    append('"');
+  }
+};
+
+#endif
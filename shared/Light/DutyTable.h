@@ -0,0 +1,139 @@
+#ifndef DUTY_TABLE_H
+#define DUTY_TABLE_H
+
+#include <array>
+#include <stdint.h>
+
+namespace DutyMath {
+/** Natural log of 2 */
+constexpr double LN_2 = 0.693147180559945309417;
+
+/**
+ * Compile-time natural logarithm for values in (0, 1]. The value is scaled
+ * into [0.5, 1] and then evaluated with the atanh series, which converges in a
+ * handful of terms in that range
+ */
+constexpr double ln(double x) {
+  int halvings = 0;
+  while (x < 0.5) {
+    x *= 2.0;
+    halvings++;
+  }
+  double z = (x - 1.0) / (x + 1.0);
+  double zSquared = z * z;
+  double term = z;
+  double sum = 0.0;
+  for (int n = 1; n < 60; n += 2) {
+    sum += term / n;
+    term *= zSquared;
+  }
+  return 2.0 * sum - halvings * LN_2;
+}
+
+/**
+ * Compile-time exponential for values <= 0. The exponent is halved until it is
+ * small, evaluated with the Taylor series and then squared back up
+ */
+constexpr double exp(double x) {
+  int squarings = 0;
+  while (x < -0.5) {
+    x /= 2.0;
+    squarings++;
+  }
+  double term = 1.0;
+  double sum = 1.0;
+  for (int n = 1; n < 30; n++) {
+    term *= x / n;
+    sum += term;
+  }
+  for (int i = 0; i < squarings; i++) {
+    sum *= sum;
+  }
+  return sum;
+}
+
+/** Compile-time x^y for x in [0, 1] and y > 0 */
+constexpr double pow(double x, double y) {
+  return x <= 0.0 ? 0.0 : x >= 1.0 ? 1.0 : exp(y * ln(x));
+}
+} // namespace DutyMath
+
+/**
+ * DutyTable maps brightness percentages (0 to 100) to PWM duty values for a
+ * given LEDC duty resolution and gamma curve. The table is generated at compile
+ * time so converting a brightness to a duty at runtime is a single lookup with
+ * no floating point math
+ * @tparam ResolutionBits The LEDC duty resolution in bits (ex. 13 for
+ * LEDC_TIMER_13_BIT)
+ * @tparam GammaTenths The gamma curve in tenths (ex. 22 for a gamma of 2.2, 10
+ * for a linear curve)
+ */
+template <unsigned int ResolutionBits, unsigned int GammaTenths>
+class DutyTable {
+  static_assert(ResolutionBits >= 1 && ResolutionBits <= 20,
+                "LEDC duty resolution must be between 1 and 20 bits");
+  static_assert(GammaTenths > 0, "Gamma must be greater than 0");
+
+public:
+  /**
+   * Duty value that is fully on. LEDC holds the output high for the whole
+   * period at 2^ResolutionBits (one count below it still drops low once per
+   * period)
+   */
+  static constexpr uint32_t MAX_LEVEL = 1u << ResolutionBits;
+
+  /** Largest brightness percentage */
+  static constexpr int MAX_PERCENTAGE = 100;
+
+  /**
+   * Convert a brightness percentage to a gamma corrected duty value
+   * @param percentage Brightness from 0 to 100 (values outside the range are
+   * clamped)
+   */
+  static constexpr uint32_t fromPercentage(int percentage) {
+    if (percentage <= 0) {
+      return 0;
+    }
+    if (percentage >= MAX_PERCENTAGE) {
+      return MAX_LEVEL;
+    }
+    return _table[percentage];
+  }
+
+  /**
+   * Convert a duty value back to the smallest brightness percentage that
+   * produces at least that duty
+   * @param level Duty value from 0 to MAX_LEVEL
+   */
+  static constexpr int toPercentage(uint32_t level) {
+    int low = 0;
+    int high = MAX_PERCENTAGE;
+    while (low < high) {
+      int middle = (low + high) / 2;
+      if (_table[middle] < level) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    return low;
+  }
+
+private:
+  /** Builds the percentage to duty lookup table */
+  static constexpr std::array<uint32_t, MAX_PERCENTAGE + 1> build(void) {
+    std::array<uint32_t, MAX_PERCENTAGE + 1> table{};
+    for (int percentage = 1; percentage <= MAX_PERCENTAGE; percentage++) {
+      double curve = DutyMath::pow((double)percentage / MAX_PERCENTAGE,
+                                   GammaTenths / 10.0);
+      uint32_t level = (uint32_t)(curve * MAX_LEVEL + 0.5);
+      // Any brightness above 0 should still produce some light
+      table[percentage] = level == 0 ? 1 : level;
+    }
+    return table;
+  }
+
+  static constexpr std::array<uint32_t, MAX_PERCENTAGE + 1> _table = build();
+};
+
+#endif
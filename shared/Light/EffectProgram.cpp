@@ -0,0 +1,179 @@
+#include "EffectProgram.h"
+
+#include <string.h>
+
+// Macros for reading operands
+#define OPERAND(data, pc, n) (data)[(pc) + (n)]
+#define OPERAND16(data, pc, n)                                                 \
+  (uint16_t)((data)[(pc) + (n)] | ((data)[(pc) + (n) + 1] << 8))
+
+// Size in bytes of an instruction
+int EffectProgram::sizeOf(uint8_t opcode) {
+  switch ((EffectOp)opcode) {
+  case EffectOp::END:
+    return 1;
+  case EffectOp::SET:
+  case EffectOp::SYNC:
+    return 2;
+  case EffectOp::WAIT:
+  case EffectOp::LOOP:
+    return 3;
+  case EffectOp::RAMP:
+    return 4;
+  }
+  return 0;
+}
+
+// Checks that a program can be run safely
+bool EffectProgram::validate(const uint8_t *data, size_t size) {
+  if (data == NULL || size > EFFECT_PROGRAM_SIZE) {
+    return false;
+  }
+  // Marks the first byte of every instruction
+  bool isStart[EFFECT_PROGRAM_SIZE] = {false};
+  int group = -1;
+  size_t pc = 0;
+  while (pc < size) {
+    int length = sizeOf(data[pc]);
+    if (length == 0 || pc + length > size) {
+      return false;
+    }
+    isStart[pc] = true;
+    EffectOp op = (EffectOp)data[pc];
+    if ((op == EffectOp::SET || op == EffectOp::RAMP) &&
+        OPERAND(data, pc, 1) > 100) {
+      return false;
+    }
+    if (op == EffectOp::SYNC) {
+      int syncGroup = OPERAND(data, pc, 1);
+      if (syncGroup >= EFFECT_SYNC_GROUPS ||
+          (group >= 0 && group != syncGroup)) {
+        return false;
+      }
+      group = syncGroup;
+    }
+    if (op == EffectOp::LOOP) {
+      size_t address = OPERAND(data, pc, 1);
+      // Loops can only jump back to the start of an earlier instruction
+      if (address >= pc || !isStart[address]) {
+        return false;
+      }
+      bool isForever = OPERAND(data, pc, 2) == EFFECT_LOOP_FOREVER;
+      bool takesTime = false;
+      for (size_t inner = address; inner < pc;
+           inner += sizeOf(data[inner])) {
+        EffectOp innerOp = (EffectOp)data[inner];
+        // A SYNC doesn't count since every light in the group could reach it
+        // at the same time
+        if ((innerOp == EffectOp::WAIT && OPERAND16(data, inner, 1) > 0) ||
+            (innerOp == EffectOp::RAMP && OPERAND16(data, inner, 2) > 0)) {
+          takesTime = true;
+        }
+        // Counted loops share a single counter, so they can't be nested
+        if (!isForever && innerOp == EffectOp::LOOP &&
+            OPERAND(data, inner, 2) != EFFECT_LOOP_FOREVER) {
+          return false;
+        }
+      }
+      if (isForever && !takesTime) {
+        return false;
+      }
+    }
+    pc += length;
+  }
+  return true;
+}
+
+// Sync group used by a (valid) program
+int EffectProgram::syncGroupOf(const uint8_t *data, size_t size) {
+  for (size_t pc = 0; pc < size; pc += sizeOf(data[pc])) {
+    if ((EffectOp)data[pc] == EffectOp::SYNC) {
+      return OPERAND(data, pc, 1);
+    }
+  }
+  return -1;
+}
+
+// Replace the program with a binary blob
+bool EffectProgram::load(const uint8_t *data, size_t size) {
+  _size = 0;
+  _isOverflowed = false;
+  if (!validate(data, size)) {
+    return false;
+  }
+  memcpy(_data, data, size);
+  _size = size;
+  return true;
+}
+
+// Append a SET instruction
+EffectProgram &EffectProgram::set(int brightness) {
+  if (brightness < 0 || brightness > 100) {
+    _isOverflowed = true;
+    return *this;
+  }
+  uint8_t instruction[] = {(uint8_t)EffectOp::SET, (uint8_t)brightness};
+  return append(instruction, sizeof(instruction));
+}
+
+// Append a RAMP instruction
+EffectProgram &EffectProgram::ramp(int brightness, int durationMs) {
+  if (brightness < 0 || brightness > 100 || durationMs < 0 ||
+      durationMs > UINT16_MAX) {
+    _isOverflowed = true;
+    return *this;
+  }
+  uint8_t instruction[] = {(uint8_t)EffectOp::RAMP, (uint8_t)brightness,
+                           (uint8_t)(durationMs & 0xFF),
+                           (uint8_t)(durationMs >> 8)};
+  return append(instruction, sizeof(instruction));
+}
+
+// Append a WAIT instruction
+EffectProgram &EffectProgram::wait(int durationMs) {
+  if (durationMs < 0 || durationMs > UINT16_MAX) {
+    _isOverflowed = true;
+    return *this;
+  }
+  uint8_t instruction[] = {(uint8_t)EffectOp::WAIT,
+                           (uint8_t)(durationMs & 0xFF),
+                           (uint8_t)(durationMs >> 8)};
+  return append(instruction, sizeof(instruction));
+}
+
+// Append a LOOP instruction
+EffectProgram &EffectProgram::loop(int count, int address) {
+  if (count < 0 || count > UINT8_MAX || address < 0 || address >= _size) {
+    _isOverflowed = true;
+    return *this;
+  }
+  uint8_t instruction[] = {(uint8_t)EffectOp::LOOP, (uint8_t)address,
+                           (uint8_t)count};
+  return append(instruction, sizeof(instruction));
+}
+
+// Append a SYNC instruction
+EffectProgram &EffectProgram::sync(int group) {
+  if (group < 0 || group >= EFFECT_SYNC_GROUPS) {
+    _isOverflowed = true;
+    return *this;
+  }
+  uint8_t instruction[] = {(uint8_t)EffectOp::SYNC, (uint8_t)group};
+  return append(instruction, sizeof(instruction));
+}
+
+// Checks if every instruction fit and the program can be run
+bool EffectProgram::isValid(void) const {
+  return !_isOverflowed && validate(_data, _size);
+}
+
+// Append an instruction
+EffectProgram &EffectProgram::append(const uint8_t *instruction, int size) {
+  if (_size + size > EFFECT_PROGRAM_SIZE) {
+    _isOverflowed = true;
+    return *this;
+  }
+  memcpy(_data + _size, instruction, size);
+  _size += size;
+  return *this;
+}
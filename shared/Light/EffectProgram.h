@@ -0,0 +1,134 @@
+#ifndef EFFECT_PROGRAM_H
+#define EFFECT_PROGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef EFFECT_PROGRAM_SIZE
+#define EFFECT_PROGRAM_SIZE 32 // Maximum size of a light's program in bytes
+#endif
+
+#ifndef EFFECT_SYNC_GROUPS
+#define EFFECT_SYNC_GROUPS 8 // Number of sync groups programs can join
+#endif
+
+#ifndef EFFECT_PROGRAM_STEPS
+#define EFFECT_PROGRAM_STEPS 16 // Instructions a light can run in one tick
+#endif
+
+static_assert(EFFECT_PROGRAM_SIZE <= 255,
+              "Program addresses must fit in a single byte");
+
+#define EFFECT_LOOP_FOREVER 0 // Loop count that repeats without end
+
+/**
+ * Effect program instructions. Every instruction is an opcode byte followed by
+ * its operands (16 bit operands are little endian)
+ */
+enum class EffectOp : uint8_t {
+  END = 0x00,  // Stop the program (the light keeps its brightness)
+  SET = 0x01,  // [brightness %] Switch to a brightness right away
+  RAMP = 0x02, // [brightness %][ms lo][ms hi] Fade to a brightness, and wait
+               // for the fade to finish
+  WAIT = 0x03, // [ms lo][ms hi] Hold the current brightness
+  LOOP = 0x04, // [address][count] Jump back to an earlier instruction count
+               // more times (EFFECT_LOOP_FOREVER repeats forever)
+  SYNC = 0x05, // [group] Wait until every light running a program in the
+               // same group reaches a SYNC instruction
+};
+
+/**
+ * EffectProgram holds a small effect in the binary format that is run by a
+ * LightBank. Programs can be built in code with the chainable instruction
+ * methods, or loaded from a binary blob (ex. an MQTT payload), in which case
+ * the blob is validated so a bad upload can never stall or crash the bank
+ */
+class EffectProgram {
+public:
+  /**
+   * Validates a binary program. A program is valid if every instruction is
+   * complete, every loop jumps back to the start of an earlier instruction,
+   * every endless loop contains a timed RAMP or WAIT (so it can't spin), and
+   * only a single sync group is used
+   * @param data The program bytes
+   * @param size Number of program bytes
+   */
+  static bool validate(const uint8_t *data, size_t size);
+
+  /** Size in bytes of an instruction, or 0 if the opcode is unknown */
+  static int sizeOf(uint8_t opcode);
+
+  /**
+   * Get the sync group a program waits on
+   * @returns The group, or -1 if the program doesn't use SYNC
+   */
+  static int syncGroupOf(const uint8_t *data, size_t size);
+
+  /**
+   * Replace the program with a binary blob
+   * @param data The program bytes
+   * @param size Number of program bytes
+   * @returns false (leaving the program empty) if the blob is too large or
+   * invalid
+   */
+  bool load(const uint8_t *data, size_t size);
+
+  /**
+   * Switch to a brightness right away
+   * @param brightness Percentage of brightness from 0 to 100
+   */
+  EffectProgram &set(int brightness);
+
+  /**
+   * Fade to a brightness and wait for the fade to finish (standard lights
+   * switch right away and then wait)
+   * @param brightness Percentage of brightness from 0 to 100
+   * @param durationMs How long the fade takes in milliseconds
+   */
+  EffectProgram &ramp(int brightness, int durationMs);
+
+  /**
+   * Hold the current brightness
+   * @param durationMs How long to wait in milliseconds
+   */
+  EffectProgram &wait(int durationMs);
+
+  /**
+   * Jump back to an earlier instruction
+   * @param count Number of extra times to run the loop (EFFECT_LOOP_FOREVER
+   * repeats forever)
+   * @param address Address of the instruction to jump to (see here())
+   */
+  EffectProgram &loop(int count = EFFECT_LOOP_FOREVER, int address = 0);
+
+  /**
+   * Wait for every other light in the sync group
+   * @param group Sync group from 0 to EFFECT_SYNC_GROUPS - 1
+   */
+  EffectProgram &sync(int group = 0);
+
+  /** Address of the next instruction (used as a loop target) */
+  int here(void) { return _size; }
+
+  /** Program bytes */
+  const uint8_t *data(void) const { return _data; }
+
+  /** Number of program bytes */
+  int size(void) const { return _size; }
+
+  /**
+   * Indicates if the program is valid (an instruction that didn't fit or had
+   * out of range operands makes the whole program invalid)
+   */
+  bool isValid(void) const;
+
+private:
+  uint8_t _data[EFFECT_PROGRAM_SIZE]; // Program bytes
+  int _size = 0;                      // Number of program bytes
+  bool _isOverflowed = false; // An instruction didn't fit or was out of range
+
+  /** Append an instruction if it fits */
+  EffectProgram &append(const uint8_t *instruction, int size);
+};
+
+#endif
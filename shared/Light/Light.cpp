@@ -1,119 +1,110 @@
 #include "Light.h"
 
-#include <driver/gpio.h>
 #include <driver/ledc.h>
-#include <math.h>
 
-// Macros for abstrating type conversions
-#define PIN (gpio_num_t) _pin
-#define CHANNEL (ledc_channel_t) _channel
-
-// Configures the global PWM timer
+// Configures the global PWM timer and the LEDC fade service
 void Light::configurePWMTimer(void) {
   ledc_timer_config_t timerConfig = {
       .speed_mode = LEDC_LOW_SPEED_MODE,
-      .duty_resolution = LEDC_TIMER_13_BIT,
+      .duty_resolution = (ledc_timer_bit_t)LIGHT_DUTY_RESOLUTION,
       .timer_num = LEDC_TIMER_0,
       .freq_hz = 4000,
       .clk_cfg = LEDC_AUTO_CLK,
   };
   ledc_timer_config(&timerConfig);
+  ledc_fade_func_install(0);
+}
+
+// Register the fade complete listener
+void Light::onFadeComplete(FadeCompleteCallback callback, void *arg) {
+  LightBank::onFadeComplete(callback, arg);
 }
 
 // Initialize standard light
-Light::Light(int pin) : _pin{pin} {};
+Light::Light(int pin, LightBank &bank)
+    : _bank{&bank}, _index{bank.add(pin, -1)} {};
 
 // Initialize dimmable light
-Light::Light(int pin, int channel) : _pin{pin}, _channel{channel} {};
+Light::Light(int pin, int channel, LightBank &bank)
+    : _bank{&bank}, _index{bank.add(pin, channel)} {};
+
+// Initialize pixel segment
+Light::Light(PixelStrip &strip, int start, int count, uint32_t color,
+             LightBank &bank)
+    : _bank{&bank}, _index{bank.add(strip, start, count, color)} {};
 
 // Setup light's GPIO pin
-void Light::configure(void) {
-  if (!_isConfigured) {
-    // Configure as standard (non dimmable)
-    if (!isDimmable()) {
-      gpio_reset_pin(PIN);
-      gpio_set_direction(PIN, GPIO_MODE_OUTPUT);
-    }
-    // Configure as PWM (dimmable)
-    else {
-      ledc_channel_config_t channelConfig = {
-          .gpio_num = _pin,
-          .speed_mode = LEDC_LOW_SPEED_MODE,
-          .channel = CHANNEL,
-          .intr_type = LEDC_INTR_DISABLE,
-          .timer_sel = LEDC_TIMER_0,
-          .duty = 0,
-          .hpoint = 0,
-      };
-      ledc_channel_config(&channelConfig);
-    }
-    _isConfigured = true;
-    // Start with the light turned off
-    off();
-  }
-};
+void Light::configure(void) { _bank->configure(_index); };
 
-// Turn on light to full brightness
+// Turn on light to a brightness percentage
 void Light::on(int brightness, bool stopEffects) {
-  // Make sure the light is configured
-  if (!_isConfigured) {
-    configure();
-  }
-  // Stop any active effects
-  if (stopEffects) {
-    _isBlinking = false;
-  }
-  // Only apply new brightness if it has changed
-  if (brightness != _currBrightness) {
-    // Update previous and current brightness values
-    _prevBrightness = _currBrightness;
-    _currBrightness = brightness;
-    // Update LED brightness based on light type
-    if (!isDimmable()) {
-      gpio_set_level(PIN, _currBrightness);
-    } else {
-      double percentage = _currBrightness == 0 ? 0.0 : _currBrightness / 100.0;
-      double duty = 8192 * percentage;
-      ledc_set_duty(LEDC_LOW_SPEED_MODE, CHANNEL, duty);
-      ledc_update_duty(LEDC_LOW_SPEED_MODE, CHANNEL);
-    }
-  }
+  brightness = brightness < 0 ? 0 : brightness > 100 ? 100 : brightness;
+  _bank->apply(_index, LightDutyTable::fromPercentage(brightness), brightness,
+               stopEffects);
 };
 
+// Turn on light to a raw brightness level
+void Light::setLevel(uint32_t level, bool stopEffects) {
+  if (level > LightDutyTable::MAX_LEVEL) {
+    level = LightDutyTable::MAX_LEVEL;
+  }
+  _bank->apply(_index, level, LightDutyTable::toPercentage(level),
+               stopEffects);
+}
+
 // Turn off light
 void Light::off(bool stopEffects) {
   // Just call the on method with a brightness of 0
   on(0, stopEffects);
 };
 
+// Change the color of a pixel segment
+void Light::setColor(uint32_t color) { _bank->setColor(_index, color); }
+
 // Toggles the state of the light
 void Light::toggle(bool stopEffects) {
-  // Just call the on method with the previous brightness
-  on(_prevBrightness, stopEffects);
+  // Just apply the previous brightness
+  _bank->apply(_index, _bank->_prevLevels[_index],
+               _bank->_prevBrightness[_index], stopEffects);
 }
 
-// Starts the blinking effect by setting various state variables
+// Fades the light to a new brightness using the LEDC fade engine
+void Light::fadeTo(int brightness, int durationMs, bool stopEffects) {
+  brightness = brightness < 0 ? 0 : brightness > 100 ? 100 : brightness;
+  _bank->fadeTo(_index, brightness, durationMs, stopEffects);
+}
+
+// Starts the blinking effect
 void Light::blink(int intervalInMs, int highBrightness, int lowBrightness) {
-  // Ignore the blink effect if the high and low settings match
-  if (highBrightness == lowBrightness) {
-    return;
+  _bank->blink(_index, millis(intervalInMs), highBrightness, lowBrightness);
+}
+
+// Starts the blinking effect with a fine interval
+void Light::blink(Duration interval, int highBrightness, int lowBrightness) {
+  _bank->blink(_index, interval, highBrightness, lowBrightness);
+}
+
+// Starts the breathing effect
+void Light::breathe(int periodInMs, int highBrightness, int lowBrightness) {
+  _bank->breathe(_index, periodInMs, highBrightness, lowBrightness);
+}
+
+// Starts running an effect program
+bool Light::run(const EffectProgram &program) {
+  if (!program.isValid()) {
+    return false;
   }
-  // Start by turning off the light
-  off();
-  // Set blinking flag so the loop function can handle the blinking effect
-  _isBlinking = true;
-  // Reset the effect interval
-  _effectInterval.reset(intervalInMs);
-  // Set updated brightness values to let the toggle function (starting with the
-  // opposite values so the first loop run will toggle to the high value)
-  _currBrightness = lowBrightness;
-  _prevBrightness = highBrightness;
+  return _bank->run(_index, program.data(), program.size());
+}
+
+// Next time the loop function has work to do
+Timestamp Light::nextDeadline(Timestamp now) {
+  return _bank->deadlineOf(_index, now);
 }
 
 // Loop function for handling lighting effects
-void Light::loop(unsigned int now) {
-  // Handle blinking effect
-  if (_isBlinking && _effectInterval.check(now)) {
-    toggle(false);
-  }
-}
\ No newline at end of file
+void Light::loop(Timestamp now) {
+  _bank->beginFrame();
+  _bank->evaluate(_index, now);
+  _bank->commitFrame();
+}
@@ -1,53 +1,110 @@
 #ifndef LIGHT_H
 #define LIGHT_H
 
+#include "LightBank.h"
 #include <Interval.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #define DEFAULT_EFFECT_INTERVAL 1000
 
 /**
  * Light is a utility class for interacting with GPIO and PWM LEDs. It comes
  * with easy methods for controlling LED brightness and state as well as
- * functionality for applying time-based lighting effects.
+ * functionality for applying time-based lighting effects. The light's state is
+ * stored in a LightBank, so a Light is only a lightweight handle that can be
+ * copied freely
  */
 class Light {
 public:
   /**
    * This function must be called before any dimmable light is configured and
-   * used otherwise the dimming effect will not work
+   * used otherwise the dimming effect will not work. It also installs the LEDC
+   * fade service used by fades and the breathing effect
    */
   static void configurePWMTimer(void);
 
+  /**
+   * Registers a function that is called from the fade end interrupt whenever
+   * any light's hardware fade finishes (ex. to wake a scheduler so the light's
+   * loop function can react)
+   * @param callback ISR safe function to call
+   * @param arg Argument passed to the callback
+   */
+  static void onFadeComplete(FadeCompleteCallback callback, void *arg = NULL);
+
   /**
    * Initialize Standard light
    * @param pin GPIO pin number
+   * @param bank The bank that stores the light's state
    */
-  Light(int pin);
+  Light(int pin, LightBank &bank = LightBank::global());
 
   /**
    * Initialize Dimmable light
    * @param pin GPIO pin number
    * @param channel PWM channel number
+   * @param bank The bank that stores the light's state
+   */
+  Light(int pin, int channel, LightBank &bank = LightBank::global());
+
+  /**
+   * Initialize a segment of pixels on an addressable strip. Segments dim in
+   * software (so they take a brightness like dimmable lights), but switch to a
+   * new brightness right away instead of fading
+   * @param strip The strip the pixels are on
+   * @param start Index of the segment's first pixel
+   * @param count Number of pixels in the segment
+   * @param color Segment color at full brightness as 0xWWRRGGBB (white is
+   * ignored by GRB pixels)
+   * @param bank The bank that stores the light's state
    */
-  Light(int pin, int channel);
+  Light(PixelStrip &strip, int start, int count, uint32_t color = 0xFFFFFF,
+        LightBank &bank = LightBank::global());
 
   /** Get current pin value */
-  int getPin() { return _pin; }
+  int getPin() { return _bank->_pins[_index]; }
 
   /** Get current pwm channel */
-  int getChannel() { return _channel; }
+  int getChannel() { return _bank->_channels[_index]; }
 
   /** Get current brightness */
-  int getBrightness() { return _currBrightness; }
+  int getBrightness() { return _bank->_currBrightness[_index]; }
+
+  /** Get current brightness level in native duty resolution */
+  uint32_t getLevel() { return _bank->_currLevels[_index]; }
 
   /** Indicates if the light is on (brightness > 0) */
-  bool isOn() { return _currBrightness > 0; }
+  bool isOn() { return getBrightness() > 0; }
 
   /** Indicates if the light is dimmable */
-  bool isDimmable() { return _channel >= 0; }
+  bool isDimmable() { return getChannel() >= 0; }
+
+  /** Indicates if the light is a segment of an addressable pixel strip */
+  bool isPixel() { return _bank->isPixel(_index); }
+
+  /** Get a pixel segment's color at full brightness (0xWWRRGGBB) */
+  uint32_t getColor() { return _bank->_colors[_index]; }
 
   /** Indicates if the light is currently blinking */
-  bool isBlinking() { return _isBlinking; }
+  bool isBlinking() { return _bank->_effects[_index] == LightEffect::BLINK; }
+
+  /** Indicates if the light is currently breathing */
+  bool isBreathing() { return _bank->_effects[_index] == LightEffect::BREATHE; }
+
+  /** Indicates if the light is currently running an effect program */
+  bool isRunning() { return _bank->_effects[_index] == LightEffect::PROGRAM; }
+
+  /** Indicates if a hardware fade is currently running */
+  bool isFading() {
+    return _bank->_isFading[_index] && !_bank->_fadeDone[_index];
+  }
+
+  /** Get the bank that stores the light's state */
+  LightBank &getBank() { return *_bank; }
+
+  /** Get the light's index in its bank */
+  int getIndex() { return _index; }
 
   /**
    * Configure the light's pin and pwm channel if necessary
@@ -61,12 +118,27 @@ public:
    */
   void on(int brightness = 100, bool stopEffects = true);
 
+  /**
+   * Turn on the light using a raw brightness level in the native PWM duty
+   * resolution. The level is written as is (no gamma correction is applied)
+   * @param level Brightness level from 0 to LightDutyTable::MAX_LEVEL
+   * @param stopEffects Whether to stop any active effects
+   */
+  void setLevel(uint32_t level, bool stopEffects = true);
+
   /**
    * Turn off the light (will also stop any active effect)
    * @param stopEffects Whether to stop any active effects
    */
   void off(bool stopEffects = true);
 
+  /**
+   * Change the color of a pixel segment, keeping its brightness (ignored by
+   * other lights)
+   * @param color Color at full brightness as 0xWWRRGGBB
+   */
+  void setColor(uint32_t color);
+
   /**
    * Toggle the light between current and previous brightness values
    * @param stopEffects Whether to stop any active effects
@@ -83,22 +155,70 @@ public:
   void blink(int intervalInMs = DEFAULT_EFFECT_INTERVAL,
              int highBrightness = 100, int lowBrightness = 0);
 
+  /**
+   * Starts the blinking effect with an interval that can be finer than a
+   * millisecond
+   * @param interval The interval used to toggle between on and off
+   * @param highBrightness How bright the light should be in the "high" state
+   * @param lowBrightness How bright the light should be in the "low" state
+   */
+  void blink(Duration interval, int highBrightness = 100,
+             int lowBrightness = 0);
+
+  /**
+   * Fade the light to a new brightness in the background using the LEDC fade
+   * engine (standard lights switch to the new brightness right away)
+   * @param brightness Percentage of brightness from 0 to 100
+   * @param durationMs How long the fade should take in milliseconds
+   * @param stopEffects Whether to stop any active effects
+   */
+  void fadeTo(int brightness, int durationMs, bool stopEffects = true);
+
+  /**
+   * Starts the breathing effect, which continuously fades between the high and
+   * low brightness using the LEDC fade engine. (must call the loop function to
+   * reverse each fade when it finishes). Standard lights blink instead
+   * @param periodInMs The time for one full cycle from high to low and back
+   * @param highBrightness How bright the light should be at the top of a breath
+   * @param lowBrightness How bright the light should be at the bottom of a
+   * breath
+   */
+  void breathe(int periodInMs = DEFAULT_EFFECT_INTERVAL * 2,
+               int highBrightness = 100, int lowBrightness = 0);
+
+  /**
+   * Starts running an effect program (must call the loop function, or tick the
+   * light's bank, to step through the program in the background)
+   * @param program The program to run (copied into the light's bank)
+   * @returns false if the program is invalid
+   */
+  bool run(const EffectProgram &program);
+
+  /**
+   * Get the timestamp of the next time the loop function has work to do
+   * @param now The current timestamp
+   * @returns The deadline, or NO_DEADLINE if the light is idle (or waiting on a
+   * hardware fade to finish)
+   */
+  Timestamp nextDeadline(Timestamp now);
+
+  /**
+   * Called by the LEDC fade end interrupt when a hardware fade finishes.
+   * Shouldn't be called directly by the user
+   */
+  void __onFadeComplete__(void) { _bank->_fadeDone[_index] = true; }
+
   /**
    * Loop function that should be called as frequently as possible to run light
    * effects in the background. This function does not need to be called if no
-   * effects are used
-   * @param now The current timestamp in milliseconds
+   * effects are used, or if the light's bank is ticked instead
+   * @param now The current timestamp
    */
-  void loop(unsigned int now);
+  void loop(Timestamp now);
 
 private:
-  int _pin;                   // GPIO pin
-  int _channel = -1;          // PWM channel
-  int _currBrightness = 0;    // Current brightness percentage
-  int _prevBrightness = 100;  // Previous brightness percentage
-  bool _isConfigured = false; // Indicates if the light has been configured
-  bool _isBlinking = false;   // Indicates if the blinking effect is active
-  Interval _effectInterval;   // Interval to use for the current effect
+  LightBank *_bank; // Bank that stores the light's state
+  int _index;       // Index of the light in the bank
 };
 
-#endif
\ No newline at end of file
+#endif
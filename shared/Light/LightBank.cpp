@@ -0,0 +1,690 @@
+#include "LightBank.h"
+
+#include <SyncClock.h>
+#include <algorithm>
+#include <assert.h>
+#include <driver/gpio.h>
+#include <driver/ledc.h>
+#include <esp_attr.h>
+#include <esp_cpu.h>
+#include <string.h>
+
+// Macros for abstrating type conversions
+#define PIN(index) (gpio_num_t) _pins[index]
+#define CHANNEL(index) (ledc_channel_t) _channels[index]
+
+// Macros for reading program operands
+#define OPERAND(index, n) _programs[index][_pcs[index] + (n)]
+#define OPERAND16(index, n)                                                    \
+  (uint16_t)(OPERAND(index, n) | (OPERAND(index, (n) + 1) << 8))
+
+#define NO_LOOP 0xFF // No counted loop is active
+
+/**
+ * Scale each byte of a 0xWWRRGGBB pixel color by a brightness level (the level
+ * is already gamma corrected, so pixels follow the same curve as PWM lights)
+ */
+static uint32_t dim(uint32_t color, uint32_t level) {
+  uint32_t dimmed = 0;
+  for (int shift = 0; shift < 32; shift += 8) {
+    uint32_t value = (color >> shift) & 0xFF;
+    value = (value * level + LightDutyTable::MAX_LEVEL / 2) /
+            LightDutyTable::MAX_LEVEL;
+    dimmed |= value << shift;
+  }
+  return dimmed;
+}
+
+// Fade complete listener shared by all banks
+static FadeCompleteCallback fadeCompleteCallback = NULL;
+static void *fadeCompleteCallbackArg = NULL;
+
+/**
+ * Handles the LEDC fade end interrupt and forwards it to the bank that owns
+ * the channel. Runs in ISR context so it only flags the completion for the
+ * bank's tick function to pick up
+ * @param param The fade event parameters
+ * @param arg This will be an instance of the bank
+ */
+static bool IRAM_ATTR fadeCompleteHandler(const ledc_cb_param_t *param,
+                                          void *arg) {
+  if (param->event == LEDC_FADE_END_EVT) {
+    LightBank *bank = (LightBank *)arg;
+    bank->__onFadeComplete__(param->channel);
+    if (fadeCompleteCallback != NULL) {
+      return fadeCompleteCallback(fadeCompleteCallbackArg);
+    }
+  }
+  return false;
+}
+
+// Global bank used by lights by default
+LightBank &LightBank::global(void) {
+  static LightBank bank;
+  return bank;
+}
+
+// Register the fade complete listener
+void LightBank::onFadeComplete(FadeCompleteCallback callback, void *arg) {
+  fadeCompleteCallbackArg = arg;
+  fadeCompleteCallback = callback;
+}
+
+// Create an empty bank
+LightBank::LightBank(void) {
+  for (int channel = 0; channel < LIGHT_CHANNEL_MAX; channel++) {
+    _channelOwners[channel] = -1;
+  }
+  for (int group = 0; group < EFFECT_SYNC_GROUPS; group++) {
+    _syncMembers[group] = 0;
+    _syncWaiting[group] = 0;
+    _syncGeneration[group] = 0;
+  }
+}
+
+// Add a light to the bank
+int LightBank::add(int pin, int channel) {
+  assert(_count < LIGHT_BANK_CAPACITY);
+  int index = _count++;
+  _pins[index] = pin;
+  _channels[index] = channel;
+  _strips[index] = NULL;
+  _pixelStarts[index] = 0;
+  _pixelCounts[index] = 0;
+  _colors[index] = 0;
+  _currBrightness[index] = 0;
+  _prevBrightness[index] = 100;
+  _currLevels[index] = 0;
+  _prevLevels[index] = LightDutyTable::MAX_LEVEL;
+  _effects[index] = LightEffect::NONE;
+  _deadlines[index] = NO_DEADLINE;
+  _periods[index] = Duration::zero();
+  _effectHigh[index] = 100;
+  _effectLow[index] = 0;
+  _isConfigured[index] = false;
+  _isRestarting[index] = false;
+  _isFading[index] = false;
+  _fadeDone[index] = false;
+  _isFadeStaged[index] = false;
+  _fadeDurations[index] = 0;
+  _isDirty[index] = false;
+  _programSizes[index] = 0;
+  _pcs[index] = 0;
+  _loopCounts[index] = 0;
+  _loopOwners[index] = NO_LOOP;
+  _syncGroups[index] = -1;
+  _syncWaits[index] = 0;
+  _isSyncing[index] = false;
+  return index;
+}
+
+// Add a pixel segment to the bank
+int LightBank::add(PixelStrip &strip, int start, int count, uint32_t color) {
+  int index = add(strip.getPin(), -1);
+  _strips[index] = &strip;
+  _pixelStarts[index] = start;
+  _pixelCounts[index] = count;
+  _colors[index] = color;
+  // Remember the strip so it can be shown when a frame is committed
+  for (int i = 0; i < _stripCount; i++) {
+    if (_stripList[i] == &strip) {
+      return index;
+    }
+  }
+  assert(_stripCount < LIGHT_BANK_STRIPS);
+  _stripList[_stripCount++] = &strip;
+  return index;
+}
+
+// Setup a light's GPIO pin, PWM channel or pixel strip
+void LightBank::configure(int index) {
+  if (_isConfigured[index]) {
+    return;
+  }
+  // Configure as a pixel segment (the strip is shared by many lights)
+  if (isPixel(index)) {
+    _strips[index]->configure();
+  }
+  // Configure as standard (non dimmable)
+  else if (!isDimmable(index)) {
+    gpio_reset_pin(PIN(index));
+    gpio_set_direction(PIN(index), GPIO_MODE_OUTPUT);
+  }
+  // Configure as PWM (dimmable)
+  else {
+    ledc_channel_config_t channelConfig = {
+        .gpio_num = _pins[index],
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .channel = CHANNEL(index),
+        .intr_type = LEDC_INTR_DISABLE,
+        .timer_sel = LEDC_TIMER_0,
+        .duty = 0,
+        .hpoint = 0,
+    };
+    ledc_channel_config(&channelConfig);
+    // Listen for hardware fades finishing
+    if (_channels[index] < LIGHT_CHANNEL_MAX) {
+      _channelOwners[_channels[index]] = index;
+    }
+    ledc_cbs_t callbacks = {.fade_cb = &fadeCompleteHandler};
+    ledc_cb_register(LEDC_LOW_SPEED_MODE, CHANNEL(index), &callbacks, this);
+  }
+  _isConfigured[index] = true;
+  // Start with the light turned off
+  apply(index, 0, 0, true);
+}
+
+// Apply a brightness level to a light
+void LightBank::apply(int index, uint32_t level, int brightness,
+                      bool stopEffects) {
+  // Make sure the light is configured
+  if (!_isConfigured[index]) {
+    configure(index);
+  }
+  // Stop any active effects
+  if (stopEffects) {
+    setEffect(index, LightEffect::NONE);
+  }
+  // Outside of a frame this is a frame of its own, so it is written right away
+  beginFrame();
+  stage(index, level, brightness);
+  commitFrame();
+}
+
+// Start a blinking effect
+void LightBank::blink(int index, Duration interval, int highBrightness,
+                      int lowBrightness) {
+  // Ignore the blink effect if the high and low settings match
+  if (highBrightness == lowBrightness) {
+    return;
+  }
+  // Start by turning off the light
+  apply(index, 0, 0, true);
+  // Set the effect so the tick function can handle the blinking effect, with
+  // the first toggle due on the next tick
+  setEffect(index, LightEffect::BLINK);
+  _periods[index] = interval;
+  _effectHigh[index] = highBrightness;
+  _effectLow[index] = lowBrightness;
+  _isRestarting[index] = true;
+  // Set updated brightness values to let the toggle (starting with the
+  // opposite values so the first tick will toggle to the high value)
+  _currBrightness[index] = lowBrightness;
+  _prevBrightness[index] = highBrightness;
+  _currLevels[index] = LightDutyTable::fromPercentage(lowBrightness);
+  _prevLevels[index] = LightDutyTable::fromPercentage(highBrightness);
+}
+
+// Fade a light to a new brightness
+void LightBank::fadeTo(int index, int brightness, int durationMs,
+                       bool stopEffects) {
+  // Make sure the light is configured
+  if (!_isConfigured[index]) {
+    configure(index);
+  }
+  // Stop any active effects
+  if (stopEffects) {
+    setEffect(index, LightEffect::NONE);
+  }
+  uint32_t level = LightDutyTable::fromPercentage(brightness);
+  // Standard lights can't fade, so the brightness is applied right away
+  if (!isDimmable(index) || durationMs <= 0) {
+    apply(index, level, brightness, false);
+    return;
+  }
+  // Ignore the fade if the light is already at (or fading to) the target
+  if (brightness == _currBrightness[index] && level == _currLevels[index]) {
+    return;
+  }
+  startFade(index, level, brightness, durationMs);
+}
+
+// Start a breathing effect
+void LightBank::breathe(int index, int periodInMs, int highBrightness,
+                        int lowBrightness) {
+  // Ignore the breathing effect if the high and low settings match
+  if (highBrightness == lowBrightness) {
+    return;
+  }
+  // Make sure the light is configured
+  if (!_isConfigured[index]) {
+    configure(index);
+  }
+  // Standard lights can't fade, so fall back to blinking at the same rate
+  if (!isDimmable(index)) {
+    blink(index, millis(periodInMs) / 2, highBrightness, lowBrightness);
+    return;
+  }
+  // Save the effect settings so the tick function can reverse each fade
+  setEffect(index, LightEffect::BREATHE);
+  _effectHigh[index] = highBrightness;
+  _effectLow[index] = lowBrightness;
+  _periods[index] = millis(periodInMs / 2);
+  // Start by fading from the current brightness to the high brightness
+  startFade(index, LightDutyTable::fromPercentage(highBrightness),
+            highBrightness, periodInMs / 2);
+}
+
+// Start a hardware fade
+void LightBank::startFade(int index, uint32_t level, int brightness,
+                          int durationMs) {
+  beginFrame();
+  stopFade(index);
+  _prevBrightness[index] = _currBrightness[index];
+  _prevLevels[index] = _currLevels[index];
+  _currBrightness[index] = brightness;
+  _currLevels[index] = level;
+  // The fade replaces any brightness waiting to be committed
+  _isFadeStaged[index] = true;
+  _fadeDurations[index] = durationMs;
+  markDirty(index);
+  commitFrame();
+}
+
+// Stop a hardware fade if one is running (or drop a staged one)
+bool LightBank::stopFade(int index) {
+  if (_isFadeStaged[index]) {
+    _isFadeStaged[index] = false;
+    return true;
+  }
+  if (!_isFading[index]) {
+    return false;
+  }
+  _isFading[index] = false;
+  _fadeDone[index] = false;
+  ledc_fade_stop(LEDC_LOW_SPEED_MODE, CHANNEL(index));
+  return true;
+}
+
+// Swap a light's current and previous brightness
+void LightBank::swap(int index) {
+  uint8_t brightness = _currBrightness[index];
+  _currBrightness[index] = _prevBrightness[index];
+  _prevBrightness[index] = brightness;
+  uint32_t level = _currLevels[index];
+  _currLevels[index] = _prevLevels[index];
+  _prevLevels[index] = level;
+}
+
+// Run a light's effect if it is due
+void LightBank::evaluate(int index, Timestamp now) {
+  // Handle blinking effect
+  if (_effects[index] == LightEffect::BLINK) {
+    bool isStarting = _isRestarting[index];
+    if (isStarting) {
+      _isRestarting[index] = false;
+      _deadlines[index] = now;
+    }
+    if (now >= _deadlines[index]) {
+      SyncClock &clock = SyncClock::global();
+      if (clock.isSynced()) {
+        // Boards sharing network time blink in phase: the light is high during
+        // even periods of network time, and toggles on period boundaries
+        bool isHigh = clock.periodIndex(now, _periods[index]) % 2 == 0;
+        _deadlines[index] = clock.nextBoundary(now, _periods[index]);
+        if (_currBrightness[index] !=
+            (isHigh ? _effectHigh[index] : _effectLow[index])) {
+          swap(index);
+          markDirty(index);
+        } else if (isStarting) {
+          // Starting in a low period (blink() turned the light off)
+          markDirty(index);
+        }
+      } else {
+        _deadlines[index] = now + _periods[index];
+        swap(index);
+        markDirty(index);
+      }
+    }
+  }
+  // Handle effect programs
+  else if (_effects[index] == LightEffect::PROGRAM) {
+    execute(index, now);
+  }
+  // Handle a hardware fade finishing
+  if (_isFading[index] && _fadeDone[index]) {
+    _isFading[index] = false;
+    _fadeDone[index] = false;
+    // Handle breathing effect by fading back the other way
+    if (_effects[index] == LightEffect::BREATHE) {
+      int target = _currBrightness[index] == _effectHigh[index]
+                       ? _effectLow[index]
+                       : _effectHigh[index];
+      startFade(index, LightDutyTable::fromPercentage(target), target,
+                toMillis(_periods[index]));
+    }
+  }
+}
+
+// Start running an effect program
+bool LightBank::run(int index, const uint8_t *data, size_t size) {
+  if (index < 0 || index >= _count || !EffectProgram::validate(data, size)) {
+    return false;
+  }
+  // Make sure the light is configured
+  if (!_isConfigured[index]) {
+    configure(index);
+  }
+  // Stop the active effect first so an old program leaves its sync group
+  setEffect(index, LightEffect::NONE);
+  memcpy(_programs[index], data, size);
+  _programSizes[index] = size;
+  _pcs[index] = 0;
+  _loopOwners[index] = NO_LOOP;
+  _isSyncing[index] = false;
+  _syncGroups[index] = EffectProgram::syncGroupOf(data, size);
+  if (_syncGroups[index] >= 0) {
+    _syncMembers[_syncGroups[index]]++;
+  }
+  // The first instruction runs on the next tick
+  _effects[index] = LightEffect::PROGRAM;
+  _isRestarting[index] = true;
+  return true;
+}
+
+// Switch a light's active effect
+void LightBank::setEffect(int index, LightEffect effect) {
+  if (_effects[index] == LightEffect::PROGRAM && _syncGroups[index] >= 0) {
+    int group = _syncGroups[index];
+    _syncGroups[index] = -1;
+    _syncMembers[group]--;
+    if (_isSyncing[index]) {
+      _isSyncing[index] = false;
+      _syncWaiting[group]--;
+    }
+    // The lights left waiting may have only been waiting on this one
+    if (_syncWaiting[group] > 0 &&
+        _syncWaiting[group] == _syncMembers[group]) {
+      release(group);
+    }
+  }
+  _effects[index] = effect;
+}
+
+// Stage a new brightness for the commit pass
+void LightBank::stage(int index, uint32_t level, int brightness) {
+  // A fade in progress is stopped, which leaves the output somewhere between
+  // the old and new levels, so it has to be written even if nothing changed
+  bool interrupted = stopFade(index);
+  bool changed =
+      brightness != _currBrightness[index] || level != _currLevels[index];
+  if (changed) {
+    _prevBrightness[index] = _currBrightness[index];
+    _prevLevels[index] = _currLevels[index];
+    _currBrightness[index] = brightness;
+    _currLevels[index] = level;
+  }
+  // Only write a new brightness if the output actually changes
+  if (interrupted ||
+      (changed &&
+       (!isDimmable(index) || _prevLevels[index] != _currLevels[index]))) {
+    markDirty(index);
+  }
+}
+
+// Change the color of a pixel segment
+void LightBank::setColor(int index, uint32_t color) {
+  if (!isPixel(index) || color == _colors[index]) {
+    return;
+  }
+  _colors[index] = color;
+  beginFrame();
+  markDirty(index);
+  commitFrame();
+}
+
+// Flag a light to be written when the frame is committed
+void LightBank::markDirty(int index) {
+  if (!_isDirty[index]) {
+    _isDirty[index] = true;
+    _dirtyLights[_dirtyCount++] = index;
+  }
+}
+
+// Run a light's program until it waits or finishes
+void LightBank::execute(int index, Timestamp now) {
+  if (_isRestarting[index]) {
+    _isRestarting[index] = false;
+    _deadlines[index] = now;
+  }
+  // Continue once every light in the group has reached the SYNC
+  if (_isSyncing[index]) {
+    if (_syncWaits[index] == _syncGeneration[_syncGroups[index]]) {
+      return;
+    }
+    _isSyncing[index] = false;
+    _deadlines[index] = now;
+  }
+  if (now < _deadlines[index]) {
+    return;
+  }
+  for (int steps = 0; steps < EFFECT_PROGRAM_STEPS; steps++) {
+    // Running past the last instruction ends the program
+    if (_pcs[index] >= _programSizes[index]) {
+      setEffect(index, LightEffect::NONE);
+      return;
+    }
+    switch ((EffectOp)OPERAND(index, 0)) {
+    case EffectOp::SET: {
+      int brightness = OPERAND(index, 1);
+      stage(index, LightDutyTable::fromPercentage(brightness), brightness);
+      _pcs[index] += 2;
+      break;
+    }
+    case EffectOp::RAMP: {
+      int brightness = OPERAND(index, 1);
+      int durationMs = OPERAND16(index, 2);
+      uint32_t level = LightDutyTable::fromPercentage(brightness);
+      if (isDimmable(index) && durationMs > 0) {
+        startFade(index, level, brightness, durationMs);
+      } else {
+        stage(index, level, brightness);
+      }
+      // Deadlines advance from the previous deadline so programs don't drift
+      _deadlines[index] += millis(durationMs);
+      _pcs[index] += 4;
+      if (durationMs > 0) {
+        return;
+      }
+      break;
+    }
+    case EffectOp::WAIT: {
+      int durationMs = OPERAND16(index, 1);
+      _deadlines[index] += millis(durationMs);
+      _pcs[index] += 3;
+      if (durationMs > 0) {
+        return;
+      }
+      break;
+    }
+    case EffectOp::LOOP: {
+      int address = OPERAND(index, 1);
+      int count = OPERAND(index, 2);
+      if (count != EFFECT_LOOP_FOREVER) {
+        // Start counting the first time the loop is reached
+        if (_loopOwners[index] != _pcs[index]) {
+          _loopOwners[index] = _pcs[index];
+          _loopCounts[index] = count;
+        }
+        if (_loopCounts[index] == 0) {
+          _loopOwners[index] = NO_LOOP;
+          _pcs[index] += 3;
+          break;
+        }
+        _loopCounts[index]--;
+      }
+      _pcs[index] = address;
+      break;
+    }
+    case EffectOp::SYNC: {
+      int group = _syncGroups[index];
+      _pcs[index] += 2;
+      _syncWaiting[group]++;
+      // The last light to arrive releases the others and keeps going
+      if (_syncWaiting[group] == _syncMembers[group]) {
+        release(group);
+        _deadlines[index] = now;
+        break;
+      }
+      _isSyncing[index] = true;
+      _syncWaits[index] = _syncGeneration[group];
+      return;
+    }
+    case EffectOp::END:
+    default:
+      setEffect(index, LightEffect::NONE);
+      return;
+    }
+  }
+  // Too many instructions without a wait, so continue on the next tick
+  _deadlines[index] = now + millis(1);
+}
+
+// Let every light waiting in a sync group continue
+void LightBank::release(int group) {
+  _syncWaiting[group] = 0;
+  _syncGeneration[group]++;
+  _isReleased = true;
+}
+
+// Write every light changed during the frame
+void LightBank::commitFrame(void) {
+  if (_frameDepth > 0) {
+    _frameDepth--;
+  }
+  if (_frameDepth > 0 || _dirtyCount == 0) {
+    return;
+  }
+  esp_cpu_cycle_count_t started = esp_cpu_get_cycle_count();
+  // Load the new duties (and render the pixel segments) first, so the
+  // latching pass below is as short as possible
+  for (int i = 0; i < _dirtyCount; i++) {
+    int index = _dirtyLights[i];
+    if (isPixel(index)) {
+      _strips[index]->fill(_pixelStarts[index], _pixelCounts[index],
+                           dim(_colors[index], _currLevels[index]));
+    } else if (isDimmable(index) && !_isFadeStaged[index]) {
+      ledc_set_duty(LEDC_LOW_SPEED_MODE, CHANNEL(index), _currLevels[index]);
+    }
+  }
+  // Latch the duties back to back. The LEDC applies a new duty at the start of
+  // the next PWM period, so every channel changes on the same period
+  for (int i = 0; i < _dirtyCount; i++) {
+    int index = _dirtyLights[i];
+    if (isPixel(index)) {
+      continue;
+    } else if (!isDimmable(index)) {
+      gpio_set_level(PIN(index), _currLevels[index] > 0 ? 1 : 0);
+    } else if (!_isFadeStaged[index]) {
+      ledc_update_duty(LEDC_LOW_SPEED_MODE, CHANNEL(index));
+    }
+  }
+  // Hand the rendered pixel frames to the RMT
+  for (int i = 0; i < _stripCount; i++) {
+    if (_stripList[i]->isDirty()) {
+      _stripList[i]->show();
+    }
+  }
+  // Start the staged fades last since starting a fade is much slower
+  for (int i = 0; i < _dirtyCount; i++) {
+    int index = _dirtyLights[i];
+    _isDirty[index] = false;
+    if (!_isFadeStaged[index]) {
+      continue;
+    }
+    _isFadeStaged[index] = false;
+    // Flag the fade before starting it since the fade end interrupt can fire
+    // before the start call returns on very short fades
+    _fadeDone[index] = false;
+    _isFading[index] = true;
+    ledc_set_fade_time_and_start(LEDC_LOW_SPEED_MODE, CHANNEL(index),
+                                 _currLevels[index], _fadeDurations[index],
+                                 LEDC_FADE_NO_WAIT);
+  }
+  // Update the frame counters
+  // Cycles are cheap enough to read on every commit (unlike the clock)
+  uint32_t cycles = esp_cpu_get_cycle_count() - started;
+  _frameStats.frames++;
+  _frameStats.lights += _dirtyCount;
+  _frameStats.maxLights =
+      std::max(_frameStats.maxLights, (uint32_t)_dirtyCount);
+  _frameStats.commitCycles += cycles;
+  _frameStats.maxCommitCycles = std::max(_frameStats.maxCommitCycles, cycles);
+  _dirtyCount = 0;
+}
+
+// Read the frame counters
+FrameStats LightBank::getFrameStats(bool reset) {
+  FrameStats stats = _frameStats;
+  if (reset) {
+    _frameStats = FrameStats();
+  }
+  return stats;
+}
+
+// Evaluate every light and commit the ones that changed
+void LightBank::tick(Timestamp now) {
+  beginFrame();
+  _isReleased = false;
+  for (int index = 0; index < _count; index++) {
+    if (_effects[index] != LightEffect::NONE || _isFading[index]) {
+      evaluate(index, now);
+    }
+  }
+  // Lights that reached a SYNC earlier in the pass than the last light in
+  // their group continue right away so the whole group stays in step
+  if (_isReleased) {
+    for (int index = 0; index < _count; index++) {
+      if (_isSyncing[index]) {
+        evaluate(index, now);
+      }
+    }
+  }
+  commitFrame();
+}
+
+// Next time a light has work to do
+Timestamp LightBank::deadlineOf(int index, Timestamp now) {
+  // A finished hardware fade needs to be handled right away
+  if (_isFading[index] && _fadeDone[index]) {
+    return now;
+  }
+  if (_effects[index] == LightEffect::BLINK) {
+    return _isRestarting[index] ? now : _deadlines[index];
+  }
+  if (_effects[index] == LightEffect::PROGRAM) {
+    if (_isRestarting[index]) {
+      return now;
+    }
+    // Lights waiting at a SYNC are woken by the last light in the group
+    if (_isSyncing[index]) {
+      return _syncWaits[index] == _syncGeneration[_syncGroups[index]]
+                 ? NO_DEADLINE
+                 : now;
+    }
+    return _deadlines[index];
+  }
+  return NO_DEADLINE;
+}
+
+// Earliest time any light has work to do
+Timestamp LightBank::nextDeadline(Timestamp now) {
+  Timestamp earliest = NO_DEADLINE;
+  for (int index = 0; index < _count; index++) {
+    Timestamp deadline = deadlineOf(index, now);
+    if (deadline < earliest) {
+      earliest = deadline;
+    }
+  }
+  return earliest;
+}
+
+// Flag a finished hardware fade
+void LightBank::__onFadeComplete__(int channel) {
+  if (channel >= 0 && channel < LIGHT_CHANNEL_MAX) {
+    int index = _channelOwners[channel];
+    if (index >= 0) {
+      _fadeDone[index] = true;
+    }
+  }
+}
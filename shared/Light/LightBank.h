@@ -0,0 +1,308 @@
+#ifndef LIGHT_BANK_H
+#define LIGHT_BANK_H
+
+#include "DutyTable.h"
+#include "EffectProgram.h"
+#include "PixelStrip.h"
+#include <Interval.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef LIGHT_BANK_CAPACITY
+#define LIGHT_BANK_CAPACITY 32 // Maximum number of lights in a bank
+#endif
+
+#ifndef LIGHT_BANK_STRIPS
+#define LIGHT_BANK_STRIPS 4 // Maximum number of pixel strips in a bank
+#endif
+
+#ifndef LIGHT_DUTY_RESOLUTION
+#define LIGHT_DUTY_RESOLUTION 13 // PWM duty resolution in bits
+#endif
+
+#ifndef LIGHT_GAMMA
+#define LIGHT_GAMMA 22 // Brightness gamma curve in tenths (10 is linear)
+#endif
+
+#define LIGHT_CHANNEL_MAX 16 // Number of PWM channels a bank can track
+
+// Percentage to duty lookup table shared by all lights
+typedef DutyTable<LIGHT_DUTY_RESOLUTION, LIGHT_GAMMA> LightDutyTable;
+
+// Called from the fade end interrupt (must be ISR safe). Returns true if a
+// higher priority task was woken
+typedef bool (*FadeCompleteCallback)(void *arg);
+
+// Time-based effects a light can run
+enum class LightEffect : uint8_t {
+  NONE,    // No effect (static brightness)
+  BLINK,   // Toggle between two brightness values
+  BREATHE, // Fade back and forth between two brightness values
+  PROGRAM, // Run an effect program
+};
+
+class Light;
+
+/**
+ * Counters collected by a bank's frame commits since the bank was created (or
+ * since the stats were last reset). Commits that had nothing to write aren't
+ * counted
+ */
+struct FrameStats {
+  uint64_t frames = 0;          // Number of commits that wrote lights
+  uint64_t lights = 0;          // Number of lights written by those commits
+  uint32_t maxLights = 0;       // Most lights written by a single commit
+  uint64_t commitCycles = 0;    // CPU cycles spent writing
+  uint32_t maxCommitCycles = 0; // Longest commit in CPU cycles
+
+  /** Average number of lights written per frame */
+  uint32_t averageLights() { return frames == 0 ? 0 : lights / frames; }
+
+  /**
+   * Average commit latency in CPU cycles (divide by the CPU frequency in MHz,
+   * ex. 240, for microseconds)
+   */
+  uint32_t averageCommitCycles() {
+    return frames == 0 ? 0 : commitCycles / frames;
+  }
+};
+
+/**
+ * LightBank stores the state of many lights in contiguous arrays (one array per
+ * field) so that every light's effects can be evaluated in one tight pass per
+ * tick. Light objects are lightweight handles into a bank, and by default
+ * every Light is stored in the global bank
+ */
+class LightBank {
+public:
+  /** The bank used by lights that aren't given one explicitly */
+  static LightBank &global(void);
+
+  /**
+   * Registers a function that is called from the fade end interrupt whenever
+   * any light's hardware fade finishes
+   * @param callback ISR safe function to call
+   * @param arg Argument passed to the callback
+   */
+  static void onFadeComplete(FadeCompleteCallback callback, void *arg = NULL);
+
+  /**
+   * Create an empty bank (most applications should use the global bank
+   * instead)
+   */
+  LightBank(void);
+
+  // Lights reference their bank, so banks can't be copied
+  LightBank(const LightBank &) = delete;
+  LightBank &operator=(const LightBank &) = delete;
+
+  /** Number of lights stored in the bank */
+  int size(void) { return _count; }
+
+  /**
+   * Evaluate the effects of every light in the bank and write the lights that
+   * changed to the hardware
+   * @param now The current timestamp
+   */
+  void tick(Timestamp now);
+
+  /**
+   * Alias for tick so the bank can be scheduled like a single effect
+   * @param now The current timestamp
+   */
+  void loop(Timestamp now) { tick(now); }
+
+  /**
+   * Get the earliest timestamp at which any light in the bank has work to do
+   * @param now The current timestamp
+   * @returns The deadline, or NO_DEADLINE if every light is idle
+   */
+  Timestamp nextDeadline(Timestamp now);
+
+  /**
+   * Start a frame. Until the matching commitFrame, brightness changes and fades
+   * on the bank's lights are only staged, so a state change that touches many
+   * lights reaches the outputs together instead of one light at a time. Frames
+   * can be nested (only the outermost commit writes). Ticks and scheduler
+   * passes run inside a frame already
+   */
+  void beginFrame(void) { _frameDepth++; }
+
+  /**
+   * End a frame and write every light that changed in one pass. The new duties
+   * of every PWM channel are loaded first and then latched back to back, so
+   * channels sharing the PWM timer switch on the same period, and staged fades
+   * are started last
+   */
+  void commitFrame(void);
+
+  /**
+   * Get the frame counters (lights written per frame and commit latency)
+   * @param reset Whether to reset the counters after reading them
+   */
+  FrameStats getFrameStats(bool reset = false);
+
+  /**
+   * Start running an effect program on a light (stops any active effect). An
+   * empty program simply stops the light's effects
+   * @param index The light's index in the bank
+   * @param data The program bytes (copied into the bank)
+   * @param size Number of program bytes
+   * @returns false if the index is out of range or the program is invalid
+   */
+  bool run(int index, const uint8_t *data, size_t size);
+
+  /**
+   * Called by the LEDC fade end interrupt when a hardware fade finishes.
+   * Shouldn't be called directly by the user
+   * @param channel The PWM channel that finished fading
+   */
+  void __onFadeComplete__(int channel);
+
+private:
+  friend class Light;
+
+  // Per light state (each field is stored contiguously)
+  int8_t _pins[LIGHT_BANK_CAPACITY];            // GPIO pin
+  int8_t _channels[LIGHT_BANK_CAPACITY];        // PWM channel (-1 if none)
+  PixelStrip *_strips[LIGHT_BANK_CAPACITY];     // Pixel strip (NULL if none)
+  uint16_t _pixelStarts[LIGHT_BANK_CAPACITY];   // First pixel of the segment
+  uint16_t _pixelCounts[LIGHT_BANK_CAPACITY];   // Pixels in the segment
+  uint32_t _colors[LIGHT_BANK_CAPACITY];        // Segment color at 100%
+  uint8_t _currBrightness[LIGHT_BANK_CAPACITY]; // Current brightness %
+  uint8_t _prevBrightness[LIGHT_BANK_CAPACITY]; // Previous brightness %
+  uint32_t _currLevels[LIGHT_BANK_CAPACITY];    // Current level (PWM duty)
+  uint32_t _prevLevels[LIGHT_BANK_CAPACITY];    // Previous level (PWM duty)
+  LightEffect _effects[LIGHT_BANK_CAPACITY];    // Active effect
+  Timestamp _deadlines[LIGHT_BANK_CAPACITY];    // Next effect step
+  Duration _periods[LIGHT_BANK_CAPACITY];       // Blink interval or breathing
+                                                // fade duration
+  uint8_t _effectHigh[LIGHT_BANK_CAPACITY];     // Blink or breathing high %
+  uint8_t _effectLow[LIGHT_BANK_CAPACITY];      // Blink or breathing low %
+  bool _isConfigured[LIGHT_BANK_CAPACITY];      // Hardware configured
+  bool _isRestarting[LIGHT_BANK_CAPACITY];      // Effect step due right away
+  bool _isFading[LIGHT_BANK_CAPACITY];          // Hardware fade started
+  volatile bool _fadeDone[LIGHT_BANK_CAPACITY]; // Set by the fade interrupt
+  bool _isFadeStaged[LIGHT_BANK_CAPACITY];      // Fade starts on commit
+  int32_t _fadeDurations[LIGHT_BANK_CAPACITY];  // Staged fade duration in ms
+  bool _isDirty[LIGHT_BANK_CAPACITY];           // Changed during the frame
+
+  // Per light effect program state
+  uint8_t _programs[LIGHT_BANK_CAPACITY][EFFECT_PROGRAM_SIZE]; // Program bytes
+  uint8_t _programSizes[LIGHT_BANK_CAPACITY]; // Number of program bytes
+  uint8_t _pcs[LIGHT_BANK_CAPACITY];          // Next instruction address
+  uint8_t _loopCounts[LIGHT_BANK_CAPACITY];   // Counted loop iterations left
+  uint8_t _loopOwners[LIGHT_BANK_CAPACITY];   // Address of the counted loop
+                                              // (NO_LOOP if none is active)
+  int8_t _syncGroups[LIGHT_BANK_CAPACITY];    // Sync group (-1 if none)
+  uint8_t _syncWaits[LIGHT_BANK_CAPACITY];    // Generation waited on
+  bool _isSyncing[LIGHT_BANK_CAPACITY];       // Waiting at a SYNC instruction
+
+  int _count = 0;                             // Number of lights stored
+  uint16_t _dirtyLights[LIGHT_BANK_CAPACITY]; // Lights changed during the
+                                              // frame, in order
+  int _dirtyCount = 0;                        // Number of dirty lights
+  int _frameDepth = 0;                        // Number of open frames
+  FrameStats _frameStats;                     // Collected frame counters
+  int16_t _channelOwners[LIGHT_CHANNEL_MAX]; // Light index using each channel
+  PixelStrip *_stripList[LIGHT_BANK_STRIPS]; // Strips used by the lights
+  int _stripCount = 0;                       // Number of strips used
+
+  // Per sync group state
+  uint16_t _syncMembers[EFFECT_SYNC_GROUPS];    // Programs in the group
+  uint16_t _syncWaiting[EFFECT_SYNC_GROUPS];    // Programs waiting at a SYNC
+  uint8_t _syncGeneration[EFFECT_SYNC_GROUPS]; // Incremented on each release
+  bool _isReleased = false; // A sync group was released during this tick
+
+  /**
+   * Add a light to the bank
+   * @returns The index of the new light
+   */
+  int add(int pin, int channel);
+
+  /**
+   * Add a pixel segment to the bank
+   * @returns The index of the new light
+   */
+  int add(PixelStrip &strip, int start, int count, uint32_t color);
+
+  /** Indicates if a light is dimmable */
+  bool isDimmable(int index) { return _channels[index] >= 0; }
+
+  /** Indicates if a light is a pixel segment */
+  bool isPixel(int index) { return _strips[index] != NULL; }
+
+  /** Change the color of a pixel segment */
+  void setColor(int index, uint32_t color);
+
+  /** Configure a light's GPIO pin or PWM channel if necessary */
+  void configure(int index);
+
+  /**
+   * Apply a new brightness level and percentage to a light (right away, or
+   * when the open frame is committed)
+   * @param index The light to update
+   * @param level Brightness level in native duty resolution
+   * @param brightness Brightness percentage matching the level
+   * @param stopEffects Whether to stop any active effects
+   */
+  void apply(int index, uint32_t level, int brightness, bool stopEffects);
+
+  /** Start a blinking effect on a light */
+  void blink(int index, Duration interval, int highBrightness,
+             int lowBrightness);
+
+  /** Fade a light to a new brightness */
+  void fadeTo(int index, int brightness, int durationMs, bool stopEffects);
+
+  /** Start a breathing effect on a light */
+  void breathe(int index, int periodInMs, int highBrightness,
+               int lowBrightness);
+
+  /**
+   * Start a hardware fade to a new brightness level (right away, or when the
+   * open frame is committed)
+   */
+  void startFade(int index, uint32_t level, int brightness, int durationMs);
+
+  /**
+   * Stop a hardware fade if one is running, or drop one that is staged
+   * @returns true if a fade was stopped or dropped
+   */
+  bool stopFade(int index);
+
+  /**
+   * Switch a light's active effect, leaving its sync group if a program is
+   * stopped
+   */
+  void setEffect(int index, LightEffect effect);
+
+  /**
+   * Stage a new brightness to be written when the frame is committed (a
+   * running hardware fade is stopped)
+   */
+  void stage(int index, uint32_t level, int brightness);
+
+  /** Flag a light to be written when the frame is committed */
+  void markDirty(int index);
+
+  /** Run a light's program until it waits or finishes */
+  void execute(int index, Timestamp now);
+
+  /** Let every light waiting in a sync group continue */
+  void release(int group);
+
+  /** Swap a light's current and previous brightness */
+  void swap(int index);
+
+  /**
+   * Run a light's effect if it is due, marking it dirty if its brightness
+   * changed
+   */
+  void evaluate(int index, Timestamp now);
+
+  /** Get the timestamp of a light's next effect step */
+  Timestamp deadlineOf(int index, Timestamp now);
+};
+
+#endif
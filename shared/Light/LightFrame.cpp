@@ -0,0 +1,55 @@
+#include "LightFrame.h"
+
+// Largest level of each level width
+#define NARROW_MAX 0xFF
+#define WIDE_MAX 0xFFFF
+
+// Check a frame's flags, mask and size
+bool LightFrame::isValid(const uint8_t *data, size_t size, int count) {
+  size_t maskSize = (count + 7) / 8;
+  if (data == NULL || count <= 0 || size < 1 + maskSize ||
+      (data[0] & ~LIGHT_FRAME_WIDE) != 0) {
+    return false;
+  }
+  bool isWide = data[0] & LIGHT_FRAME_WIDE;
+  const uint8_t *mask = data + 1;
+  // Every set bit needs a level, and bits past the last light must be clear
+  int setCount = 0;
+  for (size_t i = 0; i < maskSize; i++) {
+    setCount += __builtin_popcount(mask[i]);
+  }
+  if (count % 8 != 0 && (mask[maskSize - 1] >> (count % 8)) != 0) {
+    return false;
+  }
+  return size == 1 + maskSize + setCount * (isWide ? 2 : 1);
+}
+
+// Validate a frame and set its lights
+bool LightFrame::apply(const uint8_t *data, size_t size, Light *lights,
+                       int count) {
+  if (!isValid(data, size, count)) {
+    return false;
+  }
+  size_t maskSize = (count + 7) / 8;
+  bool isWide = data[0] & LIGHT_FRAME_WIDE;
+  const uint8_t *mask = data + 1;
+  const uint8_t *levels = mask + maskSize;
+  LightBank &bank = lights[0].getBank();
+  bank.beginFrame();
+  for (int light = 0; light < count; light++) {
+    if ((mask[light / 8] >> (light % 8) & 1) == 0) {
+      continue;
+    }
+    uint32_t level = *levels++;
+    uint32_t max = NARROW_MAX;
+    if (isWide) {
+      level |= (uint32_t)*levels++ << 8;
+      max = WIDE_MAX;
+    }
+    lights[light].setLevel(
+        (uint32_t)(((uint64_t)level * LightDutyTable::MAX_LEVEL + max / 2) /
+                   max));
+  }
+  bank.commitFrame();
+  return true;
+}
@@ -0,0 +1,55 @@
+#ifndef LIGHT_FRAME_H
+#define LIGHT_FRAME_H
+
+#include <Light.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Frame flags (the first byte of a frame)
+#define LIGHT_FRAME_WIDE 0x01 // Levels are 16 bit (little endian), not 8 bit
+
+/**
+ * LightFrame decodes binary level frames, which set any number of lights with
+ * one message (ex. a sequencer driving every light of a model at 30 to 50
+ * frames per second). A frame is:
+ * - a flags byte (LIGHT_FRAME_WIDE for 16 bit levels)
+ * - a bitmask of the lights it sets, one bit per light (bit n % 8 of byte
+ *   n / 8 is light n)
+ * - the level of every set light, in light order
+ *
+ * Levels are fractions of full duty (0 to 255, or 0 to 65535 for wide frames)
+ * written without gamma correction, so the sender owns the curve. Every level
+ * is staged in one bank frame, so all of the lights change in a single commit
+ */
+class LightFrame {
+public:
+  /**
+   * Size in bytes of the largest frame for a number of lights
+   * @param lightCount Number of lights a frame can address
+   */
+  static constexpr size_t maxSize(int lightCount) {
+    return 1 + (lightCount + 7) / 8 + lightCount * 2;
+  }
+
+  /**
+   * Indicates if a frame is well formed (known flags, no stray bits and a
+   * level for every set light)
+   * @param data The frame bytes
+   * @param size Number of frame bytes
+   * @param count Number of lights
+   */
+  static bool isValid(const uint8_t *data, size_t size, int count);
+
+  /**
+   * Validate a frame and set its lights (stopping their effects)
+   * @param data The frame bytes
+   * @param size Number of frame bytes
+   * @param lights The lights a frame addresses, in frame order (sharing a bank)
+   * @param count Number of lights
+   * @returns false (leaving every light as it was) if the frame is malformed
+   */
+  static bool apply(const uint8_t *data, size_t size, Light *lights,
+                    int count);
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef LIGHT_FRAME_BUFFER_H
+#define LIGHT_FRAME_BUFFER_H
+
+#include <LightFrame.h>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * LightFrameBuffer hands light frames from one task (ex. the MQTT task) to
+ * another (the lighting task) without losing partial frames. Every frame that
+ * is posted is merged into one pending frame (a light set by a later frame
+ * takes its level), so a burst of frames that each set a few lights is applied
+ * as one frame that sets all of them, and a sequencer that outruns the
+ * lighting task still only skips levels that were replaced.
+ *
+ * Levels are kept 16 bit (8 bit levels are scaled to the same duty), and the
+ * pending frame is guarded by a mutex that is only held while a frame is
+ * merged or copied out
+ * @tparam Count Number of lights a frame addresses
+ */
+template <int Count> class LightFrameBuffer {
+  static_assert(Count > 0, "LightFrameBuffer needs at least one light");
+
+public:
+  /** Size in bytes of the frames taken from the buffer */
+  static constexpr size_t SIZE = LightFrame::maxSize(Count);
+
+  /**
+   * Merge a frame into the pending frame
+   * @param data The frame bytes
+   * @param size Number of frame bytes
+   * @returns false (leaving the pending frame as it was) if the frame is
+   * malformed
+   */
+  bool post(const uint8_t *data, size_t size) {
+    if (!LightFrame::isValid(data, size, Count)) {
+      return false;
+    }
+    bool isWide = data[0] & LIGHT_FRAME_WIDE;
+    const uint8_t *mask = data + 1;
+    const uint8_t *levels = mask + MASK_SIZE;
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (int light = 0; light < Count; light++) {
+      if ((mask[light / 8] >> (light % 8) & 1) == 0) {
+        continue;
+      }
+      uint16_t level = *levels++;
+      if (isWide) {
+        level |= (uint16_t)(*levels++ << 8);
+      } else {
+        level *= 257; // 0xFF to 0xFFFF
+      }
+      _mask[light / 8] |= 1 << (light % 8);
+      _levels[light] = level;
+    }
+    return true;
+  }
+
+  /**
+   * Take the pending frame (a wide LightFrame), leaving the buffer empty
+   * @param frame Buffer of at least SIZE bytes for the frame
+   * @returns Number of frame bytes (0 if no frame was posted)
+   */
+  size_t take(uint8_t *frame) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint8_t *levels = frame + 1 + MASK_SIZE;
+    for (int light = 0; light < Count; light++) {
+      if ((_mask[light / 8] >> (light % 8) & 1) != 0) {
+        *levels++ = _levels[light] & 0xFF;
+        *levels++ = _levels[light] >> 8;
+      }
+    }
+    if (levels == frame + 1 + MASK_SIZE) {
+      return 0;
+    }
+    frame[0] = LIGHT_FRAME_WIDE;
+    memcpy(frame + 1, _mask, MASK_SIZE);
+    memset(_mask, 0, MASK_SIZE);
+    return levels - frame;
+  }
+
+private:
+  static const size_t MASK_SIZE = (Count + 7) / 8; // Bytes of a frame's mask
+
+  std::mutex _mutex;             // Guards the pending frame
+  uint8_t _mask[MASK_SIZE] = {}; // Lights the pending frame sets
+  uint16_t _levels[Count] = {};  // Pending level of every set light
+};
+
+#endif
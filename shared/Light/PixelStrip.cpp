@@ -0,0 +1,138 @@
+#include "PixelStrip.h"
+
+#include <string.h>
+
+// RMT tick rate (0.1us per tick)
+#define RMT_RESOLUTION_HZ 10000000
+
+// Pixel bit timings in RMT ticks. A bit is a high pulse followed by a low one,
+// where a 0 bit has a short high pulse and a 1 bit has a long one
+#define SHORT_TICKS 3 // 0.3us
+#define LONG_TICKS 9  // 0.9us
+#define BIT_TICKS (SHORT_TICKS + LONG_TICKS)
+
+// Low time that latches a frame in RMT ticks (split over both symbol halves)
+#define RESET_TICKS (PIXEL_STRIP_RESET_US * (RMT_RESOLUTION_HZ / 1000000))
+
+// RMT memory used for each transaction (the DMA buffer on chips with DMA, or
+// the channel's own memory block otherwise)
+#define DMA_BLOCK_SYMBOLS 1024
+#define MEMORY_BLOCK_SYMBOLS 64
+
+// The symbol sent after every frame to latch it
+static const rmt_symbol_word_t resetSymbol = {
+    .duration0 = RESET_TICKS / 2,
+    .level0 = 0,
+    .duration1 = RESET_TICKS / 2,
+    .level1 = 0,
+};
+
+// Initialize a strip
+PixelStrip::PixelStrip(int pin, int count, PixelOrder order)
+    : _pin{pin}, _count{count},
+      _pixelSize{order == PixelOrder::GRBW ? 4 : 3} {
+  _buffers[0].assign(count * _pixelSize, 0);
+  _buffers[1].assign(count * _pixelSize, 0);
+}
+
+// Time it takes to send one frame
+Duration PixelStrip::getFrameTime(void) {
+  int64_t ticks = (int64_t)_count * _pixelSize * 8 * BIT_TICKS + RESET_TICKS;
+  return Duration(ticks / (RMT_RESOLUTION_HZ / 1000000));
+}
+
+// Setup the RMT channel and the pixel encoders
+void PixelStrip::configure(void) {
+  if (_isConfigured) {
+    return;
+  }
+  rmt_tx_channel_config_t channelConfig = {};
+  channelConfig.gpio_num = (gpio_num_t)_pin;
+  channelConfig.clk_src = RMT_CLK_SRC_DEFAULT;
+  channelConfig.resolution_hz = RMT_RESOLUTION_HZ;
+  channelConfig.mem_block_symbols = DMA_BLOCK_SYMBOLS;
+  // Two transactions per frame (the pixels and the reset)
+  channelConfig.trans_queue_depth = 4;
+  channelConfig.flags.with_dma = true;
+  // Not every chip has an RMT DMA (ex. the original ESP32), in which case the
+  // driver refills the channel's memory from its interrupt instead
+  if (rmt_new_tx_channel(&channelConfig, &_channel) != ESP_OK) {
+    channelConfig.mem_block_symbols = MEMORY_BLOCK_SYMBOLS;
+    channelConfig.flags.with_dma = false;
+    ESP_ERROR_CHECK(rmt_new_tx_channel(&channelConfig, &_channel));
+  }
+  rmt_bytes_encoder_config_t encoderConfig = {};
+  encoderConfig.bit0 = {
+      .duration0 = SHORT_TICKS,
+      .level0 = 1,
+      .duration1 = LONG_TICKS,
+      .level1 = 0,
+  };
+  encoderConfig.bit1 = {
+      .duration0 = LONG_TICKS,
+      .level0 = 1,
+      .duration1 = SHORT_TICKS,
+      .level1 = 0,
+  };
+  encoderConfig.flags.msb_first = 1;
+  ESP_ERROR_CHECK(rmt_new_bytes_encoder(&encoderConfig, &_encoder));
+  rmt_copy_encoder_config_t resetConfig = {};
+  ESP_ERROR_CHECK(rmt_new_copy_encoder(&resetConfig, &_resetEncoder));
+  ESP_ERROR_CHECK(rmt_enable(_channel));
+  _isConfigured = true;
+}
+
+// Set one pixel in the frame being rendered
+void PixelStrip::setPixel(int index, uint32_t color) {
+  if (index < 0 || index >= _count) {
+    return;
+  }
+  fill(index, 1, color);
+}
+
+// Set a range of pixels in the frame being rendered
+void PixelStrip::fill(int start, int count, uint32_t color) {
+  if (start < 0) {
+    count += start;
+    start = 0;
+  }
+  if (start + count > _count) {
+    count = _count - start;
+  }
+  if (count <= 0) {
+    return;
+  }
+  uint8_t pixel[4] = {
+      (uint8_t)(color >> 8),  // Green
+      (uint8_t)(color >> 16), // Red
+      (uint8_t)color,         // Blue
+      (uint8_t)(color >> 24), // White
+  };
+  uint8_t *data = back() + start * _pixelSize;
+  for (int i = 0; i < count; i++, data += _pixelSize) {
+    memcpy(data, pixel, _pixelSize);
+  }
+  _isDirty = true;
+}
+
+// Send the rendered frame
+void PixelStrip::show(void) {
+  configure();
+  // The previous frame (and its reset) has to be out before its buffer is
+  // reused, which only waits when frames are shown faster than the chain can
+  // take them
+  rmt_tx_wait_all_done(_channel, -1);
+  rmt_transmit_config_t transmitConfig = {};
+  uint8_t *frame = back();
+  size_t size = _count * _pixelSize;
+  ESP_ERROR_CHECK(
+      rmt_transmit(_channel, _encoder, frame, size, &transmitConfig));
+  ESP_ERROR_CHECK(rmt_transmit(_channel, _resetEncoder, &resetSymbol,
+                               sizeof(resetSymbol), &transmitConfig));
+  // Render the next frame into the other buffer, starting from this one since
+  // lights only render the pixels that changed
+  _front ^= 1;
+  memcpy(back(), frame, size);
+  _isDirty = false;
+  _frames++;
+}
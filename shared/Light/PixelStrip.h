@@ -0,0 +1,109 @@
+#ifndef PIXEL_STRIP_H
+#define PIXEL_STRIP_H
+
+#include <Interval.h>
+#include <driver/rmt_tx.h>
+#include <stdint.h>
+#include <vector>
+
+#ifndef PIXEL_STRIP_RESET_US
+#define PIXEL_STRIP_RESET_US 300 // Low time that latches a frame (WS2812B)
+#endif
+
+// Order the color bytes of a pixel are sent in
+enum class PixelOrder : uint8_t {
+  GRB,  // WS2812 and RGB SK6812 pixels
+  GRBW, // RGBW SK6812 pixels
+};
+
+/**
+ * PixelStrip drives a chain of addressable pixels (WS2812 or SK6812) from a
+ * single GPIO pin using the RMT peripheral, so hundreds of pixels only use one
+ * pin and no LEDC channels. Frames are double buffered: show() hands the
+ * rendered frame to the RMT (through DMA on chips that support it) and the next
+ * frame is rendered into the other buffer while the first one is still being
+ * sent.
+ *
+ * Pixels are usually split into segments that are controlled like any other
+ * Light (see `Light(PixelStrip &strip, ...)`), in which case the segments'
+ * bank renders and shows the strip whenever a frame is committed
+ */
+class PixelStrip {
+public:
+  /**
+   * Initialize a strip
+   * @param pin GPIO pin connected to the first pixel's data input
+   * @param count Number of pixels in the chain
+   * @param order Color byte order of the pixels
+   */
+  PixelStrip(int pin, int count, PixelOrder order = PixelOrder::GRB);
+
+  // Lights reference their strip, so strips can't be copied
+  PixelStrip(const PixelStrip &) = delete;
+  PixelStrip &operator=(const PixelStrip &) = delete;
+
+  /** Get the data pin */
+  int getPin(void) { return _pin; }
+
+  /** Number of pixels in the chain */
+  int size(void) { return _count; }
+
+  /** Indicates if pixels changed since the last frame was shown */
+  bool isDirty(void) { return _isDirty; }
+
+  /** Number of frames shown so far */
+  uint32_t getFrameCount(void) { return _frames; }
+
+  /**
+   * Time it takes to send one frame down the chain (the upper limit on the
+   * frame rate), including the reset that latches it
+   */
+  Duration getFrameTime(void);
+
+  /**
+   * Configure the RMT channel if necessary (called on the first show if it
+   * isn't called explicitly)
+   */
+  void configure(void);
+
+  /**
+   * Set the color of a pixel in the frame being rendered
+   * @param index The pixel index
+   * @param color Color as 0xWWRRGGBB (white is ignored by GRB pixels)
+   */
+  void setPixel(int index, uint32_t color);
+
+  /**
+   * Set the color of a range of pixels in the frame being rendered
+   * @param start Index of the first pixel
+   * @param count Number of pixels
+   * @param color Color as 0xWWRRGGBB (white is ignored by GRB pixels)
+   */
+  void fill(int start, int count, uint32_t color);
+
+  /**
+   * Send the rendered frame to the pixels. Returns as soon as the frame is
+   * handed to the RMT, after waiting for the previous frame to finish (only
+   * when frames are shown faster than the chain can take them)
+   */
+  void show(void);
+
+private:
+  int _pin;                                  // Data pin
+  int _count;                                // Number of pixels
+  int _pixelSize;                            // Bytes per pixel
+  std::vector<uint8_t> _buffers[2];          // Frame being sent and frame
+                                             // being rendered
+  int _front = 0;                            // Index of the buffer being sent
+  bool _isDirty = true;                      // Pixels changed since last show
+  bool _isConfigured = false;                // RMT channel configured
+  uint32_t _frames = 0;                      // Number of frames shown
+  rmt_channel_handle_t _channel = NULL;      // RMT transmit channel
+  rmt_encoder_handle_t _encoder = NULL;      // Encodes pixel bytes into bits
+  rmt_encoder_handle_t _resetEncoder = NULL; // Sends the latching reset
+
+  /** The buffer frames are rendered into */
+  uint8_t *back(void) { return _buffers[_front ^ 1].data(); }
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "LightGroup.h"
+
+#include <SyncClock.h>
+#include <algorithm>
+
+// Configures every member
+void LightGroupBase::configure(void) {
+  for (int i = 0; i < _count; i++) {
+    _members[i].configure();
+  }
+}
+
+// Turns every member on to a specific brightness
+void LightGroupBase::on(int brightness, bool stopEffects) {
+  if (stopEffects) {
+    stop();
+  }
+  for (int i = 0; i < _count; i++) {
+    _members[i].on(brightness, stopEffects);
+  }
+}
+
+// Turn off every member
+void LightGroupBase::off(bool stopEffects) { on(0, stopEffects); }
+
+// Fade every member to a specific brightness
+void LightGroupBase::fadeTo(int brightness, int durationMs, bool stopEffects) {
+  if (stopEffects) {
+    stop();
+  }
+  for (int i = 0; i < _count; i++) {
+    _members[i].fadeTo(brightness, durationMs, stopEffects);
+  }
+}
+
+// Starts the breathing effect for every member
+void LightGroupBase::breathe(int periodInMs, int highBrightness,
+                             int lowBrightness) {
+  // Breathing runs on each light's fade engine, so the group has no pattern
+  stop();
+  for (int i = 0; i < _count; i++) {
+    _members[i].breathe(periodInMs, highBrightness, lowBrightness);
+  }
+}
+
+// Starts blinking every member together
+void LightGroupBase::blink(int intervalInMs, int highBrightness,
+                           int lowBrightness) {
+  blink(millis(intervalInMs), highBrightness, lowBrightness);
+}
+
+// Starts blinking every member together with a fine interval
+void LightGroupBase::blink(Duration interval, int highBrightness,
+                           int lowBrightness) {
+  start(GroupPattern::BLINK, interval, highBrightness, lowBrightness);
+}
+
+// Start sequential effect
+void LightGroupBase::sequence(int blinkInterval, int staggerInterval,
+                              int highBrightness, int lowBrightness) {
+  sequence(millis(blinkInterval), millis(staggerInterval), highBrightness,
+           lowBrightness);
+}
+
+// Start sequential effect with fine intervals
+void LightGroupBase::sequence(Duration blinkInterval, Duration staggerInterval,
+                              int highBrightness, int lowBrightness) {
+  start(GroupPattern::SEQUENTIAL, blinkInterval, highBrightness,
+        lowBrightness);
+  _staggerInterval = staggerInterval;
+}
+
+// Start chase effect
+void LightGroupBase::chase(int stepInterval, int highBrightness,
+                           int lowBrightness) {
+  chase(millis(stepInterval), highBrightness, lowBrightness);
+}
+
+// Start chase effect with a fine step interval
+void LightGroupBase::chase(Duration stepInterval, int highBrightness,
+                           int lowBrightness) {
+  start(GroupPattern::CHASE, stepInterval, highBrightness, lowBrightness);
+}
+
+// Start a pattern from the low state
+void LightGroupBase::start(GroupPattern pattern, Duration interval,
+                           int highBrightness, int lowBrightness) {
+  // Stops any member effects (including the patterns of nested groups)
+  on(lowBrightness);
+  if (_count == 0) {
+    return;
+  }
+  _pattern = pattern;
+  _interval = interval;
+  _highBrightness = highBrightness;
+  _lowBrightness = lowBrightness;
+  _step = 0;
+  // The first step runs on the next loop
+  _isStarting = true;
+}
+
+// Run a single pattern step
+void LightGroupBase::step(void) {
+  switch (_pattern) {
+  // Even steps are high and odd steps are low
+  case GroupPattern::BLINK:
+    for (int i = 0; i < _count; i++) {
+      _members[i].on(_step == 0 ? _highBrightness : _lowBrightness, true);
+    }
+    _step ^= 1;
+    _deadline += _interval;
+    break;
+  // Step n turns on member n, and the last step turns every member off
+  case GroupPattern::SEQUENTIAL:
+    if (_step < _count) {
+      _members[_step].on(_highBrightness, true);
+      _step++;
+      // Members that can't turn on before the high state ends stay off
+      Duration untilNext = _step * _staggerInterval;
+      if (_step < _count && untilNext < _interval) {
+        _deadline = _cycleStart + untilNext;
+        break;
+      }
+      _step = _count;
+      _deadline = _cycleStart + _interval;
+    } else {
+      for (int i = 0; i < _count; i++) {
+        _members[i].on(_lowBrightness, true);
+      }
+      _step = 0;
+      _cycleStart += 2 * _interval;
+      _deadline = _cycleStart;
+    }
+    break;
+  // Step n moves the high member from member n - 1 to member n
+  case GroupPattern::CHASE:
+    if (_count > 1) {
+      _members[(_step + _count - 1) % _count].on(_lowBrightness, true);
+    }
+    _members[_step].on(_highBrightness, true);
+    _step = (_step + 1) % _count;
+    _deadline += _interval;
+    break;
+  case GroupPattern::NONE:
+    break;
+  }
+}
+
+// Next time the loop function has work to do
+Timestamp LightGroupBase::nextDeadline(Timestamp now) {
+  // Patterns are driven by the group's step deadline
+  if (_pattern != GroupPattern::NONE) {
+    return _isStarting ? now : _deadline;
+  }
+  // All other effects are driven by the members
+  Timestamp deadline = NO_DEADLINE;
+  for (int i = 0; i < _count; i++) {
+    deadline = std::min(deadline, _members[i].nextDeadline(now));
+  }
+  return deadline;
+}
+
+// Loop function to process effects
+void LightGroupBase::loop(Timestamp now) {
+  // Pass all other effects to the members
+  if (_pattern == GroupPattern::NONE) {
+    for (int i = 0; i < _count; i++) {
+      _members[i].loop(now);
+    }
+    return;
+  }
+  if (_isStarting) {
+    _isStarting = false;
+    _deadline = now;
+    _cycleStart = now;
+    // Boards sharing network time run patterns in phase: cycles start on
+    // whole cycles of network time (the steps already due run right away)
+    SyncClock &clock = SyncClock::global();
+    if (clock.isSynced()) {
+      Duration cycle =
+          _pattern == GroupPattern::CHASE ? _interval * _count : _interval * 2;
+      _deadline = clock.lastBoundary(now, cycle);
+      _cycleStart = _deadline;
+    }
+  }
+  if (now >= _deadline) {
+    step();
+  }
+}
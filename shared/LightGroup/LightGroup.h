@@ -0,0 +1,312 @@
+#ifndef LIGHT_GROUP_H
+#define LIGHT_GROUP_H
+
+#include <Interval.h>
+#include <Light.h>
+#include <type_traits>
+#include <vector>
+
+#define DEFAULT_BLINK_INTERVAL 1000
+#define DEFAULT_STAGGER_INTERVAL 250
+#define DEFAULT_CHASE_INTERVAL 250
+
+// Animations a light group runs across its members
+enum class GroupPattern : uint8_t {
+  NONE,       // No pattern (members run their own effects)
+  BLINK,      // Every member switches between high and low together
+  SEQUENTIAL, // Members turn on one at a time, then all turn off together
+  CHASE,      // A single member is high at a time, moving to the next member
+};
+
+/**
+ * LightGroupMember is a type erased reference to a group member, which can be a
+ * Light or another light group (so groups can be nested). Any type with
+ * `configure()`, `on(int, bool)`, `fadeTo(int, int, bool)`,
+ * `breathe(int, int, int)`, `loop(Timestamp)` and `nextDeadline(Timestamp)`
+ * functions can be a member
+ */
+class LightGroupMember {
+public:
+  /**
+   * Reference a member
+   * @param target The light or group (must outlive the group)
+   */
+  template <typename T>
+    requires(!std::is_same_v<std::remove_cv_t<T>, LightGroupMember>)
+  LightGroupMember(T &target) : _target{&target}, _ops{&opsOf<T>} {}
+
+  void configure(void) { _ops->configure(_target); }
+
+  void on(int brightness, bool stopEffects) {
+    _ops->on(_target, brightness, stopEffects);
+  }
+
+  void fadeTo(int brightness, int durationMs, bool stopEffects) {
+    _ops->fadeTo(_target, brightness, durationMs, stopEffects);
+  }
+
+  void breathe(int periodInMs, int highBrightness, int lowBrightness) {
+    _ops->breathe(_target, periodInMs, highBrightness, lowBrightness);
+  }
+
+  void loop(Timestamp now) { _ops->loop(_target, now); }
+
+  Timestamp nextDeadline(Timestamp now) {
+    return _ops->nextDeadline(_target, now);
+  }
+
+private:
+  // Functions implemented by every member type
+  struct Ops {
+    void (*configure)(void *target);
+    void (*on)(void *target, int brightness, bool stopEffects);
+    void (*fadeTo)(void *target, int brightness, int durationMs,
+                   bool stopEffects);
+    void (*breathe)(void *target, int periodInMs, int highBrightness,
+                    int lowBrightness);
+    void (*loop)(void *target, Timestamp now);
+    Timestamp (*nextDeadline)(void *target, Timestamp now);
+  };
+
+  // Function table shared by every member of the same type
+  template <typename T>
+  static constexpr Ops opsOf = {
+      .configure = [](void *target) { ((T *)target)->configure(); },
+      .on = [](void *target, int brightness,
+               bool stopEffects) { ((T *)target)->on(brightness, stopEffects); },
+      .fadeTo =
+          [](void *target, int brightness, int durationMs, bool stopEffects) {
+            ((T *)target)->fadeTo(brightness, durationMs, stopEffects);
+          },
+      .breathe =
+          [](void *target, int periodInMs, int highBrightness,
+             int lowBrightness) {
+            ((T *)target)->breathe(periodInMs, highBrightness, lowBrightness);
+          },
+      .loop = [](void *target, Timestamp now) { ((T *)target)->loop(now); },
+      .nextDeadline = [](void *target, Timestamp now) {
+        return ((T *)target)->nextDeadline(now);
+      },
+  };
+
+  void *_target;    // The light or group
+  const Ops *_ops;  // Functions for the member's type
+};
+
+/**
+ * LightGroupBase controls a list of members as a single light and runs
+ * group-wide patterns. Patterns are driven by a step index that is advanced
+ * once per group when a step is due, so each step only touches the members
+ * that change instead of checking the state of every member. Use LightGroup<N>
+ * for a fixed number of members, or DynamicLightGroup to add members at runtime
+ */
+class LightGroupBase {
+public:
+  // Members reference the group, so groups can't be copied
+  LightGroupBase(const LightGroupBase &) = delete;
+  LightGroupBase &operator=(const LightGroupBase &) = delete;
+
+  /** Number of members in the group */
+  int size(void) { return _count; }
+
+  /** Get the active pattern */
+  GroupPattern getPattern(void) { return _pattern; }
+
+  /** Indicates if a pattern is running */
+  bool isRunning(void) { return _pattern != GroupPattern::NONE; }
+
+  /**
+   * Stop the running pattern, leaving every member at its level (ex. before
+   * the members are driven by something else)
+   */
+  void stop(void) { _pattern = GroupPattern::NONE; }
+
+  /**
+   * Configures every member
+   */
+  void configure(void);
+
+  /**
+   * Turn on every member to a specific brightness
+   * @param brightness Number from 0 to 100 representing brightness as a
+   * percentage
+   * @param stopEffects If the running pattern and member effects should be
+   * stopped
+   */
+  void on(int brightness = 100, bool stopEffects = true);
+
+  /**
+   * Turn off every member
+   * @param stopEffects If the running pattern and member effects should be
+   * stopped
+   */
+  void off(bool stopEffects = true);
+
+  /**
+   * Fade every member to a specific brightness using the LEDC fade engine
+   * @param brightness Number from 0 to 100 representing brightness as a
+   * percentage
+   * @param durationMs How long the fade should take in milliseconds
+   * @param stopEffects If the running pattern and member effects should be
+   * stopped
+   */
+  void fadeTo(int brightness, int durationMs, bool stopEffects = true);
+
+  /**
+   * Starts the breathing effect on every member (each light breathes with its
+   * own hardware fades)
+   * @param periodInMs Time for one full breath from high to low and back
+   * @param highBrightness High brightness level during breathing effect
+   * @param lowBrightness Low brightness level during breathing effect
+   */
+  void breathe(int periodInMs = DEFAULT_BLINK_INTERVAL * 2,
+               int highBrightness = 100, int lowBrightness = 0);
+
+  /**
+   * Starts blinking every member together
+   * @param intervalInMs Interval to switch between high and low
+   * @param highBrightness High brightness level during blink effect
+   * @param lowBrightness Low brightness level during blink effect
+   */
+  void blink(int intervalInMs = DEFAULT_BLINK_INTERVAL,
+             int highBrightness = 100, int lowBrightness = 0);
+
+  /** Starts blinking every member together with a fine interval */
+  void blink(Duration interval, int highBrightness = 100,
+             int lowBrightness = 0);
+
+  /**
+   * Start the sequential effect. Members turn on one at a time from first to
+   * last, and then every member turns off together
+   * @param blinkInterval Time in milliseconds the group stays in the high
+   * state, and then in the low state
+   * @param staggerInterval Time in milliseconds between turning on each member
+   * @param highBrightness Brightness of a member that is turned on
+   * @param lowBrightness Brightness of every member in the low state
+   */
+  void sequence(int blinkInterval = DEFAULT_BLINK_INTERVAL,
+                int staggerInterval = DEFAULT_STAGGER_INTERVAL,
+                int highBrightness = 100, int lowBrightness = 0);
+
+  /**
+   * Start the sequential effect with intervals that can be finer than a
+   * millisecond (ex. a short stagger)
+   */
+  void sequence(Duration blinkInterval, Duration staggerInterval,
+                int highBrightness = 100, int lowBrightness = 0);
+
+  /**
+   * Start the chase effect. A single member is high at a time, moving from
+   * first to last and then starting over
+   * @param stepInterval Time in milliseconds each member stays high
+   * @param highBrightness Brightness of the high member
+   * @param lowBrightness Brightness of every other member
+   */
+  void chase(int stepInterval = DEFAULT_CHASE_INTERVAL, int highBrightness = 100,
+             int lowBrightness = 0);
+
+  /** Start the chase effect with a fine step interval */
+  void chase(Duration stepInterval, int highBrightness = 100,
+             int lowBrightness = 0);
+
+  /**
+   * Get the timestamp of the next time the loop function has work to do
+   * @param now The current timestamp
+   * @returns The deadline, or NO_DEADLINE if the group is idle
+   */
+  Timestamp nextDeadline(Timestamp now);
+
+  /**
+   * Loop function that should be called as often as possible with the updated
+   * timestamp. Runs the group's pattern step when it is due, or passes the loop
+   * to every member while no pattern is running
+   * @param now The current timestamp
+   */
+  void loop(Timestamp now);
+
+protected:
+  /**
+   * Create a group from a member list owned by the derived class
+   * @param members The first member
+   * @param count Number of members
+   */
+  LightGroupBase(LightGroupMember *members, int count)
+      : _members{members}, _count{count} {}
+
+  /** Point the group at a new member list (ex. after it grows) */
+  void attach(LightGroupMember *members, int count) {
+    _members = members;
+    _count = count;
+  }
+
+private:
+  LightGroupMember *_members; // Members of the group
+  int _count;                 // Number of members
+
+  // Pattern state
+  GroupPattern _pattern = GroupPattern::NONE; // Active pattern
+  int _step = 0;                 // Next step of the pattern
+  bool _isStarting = false;      // The first step is due right away
+  Timestamp _deadline;           // Timestamp the next step is due
+  Timestamp _cycleStart;         // Timestamp the current cycle started
+  Duration _interval;            // Blink or chase interval
+  Duration _staggerInterval;     // Sequential stagger interval
+  int _highBrightness = 100;     // Pattern high brightness
+  int _lowBrightness = 0;        // Pattern low brightness
+
+  /** Start a pattern with every member in the low state */
+  void start(GroupPattern pattern, Duration interval, int highBrightness,
+             int lowBrightness);
+
+  /** Run a single pattern step and schedule the next one */
+  void step(void);
+};
+
+/**
+ * LightGroup is a light group with a fixed number of members. The number of
+ * members is deduced from the constructor (ex.
+ * `LightGroup taillight(inner, middle, outer);` is a `LightGroup<3>`)
+ * @tparam N Number of members
+ */
+template <int N> class LightGroup : public LightGroupBase {
+public:
+  /**
+   * Create a group
+   * @param members The lights or groups in the group, in pattern order
+   */
+  template <typename... T>
+  LightGroup(T &...members)
+      : LightGroupBase(_storage, N), _storage{LightGroupMember(members)...} {
+    static_assert(sizeof...(T) == N, "Expected exactly N group members");
+  }
+
+private:
+  LightGroupMember _storage[N]; // Members of the group
+};
+
+// Deduce the number of members from the constructor arguments
+template <typename... T> LightGroup(T &...) -> LightGroup<sizeof...(T)>;
+
+/**
+ * DynamicLightGroup is a light group whose members are added at runtime (ex.
+ * when the number of lights is only known after reading a config)
+ */
+class DynamicLightGroup : public LightGroupBase {
+public:
+  DynamicLightGroup(void) : LightGroupBase(NULL, 0) {}
+
+  /**
+   * Add a member to the end of the group
+   * @param member The light or group to add (must outlive the group)
+   */
+  template <typename T> DynamicLightGroup &add(T &member) {
+    _list.push_back(LightGroupMember(member));
+    attach(_list.data(), _list.size());
+    return *this;
+  }
+
+private:
+  std::vector<LightGroupMember> _list; // Members of the group
+};
+
+#endif
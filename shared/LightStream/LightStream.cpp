@@ -0,0 +1,354 @@
+#include "LightStream.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Largest level of a channel
+#define CHANNEL_MAX 0xFF
+
+// E1.31 multicast groups are 239.255.<universe high>.<universe low>
+#define E131_MULTICAST_BASE 0xEFFF0000
+
+// E1.31 packets up to this far behind the last one are discarded as out of
+// order (anything further back is a restarted source)
+#define E131_SEQUENCE_WINDOW 20
+
+// DDP sequence numbers run from 1 to 15
+#define DDP_SEQUENCE_COUNT 15
+
+// Intervals between frames longer than this are pauses, not the frame rate
+#define MAX_FRAME_INTERVAL millis(250)
+
+// Wait before receiving again after an interrupted or empty receive
+#define RECEIVE_RETRY_MS 10
+
+// Initialize a stream
+LightStream::LightStream(Light *lights, int count)
+    : _lights{lights}, _count{count} {
+  _assembly.assign(count, 0);
+  _frames.assign(count * STREAM_BUFFER_FRAMES, 0);
+}
+
+// Set the protocol and port
+LightStream &LightStream::setProtocol(StreamProtocol protocol, int port) {
+  _protocol = protocol;
+  _port = port;
+  return *this;
+}
+
+// Set the E1.31 universe
+LightStream &LightStream::setUniverse(uint16_t universe) {
+  _universe = universe;
+  return *this;
+}
+
+// Set the channel of the first light
+LightStream &LightStream::setStartChannel(uint32_t channel) {
+  _startChannel = channel;
+  return *this;
+}
+
+// Set the priority needed to take over
+LightStream &LightStream::setPriority(uint8_t priority) {
+  _priority = priority;
+  return *this;
+}
+
+// Set the buffered frame callback
+LightStream &LightStream::onReceive(void (*callback)(void)) {
+  _onReceive = callback;
+  return *this;
+}
+
+// Set the handover callback
+LightStream &LightStream::onHandover(void (*callback)(bool isActive)) {
+  _onHandover = callback;
+  return *this;
+}
+
+// Open the socket and start the receive task
+bool LightStream::start(void) {
+  if (_socket >= 0) {
+    return true;
+  }
+  int port = _port;
+  if (port == 0) {
+    port = _protocol == StreamProtocol::DDP ? DDP_PORT : E131_PORT;
+  }
+  int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (fd < 0) {
+    return false;
+  }
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    close(fd);
+    return false;
+  }
+  // Unicast packets are still received if the group can't be joined
+  if (_protocol == StreamProtocol::E131) {
+    struct ip_mreq group = {};
+    group.imr_multiaddr.s_addr = htonl(E131_MULTICAST_BASE | _universe);
+    group.imr_interface.s_addr = htonl(INADDR_ANY);
+    setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group));
+  }
+  _socket = fd;
+  if (xTaskCreate(&receiveTask, "light_stream", STREAM_TASK_STACK, this,
+                  STREAM_TASK_PRIORITY, NULL) != pdPASS) {
+    close(fd);
+    _socket = -1;
+    return false;
+  }
+  return true;
+}
+
+// Receive datagrams until the socket fails
+void LightStream::receiveTask(void *stream) {
+  LightStream *self = (LightStream *)stream;
+  uint8_t datagram[STREAM_DATAGRAM_SIZE];
+  while (true) {
+    ssize_t size = recv(self->_socket, datagram, sizeof(datagram), 0);
+    if (size > 0) {
+      self->receive(datagram, size, Clock::now());
+    } else if (size == 0 || errno == EINTR || errno == EAGAIN ||
+               errno == EWOULDBLOCK) {
+      vTaskDelay(pdMS_TO_TICKS(RECEIVE_RETRY_MS));
+    } else {
+      break;
+    }
+  }
+  // Close the socket, so the stream can be started again
+  close(self->_socket);
+  self->_socket = -1;
+  vTaskDelete(NULL);
+}
+
+// Handle a datagram
+void LightStream::receive(const uint8_t *datagram, size_t size,
+                          Timestamp now) {
+  StreamPacket packet;
+  if (!packet.parse(_protocol, datagram, size) ||
+      (_protocol == StreamProtocol::E131 && packet.universe != _universe) ||
+      packet.priority < _priority) {
+    _ignored.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  _packets.fetch_add(1, std::memory_order_relaxed);
+  // A source that was quiet for a while starts a new sequence
+  if (now - _lastPacket >= millis(STREAM_TIMEOUT_MS)) {
+    _hasSequence = false;
+  }
+  _lastPacket = now;
+  if (packet.isTerminated) {
+    _hasSequence = false;
+    _isTerminated.store(true, std::memory_order_release);
+    if (_onReceive != NULL) {
+      _onReceive();
+    }
+    return;
+  }
+  if (!checkSequence(packet)) {
+    return;
+  }
+  assemble(packet);
+  if (packet.isPush) {
+    push(now);
+  }
+}
+
+// Check a packet's sequence number
+bool LightStream::checkSequence(const StreamPacket &packet) {
+  if (!packet.hasSequence) {
+    return true;
+  }
+  if (!_hasSequence) {
+    _hasSequence = true;
+    _sequence = packet.sequence;
+    return true;
+  }
+  int gap;
+  if (_protocol == StreamProtocol::E131) {
+    gap = (int8_t)(packet.sequence - _sequence);
+    if (gap <= 0 && gap > -E131_SEQUENCE_WINDOW) {
+      _late.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  } else {
+    // Only half of the short DDP sequence can be told apart from late packets
+    gap = (packet.sequence - _sequence + DDP_SEQUENCE_COUNT) %
+          DDP_SEQUENCE_COUNT;
+    if (gap == 0 || gap > DDP_SEQUENCE_COUNT / 2) {
+      _late.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+  if (gap > 1) {
+    _lost.fetch_add(gap - 1, std::memory_order_relaxed);
+  }
+  _sequence = packet.sequence;
+  return true;
+}
+
+// Copy the channels that map to lights
+void LightStream::assemble(const StreamPacket &packet) {
+  uint64_t first = packet.offset;
+  if (first < _startChannel) {
+    first = _startChannel;
+  }
+  uint64_t end = (uint64_t)packet.offset + packet.length;
+  if (end > (uint64_t)_startChannel + _count) {
+    end = (uint64_t)_startChannel + _count;
+  }
+  if (first < end) {
+    memcpy(_assembly.data() + (first - _startChannel),
+           packet.data + (first - packet.offset), end - first);
+  }
+}
+
+// Buffer the assembled frame
+void LightStream::push(Timestamp now) {
+  uint32_t head = _head.load(std::memory_order_relaxed);
+  if (head - _tail.load(std::memory_order_acquire) >= STREAM_BUFFER_FRAMES) {
+    _overruns.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  int slot = head % STREAM_BUFFER_FRAMES;
+  memcpy(_frames.data() + slot * _count, _assembly.data(), _count);
+  _arrivals[slot] = now;
+  _head.store(head + 1, std::memory_order_release);
+  if (_onReceive != NULL) {
+    _onReceive();
+  }
+}
+
+// Get the collected counters
+StreamStats LightStream::getStats(bool reset) {
+  StreamStats stats = _stats;
+  if (reset) {
+    _stats = StreamStats();
+    stats.packets = _packets.exchange(0, std::memory_order_relaxed);
+    stats.lost = _lost.exchange(0, std::memory_order_relaxed);
+    stats.late = _late.exchange(0, std::memory_order_relaxed);
+    stats.ignored = _ignored.exchange(0, std::memory_order_relaxed);
+    stats.overruns = _overruns.exchange(0, std::memory_order_relaxed);
+  } else {
+    stats.packets = _packets.load(std::memory_order_relaxed);
+    stats.lost = _lost.load(std::memory_order_relaxed);
+    stats.late = _late.load(std::memory_order_relaxed);
+    stats.ignored = _ignored.load(std::memory_order_relaxed);
+    stats.overruns = _overruns.load(std::memory_order_relaxed);
+  }
+  stats.interval = _interval.count();
+  return stats;
+}
+
+// Frames are paced at the stream's frame rate (slightly faster, so the
+// buffer drains), but never held longer than the jitter delay
+Timestamp LightStream::dueOf(Timestamp arrival) {
+  Timestamp due = arrival;
+  if (_interval.count() > 0 && _lastDue + _interval * 15 / 16 > due) {
+    due = _lastDue + _interval * 15 / 16;
+  }
+  Timestamp latest = arrival + millis(STREAM_JITTER_MS);
+  return due < latest ? due : latest;
+}
+
+// Get when the next frame is due, or when the stream times out
+Timestamp LightStream::nextDeadline(Timestamp now) {
+  if (_isTerminated.load(std::memory_order_relaxed)) {
+    return now;
+  }
+  uint32_t tail = _tail.load(std::memory_order_relaxed);
+  if (_head.load(std::memory_order_acquire) != tail) {
+    return dueOf(_arrivals[tail % STREAM_BUFFER_FRAMES]);
+  }
+  return _isActive ? _lastApplied + millis(STREAM_TIMEOUT_MS) : NO_DEADLINE;
+}
+
+// Write the due frames
+void LightStream::loop(Timestamp now) {
+  uint32_t tail = _tail.load(std::memory_order_relaxed);
+  uint32_t head = _head.load(std::memory_order_acquire);
+  const uint8_t *levels = NULL;
+  Timestamp arrival;
+  while (tail != head) {
+    int slot = tail % STREAM_BUFFER_FRAMES;
+    Timestamp due = dueOf(_arrivals[slot]);
+    if (due > now) {
+      break;
+    }
+    // Only the newest due frame is written
+    if (levels != NULL) {
+      _stats.skipped++;
+    }
+    levels = _frames.data() + slot * _count;
+    arrival = _arrivals[slot];
+    Duration interval = arrival - _lastArrival;
+    if (interval < MAX_FRAME_INTERVAL) {
+      // The average starts at the first interval, then follows slowly
+      _interval = _interval.count() == 0
+                      ? interval
+                      : _interval + (interval - _interval) / 8;
+      Duration deviation = interval - _interval;
+      _stats.totalJitter += deviation.count() < 0 ? -deviation.count()
+                                                  : deviation.count();
+    }
+    _lastArrival = arrival;
+    _lastDue = due;
+    tail++;
+  }
+  if (levels != NULL) {
+    if (!_isActive) {
+      _isActive = true;
+      if (_onHandover != NULL) {
+        _onHandover(true);
+      }
+    }
+    apply(levels);
+    uint32_t latency = (now - arrival).count();
+    _stats.frames++;
+    _stats.totalLatency += latency;
+    if (latency > _stats.maxLatency) {
+      _stats.maxLatency = latency;
+    }
+    _lastApplied = now;
+  }
+  // The frame's slot is only handed back once it was written
+  _tail.store(tail, std::memory_order_release);
+  if (_isTerminated.exchange(false, std::memory_order_acquire) ||
+      (_isActive && now - _lastApplied >= millis(STREAM_TIMEOUT_MS))) {
+    release();
+  }
+}
+
+// Write a frame's levels
+void LightStream::apply(const uint8_t *levels) {
+  LightBank &bank = _lights[0].getBank();
+  bank.beginFrame();
+  for (int light = 0; light < _count; light++) {
+    _lights[light].setLevel(
+        (levels[light] * LightDutyTable::MAX_LEVEL + CHANNEL_MAX / 2) /
+        CHANNEL_MAX);
+  }
+  bank.commitFrame();
+}
+
+// Hand the lights back
+void LightStream::release(void) {
+  if (!_isActive) {
+    return;
+  }
+  _isActive = false;
+  _interval = Duration(0);
+  if (_onHandover != NULL) {
+    _onHandover(false);
+  }
+}
@@ -0,0 +1,253 @@
+#ifndef LIGHT_STREAM_H
+#define LIGHT_STREAM_H
+
+#include "StreamPacket.h"
+#include <Interval.h>
+#include <Light.h>
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+#ifndef STREAM_BUFFER_FRAMES
+#define STREAM_BUFFER_FRAMES 4 // Frames the jitter buffer can hold
+#endif
+
+#ifndef STREAM_JITTER_MS
+#define STREAM_JITTER_MS 30 // Longest a frame is held to even out its timing
+#endif
+
+#ifndef STREAM_TIMEOUT_MS
+#define STREAM_TIMEOUT_MS 2500 // Time without frames before control is handed
+                               // back (the E1.31 data loss timeout)
+#endif
+
+#ifndef STREAM_TASK_STACK
+#define STREAM_TASK_STACK 4096 // Stack size of the receive task in bytes
+#endif
+
+#ifndef STREAM_TASK_PRIORITY
+#define STREAM_TASK_PRIORITY 5 // FreeRTOS priority of the receive task
+#endif
+
+#ifndef STREAM_DATAGRAM_SIZE
+#define STREAM_DATAGRAM_SIZE 1500 // Largest datagram received in bytes
+#endif
+
+/**
+ * Counters collected by a light stream since the last reset. Latencies are
+ * from the moment a frame's last packet is received to the moment its levels
+ * are written, so they include the time spent in the jitter buffer
+ */
+struct StreamStats {
+  uint32_t packets = 0;      // Datagrams received
+  uint32_t frames = 0;       // Frames written to the lights
+  uint32_t lost = 0;         // Packets missing from the sequence numbers
+  uint32_t late = 0;         // Duplicate or out of order packets discarded
+  uint32_t ignored = 0;      // Malformed, other universe or low priority
+  uint32_t overruns = 0;     // Frames dropped because the buffer was full
+  uint32_t skipped = 0;      // Frames replaced by a newer one that was due
+  uint64_t totalLatency = 0; // Sum of frame latencies in microseconds
+  uint32_t maxLatency = 0;   // Longest frame latency in microseconds
+  uint64_t totalJitter = 0;  // Sum of frame interval deviations in us
+  uint32_t interval = 0;     // Average time between frames in microseconds
+
+  /** Average frame latency in microseconds */
+  uint32_t averageLatency() {
+    return frames == 0 ? 0 : totalLatency / frames;
+  }
+
+  /**
+   * Average deviation of the time between frames from the average interval,
+   * in microseconds (how unevenly frames arrive)
+   */
+  uint32_t averageJitter() {
+    uint32_t taken = frames + skipped;
+    return taken == 0 ? 0 : totalJitter / taken;
+  }
+
+  /** Fraction of the sent packets that never arrived (0 to 1) */
+  float lossRate() {
+    uint32_t sent = packets + lost;
+    return sent == 0 ? 0 : (float)lost / sent;
+  }
+};
+
+/**
+ * LightStream receives E1.31 (sACN) or DDP light data over UDP and writes it to
+ * a set of lights, so a show sequencer can drive a model at 40 frames per
+ * second without going through the MQTT broker. One channel (a byte) sets one
+ * light, starting at a configurable channel of the stream.
+ *
+ * Datagrams are received and assembled into frames on their own task, checked
+ * for lost and out of order packets with their sequence numbers, and handed to
+ * the lighting task through a small jitter buffer. The buffer paces frames at
+ * the stream's own frame rate (holding a frame for at most STREAM_JITTER_MS),
+ * so frames that arrive in bursts are still shown evenly.
+ *
+ * While frames arrive the stream owns the lights. The application is told
+ * when the stream takes over and when it hands control back (after
+ * STREAM_TIMEOUT_MS without frames, or when an E1.31 source terminates), so
+ * it can stop its own effects and restore its state. Only sources with at
+ * least the stream's priority take over (E1.31 priorities, where DDP sources
+ * count as STREAM_DEFAULT_PRIORITY).
+ *
+ * The stream is run like an effect, so it should be added to a Scheduler
+ * (which onReceive should wake)
+ */
+class LightStream {
+public:
+  /**
+   * Initialize a stream
+   * @param lights The lights, in channel order (sharing a bank)
+   * @param count Number of lights
+   */
+  LightStream(Light *lights, int count);
+
+  // The receive task references the stream, so streams can't be copied
+  LightStream(const LightStream &) = delete;
+  LightStream &operator=(const LightStream &) = delete;
+
+  /**
+   * Set the protocol to listen for (DDP by default)
+   * @param protocol The protocol
+   * @param port UDP port to listen on (0 for the protocol's default port)
+   */
+  LightStream &setProtocol(StreamProtocol protocol, int port = 0);
+
+  /**
+   * Set the E1.31 universe to receive (1 by default). The stream also joins
+   * the universe's multicast group
+   * @param universe The universe (1 to 63999)
+   */
+  LightStream &setUniverse(uint16_t universe);
+
+  /**
+   * Set the channel of the first light (0 by default). The first channel of
+   * an E1.31 universe, or the first byte of a DDP frame, is channel 0
+   * @param channel The channel
+   */
+  LightStream &setStartChannel(uint32_t channel);
+
+  /**
+   * Set the priority a source needs to take over the lights
+   * (STREAM_DEFAULT_PRIORITY by default, so any source does)
+   * @param priority E1.31 priority from 0 to 200
+   */
+  LightStream &setPriority(uint8_t priority);
+
+  /**
+   * Set the function called on the receive task whenever a frame is buffered
+   * (ex. to wake the scheduler)
+   * @param callback The function
+   */
+  LightStream &onReceive(void (*callback)(void));
+
+  /**
+   * Set the function called on the lighting task when the stream takes over
+   * the lights (before the first frame is written) or hands them back
+   * @param callback The function, called with whether the stream is active
+   */
+  LightStream &onHandover(void (*callback)(bool isActive));
+
+  /**
+   * Open the UDP socket and start the receive task (once the network is up).
+   * Calling it again does nothing
+   * @returns false if the socket couldn't be opened or the task started
+   */
+  bool start(void);
+
+  /**
+   * Handle a datagram. Called by the receive task, and can be called directly
+   * to feed packets from another source (only from one task at a time)
+   * @param datagram The datagram bytes
+   * @param size Number of datagram bytes
+   * @param now The time the datagram was received
+   */
+  void receive(const uint8_t *datagram, size_t size, Timestamp now);
+
+  /** Indicates if the stream currently owns the lights */
+  bool isActive(void) { return _isActive; }
+
+  /**
+   * Get the collected counters
+   * @param reset Whether to reset the counters after reading them
+   */
+  StreamStats getStats(bool reset = false);
+
+  /**
+   * Get the timestamp the next buffered frame is due, or when the stream
+   * times out
+   * @param now The current timestamp
+   */
+  Timestamp nextDeadline(Timestamp now);
+
+  /**
+   * Write the buffered frames that are due, and hand control back if the
+   * stream stopped
+   * @param now The current timestamp
+   */
+  void loop(Timestamp now);
+
+private:
+  Light *_lights;                                 // Lights in channel order
+  int _count;                                     // Number of lights
+  StreamProtocol _protocol = StreamProtocol::DDP; // Received protocol
+  int _port = 0;                                  // UDP port (0 for default)
+  uint16_t _universe = 1;                         // E1.31 universe
+  uint32_t _startChannel = 0;                     // Channel of the first light
+  uint8_t _priority = STREAM_DEFAULT_PRIORITY;    // Priority to take over
+  void (*_onReceive)(void) = NULL;                // Frame buffered callback
+  void (*_onHandover)(bool) = NULL;               // Control changed callback
+  std::atomic<int> _socket{-1};                   // UDP socket
+
+  // Receive task state
+  std::vector<uint8_t> _assembly; // Frame being assembled from packets
+  bool _hasSequence = false;      // A sequence number was received
+  uint8_t _sequence = 0;          // Last sequence number received
+  Timestamp _lastPacket;          // When the last packet was received
+
+  // Jitter buffer (written by the receive task, read by the lighting task)
+  std::vector<uint8_t> _frames;              // Buffered frame levels
+  Timestamp _arrivals[STREAM_BUFFER_FRAMES]; // Arrival of each frame
+  std::atomic<uint32_t> _head{0};            // Frames buffered so far
+  std::atomic<uint32_t> _tail{0};            // Frames taken so far
+  std::atomic<bool> _isTerminated{false};    // The source terminated
+
+  // Receive task counters (see StreamStats)
+  std::atomic<uint32_t> _packets{0};
+  std::atomic<uint32_t> _lost{0};
+  std::atomic<uint32_t> _late{0};
+  std::atomic<uint32_t> _ignored{0};
+  std::atomic<uint32_t> _overruns{0};
+
+  // Lighting task state
+  bool _isActive = false; // The stream owns the lights
+  Timestamp _lastApplied; // When the last frame was written
+  Timestamp _lastArrival; // Arrival of the last frame taken
+  Timestamp _lastDue;     // When the last frame taken was due
+  Duration _interval{0};  // Average time between frames
+  StreamStats _stats;     // Lighting task counters
+
+  /** Receive task entrypoint */
+  static void receiveTask(void *stream);
+
+  /** Check a packet's sequence number, counting lost and late packets */
+  bool checkSequence(const StreamPacket &packet);
+
+  /** Copy a packet's channels that map to lights into the assembled frame */
+  void assemble(const StreamPacket &packet);
+
+  /** Hand the assembled frame to the lighting task */
+  void push(Timestamp now);
+
+  /** When a buffered frame is due */
+  Timestamp dueOf(Timestamp arrival);
+
+  /** Write a frame's levels to the lights in one bank frame */
+  void apply(const uint8_t *levels);
+
+  /** Hand the lights back to the application */
+  void release(void);
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "StreamPacket.h"
+
+#include <string.h>
+
+// DDP header (the timecode is only present if its flag is set)
+#define DDP_HEADER_SIZE 10
+#define DDP_TIMECODE_SIZE 4
+#define DDP_VERSION_MASK 0xC0
+#define DDP_VERSION_1 0x40
+#define DDP_FLAG_TIMECODE 0x10
+#define DDP_FLAG_STORAGE 0x08
+#define DDP_FLAG_REPLY 0x04
+#define DDP_FLAG_QUERY 0x02
+#define DDP_FLAG_PUSH 0x01
+#define DDP_SEQUENCE_MASK 0x0F
+#define DDP_ID_DISPLAY 1 // Destination of light data
+
+// E1.31 data packet layout (ANSI E1.31-2018)
+#define E131_HEADER_SIZE 126 // Everything up to the first channel
+#define E131_MAX_CHANNELS 512
+#define E131_MAX_PRIORITY 200
+#define E131_ROOT_VECTOR 0x00000004    // VECTOR_ROOT_E131_DATA
+#define E131_FRAMING_VECTOR 0x00000002 // VECTOR_E131_DATA_PACKET
+#define E131_DMP_VECTOR 0x02           // VECTOR_DMP_SET_PROPERTY
+#define E131_OPTION_PREVIEW 0x80       // Data is for visualizers only
+#define E131_OPTION_TERMINATED 0x40    // Source stopped sending
+#define E131_START_CODE_DIMMER 0x00    // DMX dimmer data
+
+// Offsets of the E1.31 fields used by the receiver
+#define E131_ACN_ID 4
+#define E131_ROOT_VECTOR_AT 18
+#define E131_FRAMING_VECTOR_AT 40
+#define E131_PRIORITY_AT 108
+#define E131_SEQUENCE_AT 111
+#define E131_OPTIONS_AT 112
+#define E131_UNIVERSE_AT 113
+#define E131_DMP_VECTOR_AT 117
+#define E131_VALUE_COUNT_AT 123
+#define E131_START_CODE_AT 125
+
+// ACN packet identifier at the start of every E1.31 packet
+static const uint8_t ACN_PACKET_ID[12] = {'A', 'S', 'C', '-', 'E', '1',
+                                          '.', '1', '7', 0,   0,   0};
+
+// Read a big endian 16 bit value
+static uint16_t read16(const uint8_t *data) {
+  return (uint16_t)(data[0] << 8 | data[1]);
+}
+
+// Read a big endian 32 bit value
+static uint32_t read32(const uint8_t *data) {
+  return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 |
+         (uint32_t)data[2] << 8 | data[3];
+}
+
+// Parse a datagram in either protocol
+bool StreamPacket::parse(StreamProtocol protocol, const uint8_t *datagram,
+                         size_t size) {
+  if (datagram == NULL) {
+    return false;
+  }
+  return protocol == StreamProtocol::DDP ? parseDdp(datagram, size)
+                                         : parseE131(datagram, size);
+}
+
+// Parse a DDP datagram
+bool StreamPacket::parseDdp(const uint8_t *datagram, size_t size) {
+  if (size < DDP_HEADER_SIZE) {
+    return false;
+  }
+  uint8_t flags = datagram[0];
+  if ((flags & DDP_VERSION_MASK) != DDP_VERSION_1 ||
+      (flags & (DDP_FLAG_STORAGE | DDP_FLAG_REPLY | DDP_FLAG_QUERY)) != 0 ||
+      datagram[3] != DDP_ID_DISPLAY) {
+    return false;
+  }
+  size_t header = DDP_HEADER_SIZE;
+  if (flags & DDP_FLAG_TIMECODE) {
+    header += DDP_TIMECODE_SIZE;
+  }
+  uint16_t dataLength = read16(datagram + 8);
+  if (size < header + dataLength) {
+    return false;
+  }
+  data = datagram + header;
+  length = dataLength;
+  offset = read32(datagram + 4);
+  universe = 0;
+  // Sequence 0 means the sender doesn't number its packets
+  sequence = datagram[1] & DDP_SEQUENCE_MASK;
+  hasSequence = sequence != 0;
+  priority = STREAM_DEFAULT_PRIORITY;
+  isPush = flags & DDP_FLAG_PUSH;
+  isTerminated = false;
+  return true;
+}
+
+// Parse an E1.31 data packet
+bool StreamPacket::parseE131(const uint8_t *datagram, size_t size) {
+  if (size < E131_HEADER_SIZE ||
+      memcmp(datagram + E131_ACN_ID, ACN_PACKET_ID, sizeof(ACN_PACKET_ID)) !=
+          0 ||
+      read32(datagram + E131_ROOT_VECTOR_AT) != E131_ROOT_VECTOR ||
+      read32(datagram + E131_FRAMING_VECTOR_AT) != E131_FRAMING_VECTOR ||
+      datagram[E131_DMP_VECTOR_AT] != E131_DMP_VECTOR) {
+    return false;
+  }
+  uint8_t options = datagram[E131_OPTIONS_AT];
+  if ((options & E131_OPTION_PREVIEW) ||
+      datagram[E131_START_CODE_AT] != E131_START_CODE_DIMMER ||
+      datagram[E131_PRIORITY_AT] > E131_MAX_PRIORITY) {
+    return false;
+  }
+  // The value count includes the start code
+  uint16_t values = read16(datagram + E131_VALUE_COUNT_AT);
+  if (values < 1) {
+    return false;
+  }
+  size_t channels = (size_t)values - 1;
+  if (channels > E131_MAX_CHANNELS || size < E131_HEADER_SIZE + channels) {
+    return false;
+  }
+  data = datagram + E131_HEADER_SIZE;
+  length = channels;
+  offset = 0;
+  universe = read16(datagram + E131_UNIVERSE_AT);
+  sequence = datagram[E131_SEQUENCE_AT];
+  hasSequence = true;
+  priority = datagram[E131_PRIORITY_AT];
+  // A universe is a whole frame
+  isPush = true;
+  isTerminated = options & E131_OPTION_TERMINATED;
+  return true;
+}
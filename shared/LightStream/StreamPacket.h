@@ -0,0 +1,57 @@
+#ifndef STREAM_PACKET_H
+#define STREAM_PACKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Default UDP ports of the stream protocols
+#define DDP_PORT 4048
+#define E131_PORT 5568
+
+// E1.31 priority of a source that doesn't send one (ex. DDP)
+#define STREAM_DEFAULT_PRIORITY 100
+
+// Protocols a light stream can be received in
+enum class StreamProtocol : uint8_t {
+  DDP,  // Distributed Display Protocol (ex. xLights, WLED)
+  E131, // E1.31 (sACN), one DMX universe of 512 channels
+};
+
+/**
+ * StreamPacket is a validated E1.31 or DDP datagram: where its channel data
+ * goes in the stream's frame, and what the receiver needs to order and
+ * prioritize it. The data points into the parsed datagram, so it is only valid
+ * as long as the datagram is
+ */
+struct StreamPacket {
+  const uint8_t *data = NULL;                 // Channel data (byte each)
+  uint16_t length = 0;                        // Number of channels in data
+  uint32_t offset = 0;                        // Channel of the first byte
+  uint16_t universe = 0;                      // E1.31 universe (0 for DDP)
+  uint8_t sequence = 0;                       // Sequence number (if any)
+  bool hasSequence = false;                   // Packets are numbered
+  uint8_t priority = STREAM_DEFAULT_PRIORITY; // Source priority (0 to 200)
+  bool isPush = true;                         // Last packet of a frame
+  bool isTerminated = false;                  // Source stopped (E1.31)
+
+  /**
+   * Parse a datagram. Only packets carrying light data are accepted (not DDP
+   * queries, replies or other devices, or E1.31 preview data, sync packets and
+   * alternate start codes)
+   * @param protocol The protocol the datagram was received in
+   * @param datagram The datagram bytes
+   * @param size Number of datagram bytes
+   * @returns false (leaving the packet undefined) if the datagram isn't a
+   * light data packet
+   */
+  bool parse(StreamProtocol protocol, const uint8_t *datagram, size_t size);
+
+private:
+  /** Parse a DDP datagram */
+  bool parseDdp(const uint8_t *datagram, size_t size);
+
+  /** Parse an E1.31 data packet */
+  bool parseE131(const uint8_t *datagram, size_t size);
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef COMMAND_SCHEDULE_H
+#define COMMAND_SCHEDULE_H
+
+#include "Mailbox.h"
+#include <Interval.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+
+#define COMMAND_APPLY_AT '@' // Separates a command from the time to apply it
+
+/**
+ * Split the time to apply a command at from its payload. Commands can end with
+ * `@` and the network time in milliseconds since the Unix epoch (ex.
+ * "ON@1733000000000"), so several boards can act at the same moment
+ * @param data The received payload
+ * @param applyAt Set to the time in milliseconds, or 0 if the command has none
+ * @returns The payload without the time
+ */
+inline std::string_view splitApplyAt(std::string_view data, int64_t &applyAt) {
+  applyAt = 0;
+  size_t at = data.rfind(COMMAND_APPLY_AT);
+  if (at == std::string_view::npos || at + 1 == data.size()) {
+    return data;
+  }
+  int64_t time = 0;
+  for (size_t i = at + 1; i < data.size(); i++) {
+    if (data[i] < '0' || data[i] > '9' || time > INT64_MAX / 10 - 9) {
+      return data;
+    }
+    time = time * 10 + (data[i] - '0');
+  }
+  applyAt = time;
+  return data.substr(0, at);
+}
+
+/**
+ * CommandSchedule holds commands until the local time they are due (ex. the
+ * network time a command carried, converted with SyncClock), then hands them to
+ * a handler in due order. Commands are held on the task that runs the schedule
+ * (usually the lighting task, after they were received through a Mailbox), so
+ * the schedule needs no locks.
+ *
+ * The schedule is run like an effect, so it should be added to a Scheduler
+ * @tparam Capacity Number of commands that can wait at once
+ * @tparam PayloadSize Largest payload in bytes
+ */
+template <int Capacity, size_t PayloadSize> class CommandSchedule {
+public:
+  using Handler = MAILBOX_INDEXED_HANDLER;
+
+  /**
+   * Set the function that receives the commands when they are due
+   * @param handler Function to call with the command's channel and payload
+   * (only valid during the call)
+   */
+  CommandSchedule &on(Handler handler) {
+    _handler = handler;
+    return *this;
+  }
+
+  /**
+   * Hold a command until it is due
+   * @param due When the command is due
+   * @param channel The command's channel (passed to the handler)
+   * @param data The payload (copied into the schedule)
+   * @returns false if the payload is too large or the schedule is full (the
+   * command is dropped)
+   */
+  bool add(Timestamp due, int channel, std::string_view data) {
+    if (data.size() > PayloadSize) {
+      return false;
+    }
+    for (Command &command : _commands) {
+      if (!command.isWaiting) {
+        command.isWaiting = true;
+        command.due = due;
+        command.order = _added++;
+        command.channel = channel;
+        command.size = data.size();
+        memcpy(command.data, data.data(), data.size());
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Drop every waiting command */
+  void clear(void) {
+    for (Command &command : _commands) {
+      command.isWaiting = false;
+    }
+  }
+
+  /** Get the timestamp the next command is due (whatever the current time) */
+  Timestamp nextDeadline(Timestamp) {
+    Command *next = earliest();
+    return next != NULL ? next->due : NO_DEADLINE;
+  }
+
+  /**
+   * Call the handler with every command that is due, in due order (commands
+   * due at the same time in the order they were added)
+   * @param now The current timestamp
+   */
+  void loop(Timestamp now) {
+    Command *next = earliest();
+    while (next != NULL && next->due <= now) {
+      // The command is released first, so the handler can add commands
+      next->isWaiting = false;
+      if (_handler != NULL) {
+        _handler(next->channel,
+                 std::string_view((const char *)next->data, next->size));
+      }
+      next = earliest();
+    }
+  }
+
+private:
+  // A waiting command
+  struct Command {
+    Timestamp due;             // When the command is due
+    uint32_t order;            // Order the command was added in
+    int channel;               // The command's channel
+    size_t size;               // Payload length
+    uint8_t data[PayloadSize]; // Payload bytes
+    bool isWaiting = false;    // The slot holds a command
+  };
+
+  Command _commands[Capacity]; // Command slots
+  uint32_t _added = 0;         // Number of commands added
+  Handler _handler = NULL;     // Receives the due commands
+
+  /** The waiting command that is due first */
+  Command *earliest(void) {
+    Command *next = NULL;
+    for (Command &command : _commands) {
+      if (command.isWaiting &&
+          (next == NULL || command.due < next->due ||
+           (command.due == next->due && command.order < next->order))) {
+        next = &command;
+      }
+    }
+    return next;
+  }
+};
+
+#endif
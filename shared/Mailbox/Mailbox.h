@@ -0,0 +1,245 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <Interval.h>
+#include <Metrics.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+
+#define MAILBOX_HANDLER                                                        \
+  void (*)(std::string_view) // Handler signature for mailbox channels
+#define MAILBOX_INDEXED_HANDLER                                                \
+  void (*)(int, std::string_view) // Handler signature that gets the channel
+
+/**
+ * Mailbox hands commands from one task (ex. the MQTT task) to another (the
+ * lighting task) without locks. Each channel holds only the latest payload, so
+ * a flood of posts (ex. someone dragging a slider) collapses into one handler
+ * call with the last value when the receiving task drains the mailbox.
+ *
+ * Every channel is a triple buffer: the producer writes into its own buffer and
+ * swaps it with the middle one, and the consumer swaps the middle buffer with
+ * its own when it is fresh. Neither side ever waits for or copies over the
+ * other, so a payload is never torn. Payloads can only be posted to a channel
+ * from one task at a time, but signals (posts without a payload) can be sent
+ * from any task.
+ *
+ * Channels are handled in the order of their latest posts, so a command that
+ * overrides others (ex. a switch for every light) still wins when a burst of
+ * posts is drained at once. The time the oldest payload of a channel was
+ * posted is marked as received in the global Metrics when it is handled, so
+ * the scheduler pass that handles it records its latency.
+ *
+ * The mailbox is drained like an effect, so it can be added to a Scheduler
+ * (add it first, so effects started by the handlers are picked up in the same
+ * pass)
+ * @tparam Channels Number of channels (at most 32)
+ * @tparam PayloadSize Largest payload in bytes
+ */
+template <int Channels, size_t PayloadSize> class Mailbox {
+  static_assert(Channels > 0 && Channels <= 32,
+                "Mailbox supports between 1 and 32 channels");
+  static_assert(std::atomic<uint32_t>::is_always_lock_free,
+                "Mailbox needs lock free 32 bit atomics");
+
+public:
+  using Handler = MAILBOX_HANDLER;
+  using IndexedHandler = MAILBOX_INDEXED_HANDLER;
+
+  /**
+   * Set the function that receives a channel's payloads on the draining task
+   * @param channel The channel index
+   * @param handler Function to call with the latest payload (only valid during
+   * the call)
+   */
+  Mailbox &on(int channel, Handler handler) {
+    _channels[channel].handler = handler;
+    _channels[channel].indexedHandler = NULL;
+    return *this;
+  }
+
+  /**
+   * Set a function that receives a channel's payloads along with the channel
+   * index (ex. one handler shared by many channels)
+   * @param channel The channel index
+   * @param handler Function to call with the channel and its latest payload
+   */
+  Mailbox &on(int channel, IndexedHandler handler) {
+    _channels[channel].handler = NULL;
+    _channels[channel].indexedHandler = handler;
+    return *this;
+  }
+
+  /**
+   * Post a payload to a channel, replacing one that hasn't been handled yet.
+   * Only one task can post payloads to a channel
+   * @param channel The channel index
+   * @param data The payload (copied into the mailbox)
+   * @returns false if the payload is too large (it is dropped)
+   */
+  bool post(int channel, std::string_view data) {
+    if (data.size() > PayloadSize) {
+      return false;
+    }
+    Channel &target = _channels[channel];
+    Buffer &buffer = target.buffers[target.back];
+    memcpy(buffer.data, data.data(), data.size());
+    buffer.size = data.size();
+    // Keep the oldest payload's post time until the channel is drained
+    if constexpr (METRICS_ENABLED) {
+      uint32_t expected = 0;
+      target.postedAt.compare_exchange_strong(expected, postTime(Clock::now()),
+                                              std::memory_order_relaxed);
+    }
+    // Publish the buffer and take back whichever one was in the middle
+    target.back = target.middle.exchange(target.back | FRESH,
+                                         std::memory_order_acq_rel) &
+                  INDEX_MASK;
+    stamp(target);
+    _pending.fetch_or(1u << channel, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Signal a channel without a payload (the handler gets an empty view). Safe
+   * to call from any task
+   * @param channel The channel index
+   */
+  void post(int channel) {
+    _channels[channel].isSignaled.store(true, std::memory_order_relaxed);
+    stamp(_channels[channel]);
+    _pending.fetch_or(1u << channel, std::memory_order_release);
+  }
+
+  /** Indicates if any channel is waiting to be handled */
+  bool isPending(void) const {
+    return _pending.load(std::memory_order_relaxed) != 0;
+  }
+
+  /**
+   * Get the timestamp the mailbox needs to be drained
+   * @param now The current timestamp
+   * @returns now if a channel is waiting, or NO_DEADLINE
+   */
+  Timestamp nextDeadline(Timestamp now) {
+    return isPending() ? now : NO_DEADLINE;
+  }
+
+  /**
+   * Call the handler of every channel that was posted to since the last drain,
+   * in the order of their latest posts
+   * @param now The current timestamp (unused, every pending channel is drained)
+   */
+  void loop([[maybe_unused]] Timestamp now) {
+    uint32_t pending = _pending.exchange(0, std::memory_order_acquire);
+    // Sort the pending channels by sequence (there are only a few)
+    int order[Channels];
+    uint32_t sequences[Channels];
+    int count = 0;
+    while (pending != 0) {
+      int channel = __builtin_ctz(pending);
+      pending &= pending - 1;
+      uint32_t sequence =
+          _channels[channel].sequence.load(std::memory_order_relaxed);
+      int i = count++;
+      // Compare the difference, so the sequence can wrap around
+      for (; i > 0 && (int32_t)(sequence - sequences[i - 1]) < 0; i--) {
+        order[i] = order[i - 1];
+        sequences[i] = sequences[i - 1];
+      }
+      order[i] = channel;
+      sequences[i] = sequence;
+    }
+    for (int i = 0; i < count; i++) {
+      drain(order[i]);
+    }
+  }
+
+private:
+  static const uint8_t INDEX_MASK = 0x03; // Buffer index in `middle`
+  static const uint8_t FRESH = 0x04;      // The middle buffer wasn't read yet
+
+  // A payload slot
+  struct Buffer {
+    uint8_t data[PayloadSize]; // Payload bytes
+    size_t size = 0;           // Payload length
+  };
+
+  // A channel's buffers (the indexes are split between the two tasks)
+  struct Channel {
+    Buffer buffers[3];                    // Back, middle and front buffers
+    uint8_t back = 0;                     // Producer's buffer
+    std::atomic<uint8_t> middle{1};       // Exchanged buffer (and FRESH flag)
+    uint8_t front = 2;                    // Consumer's buffer
+    std::atomic<bool> isSignaled{false};  // A signal was posted
+    std::atomic<uint32_t> sequence{0};    // Sequence of the latest post
+    std::atomic<uint32_t> postedAt{0};    // Oldest payload not yet handled
+    Handler handler = NULL;               // Receives the payloads
+    IndexedHandler indexedHandler = NULL; // Receives the channel and payloads
+  };
+
+  Channel _channels[Channels];        // Channels by index
+  std::atomic<uint32_t> _pending{0};  // Bit per channel that was posted to
+  std::atomic<uint32_t> _sequence{0}; // Sequence of the next post
+
+  /**
+   * The low 32 bits of a timestamp in microseconds, for `postedAt` (a 64 bit
+   * atomic isn't lock free on every target). 0 means no payload, so it is
+   * moved to 1
+   */
+  static uint32_t postTime(Timestamp time) {
+    uint32_t micros = (uint32_t)time.time_since_epoch().count();
+    return micros != 0 ? micros : 1;
+  }
+
+  /**
+   * The timestamp a payload was posted at from its 32 bit post time, which
+   * wraps about every 71 minutes (payloads are handled long before that)
+   */
+  static Timestamp postedTimestamp(uint32_t postedAt) {
+    Timestamp now = Clock::now();
+    return now - Duration((uint32_t)(postTime(now) - postedAt));
+  }
+
+  /** Stamp a channel with the next post sequence */
+  void stamp(Channel &channel) {
+    channel.sequence.store(_sequence.fetch_add(1, std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+  }
+
+  /** Call a channel's handler with its latest payload and pending signal */
+  void drain(int index) {
+    Channel &channel = _channels[index];
+    bool isSignaled =
+        channel.isSignaled.exchange(false, std::memory_order_relaxed);
+    bool isFresh = channel.middle.load(std::memory_order_relaxed) & FRESH;
+    if (isFresh) {
+      channel.front = channel.middle.exchange(channel.front,
+                                              std::memory_order_acq_rel) &
+                      INDEX_MASK;
+    }
+    if (!isFresh && !isSignaled) {
+      return;
+    }
+    std::string_view data;
+    if (isFresh) {
+      const Buffer &buffer = channel.buffers[channel.front];
+      data = std::string_view((const char *)buffer.data, buffer.size);
+      uint32_t postedAt =
+          channel.postedAt.exchange(0, std::memory_order_relaxed);
+      if (postedAt != 0) {
+        Metrics::global().markReceived(postedTimestamp(postedAt));
+      }
+    }
+    if (channel.handler != NULL) {
+      channel.handler(data);
+    } else if (channel.indexedHandler != NULL) {
+      channel.indexedHandler(index, data);
+    }
+  }
+};
+
+#endif
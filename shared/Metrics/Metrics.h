@@ -0,0 +1,339 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "esp_system.h"
+#include <Interval.h>
+#include <atomic>
+#include <bit>
+#include <stdint.h>
+
+#ifndef METRICS_ENABLED
+#define METRICS_ENABLED 1 // Collect metrics (0 compiles every recording out)
+#endif
+
+#ifndef METRICS_BUCKETS
+#define METRICS_BUCKETS 16 // Buckets of each histogram
+#endif
+
+/**
+ * Counter counts events from any task without locks. Counting compiles to
+ * nothing when METRICS_ENABLED is 0
+ */
+class Counter {
+public:
+  /**
+   * Count events
+   * @param count Number of events
+   */
+  void add(uint32_t count = 1) {
+    if constexpr (METRICS_ENABLED) {
+      _value.fetch_add(count, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Get the number of events counted
+   * @param reset Whether to start counting from 0 again
+   */
+  uint32_t read(bool reset = false) {
+    return reset ? _value.exchange(0, std::memory_order_relaxed)
+                 : _value.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<uint32_t> _value{0}; // Events counted
+};
+
+/** Durations recorded by a histogram, read at one point in time */
+struct HistogramStats {
+  uint32_t count = 0;                     // Number of durations recorded
+  uint64_t sumUs = 0;                     // Sum of the durations
+  uint32_t maxUs = 0;                     // Longest duration
+  uint32_t firstBucketUs = 1;             // Upper bound of the first bucket
+  uint32_t buckets[METRICS_BUCKETS] = {}; // Durations recorded per bucket
+
+  /** Average duration in microseconds */
+  uint32_t averageUs() { return count == 0 ? 0 : sumUs / count; }
+
+  /**
+   * Estimate a percentile: the upper bound of the bucket holding it (or the
+   * longest duration if that is shorter)
+   * @param percentile The percentile (0 to 100)
+   */
+  uint32_t percentileUs(int percentile) {
+    uint64_t rank = ((uint64_t)count * percentile + 99) / 100;
+    uint64_t seen = 0;
+    for (int i = 0; i < METRICS_BUCKETS - 1; i++) {
+      seen += buckets[i];
+      if (seen >= rank && seen > 0) {
+        uint64_t bound = (uint64_t)firstBucketUs << i;
+        return bound < maxUs ? bound : maxUs;
+      }
+    }
+    return maxUs;
+  }
+};
+
+/**
+ * Histogram records durations into fixed buckets from any task without locks,
+ * so recording costs a few atomic adds and never allocates. Bucket 0 holds the
+ * durations shorter than the first bucket's bound, and each bucket after it
+ * holds durations up to twice as long as the previous one (the last bucket
+ * holds everything longer). Recording compiles to nothing when METRICS_ENABLED
+ * is 0
+ */
+class Histogram {
+public:
+  /**
+   * Create a histogram
+   * @param firstBucketUs Upper bound of the first bucket in microseconds
+   */
+  Histogram(uint32_t firstBucketUs) : _firstBucketUs{firstBucketUs} {}
+
+  /**
+   * Record a duration
+   * @param duration The duration (negative durations count as 0)
+   */
+  void record(Duration duration) {
+    if constexpr (METRICS_ENABLED) {
+      int64_t us = duration.count();
+      uint32_t value = us < 0 ? 0 : us > UINT32_MAX ? UINT32_MAX : us;
+      int bucket = std::bit_width(value / _firstBucketUs);
+      if (bucket >= METRICS_BUCKETS) {
+        bucket = METRICS_BUCKETS - 1;
+      }
+      _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+      _count.fetch_add(1, std::memory_order_relaxed);
+      _sum.fetch_add(value, std::memory_order_relaxed);
+      uint32_t max = _max.load(std::memory_order_relaxed);
+      while (value > max && !_max.compare_exchange_weak(
+                                max, value, std::memory_order_relaxed)) {
+      }
+    }
+  }
+
+  /**
+   * Get the recorded durations
+   * @param reset Whether to start recording from nothing again (durations
+   * recorded while reading may land in either read)
+   */
+  HistogramStats read(bool reset = false) {
+    HistogramStats stats;
+    stats.firstBucketUs = _firstBucketUs;
+    stats.count = take(_count, reset);
+    stats.sumUs = take(_sum, reset);
+    stats.maxUs = take(_max, reset);
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+      stats.buckets[i] = take(_buckets[i], reset);
+    }
+    return stats;
+  }
+
+private:
+  uint32_t _firstBucketUs;                           // Upper bound of bucket 0
+  std::atomic<uint32_t> _count{0};                   // Durations recorded
+  std::atomic<uint64_t> _sum{0};                     // Sum of the durations
+  std::atomic<uint32_t> _max{0};                     // Longest duration
+  std::atomic<uint32_t> _buckets[METRICS_BUCKETS]{}; // Counts per bucket
+
+  /** Read a value, and optionally reset it */
+  template <typename T> static T take(std::atomic<T> &value, bool reset) {
+    return reset ? value.exchange(0, std::memory_order_relaxed)
+                 : value.load(std::memory_order_relaxed);
+  }
+};
+
+// Steps of the first connection after boot
+enum class BootStep {
+  WIFI, // Associated with the access point
+  IP,   // Got an IP address
+  MQTT, // Connected to the broker
+};
+
+/**
+ * BootTimes records how long after boot each step of the first connection was
+ * reached (ex. to compare connecting with cached WiFi parameters to a full
+ * scan). Every step is only recorded once, and nothing is recorded when
+ * METRICS_ENABLED is 0
+ */
+class BootTimes {
+public:
+  /**
+   * Record a step, unless it was already reached
+   * @param step The step
+   * @param now The current timestamp
+   */
+  void mark(BootStep step, Timestamp now) {
+    if constexpr (METRICS_ENABLED) {
+      int64_t ms = toMillis(now.time_since_epoch());
+      uint32_t expected = 0;
+      _ms[(int)step].compare_exchange_strong(expected, ms > 0 ? ms : 1,
+                                             std::memory_order_relaxed);
+    }
+  }
+
+  /** Milliseconds from boot to a step (0 until it is reached) */
+  uint32_t read(BootStep step) {
+    return _ms[(int)step].load(std::memory_order_relaxed);
+  }
+
+  /** Set whether the connection used cached parameters */
+  void setFast(bool isFast) {
+    _isFast.store(isFast, std::memory_order_relaxed);
+  }
+
+  /** Indicates if the connection used cached parameters */
+  bool isFast(void) { return _isFast.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint32_t> _ms[3]{};   // Time to each step in milliseconds
+  std::atomic<bool> _isFast{false}; // Connected with cached parameters
+};
+
+/**
+ * Metrics collects how a board behaves under load. The scheduler records the
+ * duration of every pass and the latency from a message being received to its
+ * lights being committed, the MQTT client records reconnections, and
+ * applications count the payloads they drop or can't parse. Everything is
+ * recorded without locks, so any task can record metrics
+ */
+class Metrics {
+public:
+  /** The metrics shared by every library */
+  static Metrics &global(void) {
+    static Metrics metrics;
+    return metrics;
+  }
+
+  Histogram tick{8};           // Duration of each scheduler pass
+  Histogram latency{250};      // Message received to lights committed
+  Histogram reconnect{125000}; // Time from losing the broker to reconnecting
+  Counter reconnects;          // Reconnections to the broker
+  Counter dropped;             // Payloads dropped (ex. too large)
+  Counter invalid;             // Payloads that couldn't be parsed
+  BootTimes boot;              // Time to WiFi, IP and the broker after boot
+
+  /**
+   * Mark that a message was received, when it is handled (ex. by a Mailbox
+   * drain). Only the oldest message since the timestamp was last taken is
+   * kept, so the latency covers the oldest message of a burst
+   * @param received The timestamp the message was received at
+   */
+  void markReceived(Timestamp received) {
+    if constexpr (METRICS_ENABLED) {
+      int64_t at = received.time_since_epoch().count();
+      int64_t oldest = _receivedAt.load(std::memory_order_relaxed);
+      while ((oldest == 0 || at < oldest) &&
+             !_receivedAt.compare_exchange_weak(oldest, at,
+                                                std::memory_order_relaxed)) {
+      }
+    }
+  }
+
+  /**
+   * Take the timestamp of the oldest message handled since the last call
+   * @param received Set to the timestamp
+   * @returns false if no message was handled
+   */
+  bool takeReceived(Timestamp &received) {
+    if constexpr (METRICS_ENABLED) {
+      int64_t at = _receivedAt.exchange(0, std::memory_order_relaxed);
+      received = Timestamp(Duration(at));
+      return at != 0;
+    }
+    return false;
+  }
+
+  /**
+   * Write a snapshot of the metrics into the current object of a document
+   * (see the README for its members)
+   * @param writer A JsonWriter or CborWriter
+   * @param reset Whether the next snapshot only covers the time since this one
+   */
+  template <typename Writer> void write(Writer &writer, bool reset = true) {
+    writer.add("uptime", (int64_t)toMillis(Clock::now().time_since_epoch()))
+        .add("heap", (int64_t)esp_get_free_heap_size())
+        .add("heap_min", (int64_t)esp_get_minimum_free_heap_size());
+    writeHistogram(writer, "tick_us", tick.read(reset), 1);
+    writeHistogram(writer, "latency_us", latency.read(reset), 1);
+    writeHistogram(writer, "reconnect_ms", reconnect.read(reset), 1000);
+    writer.add("reconnects", (int64_t)reconnects.read(reset))
+        .add("dropped", (int64_t)dropped.read(reset))
+        .add("invalid", (int64_t)invalid.read(reset));
+    writer.beginObject("boot")
+        .add("wifi_ms", (int64_t)boot.read(BootStep::WIFI))
+        .add("ip_ms", (int64_t)boot.read(BootStep::IP))
+        .add("mqtt_ms", (int64_t)boot.read(BootStep::MQTT))
+        .add("fast", boot.isFast())
+        .endObject();
+  }
+
+private:
+  std::atomic<int64_t> _receivedAt{0}; // Oldest handled message not yet taken
+
+  /** Write the summary of a histogram as an object */
+  template <typename Writer>
+  static void writeHistogram(Writer &writer, const char *key,
+                             HistogramStats stats, uint32_t divisor) {
+    writer.beginObject(key)
+        .add("n", (int64_t)stats.count)
+        .add("avg", (int64_t)(stats.averageUs() / divisor))
+        .add("p50", (int64_t)(stats.percentileUs(50) / divisor))
+        .add("p99", (int64_t)(stats.percentileUs(99) / divisor))
+        .add("max", (int64_t)(stats.maxUs / divisor))
+        .endObject();
+  }
+};
+
+/**
+ * MetricsReporter runs an action (ex. publishing a snapshot) at a fixed
+ * interval. It is driven like an effect, so it can be added to a Scheduler,
+ * and never runs when METRICS_ENABLED is 0
+ */
+class MetricsReporter {
+public:
+  /**
+   * Create a reporter
+   * @param intervalInMs Time between reports (0 to never report)
+   * @param action Function that reports the metrics
+   */
+  MetricsReporter(int intervalInMs, void (*action)(void))
+      : _interval{millis(intervalInMs)}, _action{action} {}
+
+  /**
+   * Get the timestamp of the next report
+   * @param now The current timestamp
+   */
+  Timestamp nextDeadline(Timestamp now) {
+    if (!METRICS_ENABLED || _interval <= Duration::zero()) {
+      return NO_DEADLINE;
+    }
+    if (!_isStarted) {
+      _isStarted = true;
+      _deadline = now + _interval;
+    }
+    return _deadline;
+  }
+
+  /**
+   * Run the action when the report is due
+   * @param now The current timestamp
+   */
+  void loop(Timestamp now) {
+    if (_isStarted && now >= _deadline) {
+      // Reports stay on a fixed cadence, skipping the ones that were missed
+      while (_deadline <= now) {
+        _deadline += _interval;
+      }
+      _action();
+    }
+  }
+
+private:
+  Duration _interval;      // Time between reports
+  void (*_action)(void);   // Function that reports the metrics
+  bool _isStarted = false; // The first report was scheduled
+  Timestamp _deadline;     // Timestamp of the next report
+};
+
+#endif
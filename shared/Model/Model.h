@@ -0,0 +1,681 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <JsonWriter.h>
+#include <Light.h>
+#include <algorithm>
+#include <array>
+#include <assert.h>
+#include <driver/ledc.h>
+#include <initializer_list>
+#include <iterator>
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+#include <utility>
+
+#ifndef MODEL_TOPIC_SIZE
+#define MODEL_TOPIC_SIZE 48 // Longest topic in bytes (including the terminator)
+#endif
+
+#define NO_PIN -1 // Pin of a channel without a light
+
+/**
+ * The payloads a channel's topic accepts. A channel's value is the index of its
+ * payload, so the first payload is the channel's initial (and "off") value
+ */
+struct ModelValues {
+  const char *const *names = NULL; // Payload of each value
+  int count = 0;                   // Number of values (0 if there's no topic)
+
+  constexpr ModelValues(void) {}
+
+  template <size_t N>
+  constexpr ModelValues(const char *const (&values)[N])
+      : names{values}, count{N} {}
+};
+
+// Payloads of an on/off channel
+inline constexpr const char *SWITCH_NAMES[] = {"OFF", "ON"};
+inline constexpr ModelValues SWITCH_VALUES = SWITCH_NAMES;
+
+// Values of a channel that only has a light
+inline constexpr ModelValues NO_TOPIC;
+
+/**
+ * One channel of a model: a topic with the payloads it accepts, a light, or
+ * both (in which case the light follows the topic, turning on for any value
+ * but the first). Channels are meant to be written with designated
+ * initializers so each one is a single line, ex.
+ * `{.name = "trees", .pin = 25, .isDimmable = true, .level = 25}`
+ */
+struct ModelChannel {
+  const char *name;                   // Topic suffix and state document key
+  int pin = NO_PIN;                   // GPIO pin of the channel's light
+  bool isDimmable = false;            // The light gets a PWM channel
+  uint8_t level = 100;                // Brightness % the light turns on at
+  ModelValues values = SWITCH_VALUES; // Accepted payloads (or NO_TOPIC)
+  bool isReported = true;             // Included in the state document
+};
+
+/**
+ * A set of channels, one bit per channel (ex. the channels that changed, or the
+ * inputs an output depends on)
+ * @tparam Size Number of channels
+ */
+template <int Size> class ModelMask {
+public:
+  constexpr ModelMask(void) {}
+
+  /** A mask of the given channels */
+  constexpr ModelMask(std::initializer_list<int> channels) {
+    for (int channel : channels) {
+      set(channel);
+    }
+  }
+
+  /** Indicates if a channel is in the mask */
+  constexpr bool test(int channel) const {
+    return (_words[channel / 32] >> (channel % 32)) & 1;
+  }
+
+  /** Add a channel */
+  constexpr ModelMask &set(int channel) {
+    _words[channel / 32] |= 1u << (channel % 32);
+    return *this;
+  }
+
+  /** Remove a channel */
+  constexpr ModelMask &reset(int channel) {
+    _words[channel / 32] &= ~(1u << (channel % 32));
+    return *this;
+  }
+
+  /** Remove every channel */
+  constexpr ModelMask &clear(void) {
+    for (uint32_t &word : _words) {
+      word = 0;
+    }
+    return *this;
+  }
+
+  /** Indicates if any channel is in the mask */
+  constexpr bool any(void) const {
+    for (uint32_t word : _words) {
+      if (word != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Indicates if the masks have a channel in common */
+  constexpr bool intersects(const ModelMask &other) const {
+    for (int i = 0; i < WORDS; i++) {
+      if ((_words[i] & other._words[i]) != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  constexpr ModelMask &operator|=(const ModelMask &other) {
+    for (int i = 0; i < WORDS; i++) {
+      _words[i] |= other._words[i];
+    }
+    return *this;
+  }
+
+  constexpr ModelMask operator|(const ModelMask &other) const {
+    return ModelMask(*this) |= other;
+  }
+
+  constexpr ModelMask operator&(const ModelMask &other) const {
+    ModelMask mask;
+    for (int i = 0; i < WORDS; i++) {
+      mask._words[i] = _words[i] & other._words[i];
+    }
+    return mask;
+  }
+
+  /**
+   * Call a function with every channel in the mask, in channel order
+   * @param function Called with the channel index
+   */
+  template <typename Function> void forEach(Function function) const {
+    for (int i = 0; i < WORDS; i++) {
+      uint32_t word = _words[i];
+      while (word != 0) {
+        function(i * 32 + __builtin_ctz(word));
+        word &= word - 1;
+      }
+    }
+  }
+
+private:
+  static constexpr int WORDS = Size > 0 ? (Size + 31) / 32 : 1;
+
+  uint32_t _words[WORDS] = {}; // Bit per channel
+};
+
+// Where a channel's value is stored in the packed state
+struct ModelField {
+  uint8_t word = 0;  // Index of the word holding the value
+  uint8_t shift = 0; // Position of the value's lowest bit
+  uint32_t mask = 0; // Mask of the value's bits (0 if there's one value)
+};
+
+// A topic name built at compile time
+struct ModelTopic {
+  char name[MODEL_TOPIC_SIZE] = {};
+};
+
+/**
+ * State document members built at compile time: `"name":"VALUE"` for every
+ * value of every reported channel, stored back to back
+ */
+template <size_t Bytes, size_t Count> struct ModelMembers {
+  char text[Bytes + 1] = {};        // Every member
+  uint16_t offsets[Count + 1] = {}; // Start of each member (and the end)
+
+  /** Get a member by index */
+  constexpr std::string_view get(int index) const {
+    return std::string_view(text + offsets[index],
+                            offsets[index + 1] - offsets[index]);
+  }
+};
+
+namespace ModelTables {
+/** Number of channels with a light */
+template <size_t N>
+constexpr int countLights(const ModelChannel (&channels)[N]) {
+  int count = 0;
+  for (const ModelChannel &channel : channels) {
+    count += channel.pin != NO_PIN;
+  }
+  return count;
+}
+
+/** Number of lights that need a PWM channel */
+template <size_t N>
+constexpr int countPwm(const ModelChannel (&channels)[N]) {
+  int count = 0;
+  for (const ModelChannel &channel : channels) {
+    count += channel.pin != NO_PIN && channel.isDimmable;
+  }
+  return count;
+}
+
+/** Light slot of every channel (-1 for channels without a light) */
+template <size_t N>
+constexpr std::array<int8_t, N> slots(const ModelChannel (&channels)[N]) {
+  std::array<int8_t, N> slots{};
+  int next = 0;
+  for (size_t i = 0; i < N; i++) {
+    slots[i] = channels[i].pin != NO_PIN ? next++ : -1;
+  }
+  return slots;
+}
+
+/** Pin and PWM channel (-1 for standard lights) of every light slot */
+template <int Lights, size_t N>
+constexpr std::array<std::pair<int, int>, Lights>
+lights(const ModelChannel (&channels)[N]) {
+  std::array<std::pair<int, int>, Lights> lights{};
+  int slot = 0;
+  int pwm = 0;
+  for (const ModelChannel &channel : channels) {
+    if (channel.pin != NO_PIN) {
+      lights[slot++] = {channel.pin, channel.isDimmable ? pwm++ : -1};
+    }
+  }
+  return lights;
+}
+
+/**
+ * Where every channel's value is stored, using as few bits as the channel's
+ * values need (values never straddle two words)
+ */
+template <size_t N>
+constexpr std::array<ModelField, N> fields(const ModelChannel (&channels)[N]) {
+  std::array<ModelField, N> fields{};
+  int word = 0;
+  int shift = 0;
+  for (size_t i = 0; i < N; i++) {
+    int bits = 0;
+    while ((1 << bits) < channels[i].values.count) {
+      bits++;
+    }
+    if (bits == 0) {
+      continue;
+    }
+    if (shift + bits > 32) {
+      word++;
+      shift = 0;
+    }
+    fields[i].word = word;
+    fields[i].shift = shift;
+    fields[i].mask = (uint32_t)((1ull << bits) - 1);
+    shift += bits;
+  }
+  return fields;
+}
+
+/** Number of words the packed state takes */
+template <size_t N>
+constexpr int valueWords(const ModelChannel (&channels)[N]) {
+  int words = 1;
+  for (const ModelField &field : fields(channels)) {
+    if (field.mask != 0 && field.word + 1 > words) {
+      words = field.word + 1;
+    }
+  }
+  return words;
+}
+
+/** Channels matching a condition */
+template <int Size, size_t N, typename Condition>
+constexpr ModelMask<Size> mask(const ModelChannel (&channels)[N],
+                               Condition condition) {
+  ModelMask<Size> mask;
+  for (size_t i = 0; i < N; i++) {
+    if (condition(channels[i])) {
+      mask.set(i);
+    }
+  }
+  return mask;
+}
+
+/** Indicates if a channel's value is written to the state document */
+constexpr bool isReported(const ModelChannel &channel) {
+  return channel.values.count > 0 && channel.isReported;
+}
+
+/** Number of state document members (one per reported value) */
+template <size_t N>
+constexpr size_t memberCount(const ModelChannel (&channels)[N]) {
+  size_t count = 0;
+  for (const ModelChannel &channel : channels) {
+    count += isReported(channel) ? channel.values.count : 0;
+  }
+  return count;
+}
+
+/** Size of every state document member, `"name":"VALUE"` */
+template <size_t N>
+constexpr size_t memberBytes(const ModelChannel (&channels)[N]) {
+  size_t bytes = 0;
+  for (const ModelChannel &channel : channels) {
+    if (isReported(channel)) {
+      size_t name = std::string_view(channel.name).size();
+      for (int value = 0; value < channel.values.count; value++) {
+        std::string_view payload = channel.values.names[value];
+        bytes += name + payload.size() + 5;
+      }
+    }
+  }
+  return bytes;
+}
+
+/** Index of every reported channel's first member */
+template <size_t N>
+constexpr std::array<uint16_t, N>
+firstMembers(const ModelChannel (&channels)[N]) {
+  std::array<uint16_t, N> first{};
+  uint16_t next = 0;
+  for (size_t i = 0; i < N; i++) {
+    first[i] = next;
+    next += isReported(channels[i]) ? channels[i].values.count : 0;
+  }
+  return first;
+}
+
+/** Build every state document member (names can't need escaping) */
+template <size_t Bytes, size_t Count, size_t N>
+constexpr ModelMembers<Bytes, Count>
+members(const ModelChannel (&channels)[N]) {
+  ModelMembers<Bytes, Count> members{};
+  size_t length = 0;
+  int index = 0;
+  auto append = [&](std::string_view text, bool isName) {
+    for (char c : text) {
+      if (isName && (c == '"' || c == '\\' || (uint8_t)c < 0x20)) {
+        throw "Channel and value names can't need escaping";
+      }
+      members.text[length++] = c;
+    }
+  };
+  for (const ModelChannel &channel : channels) {
+    if (!isReported(channel)) {
+      continue;
+    }
+    for (int value = 0; value < channel.values.count; value++) {
+      members.offsets[index++] = length;
+      append("\"", false);
+      append(channel.name, true);
+      append("\":\"", false);
+      append(channel.values.names[value], true);
+      append("\"", false);
+    }
+  }
+  members.offsets[index] = length;
+  return members;
+}
+
+/**
+ * Hash (FNV-1a) of every channel's name and payloads, which changes whenever
+ * the meaning of the packed values does
+ */
+template <size_t N>
+constexpr uint32_t stateVersion(const ModelChannel (&channels)[N]) {
+  uint32_t hash = 2166136261u;
+  auto append = [&hash](std::string_view text) {
+    for (char c : text) {
+      hash = (hash ^ (uint8_t)c) * 16777619u;
+    }
+    hash = (hash ^ 0) * 16777619u;
+  };
+  for (const ModelChannel &channel : channels) {
+    append(channel.name);
+    for (int value = 0; value < channel.values.count; value++) {
+      append(channel.values.names[value]);
+    }
+  }
+  return hash;
+}
+
+/** Full topic of every channel (the prefix followed by the channel name) */
+template <size_t N>
+constexpr std::array<ModelTopic, N> topics(std::string_view prefix,
+                                           const ModelChannel (&channels)[N]) {
+  std::array<ModelTopic, N> topics{};
+  for (size_t i = 0; i < N; i++) {
+    std::string_view name = channels[i].name;
+    if (prefix.size() + name.size() >= MODEL_TOPIC_SIZE) {
+      throw "Topic doesn't fit in MODEL_TOPIC_SIZE";
+    }
+    size_t length = 0;
+    for (char c : prefix) {
+      topics[i].name[length++] = c;
+    }
+    for (char c : name) {
+      topics[i].name[length++] = c;
+    }
+  }
+  return topics;
+}
+} // namespace ModelTables
+
+/**
+ * Model generates everything an application needs for its channels from one
+ * constexpr description: the lights (with PWM channels assigned in order), the
+ * topic names, payload parsing and state storage, and the state document.
+ * Nothing is allocated and no strings are built at runtime, and adding a
+ * channel only takes one line in the description.
+ *
+ * Values are packed into as few bits as each channel needs, and every change
+ * is recorded in a change mask. Handlers take the changes and only recompute
+ * the outputs that depend on them (ex. `updateLights(changes)` only touches the
+ * lights whose channel changed).
+ *
+ * The description is a type with a `TOPIC_PREFIX` and a `CHANNELS` array:
+ * ```
+ * struct Village {
+ *   static constexpr const char *TOPIC_PREFIX = "/village/";
+ *   static constexpr ModelChannel CHANNELS[] = {
+ *       {.name = "all"},
+ *       {.name = "bakery", .pin = 16},
+ *       {.name = "trees", .pin = 25, .isDimmable = true, .level = 25},
+ *   };
+ * };
+ * ```
+ * @tparam Description The model description
+ */
+template <typename Description> class Model {
+  static constexpr const auto &CHANNELS = Description::CHANNELS;
+
+public:
+  // Number of channels
+  static constexpr int SIZE = std::size(Description::CHANNELS);
+  // Number of channels with a light
+  static constexpr int LIGHT_COUNT = ModelTables::countLights(CHANNELS);
+
+  // A set of the model's channels
+  using Mask = ModelMask<SIZE>;
+
+  // Number of words the packed values take
+  static constexpr int VALUE_WORDS = ModelTables::valueWords(CHANNELS);
+
+  // The packed values of every channel (ex. to keep the state across reboots)
+  using Snapshot = std::array<uint32_t, VALUE_WORDS>;
+
+  // Version of the snapshots, which changes with the channels or their payloads
+  // (so a snapshot saved by other firmware isn't restored)
+  static constexpr uint32_t STATE_VERSION =
+      ModelTables::stateVersion(CHANNELS);
+
+  // Channels with a light
+  static constexpr Mask LIGHTS =
+      ModelTables::mask<SIZE>(CHANNELS, [](const ModelChannel &channel) {
+        return channel.pin != NO_PIN;
+      });
+  // Channels with a light that follows the channel's topic
+  static constexpr Mask FOLLOWERS =
+      ModelTables::mask<SIZE>(CHANNELS, [](const ModelChannel &channel) {
+        return channel.pin != NO_PIN && channel.values.count > 0;
+      });
+
+  static_assert(ModelTables::countPwm(CHANNELS) <= LEDC_CHANNEL_MAX,
+                "The model has more dimmable lights than PWM channels");
+
+  /**
+   * Find a channel by name at compile time (an unknown name doesn't compile)
+   * @param name The channel name
+   */
+  static consteval int channel(std::string_view name) {
+    for (int i = 0; i < SIZE; i++) {
+      if (name == CHANNELS[i].name) {
+        return i;
+      }
+    }
+    throw "Unknown channel";
+  }
+
+  /**
+   * Create the model's lights (every channel starts at its first value)
+   * @param bank The bank that stores the lights' state
+   */
+  Model(LightBank &bank = LightBank::global())
+      : _lights{makeLights(bank, std::make_index_sequence<LIGHT_COUNT>())} {}
+
+  /** Get a channel's name */
+  static constexpr const char *name(int channel) {
+    return CHANNELS[channel].name;
+  }
+
+  /** Get a channel's full topic */
+  static constexpr const char *topic(int channel) {
+    return TOPICS[channel].name;
+  }
+
+  /** Indicates if a channel has a topic */
+  static constexpr bool hasTopic(int channel) {
+    return CHANNELS[channel].values.count > 0;
+  }
+
+  /** Indicates if a channel has a light */
+  static constexpr bool hasLight(int channel) { return SLOTS[channel] >= 0; }
+
+  /**
+   * Get a channel's light
+   * @param channel A channel with a light
+   */
+  Light &light(int channel) {
+    assert(hasLight(channel));
+    return _lights[SLOTS[channel]];
+  }
+
+  /** Every light, in channel order (ex. as effect program targets) */
+  std::array<Light, LIGHT_COUNT> &lights(void) { return _lights; }
+
+  /**
+   * Parse a payload for a channel
+   * @param channel The channel index
+   * @param payload The payload received on the channel's topic
+   * @returns The value, or -1 if the channel doesn't accept the payload
+   */
+  static int parse(int channel, std::string_view payload) {
+    const ModelValues &values = CHANNELS[channel].values;
+    for (int value = 0; value < values.count; value++) {
+      if (payload == values.names[value]) {
+        return value;
+      }
+    }
+    return -1;
+  }
+
+  /** Get a channel's value */
+  int get(int channel) const {
+    const ModelField &field = FIELDS[channel];
+    return (_values[field.word] >> field.shift) & field.mask;
+  }
+
+  /** Indicates if a channel is set to anything but its first value */
+  bool isOn(int channel) const { return _on.test(channel); }
+
+  /**
+   * Indicates if any of the channels is set to anything but its first value
+   * @param channels The channels to check (ex. LIGHTS)
+   */
+  bool isAnyOn(const Mask &channels) const { return _on.intersects(channels); }
+
+  /**
+   * Set a channel's value (marking it as changed if it is different)
+   * @param channel The channel index
+   * @param value The new value (an index into the channel's payloads)
+   * @returns true if the value changed
+   */
+  bool set(int channel, int value) {
+    const ModelField &field = FIELDS[channel];
+    uint32_t &word = _values[field.word];
+    if (((word >> field.shift) & field.mask) == (uint32_t)value) {
+      return false;
+    }
+    word = (word & ~(field.mask << field.shift)) |
+           (((uint32_t)value & field.mask) << field.shift);
+    value != 0 ? _on.set(channel) : _on.reset(channel);
+    _changes.set(channel);
+    return true;
+  }
+
+  /**
+   * Mark a channel as changed without changing its value (ex. so a repeated
+   * command still reapplies the channel's lights)
+   */
+  void touch(int channel) { _changes.set(channel); }
+
+  /** The packed values of every channel */
+  const Snapshot &snapshot(void) const { return _values; }
+
+  /**
+   * Set every channel from a snapshot, marking the channels that changed
+   * @param snapshot The packed values (ex. saved before a reboot)
+   * @returns false (changing nothing) if a channel doesn't accept its value
+   */
+  bool restore(const Snapshot &snapshot) {
+    auto value = [&snapshot](int channel) {
+      const ModelField &field = FIELDS[channel];
+      return (int)((snapshot[field.word] >> field.shift) & field.mask);
+    };
+    for (int channel = 0; channel < SIZE; channel++) {
+      if (value(channel) >= std::max(CHANNELS[channel].values.count, 1)) {
+        return false;
+      }
+    }
+    for (int channel = 0; channel < SIZE; channel++) {
+      set(channel, value(channel));
+    }
+    return true;
+  }
+
+  /** The channels that changed since the changes were last taken */
+  const Mask &getChanges(void) const { return _changes; }
+
+  /** Get the channels that changed, and start recording changes again */
+  Mask takeChanges(void) {
+    Mask changes = _changes;
+    _changes.clear();
+    return changes;
+  }
+
+  /**
+   * Turn lights that follow their topic on (at the channel's level) or off to
+   * match the channel's value
+   * @param channels The channels to update (ex. the changes)
+   */
+  void updateLights(const Mask &channels = FOLLOWERS) {
+    (channels & FOLLOWERS).forEach([this](int channel) {
+      Light &target = light(channel);
+      isOn(channel) ? target.on(CHANNELS[channel].level) : target.off();
+    });
+  }
+
+  /**
+   * Add every reported channel's payload to a state document, keyed by the
+   * channel's name (the members are built at compile time and only copied)
+   * @param writer The document (inside an open object)
+   */
+  template <size_t Size> void writeState(JsonWriter<Size> &writer) const {
+    for (int channel = 0; channel < SIZE; channel++) {
+      if (ModelTables::isReported(CHANNELS[channel])) {
+        int member = FIRST_MEMBERS[channel] + get(channel);
+        writer.addMember(MEMBERS.get(member));
+      }
+    }
+  }
+
+  /**
+   * Add every reported channel's payload to a state document in any other
+   * format with JsonWriter's functions (ex. a CborWriter)
+   * @param writer The document (inside an open object)
+   */
+  template <typename Writer> void writeState(Writer &writer) const {
+    for (int channel = 0; channel < SIZE; channel++) {
+      if (ModelTables::isReported(CHANNELS[channel])) {
+        writer.add(CHANNELS[channel].name,
+                   CHANNELS[channel].values.names[get(channel)]);
+      }
+    }
+  }
+
+private:
+  // Where each channel's value is stored
+  static constexpr auto FIELDS = ModelTables::fields(CHANNELS);
+  // Light slot of each channel
+  static constexpr auto SLOTS = ModelTables::slots(CHANNELS);
+  // Pin and PWM channel of each light slot
+  static constexpr auto LIGHT_PINS =
+      ModelTables::lights<LIGHT_COUNT>(CHANNELS);
+  // State document members, and the first member of each channel
+  static constexpr auto MEMBERS =
+      ModelTables::members<ModelTables::memberBytes(CHANNELS),
+                           ModelTables::memberCount(CHANNELS)>(CHANNELS);
+  static constexpr auto FIRST_MEMBERS = ModelTables::firstMembers(CHANNELS);
+  // Full topic of each channel
+  static constexpr auto TOPICS =
+      ModelTables::topics(Description::TOPIC_PREFIX, CHANNELS);
+
+  std::array<Light, LIGHT_COUNT> _lights; // Lights by slot
+  Snapshot _values = {};                  // Packed values of every channel
+  Mask _on;                               // Channels not at their first value
+  Mask _changes;                          // Channels changed since last taken
+
+  /** Create a light for every slot */
+  template <size_t... Slot>
+  static std::array<Light, LIGHT_COUNT>
+  makeLights(LightBank &bank, std::index_sequence<Slot...>) {
+    return {{Light(LIGHT_PINS[Slot].first, LIGHT_PINS[Slot].second, bank)...}};
+  }
+};
+
+#endif
@@ -1,15 +1,20 @@
 #include "MqttClient.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "esp_sntp.h"
 #include "esp_wifi.h"
 #include "mqtt_client.h"
 #include "nvs_flash.h"
+#include <Metrics.h>
 #include <Secrets.h>
+#include <SyncClock.h>
 #include <any>
+#include <string.h>
 #include <string>
 
-#define log(format, __VA_ARGS__...)                                            \
-  ESP_LOGI(MQTT_CLIENT_TAG, format, __VA_ARGS__)
+#define log(format, ...)                                                       \
+  ESP_LOGI(MQTT_CLIENT_TAG, format, ##__VA_ARGS__)
 
 /**
  * Handles forwarding WiFi and MQTT events back to the client. The function is
@@ -26,11 +31,25 @@ void forwardingEventHandler(void *arg, esp_event_base_t eventBase,
   client->__handleEvents__(eventBase, eventId, eventData);
 }
 
+/**
+ * Adds each SNTP response to the shared clock (runs on the SNTP task)
+ * @param time The network time that was received
+ */
+static void onTimeSync(struct timeval *time) {
+  SyncClock::global().sample((int64_t)time->tv_sec * 1000000 + time->tv_usec,
+                             Clock::now());
+}
+
 // Create MQTT client with a specific client id
 MqttClient::MqttClient(const char *clientId) : _clientId{clientId} {}
 
 // Start the WiFi and MQTT Clients and maintain the connection
 MqttClient &MqttClient::start() {
+  // Skip the scan (and DHCP) with the parameters of the last connection
+  if (_isFastConnect) {
+    useWifiCache();
+  }
+
   // Start WiFi client
   ESP_ERROR_CHECK(esp_wifi_start());
 
@@ -44,6 +63,21 @@ MqttClient &MqttClient::onConnecting(CONNECTING_CALLBACK callback) {
   return *this;
 }
 
+// Set the SNTP server
+MqttClient &MqttClient::setTimeServer(const char *server) {
+  _timeServer = server;
+
+  return *this;
+}
+
+// Connect with cached WiFi parameters
+MqttClient &MqttClient::setFastConnect(bool isEnabled, bool isReusingAddress) {
+  _isFastConnect = isEnabled;
+  _isReusingAddress = isReusingAddress;
+
+  return *this;
+}
+
 // Indicates if the client is fully connected
 bool MqttClient::isConnected(void) {
   return _wifiConnected && _ipReceived && _mqttConnected;
@@ -52,7 +86,10 @@ bool MqttClient::isConnected(void) {
 // Register topic subscription
 MqttClient &MqttClient::onTopic(std::string topic,
                                 SUBSCRIPTION_CALLBACK callback) {
-  _subscriptions[topic] = callback;
+  if (!_subscriptions.add(topic, callback)) {
+    log("Too many topics to subscribe to %s", topic.c_str());
+    return *this;
+  }
   // If the subscription is made after the client is already connected, initiate
   // the subscription now
   if (isConnected()) {
@@ -63,16 +100,107 @@ MqttClient &MqttClient::onTopic(std::string topic,
 }
 
 // Publish data on topic
-MqttClient &MqttClient::publish(std::string topic, std::string data,
-                                bool retain) {
+MqttClient &MqttClient::publish(const char *topic, std::string_view data,
+                                bool retain, int qos) {
+  // Queue straight away unless older messages are still waiting (to keep the
+  // order)
+  if (isConnected() && _outbox.isEmpty() &&
+      enqueue(topic, data, qos, retain)) {
+    return *this;
+  }
+  _outbox.add(topic, data, qos, retain);
   if (isConnected()) {
-    esp_mqtt_client_publish(_mqttClient, topic.c_str(), data.c_str(), 0, 1,
-                            retain ? 1 : 0);
+    flushOutbox();
   }
 
   return *this;
 }
 
+// Set the outbox policy
+MqttClient &MqttClient::setOutboxPolicy(OutboxOverflow overflow,
+                                        bool isReplacingRetained) {
+  _outbox.setPolicy(overflow, isReplacingRetained);
+
+  return *this;
+}
+
+// Get the outbox counters
+OutboxStats MqttClient::getOutboxStats(bool reset) {
+  OutboxStats stats;
+  stats.queued = _outbox.size();
+  stats.inFlight = _inFlight.load(std::memory_order_relaxed);
+  stats.dropped = _outbox.readDropped(reset);
+  return stats;
+}
+
+// Queue a message with the MQTT client (never blocks on the network)
+bool MqttClient::enqueue(const char *topic, std::string_view data, int qos,
+                         bool retain) {
+  int id = esp_mqtt_client_enqueue(_mqttClient, topic, data.data(),
+                                   data.size(), qos, retain ? 1 : 0, true);
+  if (id < 0) {
+    return false;
+  }
+  if (qos > 0) {
+    trackInFlight(id);
+  }
+  return true;
+}
+
+// Queue the waiting messages
+void MqttClient::flushOutbox(void) {
+  _outbox.flush([this](const Outbox::Message &message) {
+    return enqueue(message.topic, message.view(), message.qos,
+                   message.retain);
+  });
+}
+
+// Count a QoS 1 message handed to the MQTT client
+void MqttClient::trackInFlight(int msgId) {
+  // The MQTT task may have seen the acknowledgement already
+  for (std::atomic<int> &slot : _inFlightIds) {
+    int expected = -msgId;
+    if (slot.compare_exchange_strong(expected, 0, std::memory_order_relaxed)) {
+      return;
+    }
+  }
+  // Take an empty slot, or an acknowledgement that was never matched (messages
+  // aren't counted once every slot is taken)
+  for (std::atomic<int> &slot : _inFlightIds) {
+    int expected = slot.load(std::memory_order_relaxed);
+    if (expected <= 0 &&
+        slot.compare_exchange_strong(expected, msgId,
+                                     std::memory_order_relaxed)) {
+      _inFlight.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+}
+
+// Stop counting an acknowledged (or expired) QoS 1 message
+void MqttClient::settleInFlight(int msgId, bool isAcknowledged) {
+  if (msgId <= 0) {
+    return;
+  }
+  for (std::atomic<int> &slot : _inFlightIds) {
+    int expected = msgId;
+    if (slot.compare_exchange_strong(expected, 0, std::memory_order_relaxed)) {
+      _inFlight.fetch_sub(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+  // Leave the acknowledgement for the task that is about to count the message
+  if (isAcknowledged) {
+    for (std::atomic<int> &slot : _inFlightIds) {
+      int expected = 0;
+      if (slot.compare_exchange_strong(expected, -msgId,
+                                       std::memory_order_relaxed)) {
+        return;
+      }
+    }
+  }
+}
+
 // Handles all WiFi and MQTT events forwarded by the forwardingEventHandler
 void MqttClient::__handleEvents__(esp_event_base_t eventBase, int32_t eventId,
                                   void *eventData) {
@@ -94,7 +222,11 @@ void MqttClient::handleWifiEvent(int32_t eventId, void *eventData) {
   }
   // WiFi Station Connected (should be getting an IP soon)
   else if (eventId == WIFI_EVENT_STA_CONNECTED) {
-    log("WiFi Station Connected");
+    wifi_event_sta_connected_t *event = (wifi_event_sta_connected_t *)eventData;
+    log("WiFi Station Connected (channel %d)", event->channel);
+    Metrics::global().boot.mark(BootStep::WIFI, Clock::now());
+    // Remember the access point for the next boot
+    _wifiCache.setAccessPoint(event->bssid, event->channel);
     // Only update wifi status as connected
     updateAndReportStatus(true, _ipReceived, _mqttConnected);
   }
@@ -103,6 +235,13 @@ void MqttClient::handleWifiEvent(int32_t eventId, void *eventData) {
     log("WiFi Disconnected. Attempting to Reconnect");
     // Mark all statuses as disconnected
     updateAndReportStatus(false, false, false);
+    // The cached access point may be gone (ex. moved to another channel), so
+    // scan for it and ask DHCP for an address again
+    if (_isUsingAccessPoint) {
+      _isUsingAccessPoint = false;
+      stopUsingAddress();
+      setWifiConfig();
+    }
     esp_wifi_connect();
   }
 }
@@ -112,10 +251,29 @@ void MqttClient::handleIpEvent(int32_t eventId, void *eventData) {
   if (eventId == IP_EVENT_STA_GOT_IP) {
     ip_event_got_ip_t *event = (ip_event_got_ip_t *)eventData;
     log("Got IP Address: " IPSTR, IP2STR(&event->ip_info.ip));
+    BootTimes &boot = Metrics::global().boot;
+    if (boot.read(BootStep::IP) == 0) {
+      boot.setFast(_isUsingAccessPoint);
+    }
+    boot.mark(BootStep::IP, Clock::now());
     // Only report wifi and ip statuses
     updateAndReportStatus(true, true, _mqttConnected);
-    // Start the MQTT Client connection
+    // Start the MQTT Client connection as soon as there is an address
     esp_mqtt_client_start(_mqttClient);
+    // Remember the address for the next boot (only written if it changed)
+    if (_isFastConnect) {
+      esp_netif_dns_info_t dns = {};
+      esp_netif_get_dns_info(_netif, ESP_NETIF_DNS_MAIN, &dns);
+      _wifiCache.setAddress(event->ip_info, dns.ip.u_addr.ip4.addr);
+      _wifiCache.save();
+    }
+    // Start synchronizing the clock (SNTP keeps going across reconnections)
+    if (_timeServer != NULL && !_isTimeSyncing) {
+      esp_sntp_config_t sntpConfig = ESP_NETIF_SNTP_DEFAULT_CONFIG(_timeServer);
+      sntpConfig.sync_cb = &onTimeSync;
+      sntp_set_sync_interval(TIME_SYNC_INTERVAL);
+      _isTimeSyncing = esp_netif_sntp_init(&sntpConfig) == ESP_OK;
+    }
   }
 }
 
@@ -126,13 +284,15 @@ void MqttClient::handleMqttEvent(int32_t eventId, void *eventData) {
   // MQTT Client Connected (subscribe/resubscribe to topics)
   if (eventId == MQTT_EVENT_CONNECTED) {
     log("MQTT Client Connected");
+    Metrics::global().boot.mark(BootStep::MQTT, Clock::now());
     // Only report mqtt status
     updateAndReportStatus(_wifiConnected, _ipReceived, true);
-    // Iterate over all subscription keys (topics) and subscribe to them
-    for (SUBSCRIPTION_MAP::iterator iter = _subscriptions.begin();
-         iter != _subscriptions.end(); ++iter) {
-      esp_mqtt_client_subscribe_single(_mqttClient, iter->first.c_str(), 0);
-    }
+    // Iterate over all subscription topics and subscribe to them
+    _subscriptions.forEachTopic([this](const std::string &topic) {
+      esp_mqtt_client_subscribe_single(_mqttClient, topic.c_str(), 0);
+    });
+    // Send what was published while disconnected
+    flushOutbox();
   }
   // MQTT Client Disconnected (wait to reconnect)
   else if (eventId == MQTT_EVENT_DISCONNECTED) {
@@ -142,18 +302,28 @@ void MqttClient::handleMqttEvent(int32_t eventId, void *eventData) {
   }
   // Data received for subscribed topic
   else if (eventId == MQTT_EVENT_DATA) {
-    std::string topic;
-    topic.assign(event->topic, (size_t)event->topic_len);
-    // Execute subscription callback if available
-    if (_subscriptions.contains(topic)) {
-      std::string data;
-      data.assign(event->data, (size_t)event->data_len);
-      _subscriptions.at(topic)(data);
-    }
+    // Execute subscription callback if available (the topic and payload are
+    // passed as views into the event buffer without copying)
+    _subscriptions.dispatch(
+        std::string_view(event->topic, (size_t)event->topic_len),
+        std::string_view(event->data, (size_t)event->data_len));
+  }
+  // QoS 1 message acknowledged by the broker (room for waiting messages)
+  else if (eventId == MQTT_EVENT_PUBLISHED) {
+    settleInFlight(event->msg_id, true);
+    flushOutbox();
+  }
+  // Message expired in the client's queue without being acknowledged
+  else if (eventId == MQTT_EVENT_DELETED) {
+    settleInFlight(event->msg_id, false);
   }
   // MQTT Error
   else if (eventId == MQTT_EVENT_ERROR) {
     log("MQTT Error occurred");
+    // The cached address may belong to another network by now
+    if (!_wasConnected) {
+      stopUsingAddress();
+    }
   }
 }
 
@@ -162,9 +332,21 @@ void MqttClient::updateAndReportStatus(bool wifiOk, bool ipOk, bool mqttOk) {
   bool wifiChanged = wifiOk != _wifiConnected;
   bool ipChanged = ipOk != _ipReceived;
   bool mqttChanged = mqttOk != _mqttConnected;
+  bool wasConnected = isConnected();
   _wifiConnected = wifiOk;
   _ipReceived = ipOk;
   _mqttConnected = mqttOk;
+  // Measure how long the client takes to reconnect
+  if (wasConnected && !isConnected()) {
+    _disconnectedAt = Clock::now();
+  } else if (!wasConnected && isConnected()) {
+    if (_wasConnected) {
+      Metrics &metrics = Metrics::global();
+      metrics.reconnects.add();
+      metrics.reconnect.record(Clock::now() - _disconnectedAt);
+    }
+    _wasConnected = true;
+  }
   // Only report status if a callback has been set, and the status actually
   // changed
   if (_connectingCallback != NULL &&
@@ -195,7 +377,7 @@ void MqttClient::configureWifi(void) {
   ESP_ERROR_CHECK_WITHOUT_ABORT(esp_event_loop_create_default());
 
   // Initialize default WiFi Station
-  esp_netif_create_default_wifi_sta();
+  _netif = esp_netif_create_default_wifi_sta();
 
   // Initialize WiFi with the default config
   wifi_init_config_t defaultConfig = WIFI_INIT_CONFIG_DEFAULT();
@@ -210,17 +392,57 @@ void MqttClient::configureWifi(void) {
       IP_EVENT, IP_EVENT_STA_GOT_IP, &forwardingEventHandler, this, NULL));
 
   // Update WiFi mode and config
-  wifi_config_t wifiConfig = {
-      .sta =
-          {
-              .ssid = WIFI_SSID,
-              .password = WIFI_PASSWORD,
-          },
-  };
   ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+  setWifiConfig();
+}
+
+// Set the WiFi config
+void MqttClient::setWifiConfig(void) {
+  // The credentials fill their arrays (a full length one has no terminator)
+  wifi_config_t wifiConfig = {};
+  strncpy((char *)wifiConfig.sta.ssid, WIFI_SSID, sizeof(wifiConfig.sta.ssid));
+  strncpy((char *)wifiConfig.sta.password, WIFI_PASSWORD,
+          sizeof(wifiConfig.sta.password));
+  // Only listen on the cached channel, for the cached access point
+  if (_isUsingAccessPoint) {
+    const WifiCache::Entry &entry = _wifiCache.get();
+    wifiConfig.sta.bssid_set = true;
+    memcpy(wifiConfig.sta.bssid, entry.bssid, sizeof(entry.bssid));
+    wifiConfig.sta.channel = entry.channel;
+  }
   ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifiConfig));
 }
 
+// Connect with the cached WiFi parameters
+void MqttClient::useWifiCache(void) {
+  if (!_wifiCache.load(WIFI_SSID)) {
+    return;
+  }
+  const WifiCache::Entry &entry = _wifiCache.get();
+  log("Connecting on cached channel %d", entry.channel);
+  _isUsingAccessPoint = true;
+  setWifiConfig();
+  // A static address is up as soon as the station is (no DHCP exchange)
+  if (_isReusingAddress && _wifiCache.hasAddress() &&
+      esp_netif_dhcpc_stop(_netif) == ESP_OK) {
+    log("Reusing address " IPSTR, IP2STR(&entry.ipInfo.ip));
+    esp_netif_set_ip_info(_netif, &entry.ipInfo);
+    esp_netif_dns_info_t dns = {};
+    dns.ip.u_addr.ip4.addr = entry.dns;
+    dns.ip.type = ESP_IPADDR_TYPE_V4;
+    esp_netif_set_dns_info(_netif, ESP_NETIF_DNS_MAIN, &dns);
+    _isUsingAddress = true;
+  }
+}
+
+// Ask DHCP for an address
+void MqttClient::stopUsingAddress(void) {
+  if (_isUsingAddress.exchange(false)) {
+    log("Asking DHCP for an address");
+    esp_netif_dhcpc_start(_netif);
+  }
+}
+
 /**
  * Setup and configure MQTT client and listen to events
  */
@@ -238,6 +460,9 @@ void MqttClient::configureMqtt(std::string lwtTopic, std::string lwtMsg,
                   },
           },
       .credentials = {.client_id = _clientId},
+      // Messages beyond the limit wait in the Outbox, where they can be
+      // dropped or replaced
+      .outbox = {.limit = MQTT_CLIENT_OUTBOX_LIMIT},
   };
   // Configure Last Will and Testament if specified
   if (lwtTopic != "__NULL__" && lwtMsg != "__NULL__") {
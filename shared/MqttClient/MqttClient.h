@@ -1,22 +1,43 @@
 #ifndef MQTT_CLIENT_H
 #define MQTT_CLIENT_H
 
+#include "Outbox.h"
+#include "TopicTable.h"
+#include "WifiCache.h"
+#include "esp_wifi.h"
 #include "mqtt_client.h"
+#include <Interval.h>
+#include <atomic>
 #include <functional>
-#include <map>
 #include <string>
+#include <string_view>
 
 // Logging tag
 static const char *MQTT_CLIENT_TAG = "mqtt_client";
 
+#ifndef TIME_SYNC_INTERVAL
+#define TIME_SYNC_INTERVAL 60000 // Time between SNTP requests in ms (at least
+                                 // 15000)
+#endif
+
+#ifndef MQTT_PUBLISH_QOS
+#define MQTT_PUBLISH_QOS 1 // Default QoS of published messages
+#endif
+
+#ifndef MQTT_CLIENT_OUTBOX_LIMIT
+#define MQTT_CLIENT_OUTBOX_LIMIT 4096 // Bytes the ESP-IDF MQTT client can hold
+                                      // before messages wait in the Outbox
+#endif
+
+#ifndef MQTT_IN_FLIGHT_SIZE
+#define MQTT_IN_FLIGHT_SIZE 16 // QoS 1 messages counted until acknowledged
+#endif
+
 #define CONNECTING_CALLBACK                                                    \
   std::function<void(bool, bool,                                               \
                      bool)> // Callback signature for connecting events
 #define SUBSCRIPTION_CALLBACK                                                  \
-  std::function<void(std::string)> // Callback signature for topic subscriptions
-#define SUBSCRIPTION_MAP                                                       \
-  std::map<std::string,                                                        \
-           SUBSCRIPTION_CALLBACK> // Topic subscription map definition
+  TOPIC_CALLBACK // Callback signature for topic subscriptions
 
 /**
  * MqttClient is an abstraction layer on top of the underlying
@@ -45,6 +66,27 @@ public:
    */
   MqttClient &onConnecting(CONNECTING_CALLBACK callback);
 
+  /**
+   * Synchronize the shared SyncClock with an SNTP server once an IP address is
+   * received, so boards using the same server act and blink in step. Must be
+   * set before the client is started
+   * @param server The server's hostname or address (ex. "pool.ntp.org", or
+   * the broker's host if it runs an NTP server)
+   */
+  MqttClient &setTimeServer(const char *server);
+
+  /**
+   * Connect with the access point (and optionally the address) of the last
+   * successful connection, cached in NVS, so a board skips the scan (and
+   * DHCP) after a power cut. Falls back to a full scan if the access point
+   * can't be joined, and to DHCP if the broker can't be reached before the
+   * first connection. Must be set before the client is started
+   * @param isEnabled Whether to connect with the cached parameters
+   * @param isReusingAddress Whether to reuse the cached address instead of
+   * asking DHCP (requires a DHCP reservation for the board on the router)
+   */
+  MqttClient &setFastConnect(bool isEnabled, bool isReusingAddress = false);
+
   /**
    * Starts connecting to WiFi and the MQTT broker
    */
@@ -58,17 +100,52 @@ public:
   /**
    * Registers a topic subscription for the MQTT client to listen to
    * @param topic The name of the topic to subscribe to
-   * @param callback A callback to execute when a message on the topic comes in
+   * @param callback A callback to execute when a message on the topic comes
+   * in. The payload view points straight into the MQTT client's buffer, so it
+   * is only valid during the call (copy it to keep it)
    */
   MqttClient &onTopic(std::string topic, SUBSCRIPTION_CALLBACK callback);
 
   /**
-   * Publish data string on a topic
+   * Publish data on a topic without blocking. The message is queued with the
+   * MQTT client (which sends it from its own task), or copied into the Outbox
+   * while the client is disconnected or its queue is full, so the data can live
+   * in a temporary buffer
    * @param topic The name of the topic to publish to
-   * @param data A data string to send
+   * @param data The data to send
    * @param retain Whether the MQTT broker should retain the message
+   * @param qos The QoS to publish with (0 or 1)
+   */
+  MqttClient &publish(const char *topic, std::string_view data,
+                      bool retain = false, int qos = MQTT_PUBLISH_QOS);
+
+  /**
+   * Set what the Outbox does when it is full, and whether a retained message
+   * replaces one waiting on the same topic (ex. only the latest state is sent
+   * after reconnecting)
+   * @param overflow Which message a full outbox drops
+   * @param isReplacingRetained Whether retained messages replace each other
+   */
+  MqttClient &setOutboxPolicy(OutboxOverflow overflow,
+                              bool isReplacingRetained = true);
+
+  /**
+   * Get the number of messages waiting in the Outbox, waiting for the broker's
+   * acknowledgement, and dropped
+   * @param reset Whether to start counting dropped messages from 0 again
    */
-  MqttClient &publish(std::string topic, std::string data, bool retain = false);
+  OutboxStats getOutboxStats(bool reset = false);
+
+  /**
+   * Call a function with every subscribed topic and the number of messages
+   * received on it (ex. for a metrics snapshot)
+   * @param callback Function that takes a `const std::string &` topic name and
+   * a `uint32_t` count
+   * @param reset Whether to start counting from 0 again
+   */
+  template <typename F> void forEachTopicCount(F callback, bool reset = false) {
+    _subscriptions.forEachCount(callback, reset);
+  }
 
   /**
    * Called by the ESP event loop in reponse to background WiFi and MQTT events.
@@ -80,23 +157,45 @@ public:
 private:
   // Clients
   esp_mqtt_client_handle_t _mqttClient = NULL; // MQTT Client
+  esp_netif_t *_netif = NULL;                  // WiFi station interface
 
   // State
-  const char *_clientId;       // MQTT Client Id
-  bool _isConfigured = false;  // Indicates if the client has been configured
-  bool _wifiConnected = false; // Indicates if the client is connected to wifi
-                               // and has an IP address
-  bool _ipReceived = false;    // Indicates if an IP address has been received
-  bool _mqttConnected = false; // Indicates if the mqtt client is connected
-                               // to the broker and is ready
-                               // to send and receive messages
+  const char *_clientId;          // MQTT Client Id
+  const char *_timeServer = NULL; // SNTP server (NULL to not sync time)
+  bool _isTimeSyncing = false;    // Indicates if SNTP was started
+  bool _isConfigured = false;     // Indicates if the client has been configured
+  bool _wifiConnected = false;    // Indicates if the client is connected to
+                                  // wifi and has an IP address
+  bool _ipReceived = false;       // Indicates if an IP address has been
+                                  // received
+  bool _mqttConnected = false;    // Indicates if the mqtt client is connected
+                                  // to the broker and is ready to send and
+                                  // receive messages
+  bool _wasConnected = false;     // Indicates if the client was ever fully
+                                  // connected (later connections are
+                                  // reconnections)
+  Timestamp _disconnectedAt;      // When the client was last fully connected
+
+  // Fast connect
+  WifiCache _wifiCache;                     // Last connection's parameters
+  bool _isFastConnect = false;              // Connect with cached parameters
+  bool _isReusingAddress = false;           // Reuse the cached address
+  bool _isUsingAccessPoint = false;         // The cached access point is set
+  std::atomic<bool> _isUsingAddress{false}; // The cached address is set
 
   // Callbacks
   CONNECTING_CALLBACK _connectingCallback =
       NULL; // Called without delay while disconnected
 
   // Subscriptions
-  SUBSCRIPTION_MAP _subscriptions; // Holds all subscription callbacks
+  TopicTable _subscriptions; // Holds all subscription callbacks
+
+  // Publishing
+  Outbox _outbox;                     // Messages waiting to be queued
+  std::atomic<uint32_t> _inFlight{0}; // QoS 1 messages not acknowledged yet
+  // Ids of the counted messages (negative when acknowledged before they were
+  // counted, 0 for none)
+  std::atomic<int> _inFlightIds[MQTT_IN_FLIGHT_SIZE]{};
 
   /** Configure Non Volatile Storage for WiFi configuration */
   void configureNvs(void);
@@ -104,6 +203,15 @@ private:
   /** Configure Wifi client */
   void configureWifi(void);
 
+  /** Set the WiFi config (with the cached access point if it is used) */
+  void setWifiConfig(void);
+
+  /** Connect with the cached parameters if there are any */
+  void useWifiCache(void);
+
+  /** Ask DHCP for an address instead of using the cached one */
+  void stopUsingAddress(void);
+
   /** Configure Mqtt client */
   void configureMqtt(std::string lwtTopic, std::string lwtMsg, bool lwtRetain);
 
@@ -116,6 +224,28 @@ private:
   /** Handle MQTT events */
   void handleMqttEvent(int32_t eventId, void *eventData);
 
+  /**
+   * Queue a message with the MQTT client
+   * @returns false if the client's queue is full
+   */
+  bool enqueue(const char *topic, std::string_view data, int qos,
+               bool retain);
+
+  /** Queue the messages waiting in the Outbox until it is empty */
+  void flushOutbox(void);
+
+  /** Count a QoS 1 message handed to the MQTT client */
+  void trackInFlight(int msgId);
+
+  /**
+   * Stop counting a message that was acknowledged or deleted (messages that
+   * weren't counted are ignored)
+   * @param msgId The message id
+   * @param isAcknowledged Whether the broker acknowledged the message (it can
+   * be acknowledged before it is counted)
+   */
+  void settleInFlight(int msgId, bool isAcknowledged);
+
   /**
    * Updates the current connection status, and reports the connection status if
    * the new status differs from the current and a callback has been registered
@@ -0,0 +1,245 @@
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+
+#ifndef MQTT_OUTBOX_SIZE
+#define MQTT_OUTBOX_SIZE 8 // Messages that can wait to be published (at most
+                           // 31)
+#endif
+
+#ifndef MQTT_OUTBOX_MESSAGE_SIZE
+#define MQTT_OUTBOX_MESSAGE_SIZE 1024 // Largest payload that can wait in bytes
+#endif
+
+#ifndef MQTT_OUTBOX_TOPIC_SIZE
+#define MQTT_OUTBOX_TOPIC_SIZE 64 // Longest topic that can wait (with the NUL)
+#endif
+
+/** What a full outbox does with another message */
+enum class OutboxOverflow {
+  DROP_OLDEST, // Drop the message that has waited longest to make room
+  DROP_NEWEST, // Drop the new message
+};
+
+/** Messages handled by an outbox, read at one point in time */
+struct OutboxStats {
+  uint32_t queued = 0;   // Messages waiting in the outbox
+  uint32_t inFlight = 0; // Messages handed over and not acknowledged yet
+  uint32_t dropped = 0;  // Messages dropped (overflow, or too large)
+};
+
+/**
+ * Outbox holds messages that can't be handed to the MQTT client yet (it is
+ * disconnected, or its own outbox is full) in a fixed number of slots, so
+ * publishing never blocks and never allocates. A full outbox drops the oldest
+ * or the newest message, and a retained message replaces one waiting on the
+ * same topic (only the latest retained state matters). Any task can add
+ * messages and send them, and the slots are guarded by a mutex that is only
+ * held while a message is copied. Only one task sends at a time: a flush
+ * started while another one runs returns right away, and the running flush
+ * picks up the messages added meanwhile, so messages keep their order and
+ * only one slot is ever out of the queue
+ */
+class Outbox {
+  static_assert(MQTT_OUTBOX_SIZE > 0 && MQTT_OUTBOX_SIZE < 32,
+                "Outbox supports between 1 and 31 messages");
+
+public:
+  /** A waiting message */
+  struct Message {
+    char topic[MQTT_OUTBOX_TOPIC_SIZE];     // Topic (NUL terminated)
+    uint8_t data[MQTT_OUTBOX_MESSAGE_SIZE]; // Payload bytes
+    size_t size = 0;                        // Payload length
+    int qos = 0;                            // QoS to publish with
+    bool retain = false;                    // Retain flag
+
+    /** The payload */
+    std::string_view view(void) const {
+      return std::string_view((const char *)data, size);
+    }
+  };
+
+  /**
+   * Set what happens when the outbox is full and what retained messages do
+   * @param overflow Which message a full outbox drops
+   * @param isReplacingRetained Whether a retained message replaces a retained
+   * message waiting on the same topic
+   */
+  void setPolicy(OutboxOverflow overflow, bool isReplacingRetained) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _overflow = overflow;
+    _isReplacingRetained = isReplacingRetained;
+  }
+
+  /**
+   * Add a message (copied into the outbox)
+   * @param topic The topic
+   * @param data The payload
+   * @param qos The QoS to publish with
+   * @param retain Whether the broker should retain the message
+   * @returns false if the message was dropped (too large, the outbox is full
+   * and drops new messages, or no slot is free)
+   */
+  bool add(const char *topic, std::string_view data, int qos, bool retain) {
+    size_t topicSize = strlen(topic) + 1;
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (topicSize > MQTT_OUTBOX_TOPIC_SIZE ||
+        data.size() > MQTT_OUTBOX_MESSAGE_SIZE) {
+      _dropped++;
+      return false;
+    }
+    int slot = -1;
+    if (retain && _isReplacingRetained) {
+      slot = findRetained(topic);
+    }
+    if (slot < 0) {
+      if (_count == MQTT_OUTBOX_SIZE) {
+        _dropped++;
+        if (_overflow == OutboxOverflow::DROP_NEWEST) {
+          return false;
+        }
+        release(pop());
+      }
+      if (_free == 0) {
+        _dropped++;
+        return false;
+      }
+      slot = __builtin_ctz(_free);
+      _free &= ~(1u << slot);
+      push(slot);
+    }
+    Message &message = _messages[slot];
+    memcpy(message.topic, topic, topicSize);
+    memcpy(message.data, data.data(), data.size());
+    message.size = data.size();
+    message.qos = qos;
+    message.retain = retain;
+    return true;
+  }
+
+  /**
+   * Send the waiting messages, oldest first, until the outbox is empty or a
+   * message can't be sent (it goes back to the front). The outbox isn't locked
+   * while a message is sent, and nothing is sent if another task is flushing
+   * (it sends the new messages too)
+   * @param send Function that takes a `const Message &` and returns false if
+   * the message couldn't be sent
+   * @returns The number of messages sent
+   */
+  template <typename F> int flush(F send) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_isFlushing) {
+        return 0;
+      }
+      _isFlushing = true;
+    }
+    int sent = 0;
+    while (true) {
+      int slot;
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_count == 0) {
+          _isFlushing = false;
+          return sent;
+        }
+        // The slot is neither free nor queued while it is sent, so adding
+        // messages can't touch it
+        slot = pop();
+      }
+      bool isSent = send((const Message &)_messages[slot]);
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (isSent) {
+        release(slot);
+        sent++;
+        continue;
+      }
+      // Put the message back in front, unless new messages filled the outbox
+      // (then it is the oldest one)
+      if (_count == MQTT_OUTBOX_SIZE) {
+        _dropped++;
+        release(slot);
+      } else {
+        _head = (_head + MQTT_OUTBOX_SIZE - 1) % MQTT_OUTBOX_SIZE;
+        _order[_head] = slot;
+        _count++;
+      }
+      _isFlushing = false;
+      return sent;
+    }
+  }
+
+  /** Indicates if no message is waiting or being sent */
+  bool isEmpty(void) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _count == 0 && !_isFlushing;
+  }
+
+  /** Number of messages waiting */
+  uint32_t size(void) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _count;
+  }
+
+  /**
+   * Get the number of messages dropped
+   * @param reset Whether to start counting from 0 again
+   */
+  uint32_t readDropped(bool reset = false) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t dropped = _dropped;
+    if (reset) {
+      _dropped = 0;
+    }
+    return dropped;
+  }
+
+private:
+  static const uint32_t ALL_FREE = (1u << (MQTT_OUTBOX_SIZE + 1)) - 1;
+
+  Message _messages[MQTT_OUTBOX_SIZE + 1]; // Slots (one more for sending)
+  uint8_t _order[MQTT_OUTBOX_SIZE];        // Waiting slots, oldest first
+  int _head = 0;                           // Position of the oldest slot
+  int _count = 0;                          // Number of waiting slots
+  uint32_t _free = ALL_FREE;               // Bit per free slot
+  uint32_t _dropped = 0;                   // Messages dropped
+  bool _isFlushing = false;                // A task is sending messages
+  bool _isReplacingRetained = true;        // Retained messages replace others
+  OutboxOverflow _overflow = OutboxOverflow::DROP_OLDEST; // Overflow policy
+  std::mutex _mutex; // Guards the slots, their order and the counter
+
+  /** Queue a slot behind the others */
+  void push(int slot) {
+    _order[(_head + _count) % MQTT_OUTBOX_SIZE] = slot;
+    _count++;
+  }
+
+  /** Take the oldest slot out of the queue */
+  int pop(void) {
+    int slot = _order[_head];
+    _head = (_head + 1) % MQTT_OUTBOX_SIZE;
+    _count--;
+    return slot;
+  }
+
+  /** Free a slot */
+  void release(int slot) { _free |= 1u << slot; }
+
+  /** Find the waiting retained message on a topic (or -1) */
+  int findRetained(const char *topic) {
+    for (int i = 0; i < _count; i++) {
+      int slot = _order[(_head + i) % MQTT_OUTBOX_SIZE];
+      if (_messages[slot].retain && strcmp(_messages[slot].topic, topic) == 0) {
+        return slot;
+      }
+    }
+    return -1;
+  }
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "TopicTable.h"
+
+#include <stddef.h>
+#include <utility>
+
+// Add or replace a topic
+bool TopicTable::add(std::string topic, TOPIC_CALLBACK callback) {
+  uint32_t topicHash = hash(topic);
+  int slot = slotOf(topic, topicHash);
+  if (slot < 0) {
+    return false;
+  }
+  if (!_slots[slot].isUsed) {
+    _slots[slot].isUsed = true;
+    _slots[slot].hash = topicHash;
+    _slots[slot].topic = std::move(topic);
+    _count++;
+  }
+  _slots[slot].callback = std::move(callback);
+  return true;
+}
+
+// Find the callback for a topic
+const TOPIC_CALLBACK *TopicTable::find(std::string_view topic) const {
+  int slot = slotOf(topic, hash(topic));
+  if (slot < 0 || !_slots[slot].isUsed) {
+    return NULL;
+  }
+  return &_slots[slot].callback;
+}
+
+// Call the callback for a topic
+bool TopicTable::dispatch(std::string_view topic,
+                          std::string_view data) const {
+  int slot = slotOf(topic, hash(topic));
+  if (slot < 0 || !_slots[slot].isUsed || !_slots[slot].callback) {
+    return false;
+  }
+  _slots[slot].dispatches.add();
+  _slots[slot].callback(data);
+  return true;
+}
+
+// Find a topic's slot (or the empty slot where it belongs)
+int TopicTable::slotOf(std::string_view topic, uint32_t topicHash) const {
+  for (int probe = 0; probe < TOPIC_TABLE_SLOTS; probe++) {
+    int slot = (topicHash + probe) & (TOPIC_TABLE_SLOTS - 1);
+    const Slot &entry = _slots[slot];
+    // Names are only compared when the hashes match
+    if (!entry.isUsed ||
+        (entry.hash == topicHash && entry.topic == topic)) {
+      return slot;
+    }
+  }
+  return -1;
+}
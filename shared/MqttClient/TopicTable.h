@@ -0,0 +1,115 @@
+#ifndef TOPIC_TABLE_H
+#define TOPIC_TABLE_H
+
+#include <Metrics.h>
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+#ifndef TOPIC_TABLE_SLOTS
+#define TOPIC_TABLE_SLOTS 32 // Number of slots (must be a power of 2)
+#endif
+
+static_assert((TOPIC_TABLE_SLOTS & (TOPIC_TABLE_SLOTS - 1)) == 0,
+              "TOPIC_TABLE_SLOTS must be a power of 2");
+
+#define TOPIC_CALLBACK                                                         \
+  std::function<void(std::string_view)> // Callback signature for topics
+
+/**
+ * TopicTable maps topic names to callbacks. Topics are stored by their FNV-1a
+ * hash in a fixed open addressing table, so looking up an incoming topic is a
+ * single pass over its bytes plus (almost always) one slot check, and nothing
+ * is copied or allocated. Topics are only hashed and copied when they are added
+ */
+class TopicTable {
+public:
+  /**
+   * Hash a topic name (FNV-1a). This is constexpr so topics that are known at
+   * compile time (ex. topic macros) can be hashed by the compiler
+   * @param topic The topic name
+   */
+  static constexpr uint32_t hash(std::string_view topic) {
+    uint32_t value = 2166136261u;
+    for (char c : topic) {
+      value = (value ^ (uint8_t)c) * 16777619u;
+    }
+    return value;
+  }
+
+  /**
+   * Add a topic, or replace the callback of a topic that was already added
+   * @param topic The topic name
+   * @param callback Function to call with each message's payload
+   * @returns false if the table is full
+   */
+  bool add(std::string topic, TOPIC_CALLBACK callback);
+
+  /**
+   * Find the callback for a topic
+   * @param topic The topic name
+   * @returns The callback, or NULL if the topic hasn't been added
+   */
+  const TOPIC_CALLBACK *find(std::string_view topic) const;
+
+  /**
+   * Call the callback for a topic
+   * @param topic The topic name
+   * @param data The message payload (only valid during the call)
+   * @returns false if the topic hasn't been added
+   */
+  bool dispatch(std::string_view topic, std::string_view data) const;
+
+  /** Number of topics in the table */
+  int size(void) const { return _count; }
+
+  /**
+   * Call a function with the name of every topic in the table (ex. to
+   * subscribe to every topic after connecting)
+   * @param callback Function that takes a `const std::string &` topic name
+   */
+  template <typename F> void forEachTopic(F callback) const {
+    for (int slot = 0; slot < TOPIC_TABLE_SLOTS; slot++) {
+      if (_slots[slot].isUsed) {
+        callback(_slots[slot].topic);
+      }
+    }
+  }
+
+  /**
+   * Call a function with the name of every topic in the table and the number
+   * of messages dispatched to it (ex. for a metrics snapshot)
+   * @param callback Function that takes a `const std::string &` topic name and
+   * a `uint32_t` count
+   * @param reset Whether to start counting from 0 again
+   */
+  template <typename F> void forEachCount(F callback, bool reset = false) {
+    for (int slot = 0; slot < TOPIC_TABLE_SLOTS; slot++) {
+      if (_slots[slot].isUsed) {
+        callback(_slots[slot].topic, _slots[slot].dispatches.read(reset));
+      }
+    }
+  }
+
+private:
+  // A topic stored in the table
+  struct Slot {
+    bool isUsed = false;        // Slot holds a topic
+    uint32_t hash = 0;          // Hash of the topic name
+    std::string topic;          // Topic name
+    TOPIC_CALLBACK callback;    // Function to call with the payload
+    mutable Counter dispatches; // Messages dispatched to the callback
+  };
+
+  Slot _slots[TOPIC_TABLE_SLOTS]; // Topics (probed linearly from the hash)
+  int _count = 0;                 // Number of topics
+
+  /**
+   * Find the slot that holds a topic, or the empty slot where it belongs
+   * @returns The slot index, or -1 if the table is full
+   */
+  int slotOf(std::string_view topic, uint32_t topicHash) const;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "WifiCache.h"
+#include "TopicTable.h"
+#include "nvs.h"
+#include <string.h>
+
+// Start with nothing cached (with the padding cleared, so entries compare
+// byte for byte)
+WifiCache::WifiCache(void) {
+  memset(&_entry, 0, sizeof(_entry));
+  memset(&_stored, 0, sizeof(_stored));
+}
+
+// Load the parameters cached for an SSID
+bool WifiCache::load(const char *ssid) {
+  uint32_t ssidHash = TopicTable::hash(ssid);
+  nvs_handle_t handle;
+  if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+    Entry entry;
+    size_t length = sizeof(entry);
+    if (nvs_get_blob(handle, WIFI_CACHE_KEY, &entry, &length) == ESP_OK &&
+        length == sizeof(entry)) {
+      memcpy(&_stored, &entry, sizeof(entry));
+    }
+    nvs_close(handle);
+  }
+  // Parameters of another SSID are replaced by the next save
+  if (_stored.ssidHash == ssidHash) {
+    memcpy(&_entry, &_stored, sizeof(_entry));
+  } else {
+    memset(&_entry, 0, sizeof(_entry));
+    _entry.ssidHash = ssidHash;
+  }
+  return hasAccessPoint();
+}
+
+// Update the access point
+void WifiCache::setAccessPoint(const uint8_t *bssid, uint8_t channel) {
+  memcpy(_entry.bssid, bssid, sizeof(_entry.bssid));
+  _entry.channel = channel;
+}
+
+// Update the address
+void WifiCache::setAddress(const esp_netif_ip_info_t &ipInfo, uint32_t dns) {
+  _entry.ipInfo = ipInfo;
+  _entry.dns = dns;
+}
+
+// Write the parameters to NVS
+bool WifiCache::save(void) {
+  if (!hasAccessPoint() || memcmp(&_entry, &_stored, sizeof(_entry)) == 0) {
+    return true;
+  }
+  nvs_handle_t handle;
+  if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return false;
+  }
+  bool isWritten =
+      nvs_set_blob(handle, WIFI_CACHE_KEY, &_entry, sizeof(_entry)) == ESP_OK &&
+      nvs_commit(handle) == ESP_OK;
+  nvs_close(handle);
+  if (isWritten) {
+    memcpy(&_stored, &_entry, sizeof(_entry));
+  }
+  return isWritten;
+}
@@ -0,0 +1,75 @@
+#ifndef WIFI_CACHE_H
+#define WIFI_CACHE_H
+
+#include "esp_wifi.h"
+#include <stdint.h>
+
+#define WIFI_CACHE_NAMESPACE "mqtt_client" // NVS namespace of the cache
+#define WIFI_CACHE_KEY "wifi"              // NVS key of the cache
+
+/**
+ * WifiCache keeps the parameters of the last successful WiFi connection in
+ * NVS: the access point's BSSID and channel, and the address, netmask, gateway
+ * and DNS server that DHCP handed out. Connecting with them skips the scan (and
+ * DHCP, if the address is reused), which takes most of the time to connect
+ * after a power cut.
+ *
+ * The cache belongs to an SSID, so changing the WiFi credentials forgets it.
+ * It is only written when the parameters changed, so reconnecting to the same
+ * access point doesn't wear the flash
+ */
+class WifiCache {
+public:
+  // Cached parameters
+  struct Entry {
+    uint32_t ssidHash;          // Hash of the SSID the parameters belong to
+    esp_netif_ip_info_t ipInfo; // Address, netmask and gateway (0 for none)
+    uint32_t dns;               // DNS server (0 for none)
+    uint8_t bssid[6];           // BSSID of the access point
+    uint8_t channel;            // Channel of the access point (0 for none)
+  };
+
+  WifiCache(void);
+
+  /**
+   * Load the parameters cached for an SSID (NVS must be initialized)
+   * @param ssid The SSID
+   * @returns false if no access point is cached for the SSID
+   */
+  bool load(const char *ssid);
+
+  /** The loaded (or updated) parameters */
+  const Entry &get(void) { return _entry; }
+
+  /** Indicates if an access point is cached */
+  bool hasAccessPoint(void) { return _entry.channel != 0; }
+
+  /** Indicates if an address is cached */
+  bool hasAddress(void) { return _entry.ipInfo.ip.addr != 0; }
+
+  /**
+   * Update the access point
+   * @param bssid BSSID of the access point
+   * @param channel Channel of the access point
+   */
+  void setAccessPoint(const uint8_t *bssid, uint8_t channel);
+
+  /**
+   * Update the address
+   * @param ipInfo Address, netmask and gateway
+   * @param dns DNS server
+   */
+  void setAddress(const esp_netif_ip_info_t &ipInfo, uint32_t dns);
+
+  /**
+   * Write the parameters to NVS, unless NVS already holds them
+   * @returns false if the write failed
+   */
+  bool save(void);
+
+private:
+  Entry _entry;  // Loaded (or updated) parameters
+  Entry _stored; // Parameters NVS holds
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef COALESCER_H
+#define COALESCER_H
+
+#include <Interval.h>
+#include <atomic>
+
+/**
+ * Coalescer merges a burst of requests into a single call. The first request
+ * opens a window, and the action runs once when the window closes no matter
+ * how many requests arrived in the meantime (ex. publish the state once after
+ * an automation changes 8 lights). It is driven like an effect, so it can be
+ * added to a Scheduler
+ */
+class Coalescer {
+public:
+  /**
+   * Create a coalescer
+   * @param windowInMs How long to wait for more requests before running the
+   * action
+   * @param action Function to run when the window closes
+   */
+  Coalescer(int windowInMs, void (*action)(void))
+      : _window{millis(windowInMs)}, _action{action} {}
+
+  /**
+   * Request the action. Safe to call from any task, but the scheduler must be
+   * woken afterwards so it sees the new deadline
+   */
+  void request(void) {
+    _isRequested.store(true, std::memory_order_release);
+  }
+
+  /** Indicates if the action is waiting for its window to close */
+  bool isPending(void) {
+    return _isRequested.load(std::memory_order_relaxed) || _isOpen;
+  }
+
+  /**
+   * Get the timestamp the window closes
+   * @param now The current timestamp
+   * @returns The deadline, or NO_DEADLINE if nothing was requested
+   */
+  Timestamp nextDeadline(Timestamp now) {
+    if (_isOpen) {
+      return _deadline;
+    }
+    return _isRequested.load(std::memory_order_relaxed) ? now : NO_DEADLINE;
+  }
+
+  /**
+   * Opens the window for a new request, and runs the action when the window
+   * closes
+   * @param now The current timestamp
+   */
+  void loop(Timestamp now) {
+    if (!_isOpen) {
+      if (!_isRequested.load(std::memory_order_relaxed)) {
+        return;
+      }
+      _isOpen = true;
+      _deadline = now + _window;
+    }
+    if (now >= _deadline) {
+      // Take the requests (and whatever their tasks wrote before them), so
+      // requests made while the action runs open a new window
+      _isRequested.exchange(false, std::memory_order_acquire);
+      _isOpen = false;
+      _action();
+    }
+  }
+
+private:
+  Duration _window;                      // Window length
+  void (*_action)(void);                 // Runs when the window closes
+  std::atomic<bool> _isRequested{false}; // A request arrived
+  bool _isOpen = false;                  // The window is open
+  Timestamp _deadline;                   // Timestamp the window closes
+};
+
+#endif
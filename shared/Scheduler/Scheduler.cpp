@@ -0,0 +1,118 @@
+#include "Scheduler.h"
+
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include <Metrics.h>
+
+/**
+ * Forwards the Light fade end interrupt to the scheduler so a breathing light
+ * is handled as soon as its fade finishes
+ * @param arg This will be an instance of the scheduler
+ */
+static bool IRAM_ATTR wakeOnFadeComplete(void *arg) {
+  Scheduler *scheduler = (Scheduler *)arg;
+  return scheduler->wakeFromISR();
+}
+
+/**
+ * Wakes the scheduler when the deadline it sleeps until is reached
+ * @param arg This will be an instance of the scheduler
+ */
+static void wakeOnDeadline(void *arg) {
+  Scheduler *scheduler = (Scheduler *)arg;
+  scheduler->wake();
+}
+
+// Wake the scheduler task
+void Scheduler::wake(void) {
+  if (_task != NULL) {
+    xTaskNotifyGive(_task);
+  }
+}
+
+// Wake the scheduler task from an interrupt
+bool Scheduler::wakeFromISR(void) {
+  BaseType_t woken = pdFALSE;
+  if (_task != NULL) {
+    vTaskNotifyGiveFromISR(_task, &woken);
+  }
+  return woken == pdTRUE;
+}
+
+// Run due effects and find the next deadline
+Timestamp Scheduler::runDue(Timestamp now) {
+  // Every light changed during the pass is written together at the end
+  LightBank &bank = LightBank::global();
+  Metrics &metrics = Metrics::global();
+  bank.beginFrame();
+  Timestamp earliest = NO_DEADLINE;
+  for (Entry &entry : _entries) {
+    Timestamp deadline = entry.nextDeadline(entry.target, now);
+    // Run the effect if its deadline has been reached (and find out when it
+    // needs to run next)
+    if (deadline <= now) {
+      entry.loop(entry.target, now);
+      _stats.runs++;
+      deadline = entry.nextDeadline(entry.target, now);
+    }
+    if (deadline < earliest) {
+      earliest = deadline;
+    }
+  }
+  // Messages handled by this pass (ex. drained from a Mailbox) were marked
+  Timestamp received;
+  bool isReceived = metrics.takeReceived(received);
+  bank.commitFrame();
+  // Time the pass, and the oldest message it handled from being received to
+  // its lights being written
+  if constexpr (METRICS_ENABLED) {
+    Timestamp committed = Clock::now();
+    metrics.tick.record(committed - now);
+    if (isReceived) {
+      metrics.latency.record(committed - received);
+    }
+  }
+  return earliest;
+}
+
+// Start the scheduler loop
+void Scheduler::start(void) {
+  _task = xTaskGetCurrentTaskHandle();
+  _statsStartedUs = esp_timer_get_time();
+  Light::onFadeComplete(&wakeOnFadeComplete, this);
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = &wakeOnDeadline;
+  timerArgs.arg = this;
+  timerArgs.dispatch_method = ESP_TIMER_TASK;
+  timerArgs.name = "scheduler";
+  ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &_timer));
+  while (1) {
+    Timestamp woke = Clock::now();
+    _stats.wakeups++;
+    Timestamp deadline = runDue(woke);
+    Timestamp slept = Clock::now();
+    _stats.busyUs += (slept - woke).count();
+    // Sleep until another task wakes the scheduler, or until the deadline
+    // timer does (tick rounding would delay deadlines by up to a tick)
+    esp_timer_stop(_timer);
+    if (deadline > slept) {
+      if (deadline != NO_DEADLINE) {
+        esp_timer_start_once(_timer, (deadline - slept).count());
+      }
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    _stats.idleUs += (Clock::now() - slept).count();
+  }
+}
+
+// Read the scheduler counters
+SchedulerStats Scheduler::getStats(bool reset) {
+  int64_t nowUs = esp_timer_get_time();
+  SchedulerStats stats = _stats;
+  stats.elapsedUs = nowUs - _statsStartedUs;
+  if (reset) {
+    _stats = SchedulerStats();
+    _statsStartedUs = nowUs;
+  }
+  return stats;
+}
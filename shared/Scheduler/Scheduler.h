@@ -0,0 +1,111 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <Interval.h>
+#include <Light.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Counters collected by the scheduler since it started (or since the stats
+ * were last reset)
+ */
+struct SchedulerStats {
+  uint64_t wakeups = 0;   // Number of times the scheduler task woke up
+  uint64_t runs = 0;      // Number of effect loop calls made
+  uint64_t busyUs = 0;    // Time spent running effects in microseconds
+  uint64_t idleUs = 0;    // Time spent sleeping in microseconds
+  uint64_t elapsedUs = 0; // Total time covered by the stats in microseconds
+
+  /** Average number of wakeups per second */
+  uint32_t wakeupsPerSecond() {
+    return elapsedUs == 0 ? 0 : (wakeups * 1000000) / elapsedUs;
+  }
+
+  /** Percentage (0 to 100) of the time the scheduler task was asleep */
+  uint32_t idlePercentage() {
+    return elapsedUs == 0 ? 0 : (idleUs * 100) / elapsedUs;
+  }
+};
+
+/**
+ * Scheduler replaces a fixed-rate polling loop for lighting effects. Each
+ * registered effect (a Light, a light group, or anything else with
+ * `loop(now)` and `nextDeadline(now)` functions) is asked for the next time it
+ * has work to do. The scheduler task then sleeps until the earliest deadline,
+ * or until it is woken because something changed (ex. a new command arrived),
+ * and only runs the effects that are due
+ */
+class Scheduler {
+public:
+  /**
+   * Register an effect. The effect type must have `void loop(Timestamp)` and
+   * `Timestamp nextDeadline(Timestamp)` functions
+   * @param effect The effect to schedule (must outlive the scheduler)
+   */
+  template <typename T> Scheduler &add(T &effect) {
+    _entries.push_back({
+        .target = &effect,
+        .loop = [](void *target, Timestamp now) { ((T *)target)->loop(now); },
+        .nextDeadline = [](void *target, Timestamp now) {
+          return ((T *)target)->nextDeadline(now);
+        },
+    });
+    return *this;
+  }
+
+  /**
+   * Wake the scheduler task so it re-checks every deadline. Must be called
+   * from other tasks after starting or changing an effect
+   */
+  void wake(void);
+
+  /**
+   * Interrupt safe version of wake
+   * @returns true if a higher priority task was woken
+   */
+  bool wakeFromISR(void);
+
+  /**
+   * Start the scheduler on the calling task. This function never returns
+   */
+  void start(void);
+
+  /**
+   * Run every effect that is due. Called by start on every wakeup, but can
+   * also be used to drive the scheduler manually. The pass runs inside a frame
+   * of the global LightBank, so the lights it changes are written together.
+   * The pass (from `now` to the commit) and the latency of the messages it
+   * handled are recorded in the global Metrics
+   * @param now The current timestamp
+   * @returns The earliest deadline (`now` or earlier if an effect is already
+   * due again), or NO_DEADLINE if no effect has anything scheduled
+   */
+  Timestamp runDue(Timestamp now);
+
+  /**
+   * Get the scheduler counters
+   * @param reset Whether to reset the counters after reading them (makes the
+   * next read cover only the time since this call)
+   */
+  SchedulerStats getStats(bool reset = false);
+
+private:
+  // Type erased effect registration
+  struct Entry {
+    void *target;
+    void (*loop)(void *target, Timestamp now);
+    Timestamp (*nextDeadline)(void *target, Timestamp now);
+  };
+
+  std::vector<Entry> _entries;      // Registered effects
+  TaskHandle_t _task = NULL;        // Task running the scheduler
+  esp_timer_handle_t _timer = NULL; // Wakes the task at the next deadline
+  SchedulerStats _stats;            // Collected counters
+  int64_t _statsStartedUs = 0;      // Timestamp the counters were last reset
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "ShowEncoder.h"
+
+#include <algorithm>
+#include <string.h>
+
+// Shortest run of equal levels filled instead of copied (a fill of 2 costs as
+// much as copying the levels, and breaks up a copy)
+#define MIN_FILL 3
+
+// Append a little endian 16 bit value
+static void write16(std::vector<uint8_t> &out, uint16_t value) {
+  out.push_back((uint8_t)value);
+  out.push_back((uint8_t)(value >> 8));
+}
+
+// Append a little endian 32 bit value
+static void write32(std::vector<uint8_t> &out, uint32_t value) {
+  write16(out, (uint16_t)value);
+  write16(out, (uint16_t)(value >> 16));
+}
+
+// Initialize an empty show
+ShowEncoder::ShowEncoder(uint16_t channels, Duration interval)
+    : _channels{channels}, _interval{interval} {
+  _levels.assign(channels, 0);
+}
+
+// Encode the next frame
+void ShowEncoder::add(const uint8_t *levels) {
+  int channel = 0;
+  while (channel < _channels) {
+    int kept = keptRun(levels, channel, SHOW_MAX_SKIP);
+    int filled = fillRun(levels, channel, SHOW_MAX_FILL);
+    if (kept > 0 && kept >= filled) {
+      _data.push_back(SHOW_OP_SKIP | (kept - 1));
+      channel += kept;
+    } else if (filled >= MIN_FILL) {
+      _data.push_back(SHOW_OP_FILL | (filled - 1));
+      _data.push_back(levels[channel]);
+      channel += filled;
+    } else {
+      // Copy up to the next channel that is kept or starts a fill
+      int count = 1;
+      while (channel + count < _channels && count < SHOW_MAX_COPY &&
+             keptRun(levels, channel + count, 1) == 0 &&
+             fillRun(levels, channel + count, MIN_FILL) < MIN_FILL) {
+        count++;
+      }
+      _data.push_back(SHOW_OP_COPY | (count - 1));
+      _data.insert(_data.end(), levels + channel, levels + channel + count);
+      channel += count;
+    }
+  }
+  memcpy(_levels.data(), levels, _channels);
+  _frameCount++;
+}
+
+// Build the show file
+std::vector<uint8_t> ShowEncoder::build(void) {
+  std::vector<uint8_t> show(SHOW_MAGIC, SHOW_MAGIC + 4);
+  show.push_back(SHOW_VERSION);
+  show.push_back(0); // Flags
+  write16(show, _channels);
+  write32(show, (uint32_t)_interval.count());
+  write32(show, _frameCount);
+  write32(show, (uint32_t)_data.size());
+  show.insert(show.end(), _data.begin(), _data.end());
+  return show;
+}
+
+// Count the kept channels
+int ShowEncoder::keptRun(const uint8_t *levels, int channel, int limit) {
+  int end = std::min<int>(_channels, channel + limit);
+  int count = 0;
+  while (channel + count < end &&
+         levels[channel + count] == _levels[channel + count]) {
+    count++;
+  }
+  return count;
+}
+
+// Count the channels set to the same level
+int ShowEncoder::fillRun(const uint8_t *levels, int channel, int limit) {
+  int end = std::min<int>(_channels, channel + limit);
+  int count = 1;
+  while (channel + count < end && levels[channel + count] == levels[channel]) {
+    count++;
+  }
+  return count;
+}
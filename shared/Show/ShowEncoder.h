@@ -0,0 +1,47 @@
+#ifndef SHOW_ENCODER_H
+#define SHOW_ENCODER_H
+
+#include "ShowFile.h"
+#include <vector>
+
+/**
+ * ShowEncoder compiles frames of channel levels into a show file (see
+ * ShowFile), ex. in a host tool that converts a timeline into a show. Frames
+ * are added in order, and each is encoded as its changes from the previous one
+ */
+class ShowEncoder {
+public:
+  /**
+   * Initialize an empty show
+   * @param channels Number of channels of every frame (1 to SHOW_MAX_CHANNELS)
+   * @param interval Time between frames
+   */
+  ShowEncoder(uint16_t channels, Duration interval);
+
+  /**
+   * Add the next frame
+   * @param levels The level of every channel
+   */
+  void add(const uint8_t *levels);
+
+  /** Number of frames added */
+  uint32_t frames(void) { return _frameCount; }
+
+  /** The show file with every frame added so far */
+  std::vector<uint8_t> build(void);
+
+private:
+  uint16_t _channels;           // Channels per frame
+  Duration _interval;           // Time between frames
+  uint32_t _frameCount = 0;     // Frames added
+  std::vector<uint8_t> _levels; // Levels of the last frame added
+  std::vector<uint8_t> _data;   // Encoded frames
+
+  /** Number of channels from a channel on that are kept */
+  int keptRun(const uint8_t *levels, int channel, int limit);
+
+  /** Number of channels from a channel on that are set to its level */
+  int fillRun(const uint8_t *levels, int channel, int limit);
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "ShowFile.h"
+
+#include <string.h>
+
+// Operation types and counts
+#define OP_TYPE_MASK 0xC0
+#define OP_COPY_COUNT_MASK 0x7F
+#define OP_COUNT_MASK 0x3F
+
+// Header field offsets
+#define VERSION_AT 4
+#define FLAGS_AT 5
+#define CHANNELS_AT 6
+#define INTERVAL_AT 8
+#define FRAMES_AT 12
+#define DATA_SIZE_AT 16
+
+// Read a little endian 16 bit value
+static uint16_t read16(const uint8_t *data) {
+  return (uint16_t)(data[0] | data[1] << 8);
+}
+
+// Read a little endian 32 bit value
+static uint32_t read32(const uint8_t *data) {
+  return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+// Open and check a show
+bool ShowFile::open(const uint8_t *data, size_t size) {
+  _frames = NULL;
+  if (data == NULL || size < SHOW_HEADER_SIZE ||
+      memcmp(data, SHOW_MAGIC, 4) != 0 || data[VERSION_AT] != SHOW_VERSION ||
+      data[FLAGS_AT] != 0) {
+    return false;
+  }
+  uint16_t channels = read16(data + CHANNELS_AT);
+  uint32_t interval = read32(data + INTERVAL_AT);
+  uint32_t frameCount = read32(data + FRAMES_AT);
+  uint32_t dataSize = read32(data + DATA_SIZE_AT);
+  if (channels == 0 || channels > SHOW_MAX_CHANNELS || interval == 0 ||
+      frameCount == 0 || dataSize > size - SHOW_HEADER_SIZE) {
+    return false;
+  }
+  const uint8_t *frames = data + SHOW_HEADER_SIZE;
+  const uint8_t *end = frames + dataSize;
+  const uint8_t *at = frames;
+  int from, to;
+  for (uint32_t frame = 0; frame < frameCount; frame++) {
+    at = decode(at, end, NULL, channels, from, to);
+    if (at == NULL) {
+      return false;
+    }
+  }
+  if (at != end) {
+    return false;
+  }
+  _frames = frames;
+  _end = end;
+  _at = frames;
+  _channels = channels;
+  _frameCount = frameCount;
+  _interval = Duration(interval);
+  _position = 0;
+  return true;
+}
+
+// Go back to the first frame
+void ShowFile::rewind(uint8_t *levels) {
+  memset(levels, 0, _channels);
+  _at = _frames;
+  _position = 0;
+}
+
+// Decode the next frame
+bool ShowFile::next(uint8_t *levels) {
+  if (_position >= _frameCount) {
+    return false;
+  }
+  // Frames were checked when the show was opened
+  _at = decode(_at, _end, levels, _channels, _changedFrom, _changedTo);
+  _position++;
+  return true;
+}
+
+// Decode (or check) one frame
+const uint8_t *ShowFile::decode(const uint8_t *at, const uint8_t *end,
+                                uint8_t *levels, int channels, int &from,
+                                int &to) {
+  from = channels;
+  to = 0;
+  int channel = 0;
+  while (channel < channels) {
+    if (at >= end) {
+      return NULL;
+    }
+    uint8_t op = *at++;
+    if (op & (SHOW_OP_COPY | SHOW_OP_FILL)) {
+      from = from < channel ? from : channel;
+    }
+    if (op & SHOW_OP_COPY) {
+      int count = (op & OP_COPY_COUNT_MASK) + 1;
+      if (channel + count > channels || end - at < count) {
+        return NULL;
+      }
+      if (levels != NULL) {
+        memcpy(levels + channel, at, count);
+      }
+      at += count;
+      channel += count;
+      to = channel;
+      continue;
+    }
+    int count = (op & OP_COUNT_MASK) + 1;
+    if (channel + count > channels) {
+      return NULL;
+    }
+    if ((op & OP_TYPE_MASK) == SHOW_OP_FILL) {
+      if (at >= end) {
+        return NULL;
+      }
+      if (levels != NULL) {
+        memset(levels + channel, *at, count);
+      }
+      at++;
+      to = channel + count;
+    }
+    channel += count;
+  }
+  return at;
+}
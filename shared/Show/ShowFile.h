@@ -0,0 +1,122 @@
+#ifndef SHOW_FILE_H
+#define SHOW_FILE_H
+
+#include <Clock.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Show file header (little endian)
+#define SHOW_MAGIC "MLSH"     // Identifies a show file
+#define SHOW_VERSION 1        // Format version
+#define SHOW_HEADER_SIZE 20   // Bytes before the first frame
+#define SHOW_MAX_CHANNELS 512 // Most channels a show can have
+
+// Frame operations (the top bits of an operation byte, the rest are the number
+// of channels it covers minus one)
+#define SHOW_OP_SKIP 0x00     // 00nnnnnn: keep the next n + 1 channels
+#define SHOW_OP_FILL 0x40     // 01nnnnnn: set n + 1 channels to the next byte
+#define SHOW_OP_COPY 0x80     // 1nnnnnnn: set n + 1 channels to the next bytes
+#define SHOW_MAX_SKIP 64      // Most channels a skip covers
+#define SHOW_MAX_FILL 64      // Most channels a fill covers
+#define SHOW_MAX_COPY 128     // Most channels a copy covers
+
+/**
+ * ShowFile reads a precompiled light show in place (ex. from a memory mapped
+ * flash partition), without copying it. A show is a fixed number of frames of
+ * one level (a byte) per channel, played at a fixed frame interval.
+ *
+ * Every frame only encodes the channels that changed since the previous frame,
+ * as runs: channels that are kept are skipped, runs of channels set to the same
+ * level are filled with one byte, and the rest are copied level by level. The
+ * first frame starts from every channel at 0. A show is laid out as:
+ *
+ * | Bytes | Description |
+ * | 4 | "MLSH" |
+ * | 1 | Version (1) |
+ * | 1 | Flags (must be 0) |
+ * | 2 | Number of channels (1 to 512) |
+ * | 4 | Frame interval in microseconds |
+ * | 4 | Number of frames |
+ * | 4 | Number of frame bytes that follow |
+ * | ... | Frames, each covering every channel exactly once |
+ */
+class ShowFile {
+public:
+  /**
+   * Open a show. Every frame is checked, so a truncated or corrupt show is
+   * rejected before it is played
+   * @param data The show bytes (must stay valid while the show is open)
+   * @param size Number of bytes available (can be more than the show, ex. the
+   * rest of a partition)
+   * @returns false (leaving the show closed) if the data isn't a valid show
+   */
+  bool open(const uint8_t *data, size_t size);
+
+  /** Close the show */
+  void close(void) { _frames = NULL; }
+
+  /** Indicates if a show is open */
+  bool isOpen(void) { return _frames != NULL; }
+
+  /** Number of channels of every frame */
+  uint16_t channels(void) { return _channels; }
+
+  /** Number of frames in the show */
+  uint32_t frames(void) { return _frameCount; }
+
+  /** Time between frames */
+  Duration interval(void) { return _interval; }
+
+  /** Number of frames decoded since the last rewind */
+  uint32_t position(void) { return _position; }
+
+  /**
+   * Go back to the first frame
+   * @param levels The channel levels, reset to 0
+   */
+  void rewind(uint8_t *levels);
+
+  /**
+   * Decode the next frame
+   * @param levels The channel levels of the previous frame, updated to the
+   * next frame's
+   * @returns false if every frame was decoded
+   */
+  bool next(uint8_t *levels);
+
+  /**
+   * First channel the last decoded frame set (channels() if it only kept
+   * channels)
+   */
+  int changedFrom(void) { return _changedFrom; }
+
+  /** Channel after the last one the last decoded frame set */
+  int changedTo(void) { return _changedTo; }
+
+private:
+  const uint8_t *_frames = NULL; // First frame
+  const uint8_t *_end = NULL;    // End of the frames
+  const uint8_t *_at = NULL;     // Next frame to decode
+  uint16_t _channels = 0;        // Channels per frame
+  uint32_t _frameCount = 0;      // Number of frames
+  Duration _interval{0};         // Time between frames
+  uint32_t _position = 0;        // Frames decoded since the last rewind
+  int _changedFrom = 0;          // First channel set by the last frame
+  int _changedTo = 0;            // Channel after the last one it set
+
+  /**
+   * Decode one frame
+   * @param at The frame's first operation
+   * @param end End of the frames
+   * @param levels The levels to update (NULL to only check the frame)
+   * @param channels Number of channels
+   * @param from Set to the first channel the frame sets
+   * @param to Set to the channel after the last one the frame sets
+   * @returns The next frame, or NULL if the frame is malformed
+   */
+  static const uint8_t *decode(const uint8_t *at, const uint8_t *end,
+                               uint8_t *levels, int channels, int &from,
+                               int &to);
+};
+
+#endif
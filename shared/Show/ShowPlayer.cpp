@@ -0,0 +1,145 @@
+#include "ShowPlayer.h"
+
+#include <algorithm>
+#include <limits.h>
+
+// Largest level of a channel
+#define CHANNEL_MAX 0xFF
+
+// Load a show from memory
+bool ShowPlayer::load(const uint8_t *data, size_t size) {
+  _isPlaying = false;
+  if (!_show.open(data, size)) {
+    return false;
+  }
+  _levels.assign(_show.channels(), 0);
+  _show.rewind(_levels.data());
+  return true;
+}
+
+// Map a data partition and load its show
+bool ShowPlayer::loadPartition(const char *label) {
+  _isPlaying = false;
+  _show.close();
+  unmap();
+  const esp_partition_t *partition = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+  if (partition == NULL) {
+    return false;
+  }
+  const void *data = NULL;
+  if (esp_partition_mmap(partition, 0, partition->size,
+                         ESP_PARTITION_MMAP_DATA, &data,
+                         &_mapping) != ESP_OK) {
+    return false;
+  }
+  _isMapped = true;
+  if (!load((const uint8_t *)data, partition->size)) {
+    unmap();
+    return false;
+  }
+  return true;
+}
+
+// Set whether the show loops
+ShowPlayer &ShowPlayer::setLoop(bool isLooping) {
+  _isLooping = isLooping;
+  return *this;
+}
+
+// Set the show ended callback
+ShowPlayer &ShowPlayer::onFinish(void (*callback)(void)) {
+  _onFinish = callback;
+  return *this;
+}
+
+// Play from the first frame
+void ShowPlayer::play(void) {
+  if (!_show.isOpen()) {
+    return;
+  }
+  rewind();
+  _start = Clock::now();
+  _isPlaying = true;
+}
+
+// Get (and reset) the late frame counter
+uint32_t ShowPlayer::getLateFrames(bool reset) {
+  uint32_t lateFrames = _lateFrames;
+  if (reset) {
+    _lateFrames = 0;
+  }
+  return lateFrames;
+}
+
+// Get when the next frame is due
+Timestamp ShowPlayer::nextDeadline(Timestamp) {
+  return _isPlaying ? nextFrameDue() : NO_DEADLINE;
+}
+
+// Write the frame that is due
+void ShowPlayer::loop(Timestamp now) {
+  if (!_isPlaying || now < nextFrameDue()) {
+    return;
+  }
+  uint32_t frameCount = _show.frames();
+  // The last frame was shown for a whole interval
+  if (_show.position() == frameCount) {
+    if (!_isLooping) {
+      _isPlaying = false;
+      if (_onFinish != NULL) {
+        _onFinish();
+      }
+      return;
+    }
+    _start += _show.interval() * frameCount;
+    rewind();
+  }
+  // Frames build on each other, so late frames are decoded but not written
+  uint32_t due = std::min<int64_t>((now - _start) / _show.interval(),
+                                   frameCount - 1);
+  uint32_t decoded = 0;
+  while (_show.position() <= due && _show.next(_levels.data())) {
+    _changedFrom = std::min(_changedFrom, _show.changedFrom());
+    _changedTo = std::max(_changedTo, _show.changedTo());
+    decoded++;
+  }
+  _lateFrames += decoded - 1;
+  apply();
+}
+
+// Go back to the first frame
+void ShowPlayer::rewind(void) {
+  _show.rewind(_levels.data());
+  // The first frame only sets channels that aren't 0, and the lights may have
+  // been changed since the last frame, so every light is written
+  _changedFrom = 0;
+  _changedTo = _show.channels();
+}
+
+// Write the changed levels
+void ShowPlayer::apply(void) {
+  int from = _changedFrom;
+  int to = std::min(_count, _changedTo);
+  _changedFrom = INT_MAX;
+  _changedTo = 0;
+  if (from >= to) {
+    return;
+  }
+  LightBank &bank = _lights[0].getBank();
+  bank.beginFrame();
+  for (int light = from; light < to; light++) {
+    _lights[light].setLevel(
+        (_levels[light] * LightDutyTable::MAX_LEVEL + CHANNEL_MAX / 2) /
+        CHANNEL_MAX);
+  }
+  bank.commitFrame();
+}
+
+// Unmap the partition
+void ShowPlayer::unmap(void) {
+  if (_isMapped) {
+    esp_partition_munmap(_mapping);
+    _isMapped = false;
+  }
+}
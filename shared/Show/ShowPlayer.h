@@ -0,0 +1,132 @@
+#ifndef SHOW_PLAYER_H
+#define SHOW_PLAYER_H
+
+#include "ShowFile.h"
+#include <Light.h>
+#include <esp_partition.h>
+#include <vector>
+
+/**
+ * ShowPlayer plays a precompiled show (see ShowFile) on a set of lights, so a
+ * model can run a choreographed show without a network. Shows are read in
+ * place, usually straight from a data partition mapped into memory, so even
+ * long shows take no RAM beyond one level per channel.
+ *
+ * Frame timing is deterministic: frame n is written at the start of playback
+ * plus n frame intervals, however late the previous frames were. Frames the
+ * lighting task was too late for are still decoded (each frame builds on the
+ * previous one) but only the newest is written. One channel sets one light, in
+ * order, and levels are scaled to the full duty range as is (no gamma
+ * correction).
+ *
+ * The player is run like an effect, so it should be added to a Scheduler
+ */
+class ShowPlayer {
+public:
+  /**
+   * Initialize a player
+   * @param lights The lights, in channel order (sharing a bank)
+   * @param count Number of lights
+   */
+  ShowPlayer(Light *lights, int count) : _lights{lights}, _count{count} {}
+
+  // A mapped partition is unmapped once, so players can't be copied
+  ShowPlayer(const ShowPlayer &) = delete;
+  ShowPlayer &operator=(const ShowPlayer &) = delete;
+
+  ~ShowPlayer(void) { unmap(); }
+
+  /**
+   * Load a show from memory (stopping the current one)
+   * @param data The show bytes (must stay valid while the show is loaded)
+   * @param size Number of bytes available
+   * @returns false if the data isn't a valid show
+   */
+  bool load(const uint8_t *data, size_t size);
+
+  /**
+   * Load a show from a data partition, mapped into memory without copying it
+   * @param label The partition's label (ex. "show")
+   * @returns false if there is no such partition, or it doesn't hold a valid
+   * show
+   */
+  bool loadPartition(const char *label);
+
+  /** Indicates if a show is loaded */
+  bool isLoaded(void) { return _show.isOpen(); }
+
+  /**
+   * Set whether the show starts over when it ends (true by default)
+   * @param isLooping Whether to loop
+   */
+  ShowPlayer &setLoop(bool isLooping);
+
+  /**
+   * Set the function called on the lighting task when a show that doesn't
+   * loop ends
+   * @param callback The function
+   */
+  ShowPlayer &onFinish(void (*callback)(void));
+
+  /** Play the loaded show from its first frame */
+  void play(void);
+
+  /** Stop playing (the lights keep the last frame's levels) */
+  void stop(void) { _isPlaying = false; }
+
+  /** Indicates if the show is playing */
+  bool isPlaying(void) { return _isPlaying; }
+
+  /**
+   * Get the number of frames that were decoded but never written because the
+   * lighting task was late
+   * @param reset Whether to reset the counter after reading it
+   */
+  uint32_t getLateFrames(bool reset = false);
+
+  /**
+   * Get the timestamp the next frame is due, or the show ends (whatever the
+   * current time)
+   */
+  Timestamp nextDeadline(Timestamp);
+
+  /**
+   * Write the frame that is due, and loop or finish the show at its end
+   * @param now The current timestamp
+   */
+  void loop(Timestamp now);
+
+private:
+  Light *_lights;                           // Lights in channel order
+  int _count;                               // Number of lights
+  ShowFile _show;                           // Loaded show
+  std::vector<uint8_t> _levels;             // Levels of the last frame decoded
+  bool _isLooping = true;                   // Start over at the end
+  bool _isPlaying = false;                  // Frames are being written
+  void (*_onFinish)(void) = NULL;           // Show ended callback
+  Timestamp _start;                         // When the first frame was due
+  uint32_t _lateFrames = 0;                 // Frames decoded but not written
+  int _changedFrom = 0;                     // First channel to write
+  int _changedTo = 0;                       // Channel after the last to write
+  bool _isMapped = false;                   // A partition is mapped
+  esp_partition_mmap_handle_t _mapping = 0; // Mapped partition
+
+  /** When the next frame is due */
+  Timestamp nextFrameDue(void) {
+    return _start + _show.interval() * _show.position();
+  }
+
+  /** Go back to the first frame, writing every light with it */
+  void rewind(void);
+
+  /**
+   * Write the levels of the channels decoded frames changed since the last
+   * write to the lights in one bank frame
+   */
+  void apply(void);
+
+  /** Unmap the mapped partition (if any) */
+  void unmap(void);
+};
+
+#endif
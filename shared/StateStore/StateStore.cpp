@@ -0,0 +1,118 @@
+#include "StateStore.h"
+
+#include <esp_attr.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+#include <string.h>
+
+// Marks a valid RTC copy ("STAT")
+#define RTC_MAGIC 0x54415453
+
+// Bytes of the version stored in front of the snapshot in NVS
+#define VERSION_SIZE sizeof(uint32_t)
+
+// Copy of the last saved snapshot that survives warm resets
+struct RtcSnapshot {
+  uint32_t magic;                 // RTC_MAGIC once a snapshot was saved
+  uint32_t version;               // Version of the snapshot
+  uint32_t size;                  // Size of the snapshot
+  uint8_t data[STATE_STORE_SIZE]; // Snapshot
+  uint32_t checksum;              // Checksum of everything above
+};
+
+// Not cleared at boot (random after a power cycle, hence the checksum)
+RTC_NOINIT_ATTR static RtcSnapshot rtcSnapshot;
+
+// Checksum (FNV-1a) of an RTC copy
+static uint32_t checksum(const RtcSnapshot &snapshot) {
+  const uint8_t *bytes = (const uint8_t *)&snapshot;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < offsetof(RtcSnapshot, checksum); i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// Load the RTC copy, or what NVS holds
+bool StateStore::load(void *data, size_t size) {
+  if (size == 0 || size > STATE_STORE_SIZE) {
+    return false;
+  }
+  // Read NVS either way, so commits know what it holds
+  nvs_handle_t handle;
+  if (initNvs() &&
+      nvs_open(STATE_STORE_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+    uint8_t blob[VERSION_SIZE + STATE_STORE_SIZE];
+    size_t length = sizeof(blob);
+    if (nvs_get_blob(handle, _key, blob, &length) == ESP_OK &&
+        length == VERSION_SIZE + size &&
+        memcmp(blob, &_version, VERSION_SIZE) == 0) {
+      memcpy(_stored, blob + VERSION_SIZE, size);
+      _storedSize = size;
+    }
+    nvs_close(handle);
+  }
+  // The RTC copy is newer than NVS after a warm reset
+  if (rtcSnapshot.magic == RTC_MAGIC && rtcSnapshot.version == _version &&
+      rtcSnapshot.size == size &&
+      rtcSnapshot.checksum == checksum(rtcSnapshot)) {
+    memcpy(_saved, rtcSnapshot.data, size);
+  } else if (_storedSize == size) {
+    memcpy(_saved, _stored, size);
+  } else {
+    return false;
+  }
+  _savedSize = size;
+  memcpy(data, _saved, size);
+  return true;
+}
+
+// Save a snapshot into RTC memory
+void StateStore::save(const void *data, size_t size) {
+  if (size == 0 || size > STATE_STORE_SIZE ||
+      (size == _savedSize && memcmp(_saved, data, size) == 0)) {
+    return;
+  }
+  memcpy(_saved, data, size);
+  _savedSize = size;
+  rtcSnapshot.magic = RTC_MAGIC;
+  rtcSnapshot.version = _version;
+  rtcSnapshot.size = size;
+  memcpy(rtcSnapshot.data, data, size);
+  rtcSnapshot.checksum = checksum(rtcSnapshot);
+}
+
+// Write the last saved snapshot to NVS
+bool StateStore::commit(void) {
+  if (_savedSize == 0 || (_savedSize == _storedSize &&
+                          memcmp(_saved, _stored, _savedSize) == 0)) {
+    return true;
+  }
+  nvs_handle_t handle;
+  if (!initNvs() ||
+      nvs_open(STATE_STORE_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return false;
+  }
+  uint8_t blob[VERSION_SIZE + STATE_STORE_SIZE];
+  memcpy(blob, &_version, VERSION_SIZE);
+  memcpy(blob + VERSION_SIZE, _saved, _savedSize);
+  bool isWritten = nvs_set_blob(handle, _key, blob,
+                                VERSION_SIZE + _savedSize) == ESP_OK &&
+                   nvs_commit(handle) == ESP_OK;
+  nvs_close(handle);
+  if (isWritten) {
+    memcpy(_stored, _saved, _savedSize);
+    _storedSize = _savedSize;
+    _writes++;
+  }
+  return isWritten;
+}
+
+// Initialize NVS (the MQTT client initializes it again later, which is fine)
+bool StateStore::initNvs(void) {
+  static bool isReady = false;
+  if (!isReady) {
+    isReady = nvs_flash_init() == ESP_OK;
+  }
+  return isReady;
+}
@@ -0,0 +1,89 @@
+#ifndef STATE_STORE_H
+#define STATE_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef STATE_STORE_SIZE
+#define STATE_STORE_SIZE 32 // Largest snapshot in bytes
+#endif
+
+#define STATE_STORE_NAMESPACE "state" // NVS namespace of the snapshots
+
+/**
+ * StateStore keeps a snapshot of an application's state (ex. a Model's packed
+ * values) across reboots, so the lights can show the last state before WiFi
+ * and the broker are up.
+ *
+ * A saved snapshot is copied into RTC memory right away, which survives warm
+ * resets (a crash, the watchdog or esp_restart) but not a power cycle. It is
+ * only written to NVS when committed, and only if NVS doesn't already hold it,
+ * so commits are meant to be coalesced (ex. with a Coalescer) to limit flash
+ * wear. Snapshots carry a version, so one saved by firmware with another
+ * layout is never restored.
+ *
+ * An application has a single store (there is one RTC copy), and it is used
+ * from one task
+ */
+class StateStore {
+public:
+  /**
+   * Create a store
+   * @param key NVS key of the snapshot (up to 15 characters)
+   * @param version Version of the snapshot's layout (ex. a Model's
+   * STATE_VERSION)
+   */
+  StateStore(const char *key, uint32_t version)
+      : _key{key}, _version{version} {}
+
+  /**
+   * Load the last snapshot: the RTC copy after a warm reset (it can be newer
+   * than the one in NVS), or the one in NVS. Initializes NVS if needed
+   * @param data Receives the snapshot
+   * @param size Size of the snapshot in bytes
+   * @returns false (leaving the data unchanged) if no snapshot of this version
+   * and size was saved
+   */
+  bool load(void *data, size_t size);
+
+  /** Load the last snapshot into a value (ex. a Model's Snapshot) */
+  template <typename T> bool load(T &value) {
+    return load(&value, sizeof(value));
+  }
+
+  /**
+   * Save a snapshot into RTC memory, to be written to NVS by the next commit
+   * @param data The snapshot
+   * @param size Size of the snapshot in bytes (up to STATE_STORE_SIZE)
+   */
+  void save(const void *data, size_t size);
+
+  /** Save a value as the snapshot */
+  template <typename T> void save(const T &value) {
+    save(&value, sizeof(value));
+  }
+
+  /**
+   * Write the last saved snapshot to NVS, unless NVS already holds it. Flash
+   * writes take a few milliseconds, during which the caller is blocked
+   * @returns false if the write failed
+   */
+  bool commit(void);
+
+  /** Number of snapshots written to NVS since boot */
+  uint32_t getWrites(void) { return _writes; }
+
+private:
+  const char *_key;                  // NVS key
+  uint32_t _version;                 // Version of the snapshots
+  uint8_t _saved[STATE_STORE_SIZE];  // Last saved snapshot
+  size_t _savedSize = 0;             // Size of the last saved snapshot
+  uint8_t _stored[STATE_STORE_SIZE]; // Snapshot NVS holds
+  size_t _storedSize = 0;            // Size of the snapshot NVS holds
+  uint32_t _writes = 0;              // Snapshots written to NVS
+
+  /** Initialize NVS (once) and indicate if it can be used */
+  static bool initNvs(void);
+};
+
+#endif